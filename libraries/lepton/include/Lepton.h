@@ -33,7 +33,9 @@
  * -------------------------------------------------------------------------- */
 
 #include "lepton/CompiledExpression.h"
+#include "lepton/CompiledVectorExpression.h"
 #include "lepton/CustomFunction.h"
+#include "lepton/ExpressionCache.h"
 #include "lepton/ExpressionProgram.h"
 #include "lepton/ExpressionTreeNode.h"
 #include "lepton/Operation.h"
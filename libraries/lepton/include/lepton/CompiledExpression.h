@@ -82,11 +82,25 @@ public:
     void setVariableLocations(std::map<std::string, double*>& variableLocations);
     /**
      * Evaluate the expression.  The values of all variables should have been set before calling this.
+     * If this object was created from several expressions, all of them are evaluated, and the value of
+     * the first one is returned.
      */
     double evaluate() const;
+    /**
+     * Get the number of expressions that are computed by evaluate().
+     */
+    int getNumResults() const;
+    /**
+     * Get the value of one of the expressions, as computed by the most recent call to evaluate().
+     *
+     * @param index    the index of the expression, in the order they were passed to
+     *                 ParsedExpression::createCompiledExpression()
+     */
+    double getResult(int index) const;
 private:
     friend class ParsedExpression;
     CompiledExpression(const ParsedExpression& expression);
+    CompiledExpression(const std::vector<ParsedExpression>& expressions);
     void compileExpression(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
     int findTempIndex(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
     std::map<std::string, double*> variablePointers;
@@ -96,6 +110,7 @@ private:
     std::vector<Operation*> operation;
     std::map<std::string, int> variableIndices;
     std::set<std::string> variableNames;
+    std::vector<int> resultIndices;
     mutable std::vector<double> workspace;
     mutable std::vector<double> argValues;
     std::map<std::string, double> dummyVariables;
@@ -104,7 +119,9 @@ private:
     void generateJitCode();
     void generateSingleArgCall(asmjit::X86Compiler& c, asmjit::X86Xmm& dest, asmjit::X86Xmm& arg, double (*function)(double));
     void generateTwoArgCall(asmjit::X86Compiler& c, asmjit::X86Xmm& dest, asmjit::X86Xmm& arg1, asmjit::X86Xmm& arg2, double (*function)(double, double));
+    bool generateUniformPolynomial(asmjit::X86Compiler& c, const Operation& op, asmjit::X86Xmm& dest, asmjit::X86Xmm& arg);
     std::vector<double> constants;
+    std::vector<std::vector<double> > polynomialData;
     asmjit::JitRuntime runtime;
 #endif
 };
@@ -0,0 +1,153 @@
+#ifndef LEPTON_COMPILED_VECTOR_EXPRESSION_H_
+#define LEPTON_COMPILED_VECTOR_EXPRESSION_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   Lepton                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the Lepton expression parser originating from              *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: agent                                                             *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "ExpressionTreeNode.h"
+#include "windowsIncludes.h"
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#ifdef LEPTON_USE_JIT
+    #include "asmjit.h"
+#endif
+
+namespace Lepton {
+
+class Operation;
+class ParsedExpression;
+
+/**
+ * A CompiledVectorExpression is a highly optimized representation of an expression for cases when you want to evaluate
+ * it many times as quickly as possible.  It is similar to CompiledExpression, with the difference that it evaluates
+ * the expression for several sets of variable values at once, using single precision SIMD instructions.  Each variable
+ * is stored as an array of width() floats, and evaluate() returns an array of the same length holding one result for
+ * each element.  You should treat it as an opaque object; none of the internal representation is visible.
+ *
+ * A width of 1 gives a single precision counterpart to CompiledExpression, for code that does not need double
+ * precision and otherwise works in floats.
+ *
+ * A CompiledVectorExpression is created by calling createCompiledVectorExpression() on a ParsedExpression.
+ *
+ * WARNING: CompiledVectorExpression is NOT thread safe.  You should never access a CompiledVectorExpression from two
+ * threads at the same time.
+ */
+
+class LEPTON_EXPORT CompiledVectorExpression {
+public:
+    CompiledVectorExpression();
+    CompiledVectorExpression(const CompiledVectorExpression& expression);
+    ~CompiledVectorExpression();
+    CompiledVectorExpression& operator=(const CompiledVectorExpression& expression);
+    /**
+     * Get the width of the vectors on which the expression is evaluated.
+     */
+    int getWidth() const;
+    /**
+     * Get the names of all variables used by this expression.
+     */
+    const std::set<std::string>& getVariables() const;
+    /**
+     * Get a pointer to the memory location where the value of a particular variable is stored.  This is an array
+     * of getWidth() floats, which can be used to set the values of the variable before calling evaluate().
+     */
+    float* getVariablePointer(const std::string& name);
+    /**
+     * You can optionally specify the memory locations from which the values of variables should be read.
+     * This is useful, for example, when several expressions all use the same variable.  You can then set
+     * the value of that variable in one place, and it will be seen by all of them.  Each location must
+     * point to an array of getWidth() floats.
+     */
+    void setVariableLocations(std::map<std::string, float*>& variableLocations);
+    /**
+     * Evaluate the expression.  The values of all variables should have been set before calling this.
+     * If this object was created from several expressions, all of them are evaluated, and the values of
+     * the first one are returned.
+     *
+     * @return an array of getWidth() floats containing the values of the expression for each element
+     */
+    const float* evaluate() const;
+    /**
+     * Get the number of expressions that are computed by evaluate().
+     */
+    int getNumResults() const;
+    /**
+     * Get the values of one of the expressions, as computed by the most recent call to evaluate().
+     *
+     * @param index    the index of the expression, in the order they were passed to
+     *                 ParsedExpression::createCompiledVectorExpression()
+     * @return an array of getWidth() floats containing the values of the expression for each element
+     */
+    const float* getResult(int index) const;
+    /**
+     * Get the list of vector widths that are supported on the current processor.
+     */
+    static const std::vector<int>& getAllowedWidths();
+private:
+    friend class ParsedExpression;
+    CompiledVectorExpression(const ParsedExpression& expression, int width);
+    CompiledVectorExpression(const std::vector<ParsedExpression>& expressions, int width);
+    void compileExpression(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
+    int findTempIndex(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
+    int width;
+    std::map<std::string, float*> variablePointers;
+    std::vector<std::pair<float*, float*> > variablesToCopy;
+    std::vector<std::vector<int> > arguments;
+    std::vector<int> target;
+    std::vector<int> resultIndices;
+    std::vector<Operation*> operation;
+    std::map<std::string, int> variableIndices;
+    std::set<std::string> variableNames;
+    mutable std::vector<float> workspace;
+    mutable std::vector<float> argValues;
+    mutable std::vector<double> argDoubles;
+    std::map<std::string, double> dummyVariables;
+    void (*jitCode)();
+#ifdef LEPTON_USE_JIT
+    void generateJitCode();
+    void generateMove(asmjit::X86Compiler& c, const asmjit::X86Vec& dest, const asmjit::X86Vec& arg);
+    void generateBinaryOp(asmjit::X86Compiler& c, uint32_t sseInst, uint32_t avxInst, const asmjit::X86Vec& dest, const asmjit::X86Vec& arg1, const asmjit::X86Vec& arg2);
+    void generateCompare(asmjit::X86Compiler& c, const asmjit::X86Vec& dest, const asmjit::X86Vec& arg1, const asmjit::X86Vec& arg2, int predicate);
+    bool generateUniformPolynomial(asmjit::X86Compiler& c, const Operation& op, const asmjit::X86Vec& dest, const asmjit::X86Vec& arg);
+    bool useAvx;
+    std::vector<float> constants;
+    std::vector<float> constantData;
+    std::vector<std::vector<float> > polynomialData;
+    asmjit::JitRuntime runtime;
+#endif
+};
+
+} // namespace Lepton
+
+#endif /*LEPTON_COMPILED_VECTOR_EXPRESSION_H_*/
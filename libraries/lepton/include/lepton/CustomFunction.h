@@ -33,6 +33,7 @@
  * -------------------------------------------------------------------------- */
 
 #include "windowsIncludes.h"
+#include <vector>
 
 namespace Lepton {
 
@@ -70,6 +71,26 @@ public:
      * Create a new duplicate of this object on the heap using the "new" operator.
      */
     virtual CustomFunction* clone() const = 0;
+    /**
+     * Compiled expressions can evaluate some functions of one argument directly, without calling evaluate()
+     * or evaluateDerivative().  This is possible when the function (or the requested derivative of it) is a
+     * piecewise cubic polynomial on evenly spaced intervals, such as a cubic spline through uniformly spaced
+     * points, and is zero outside them.  Subclasses for which that is true may override this method to
+     * describe the polynomials.  The default implementation returns false.
+     *
+     * @param derivOrder    an array specifying the number of times the function has been differentiated
+     *                      with respect to each of its arguments, as for evaluateDerivative()
+     * @param min           on exit, the start of the first interval
+     * @param max           on exit, the end of the last interval
+     * @param coefficients  on exit, four coefficients for each interval.  Within interval i, the function equals
+     *                      c[4i]+c[4i+1]*t+c[4i+2]*t^2+c[4i+3]*t^3, where t goes from 0 at the start of the interval
+     *                      to 1 at the end.
+     * @return true if the polynomials were described, false if the function must be evaluated by calling
+     *         evaluate() or evaluateDerivative()
+     */
+    virtual bool getUniformPolynomials(const int* derivOrder, double& min, double& max, std::vector<double>& coefficients) const {
+        return false;
+    }
 };
 
 /**
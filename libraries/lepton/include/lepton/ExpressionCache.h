@@ -0,0 +1,86 @@
+#ifndef LEPTON_EXPRESSION_CACHE_H_
+#define LEPTON_EXPRESSION_CACHE_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   Lepton                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the Lepton expression parser originating from              *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: agent                                                             *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "windowsIncludes.h"
+#include "ParsedExpression.h"
+#include <map>
+#include <string>
+
+namespace Lepton {
+
+class CustomFunction;
+
+/**
+ * This class maintains a process-wide cache of parsed expressions.  Parsing an expression, differentiating
+ * it, and optimizing the result can be expensive for complicated expressions, and the same expressions
+ * usually get processed again every time a Context is created.  The methods of this class return the same
+ * results as calling Parser::parse(), ParsedExpression::differentiate(), and ParsedExpression::optimize()
+ * directly, but each result is only computed once and then reused.
+ *
+ * Entries are identified by the text of the expression, the variable it is differentiated with respect to,
+ * and the name and number of arguments of every custom function.  Custom functions are never evaluated
+ * while processing an expression, so the cached trees do not depend on what the functions compute.  Every
+ * tree that is returned refers to copies of the CustomFunction objects passed to the method.
+ *
+ * All methods are thread safe.
+ */
+
+class LEPTON_EXPORT ExpressionCache {
+public:
+    /**
+     * Parse an expression and optimize it.  This is equivalent to Parser::parse(expression, customFunctions).optimize().
+     *
+     * @param expression        the expression to parse
+     * @param customFunctions   a map specifying user defined functions that may appear in the expression
+     */
+    static ParsedExpression parse(const std::string& expression, const std::map<std::string, CustomFunction*>& customFunctions);
+    /**
+     * Parse an expression, differentiate it, and optimize the result.  This is equivalent to
+     * Parser::parse(expression, customFunctions).optimize().differentiate(variable).optimize().
+     *
+     * @param expression        the expression to parse
+     * @param customFunctions   a map specifying user defined functions that may appear in the expression
+     * @param variable          the variable with respect to which the derivative should be taken
+     */
+    static ParsedExpression differentiate(const std::string& expression, const std::map<std::string, CustomFunction*>& customFunctions,
+            const std::string& variable);
+    /**
+     * Discard all cached expressions.
+     */
+    static void clear();
+};
+
+} // namespace Lepton
+
+#endif /*LEPTON_EXPRESSION_CACHE_H_*/
@@ -90,6 +90,21 @@ public:
      *                     will be thrown.
      */
     double evaluate(const std::map<std::string, double>& variables) const;
+    /**
+     * Evaluate the expression at many points with a single call.  Each Operation is applied to a block of
+     * points at once, so the cost of dispatching on it is shared by the whole block rather than paid for
+     * every point.
+     *
+     * @param numPoints        the number of points at which to evaluate the expression
+     * @param variableNames    the names of the variables that appear in the expression.  If any variable
+     *                         appears in the expression but is not included in this list, an exception
+     *                         will be thrown.
+     * @param variableValues   the values of the variables.  Element i points to an array of length numPoints
+     *                         containing the values of variableNames[i] at every point.
+     * @param results          on exit, element j contains the value of the expression at point j.  It must
+     *                         have length at least numPoints.
+     */
+    void evaluate(int numPoints, const std::vector<std::string>& variableNames, const std::vector<const double*>& variableValues, double* results) const;
 private:
     friend class ParsedExpression;
     ExpressionProgram(const ParsedExpression& expression);
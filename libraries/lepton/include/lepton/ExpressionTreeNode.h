@@ -33,6 +33,7 @@
  * -------------------------------------------------------------------------- */
 
 #include "windowsIncludes.h"
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -45,6 +46,11 @@ class Operation;
  * Each node is defined by an Operation and a set of children.  When the expression is
  * evaluated, each child is first evaluated in order, then the resulting values are passed
  * as the arguments to the Operation's evaluate() method.
+ *
+ * Nodes are immutable, so copying a node does not copy the subtree below it.  The copy refers to the
+ * same storage as the original.  When a subexpression is reused, for example when the chain rule copies
+ * it into a derivative, the expression is really a directed acyclic graph, and its size in memory stays
+ * proportional to the number of distinct subexpressions rather than the size of the equivalent tree.
  */
 
 class LEPTON_EXPORT ExpressionTreeNode {
@@ -95,9 +101,15 @@ public:
      * Get this node's child nodes.
      */
     const std::vector<ExpressionTreeNode>& getChildren() const;
+    /**
+     * Get a pointer that identifies the storage used by this node.  Two nodes that return the same
+     * value are copies of each other, and so are guaranteed to be identical.  This can be used to
+     * process each distinct subexpression only once when walking an expression.
+     */
+    const void* getStorage() const;
 private:
-    Operation* operation;
-    std::vector<ExpressionTreeNode> children;
+    class NodeData;
+    std::shared_ptr<const NodeData> data;
 };
 
 } // namespace Lepton
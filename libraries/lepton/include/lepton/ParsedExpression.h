@@ -40,6 +40,7 @@
 namespace Lepton {
 
 class CompiledExpression;
+class CompiledVectorExpression;
 class ExpressionProgram;
 
 /**
@@ -102,6 +103,34 @@ public:
      * Create a CompiledExpression that represents the same calculation as this expression.
      */
     CompiledExpression createCompiledExpression() const;
+    /**
+     * Create a CompiledExpression that evaluates several expressions at once.  Subexpressions that
+     * appear in more than one of them are only computed once.  This is useful for evaluating an
+     * expression together with its derivatives, which typically have many terms in common.
+     *
+     * @param expressions    the expressions to evaluate.  CompiledExpression::getResult() returns
+     *                       their values in the same order.
+     */
+    static CompiledExpression createCompiledExpression(const std::vector<ParsedExpression>& expressions);
+    /**
+     * Create a CompiledVectorExpression that allows the expression to be evaluated efficiently
+     * using the CPU's vector unit.
+     *
+     * @param width    the width of the vectors to evaluate it on.  The allowed values
+     *                 depend on the CPU.  1 and 4 are always allowed, and 8 is allowed on
+     *                 x86 processors with AVX.  Call CompiledVectorExpression::getAllowedWidths()
+     *                 to query the allowed widths on the current processor.
+     */
+    CompiledVectorExpression createCompiledVectorExpression(int width) const;
+    /**
+     * Create a CompiledVectorExpression that evaluates several expressions at once.  Subexpressions that
+     * appear in more than one of them are only computed once.
+     *
+     * @param expressions    the expressions to evaluate.  CompiledVectorExpression::getResult() returns
+     *                       their values in the same order.
+     * @param width          the width of the vectors to evaluate them on
+     */
+    static CompiledVectorExpression createCompiledVectorExpression(const std::vector<ParsedExpression>& expressions, int width);
     /**
      * Create a new ParsedExpression which is identical to this one, except that the names of some
      * variables have been changed.
@@ -112,13 +141,14 @@ public:
     ParsedExpression renameVariables(const std::map<std::string, std::string>& replacements) const;
 private:
     static double evaluate(const ExpressionTreeNode& node, const std::map<std::string, double>& variables);
-    static ExpressionTreeNode preevaluateVariables(const ExpressionTreeNode& node, const std::map<std::string, double>& variables);
-    static ExpressionTreeNode precalculateConstantSubexpressions(const ExpressionTreeNode& node);
-    static ExpressionTreeNode substituteSimplerExpression(const ExpressionTreeNode& node);
-    static ExpressionTreeNode differentiate(const ExpressionTreeNode& node, const std::string& variable);
+    static ExpressionTreeNode preevaluateVariables(const ExpressionTreeNode& node, const std::map<std::string, double>& variables, std::map<const void*, ExpressionTreeNode>& nodeCache);
+    static ExpressionTreeNode precalculateConstantSubexpressions(const ExpressionTreeNode& node, std::map<const void*, ExpressionTreeNode>& nodeCache);
+    static ExpressionTreeNode substituteSimplerExpression(const ExpressionTreeNode& node, std::map<const void*, ExpressionTreeNode>& nodeCache);
+    static ExpressionTreeNode substituteSimplerNode(const ExpressionTreeNode& node, const std::vector<ExpressionTreeNode>& children);
+    static ExpressionTreeNode differentiate(const ExpressionTreeNode& node, const std::string& variable, std::map<const void*, ExpressionTreeNode>& nodeCache);
     static bool isConstant(const ExpressionTreeNode& node);
     static double getConstantValue(const ExpressionTreeNode& node);
-    static ExpressionTreeNode renameNodeVariables(const ExpressionTreeNode& node, const std::map<std::string, std::string>& replacements);
+    static ExpressionTreeNode renameNodeVariables(const ExpressionTreeNode& node, const std::map<std::string, std::string>& replacements, std::map<const void*, ExpressionTreeNode>& nodeCache);
     ExpressionTreeNode rootNode;
 };
 
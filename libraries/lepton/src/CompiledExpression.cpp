@@ -32,6 +32,7 @@
 #include "lepton/CompiledExpression.h"
 #include "lepton/Operation.h"
 #include "lepton/ParsedExpression.h"
+#include "MSVC_erfc.h"
 #include <utility>
 
 using namespace Lepton;
@@ -43,18 +44,27 @@ using namespace std;
 CompiledExpression::CompiledExpression() : jitCode(NULL) {
 }
 
-CompiledExpression::CompiledExpression(const ParsedExpression& expression) : jitCode(NULL) {
-    ParsedExpression expr = expression.optimize(); // Just in case it wasn't already optimized.
+CompiledExpression::CompiledExpression(const ParsedExpression& expression) : CompiledExpression(vector<ParsedExpression>(1, expression)) {
+}
+
+CompiledExpression::CompiledExpression(const vector<ParsedExpression>& expressions) : jitCode(NULL) {
+    if (expressions.size() == 0)
+        throw Exception("CompiledExpression: No expressions specified");
+
+    // All the expressions share one list of temporaries, so subexpressions they have in common are only
+    // evaluated once.
+
     vector<pair<ExpressionTreeNode, int> > temps;
-    compileExpression(expr.getRootNode(), temps);
+    for (const ParsedExpression& expression : expressions) {
+        ParsedExpression expr = expression.optimize(); // Just in case it wasn't already optimized.
+        compileExpression(expr.getRootNode(), temps);
+        resultIndices.push_back(temps[findTempIndex(expr.getRootNode(), temps)].second);
+    }
     int maxArguments = 1;
     for (int i = 0; i < (int) operation.size(); i++)
         if (operation[i]->getNumArguments() > maxArguments)
             maxArguments = operation[i]->getNumArguments();
     argValues.resize(maxArguments);
-#ifdef LEPTON_USE_JIT
-    generateJitCode();
-#endif
 }
 
 CompiledExpression::~CompiledExpression() {
@@ -72,6 +82,7 @@ CompiledExpression& CompiledExpression::operator=(const CompiledExpression& expr
     target = expression.target;
     variableIndices = expression.variableIndices;
     variableNames = expression.variableNames;
+    resultIndices = expression.resultIndices;
     workspace.resize(expression.workspace.size());
     argValues.resize(expression.argValues.size());
     operation.resize(expression.operation.size());
@@ -147,10 +158,10 @@ double& CompiledExpression::getVariableReference(const string& name) {
 void CompiledExpression::setVariableLocations(map<string, double*>& variableLocations) {
     variablePointers = variableLocations;
 #ifdef LEPTON_USE_JIT
-    // Rebuild the JIT code.
+    // Discard the JIT code.  It gets generated the first time evaluate() is called, so copies that have their
+    // variable locations set before they are used only get compiled once.
     
-    if (workspace.size() > 0)
-        generateJitCode();
+    jitCode = NULL;
 #else
     // Make a list of all variables we will need to copy before evaluating the expression.
     
@@ -163,8 +174,18 @@ void CompiledExpression::setVariableLocations(map<string, double*>& variableLoca
 #endif
 }
 
+int CompiledExpression::getNumResults() const {
+    return resultIndices.size();
+}
+
+double CompiledExpression::getResult(int index) const {
+    return workspace[resultIndices[index]];
+}
+
 double CompiledExpression::evaluate() const {
 #ifdef LEPTON_USE_JIT
+    if (jitCode == NULL)
+        const_cast<CompiledExpression*>(this)->generateJitCode();
     return jitCode();
 #else
     for (int i = 0; i < variablesToCopy.size(); i++)
@@ -182,7 +203,7 @@ double CompiledExpression::evaluate() const {
             workspace[target[step]] = operation[step]->evaluate(&argValues[0], dummyVariables);
         }
     }
-    return workspace[workspace.size()-1];
+    return workspace[resultIndices[0]];
 #endif
 }
 
@@ -197,6 +218,7 @@ void CompiledExpression::generateJitCode() {
     code.init(runtime.getCodeInfo());
     X86Compiler c(&code);
     c.addFunc(FuncSignature0<double>());
+    polynomialData.clear();
     vector<X86Xmm> workspaceVar(workspace.size());
     for (int i = 0; i < (int) workspaceVar.size(); i++)
         workspaceVar[i] = c.newXmmSd();
@@ -232,6 +254,16 @@ void CompiledExpression::generateJitCode() {
             value = 1.0;
         else if (op.getId() == Operation::DELTA)
             value = 1.0;
+        else if (op.getId() == Operation::POWER_CONSTANT) {
+            // Integer powers need 1.0 if the exponent is zero or negative.  Other powers need the exponent.
+
+            value = dynamic_cast<Operation::PowerConstant&>(op).getValue();
+            if (value == (int) value) {
+                if (value > 0)
+                    continue;
+                value = 1.0;
+            }
+        }
         else
             continue;
         
@@ -340,6 +372,12 @@ void CompiledExpression::generateJitCode() {
             case Operation::TANH:
                 generateSingleArgCall(c, workspaceVar[target[step]], workspaceVar[args[0]], tanh);
                 break;
+            case Operation::ERF:
+                generateSingleArgCall(c, workspaceVar[target[step]], workspaceVar[args[0]], erf);
+                break;
+            case Operation::ERFC:
+                generateSingleArgCall(c, workspaceVar[target[step]], workspaceVar[args[0]], erfc);
+                break;
             case Operation::STEP:
                 c.xorps(workspaceVar[target[step]], workspaceVar[target[step]]);
                 c.cmpsd(workspaceVar[target[step]], workspaceVar[args[0]], imm(18)); // Comparison mode is _CMP_LE_OQ = 18
@@ -371,6 +409,42 @@ void CompiledExpression::generateJitCode() {
                 c.movsd(workspaceVar[target[step]], workspaceVar[args[0]]);
                 c.mulsd(workspaceVar[target[step]], constantVar[operationConstantIndex[step]]);
                 break;
+            case Operation::POWER_CONSTANT: {
+                double exponent = dynamic_cast<Operation::PowerConstant&>(op).getValue();
+                int intExponent = (int) exponent;
+                if (intExponent == exponent) {
+                    // Compute integer powers by repeated multiplication, exactly as Operation::PowerConstant does.
+
+                    if (intExponent == 0) {
+                        c.movsd(workspaceVar[target[step]], constantVar[operationConstantIndex[step]]);
+                        break;
+                    }
+                    X86Xmm base = c.newXmmSd();
+                    if (intExponent < 0) {
+                        c.movsd(base, constantVar[operationConstantIndex[step]]);
+                        c.divsd(base, workspaceVar[args[0]]);
+                        intExponent = -intExponent;
+                    }
+                    else
+                        c.movsd(base, workspaceVar[args[0]]);
+                    bool first = true;
+                    while (intExponent != 0) {
+                        if ((intExponent&1) == 1) {
+                            if (first)
+                                c.movsd(workspaceVar[target[step]], base);
+                            else
+                                c.mulsd(workspaceVar[target[step]], base);
+                            first = false;
+                        }
+                        intExponent = intExponent>>1;
+                        if (intExponent != 0)
+                            c.mulsd(base, base);
+                    }
+                }
+                else
+                    generateTwoArgCall(c, workspaceVar[target[step]], workspaceVar[args[0]], constantVar[operationConstantIndex[step]], pow);
+                break;
+            }
             case Operation::ABS:
                 generateSingleArgCall(c, workspaceVar[target[step]], workspaceVar[args[0]], fabs);
                 break;
@@ -381,6 +455,9 @@ void CompiledExpression::generateJitCode() {
                 generateSingleArgCall(c, workspaceVar[target[step]], workspaceVar[args[0]], ceil);
                 break;
             default:
+                if (op.getId() == Operation::CUSTOM && generateUniformPolynomial(c, op, workspaceVar[target[step]], workspaceVar[args[0]]))
+                    break;
+
                 // Just invoke evaluateOperation().
                 
                 for (int i = 0; i < (int) args.size(); i++)
@@ -393,12 +470,77 @@ void CompiledExpression::generateJitCode() {
                 call->setRet(0, workspaceVar[target[step]]);
         }
     }
-    c.ret(workspaceVar[workspace.size()-1]);
+    
+    // Store the results to the workspace, where getResult() will return them from.
+    
+    X86Gp resultPointer = c.newIntPtr();
+    c.mov(resultPointer, imm_ptr(&workspace[0]));
+    for (int index : resultIndices)
+        c.movsd(x86::ptr(resultPointer, 8*index, 0), workspaceVar[index]);
+    c.ret(workspaceVar[resultIndices[0]]);
     c.endFunc();
     c.finalize();
     runtime.add(&jitCode, &code);
 }
 
+bool CompiledExpression::generateUniformPolynomial(X86Compiler& c, const Operation& op, X86Xmm& dest, X86Xmm& arg) {
+    const Operation::Custom& custom = dynamic_cast<const Operation::Custom&>(op);
+    double min, max;
+    vector<double> coefficients;
+    if (custom.getNumArguments() != 1 || !custom.getFunction().getUniformPolynomials(&custom.getDerivOrder()[0], min, max, coefficients))
+        return false;
+    int numIntervals = coefficients.size()/4;
+    if (numIntervals == 0 || !(max > min))
+        return false;
+
+    // The data starts with the range, the number of intervals per unit length, and the number of intervals.
+    // The coefficients follow.  An extra interval at the end holds the value at max, so evaluating exactly
+    // at max needs no special handling.
+
+    polynomialData.push_back({min, max, numIntervals/(max-min), (double) numIntervals});
+    vector<double>& data = polynomialData.back();
+    data.insert(data.end(), coefficients.begin(), coefficients.end());
+    data.push_back(coefficients[4*numIntervals-4]+coefficients[4*numIntervals-3]+coefficients[4*numIntervals-2]+coefficients[4*numIntervals-1]);
+    data.resize(data.size()+3, 0.0);
+    X86Gp dataPointer = c.newIntPtr();
+    c.mov(dataPointer, imm_ptr(&data[0]));
+
+    // Find the interval containing the argument and the position within it.  maxsd returns its second
+    // operand if the first one is NaN, so the index is always valid.
+
+    X86Xmm position = c.newXmmSd();
+    X86Xmm temp = c.newXmmSd();
+    c.movsd(position, arg);
+    c.subsd(position, x86::ptr(dataPointer, 0, 0));
+    c.mulsd(position, x86::ptr(dataPointer, 16, 0));
+    c.xorps(temp, temp);
+    c.maxsd(position, temp);
+    c.minsd(position, x86::ptr(dataPointer, 24, 0));
+    X86Gp index = c.newIntPtr();
+    c.cvttsd2si(index, position);
+    c.cvtsi2sd(temp, index);
+    c.subsd(position, temp);
+    c.shl(index, 2);
+
+    // Evaluate the polynomial with Horner's rule.
+
+    c.movsd(dest, x86::ptr(dataPointer, index, 3, 56));
+    for (int i = 2; i >= 0; i--) {
+        c.mulsd(dest, position);
+        c.addsd(dest, x86::ptr(dataPointer, index, 3, 32+8*i));
+    }
+
+    // The function is zero outside its range.
+
+    c.movsd(temp, x86::ptr(dataPointer, 0, 0));
+    c.cmpsd(temp, arg, imm(2)); // Comparison mode is _CMP_LE_OS = 2
+    c.andps(dest, temp);
+    c.movsd(temp, arg);
+    c.cmpsd(temp, x86::ptr(dataPointer, 8, 0), imm(2));
+    c.andps(dest, temp);
+    return true;
+}
+
 void CompiledExpression::generateSingleArgCall(X86Compiler& c, X86Xmm& dest, X86Xmm& arg, double (*function)(double)) {
     X86Gp fn = c.newIntPtr();
     c.mov(fn, imm_ptr((void*) function));
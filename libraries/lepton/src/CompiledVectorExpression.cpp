@@ -0,0 +1,652 @@
+/* -------------------------------------------------------------------------- *
+ *                                   Lepton                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the Lepton expression parser originating from              *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: agent                                                             *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "lepton/CompiledVectorExpression.h"
+#include "lepton/Exception.h"
+#include "lepton/Operation.h"
+#include "lepton/ParsedExpression.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+using namespace Lepton;
+using namespace std;
+#ifdef LEPTON_USE_JIT
+    using namespace asmjit;
+#endif
+
+CompiledVectorExpression::CompiledVectorExpression() : width(0), jitCode(NULL) {
+}
+
+CompiledVectorExpression::CompiledVectorExpression(const ParsedExpression& expression, int width) :
+        CompiledVectorExpression(vector<ParsedExpression>(1, expression), width) {
+}
+
+CompiledVectorExpression::CompiledVectorExpression(const vector<ParsedExpression>& expressions, int width) : width(width), jitCode(NULL) {
+    const vector<int>& allowedWidths = getAllowedWidths();
+    if (find(allowedWidths.begin(), allowedWidths.end(), width) == allowedWidths.end())
+        throw Exception("Unsupported width for CompiledVectorExpression");
+    if (expressions.size() == 0)
+        throw Exception("CompiledVectorExpression: No expressions specified");
+
+    // All the expressions share one list of temporaries, so subexpressions they have in common are only
+    // evaluated once.
+
+    vector<pair<ExpressionTreeNode, int> > temps;
+    for (const ParsedExpression& expression : expressions) {
+        ParsedExpression expr = expression.optimize(); // Just in case it wasn't already optimized.
+        compileExpression(expr.getRootNode(), temps);
+        resultIndices.push_back(findTempIndex(expr.getRootNode(), temps));
+    }
+    int maxArguments = 1;
+    for (int i = 0; i < (int) operation.size(); i++)
+        if (operation[i]->getNumArguments() > maxArguments)
+            maxArguments = operation[i]->getNumArguments();
+    argValues.resize(maxArguments*width);
+    argDoubles.resize(maxArguments);
+}
+
+CompiledVectorExpression::~CompiledVectorExpression() {
+    for (int i = 0; i < (int) operation.size(); i++)
+        if (operation[i] != NULL)
+            delete operation[i];
+}
+
+CompiledVectorExpression::CompiledVectorExpression(const CompiledVectorExpression& expression) : jitCode(NULL) {
+    *this = expression;
+}
+
+CompiledVectorExpression& CompiledVectorExpression::operator=(const CompiledVectorExpression& expression) {
+    for (int i = 0; i < (int) operation.size(); i++)
+        if (operation[i] != NULL)
+            delete operation[i];
+    width = expression.width;
+    arguments = expression.arguments;
+    target = expression.target;
+    variableIndices = expression.variableIndices;
+    variableNames = expression.variableNames;
+    resultIndices = expression.resultIndices;
+    workspace.resize(expression.workspace.size());
+    argValues.resize(expression.argValues.size());
+    argDoubles.resize(expression.argDoubles.size());
+    operation.resize(expression.operation.size());
+    for (int i = 0; i < (int) operation.size(); i++)
+        operation[i] = expression.operation[i]->clone();
+    setVariableLocations(variablePointers);
+    return *this;
+}
+
+const vector<int>& CompiledVectorExpression::getAllowedWidths() {
+    static const vector<int> widths = [] () {
+        vector<int> result;
+        result.push_back(1);
+        result.push_back(4);
+#ifdef LEPTON_USE_JIT
+        // Eight wide vectors are only supported on processors with AVX.
+
+        if (CpuInfo::getHost().hasFeature(CpuInfo::kX86FeatureAVX))
+            result.push_back(8);
+#else
+        result.push_back(8);
+#endif
+        return result;
+    }();
+    return widths;
+}
+
+void CompiledVectorExpression::compileExpression(const ExpressionTreeNode& node, vector<pair<ExpressionTreeNode, int> >& temps) {
+    if (findTempIndex(node, temps) != -1)
+        return; // We have already processed a node identical to this one.
+    
+    // Process the child nodes.
+    
+    vector<int> args;
+    for (int i = 0; i < node.getChildren().size(); i++) {
+        compileExpression(node.getChildren()[i], temps);
+        args.push_back(findTempIndex(node.getChildren()[i], temps));
+    }
+    
+    // Process this node.  Each temporary value occupies width consecutive elements of the workspace.
+    
+    int tempIndex = (int) temps.size();
+    if (node.getOperation().getId() == Operation::VARIABLE) {
+        variableIndices[node.getOperation().getName()] = tempIndex;
+        variableNames.insert(node.getOperation().getName());
+    }
+    else {
+        int stepIndex = (int) arguments.size();
+        arguments.push_back(vector<int>());
+        target.push_back(tempIndex);
+        operation.push_back(node.getOperation().clone());
+        if (args.size() == 0)
+            arguments[stepIndex].push_back(0); // The value won't actually be used.  We just need something there.
+        else {
+            // If the arguments are sequential, we can just pass a pointer to the first one.
+            
+            bool sequential = true;
+            for (int i = 1; i < args.size(); i++)
+                if (args[i] != args[i-1]+1)
+                    sequential = false;
+            if (sequential)
+                arguments[stepIndex].push_back(args[0]);
+            else
+                arguments[stepIndex] = args;
+        }
+    }
+    temps.push_back(make_pair(node, tempIndex));
+    workspace.resize(workspace.size()+width, 0.0f);
+}
+
+int CompiledVectorExpression::findTempIndex(const ExpressionTreeNode& node, vector<pair<ExpressionTreeNode, int> >& temps) {
+    for (int i = 0; i < (int) temps.size(); i++)
+        if (temps[i].first == node)
+            return i;
+    return -1;
+}
+
+int CompiledVectorExpression::getWidth() const {
+    return width;
+}
+
+const set<string>& CompiledVectorExpression::getVariables() const {
+    return variableNames;
+}
+
+float* CompiledVectorExpression::getVariablePointer(const string& name) {
+    map<string, float*>::iterator pointer = variablePointers.find(name);
+    if (pointer != variablePointers.end())
+        return pointer->second;
+    map<string, int>::iterator index = variableIndices.find(name);
+    if (index == variableIndices.end())
+        throw Exception("getVariablePointer: Unknown variable '"+name+"'");
+    return &workspace[index->second*width];
+}
+
+void CompiledVectorExpression::setVariableLocations(map<string, float*>& variableLocations) {
+    variablePointers = variableLocations;
+#ifdef LEPTON_USE_JIT
+    // Discard the JIT code.  It gets generated the first time evaluate() is called, so copies that have their
+    // variable locations set before they are used only get compiled once.
+    
+    jitCode = NULL;
+#else
+    // Make a list of all variables we will need to copy before evaluating the expression.
+    
+    variablesToCopy.clear();
+    for (map<string, int>::const_iterator iter = variableIndices.begin(); iter != variableIndices.end(); ++iter) {
+        map<string, float*>::iterator pointer = variablePointers.find(iter->first);
+        if (pointer != variablePointers.end())
+            variablesToCopy.push_back(make_pair(&workspace[iter->second*width], pointer->second));
+    }
+#endif
+}
+
+const float* CompiledVectorExpression::evaluate() const {
+#ifdef LEPTON_USE_JIT
+    if (jitCode == NULL)
+        const_cast<CompiledVectorExpression*>(this)->generateJitCode();
+    jitCode();
+#else
+    for (int i = 0; i < variablesToCopy.size(); i++)
+        for (int j = 0; j < width; j++)
+            variablesToCopy[i].first[j] = variablesToCopy[i].second[j];
+
+    // Loop over the operations and evaluate each one, one element at a time.
+    
+    for (int step = 0; step < operation.size(); step++) {
+        const vector<int>& args = arguments[step];
+        int numArgs = operation[step]->getNumArguments();
+        float* result = &workspace[target[step]*width];
+        for (int element = 0; element < width; element++) {
+            if (args.size() == 1) {
+                for (int i = 0; i < numArgs; i++)
+                    argDoubles[i] = workspace[(args[0]+i)*width+element];
+            }
+            else {
+                for (int i = 0; i < args.size(); i++)
+                    argDoubles[i] = workspace[args[i]*width+element];
+            }
+            result[element] = (float) operation[step]->evaluate(&argDoubles[0], dummyVariables);
+        }
+    }
+#endif
+    return &workspace[resultIndices[0]*width];
+}
+
+int CompiledVectorExpression::getNumResults() const {
+    return resultIndices.size();
+}
+
+const float* CompiledVectorExpression::getResult(int index) const {
+    return &workspace[resultIndices[index]*width];
+}
+
+#ifdef LEPTON_USE_JIT
+template <int WIDTH>
+static void evaluateVectorOperation(Operation* op, float* args, float* result, double* argDoubles) {
+    static map<string, double> dummyVariables;
+    int numArgs = op->getNumArguments();
+    for (int element = 0; element < WIDTH; element++) {
+        for (int i = 0; i < numArgs; i++)
+            argDoubles[i] = args[i*WIDTH+element];
+        result[element] = (float) op->evaluate(argDoubles, dummyVariables);
+    }
+}
+
+void CompiledVectorExpression::generateJitCode() {
+    const CpuInfo& cpu = CpuInfo::getHost();
+    useAvx = cpu.hasFeature(CpuInfo::kX86FeatureAVX);
+    bool canRound = (useAvx || cpu.hasFeature(CpuInfo::kX86FeatureSSE4_1));
+    uint32_t moveUnaligned = (useAvx ? X86Inst::kIdVmovups : X86Inst::kIdMovups);
+    if (width == 1) {
+        // Each value occupies the lowest element of an SSE register.  Only that element is loaded and stored,
+        // and the others are zero, so packed instructions still work.
+
+        moveUnaligned = (useAvx ? X86Inst::kIdVmovss : X86Inst::kIdMovss);
+    }
+    CodeHolder code;
+    code.init(runtime.getCodeInfo());
+    X86Compiler c(&code);
+    CCFunc* func = c.addFunc(FuncSignature0<void>());
+    if (useAvx)
+        func->getFrameInfo().enableAvxCleanup();
+    int numTemps = workspace.size()/width;
+    vector<X86Vec> workspaceVar(numTemps);
+    for (int i = 0; i < numTemps; i++) {
+        if (width <= 4)
+            workspaceVar[i] = c.newXmmPs();
+        else
+            workspaceVar[i] = c.newYmmPs();
+    }
+    X86Gp argsPointer = c.newIntPtr();
+    c.mov(argsPointer, imm_ptr(&argValues[0]));
+    
+    // Load the arguments into variables.
+    
+    for (set<string>::const_iterator iter = variableNames.begin(); iter != variableNames.end(); ++iter) {
+        map<string, int>::iterator index = variableIndices.find(*iter);
+        X86Gp variablePointer = c.newIntPtr();
+        c.mov(variablePointer, imm_ptr(getVariablePointer(index->first)));
+        c.emit(moveUnaligned, workspaceVar[index->second], x86::ptr(variablePointer, 0, 0));
+    }
+
+    // Make a list of all constants that will be needed for evaluation.
+    
+    constants.clear();
+    polynomialData.clear();
+    vector<int> operationConstantIndex(operation.size(), -1);
+    for (int step = 0; step < (int) operation.size(); step++) {
+        // Find the constant value (if any) used by this operation.
+        
+        Operation& op = *operation[step];
+        float value;
+        if (op.getId() == Operation::CONSTANT)
+            value = (float) dynamic_cast<Operation::Constant&>(op).getValue();
+        else if (op.getId() == Operation::ADD_CONSTANT)
+            value = (float) dynamic_cast<Operation::AddConstant&>(op).getValue();
+        else if (op.getId() == Operation::MULTIPLY_CONSTANT)
+            value = (float) dynamic_cast<Operation::MultiplyConstant&>(op).getValue();
+        else if (op.getId() == Operation::RECIPROCAL)
+            value = 1.0f;
+        else if (op.getId() == Operation::STEP)
+            value = 1.0f;
+        else if (op.getId() == Operation::DELTA)
+            value = 1.0f;
+        else if (op.getId() == Operation::POWER_CONSTANT)
+            value = 1.0f;
+        else if (op.getId() == Operation::ABS) {
+            // This is a mask that clears the sign bit.
+
+            int mask = 0x7FFFFFFF;
+            memcpy(&value, &mask, sizeof(float));
+        }
+        else
+            continue;
+        
+        // See if we already have a variable for this constant.  Compare the bit patterns, since the ABS mask is a NaN.
+        
+        for (int i = 0; i < (int) constants.size(); i++)
+            if (memcmp(&value, &constants[i], sizeof(float)) == 0) {
+                operationConstantIndex[step] = i;
+                break;
+            }
+        if (operationConstantIndex[step] == -1) {
+            operationConstantIndex[step] = constants.size();
+            constants.push_back(value);
+        }
+    }
+    
+    // Load constants into variables.  Each one is replicated across all elements of a vector.
+    
+    constantData.resize(constants.size()*width);
+    for (int i = 0; i < (int) constants.size(); i++)
+        for (int j = 0; j < width; j++)
+            constantData[i*width+j] = constants[i];
+    vector<X86Vec> constantVar(constants.size());
+    if (constants.size() > 0) {
+        X86Gp constantsPointer = c.newIntPtr();
+        c.mov(constantsPointer, imm_ptr(&constantData[0]));
+        for (int i = 0; i < (int) constants.size(); i++) {
+            if (width <= 4)
+                constantVar[i] = c.newXmmPs();
+            else
+                constantVar[i] = c.newYmmPs();
+            c.emit(moveUnaligned, constantVar[i], x86::ptr(constantsPointer, 4*width*i, 0));
+        }
+    }
+    
+    // Evaluate the operations.
+    
+    for (int step = 0; step < (int) operation.size(); step++) {
+        Operation& op = *operation[step];
+        vector<int> args = arguments[step];
+        if (args.size() == 1) {
+            // One or more sequential arguments.  Fill out the list.
+            
+            for (int i = 1; i < op.getNumArguments(); i++)
+                args.push_back(args[0]+i);
+        }
+        X86Vec& dest = workspaceVar[target[step]];
+        X86Vec temp;
+        if (width <= 4)
+            temp = c.newXmmPs();
+        else
+            temp = c.newYmmPs();
+        bool inlined = true;
+        
+        // Generate instructions to execute this operation.
+        
+        switch (op.getId()) {
+            case Operation::CONSTANT:
+                generateMove(c, dest, constantVar[operationConstantIndex[step]]);
+                break;
+            case Operation::ADD:
+                generateBinaryOp(c, X86Inst::kIdAddps, X86Inst::kIdVaddps, dest, workspaceVar[args[0]], workspaceVar[args[1]]);
+                break;
+            case Operation::SUBTRACT:
+                generateBinaryOp(c, X86Inst::kIdSubps, X86Inst::kIdVsubps, dest, workspaceVar[args[0]], workspaceVar[args[1]]);
+                break;
+            case Operation::MULTIPLY:
+                generateBinaryOp(c, X86Inst::kIdMulps, X86Inst::kIdVmulps, dest, workspaceVar[args[0]], workspaceVar[args[1]]);
+                break;
+            case Operation::DIVIDE:
+                generateBinaryOp(c, X86Inst::kIdDivps, X86Inst::kIdVdivps, dest, workspaceVar[args[0]], workspaceVar[args[1]]);
+                break;
+            case Operation::NEGATE:
+                generateBinaryOp(c, X86Inst::kIdXorps, X86Inst::kIdVxorps, dest, dest, dest);
+                generateBinaryOp(c, X86Inst::kIdSubps, X86Inst::kIdVsubps, dest, dest, workspaceVar[args[0]]);
+                break;
+            case Operation::SQRT:
+                c.emit(useAvx ? X86Inst::kIdVsqrtps : X86Inst::kIdSqrtps, dest, workspaceVar[args[0]]);
+                break;
+            case Operation::STEP:
+                generateBinaryOp(c, X86Inst::kIdXorps, X86Inst::kIdVxorps, dest, dest, dest);
+                generateCompare(c, dest, dest, workspaceVar[args[0]], 2); // Comparison mode is _CMP_LE_OS = 2
+                generateBinaryOp(c, X86Inst::kIdAndps, X86Inst::kIdVandps, dest, dest, constantVar[operationConstantIndex[step]]);
+                break;
+            case Operation::DELTA:
+                generateBinaryOp(c, X86Inst::kIdXorps, X86Inst::kIdVxorps, dest, dest, dest);
+                generateCompare(c, dest, dest, workspaceVar[args[0]], 0); // Comparison mode is _CMP_EQ_OQ = 0
+                generateBinaryOp(c, X86Inst::kIdAndps, X86Inst::kIdVandps, dest, dest, constantVar[operationConstantIndex[step]]);
+                break;
+            case Operation::SQUARE:
+                generateBinaryOp(c, X86Inst::kIdMulps, X86Inst::kIdVmulps, dest, workspaceVar[args[0]], workspaceVar[args[0]]);
+                break;
+            case Operation::CUBE:
+                generateBinaryOp(c, X86Inst::kIdMulps, X86Inst::kIdVmulps, dest, workspaceVar[args[0]], workspaceVar[args[0]]);
+                generateBinaryOp(c, X86Inst::kIdMulps, X86Inst::kIdVmulps, dest, dest, workspaceVar[args[0]]);
+                break;
+            case Operation::RECIPROCAL:
+                generateBinaryOp(c, X86Inst::kIdDivps, X86Inst::kIdVdivps, dest, constantVar[operationConstantIndex[step]], workspaceVar[args[0]]);
+                break;
+            case Operation::ADD_CONSTANT:
+                generateBinaryOp(c, X86Inst::kIdAddps, X86Inst::kIdVaddps, dest, workspaceVar[args[0]], constantVar[operationConstantIndex[step]]);
+                break;
+            case Operation::MULTIPLY_CONSTANT:
+                generateBinaryOp(c, X86Inst::kIdMulps, X86Inst::kIdVmulps, dest, workspaceVar[args[0]], constantVar[operationConstantIndex[step]]);
+                break;
+            case Operation::POWER_CONSTANT: {
+                // Integer powers are computed by repeated squaring.  Anything else is handled below.
+
+                double exponent = dynamic_cast<Operation::PowerConstant&>(op).getValue();
+                if (exponent != floor(exponent) || fabs(exponent) > 1024) {
+                    inlined = false;
+                    break;
+                }
+                int remaining = (int) fabs(exponent);
+                generateMove(c, temp, workspaceVar[args[0]]);
+                generateMove(c, dest, constantVar[operationConstantIndex[step]]);
+                while (true) {
+                    if ((remaining&1) != 0)
+                        generateBinaryOp(c, X86Inst::kIdMulps, X86Inst::kIdVmulps, dest, dest, temp);
+                    remaining >>= 1;
+                    if (remaining == 0)
+                        break;
+                    generateBinaryOp(c, X86Inst::kIdMulps, X86Inst::kIdVmulps, temp, temp, temp);
+                }
+                if (exponent < 0) {
+                    generateMove(c, temp, dest);
+                    generateBinaryOp(c, X86Inst::kIdDivps, X86Inst::kIdVdivps, dest, constantVar[operationConstantIndex[step]], temp);
+                }
+                break;
+            }
+            case Operation::MIN:
+                generateBinaryOp(c, X86Inst::kIdMinps, X86Inst::kIdVminps, dest, workspaceVar[args[0]], workspaceVar[args[1]]);
+                break;
+            case Operation::MAX:
+                generateBinaryOp(c, X86Inst::kIdMaxps, X86Inst::kIdVmaxps, dest, workspaceVar[args[0]], workspaceVar[args[1]]);
+                break;
+            case Operation::ABS:
+                generateBinaryOp(c, X86Inst::kIdAndps, X86Inst::kIdVandps, dest, workspaceVar[args[0]], constantVar[operationConstantIndex[step]]);
+                break;
+            case Operation::FLOOR:
+                if (canRound)
+                    c.emit(useAvx ? X86Inst::kIdVroundps : X86Inst::kIdRoundps, dest, workspaceVar[args[0]], imm(9)); // Round down, suppress exceptions
+                else
+                    inlined = false;
+                break;
+            case Operation::CEIL:
+                if (canRound)
+                    c.emit(useAvx ? X86Inst::kIdVroundps : X86Inst::kIdRoundps, dest, workspaceVar[args[0]], imm(10)); // Round up, suppress exceptions
+                else
+                    inlined = false;
+                break;
+            case Operation::SELECT:
+                // Build a mask of the elements where the condition is nonzero, and use it to combine the other two arguments.
+
+                generateBinaryOp(c, X86Inst::kIdXorps, X86Inst::kIdVxorps, temp, temp, temp);
+                generateCompare(c, temp, temp, workspaceVar[args[0]], 4); // Comparison mode is _CMP_NEQ_UQ = 4
+                if (useAvx)
+                    c.emit(X86Inst::kIdVblendvps, dest, workspaceVar[args[2]], workspaceVar[args[1]], temp);
+                else {
+                    generateBinaryOp(c, X86Inst::kIdAndps, X86Inst::kIdVandps, dest, temp, workspaceVar[args[1]]);
+                    c.emit(X86Inst::kIdAndnps, temp, workspaceVar[args[2]]);
+                    c.emit(X86Inst::kIdOrps, dest, temp);
+                }
+                break;
+            case Operation::CUSTOM:
+                inlined = generateUniformPolynomial(c, op, dest, workspaceVar[args[0]]);
+                break;
+            default:
+                inlined = false;
+        }
+        if (!inlined) {
+            // Store the arguments to memory and invoke evaluateVectorOperation(), which processes one element at a time.
+            
+            for (int i = 0; i < (int) args.size(); i++)
+                c.emit(moveUnaligned, x86::ptr(argsPointer, 4*width*i, 0), workspaceVar[args[i]]);
+            X86Gp fn = c.newIntPtr();
+            if (width == 1)
+                c.mov(fn, imm_ptr((void*) evaluateVectorOperation<1>));
+            else if (width == 4)
+                c.mov(fn, imm_ptr((void*) evaluateVectorOperation<4>));
+            else
+                c.mov(fn, imm_ptr((void*) evaluateVectorOperation<8>));
+            CCFuncCall* call = c.call(fn, FuncSignature4<void, Operation*, float*, float*, double*>());
+            call->setArg(0, imm_ptr(&op));
+            call->setArg(1, imm_ptr(&argValues[0]));
+            call->setArg(2, imm_ptr(&workspace[target[step]*width]));
+            call->setArg(3, imm_ptr(&argDoubles[0]));
+            X86Gp resultPointer = c.newIntPtr();
+            c.mov(resultPointer, imm_ptr(&workspace[target[step]*width]));
+            c.emit(moveUnaligned, dest, x86::ptr(resultPointer, 0, 0));
+        }
+    }
+    
+    // Store the results to the workspace, where evaluate() and getResult() will return them from.
+    
+    X86Gp resultPointer = c.newIntPtr();
+    c.mov(resultPointer, imm_ptr(&workspace[0]));
+    for (int index : resultIndices)
+        c.emit(moveUnaligned, x86::ptr(resultPointer, 4*width*index, 0), workspaceVar[index]);
+    c.ret();
+    c.endFunc();
+    c.finalize();
+    runtime.add(&jitCode, &code);
+}
+
+bool CompiledVectorExpression::generateUniformPolynomial(X86Compiler& c, const Operation& op, const X86Vec& dest, const X86Vec& arg) {
+    const Operation::Custom& custom = dynamic_cast<const Operation::Custom&>(op);
+    double min, max;
+    vector<double> coefficients;
+    if (custom.getNumArguments() != 1 || !custom.getFunction().getUniformPolynomials(&custom.getDerivOrder()[0], min, max, coefficients))
+        return false;
+    int numIntervals = coefficients.size()/4;
+    if (numIntervals == 0 || !(max > min))
+        return false;
+
+    // The data starts with vectors holding the range, the number of intervals per unit length, and the number
+    // of intervals.  Next is space to store the interval index for each element and to gather the coefficients
+    // into vectors.  The coefficients follow.  An extra interval at the end holds the value at max, so evaluating
+    // exactly at max needs no special handling.
+
+    polynomialData.push_back(vector<float>(9*width));
+    vector<float>& data = polynomialData.back();
+    float parameters[] = {(float) min, (float) max, (float) (numIntervals/(max-min)), (float) numIntervals};
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < width; j++)
+            data[i*width+j] = parameters[i];
+    for (double coefficient : coefficients)
+        data.push_back((float) coefficient);
+    data.push_back((float) (coefficients[4*numIntervals-4]+coefficients[4*numIntervals-3]+coefficients[4*numIntervals-2]+coefficients[4*numIntervals-1]));
+    data.resize(data.size()+3, 0.0f);
+    X86Gp dataPointer = c.newIntPtr();
+    c.mov(dataPointer, imm_ptr(&data[0]));
+    uint32_t moveUnaligned = (width == 1 ? (useAvx ? X86Inst::kIdVmovss : X86Inst::kIdMovss) : (useAvx ? X86Inst::kIdVmovups : X86Inst::kIdMovups));
+    uint32_t moveScalar = (useAvx ? X86Inst::kIdVmovss : X86Inst::kIdMovss);
+    X86Vec position, temp, mask;
+    if (width <= 4) {
+        position = c.newXmmPs();
+        temp = c.newXmmPs();
+        mask = c.newXmmPs();
+    }
+    else {
+        position = c.newYmmPs();
+        temp = c.newYmmPs();
+        mask = c.newYmmPs();
+    }
+
+    // Find the interval containing each argument and the position within it.  maxps returns its second
+    // operand if the first one is NaN, so the indices are always valid.
+
+    c.emit(moveUnaligned, temp, x86::ptr(dataPointer, 0, 0));
+    generateBinaryOp(c, X86Inst::kIdSubps, X86Inst::kIdVsubps, position, arg, temp);
+    c.emit(moveUnaligned, temp, x86::ptr(dataPointer, 8*width, 0));
+    generateBinaryOp(c, X86Inst::kIdMulps, X86Inst::kIdVmulps, position, position, temp);
+    generateBinaryOp(c, X86Inst::kIdXorps, X86Inst::kIdVxorps, temp, temp, temp);
+    generateBinaryOp(c, X86Inst::kIdMaxps, X86Inst::kIdVmaxps, position, position, temp);
+    c.emit(moveUnaligned, temp, x86::ptr(dataPointer, 12*width, 0));
+    generateBinaryOp(c, X86Inst::kIdMinps, X86Inst::kIdVminps, position, position, temp);
+    c.emit(useAvx ? X86Inst::kIdVcvttps2dq : X86Inst::kIdCvttps2dq, temp, position);
+    c.emit(moveUnaligned, x86::ptr(dataPointer, 16*width, 0), temp);
+    c.emit(useAvx ? X86Inst::kIdVcvtdq2ps : X86Inst::kIdCvtdq2ps, temp, temp);
+    generateBinaryOp(c, X86Inst::kIdSubps, X86Inst::kIdVsubps, position, position, temp);
+
+    // Gather the coefficients for each element into vectors.
+
+    X86Gp index = c.newIntPtr();
+    X86Xmm element = c.newXmmPs();
+    for (int i = 0; i < width; i++) {
+        c.mov(index.r32(), x86::dword_ptr(dataPointer, 16*width+4*i));
+        c.shl(index, 4);
+        for (int j = 0; j < 4; j++) {
+            c.emit(moveScalar, element, x86::ptr(dataPointer, index, 0, 36*width+4*j));
+            c.emit(moveScalar, x86::ptr(dataPointer, 20*width+4*(j*width+i), 0), element);
+        }
+    }
+
+    // Evaluate the polynomials with Horner's rule.
+
+    c.emit(moveUnaligned, dest, x86::ptr(dataPointer, 32*width, 0));
+    for (int j = 2; j >= 0; j--) {
+        generateBinaryOp(c, X86Inst::kIdMulps, X86Inst::kIdVmulps, dest, dest, position);
+        c.emit(moveUnaligned, temp, x86::ptr(dataPointer, 4*(5+j)*width, 0));
+        generateBinaryOp(c, X86Inst::kIdAddps, X86Inst::kIdVaddps, dest, dest, temp);
+    }
+
+    // The function is zero outside its range.
+
+    c.emit(moveUnaligned, temp, x86::ptr(dataPointer, 0, 0));
+    generateCompare(c, mask, temp, arg, 2); // Comparison mode is _CMP_LE_OS = 2
+    generateBinaryOp(c, X86Inst::kIdAndps, X86Inst::kIdVandps, dest, dest, mask);
+    c.emit(moveUnaligned, temp, x86::ptr(dataPointer, 4*width, 0));
+    generateCompare(c, mask, arg, temp, 2);
+    generateBinaryOp(c, X86Inst::kIdAndps, X86Inst::kIdVandps, dest, dest, mask);
+    return true;
+}
+
+void CompiledVectorExpression::generateMove(X86Compiler& c, const X86Vec& dest, const X86Vec& arg) {
+    c.emit(useAvx ? X86Inst::kIdVmovaps : X86Inst::kIdMovaps, dest, arg);
+}
+
+void CompiledVectorExpression::generateBinaryOp(X86Compiler& c, uint32_t sseInst, uint32_t avxInst, const X86Vec& dest, const X86Vec& arg1, const X86Vec& arg2) {
+    // SSE instructions overwrite their first operand, so dest must not be the same as arg2 unless it is also arg1.
+
+    if (useAvx)
+        c.emit(avxInst, dest, arg1, arg2);
+    else {
+        if (dest.getId() != arg1.getId())
+            generateMove(c, dest, arg1);
+        c.emit(sseInst, dest, arg2);
+    }
+}
+
+void CompiledVectorExpression::generateCompare(X86Compiler& c, const X86Vec& dest, const X86Vec& arg1, const X86Vec& arg2, int predicate) {
+    if (useAvx)
+        c.emit(X86Inst::kIdVcmpps, dest, arg1, arg2, imm(predicate));
+    else {
+        if (dest.getId() != arg1.getId())
+            generateMove(c, dest, arg1);
+        c.emit(X86Inst::kIdCmpps, dest, arg2, imm(predicate));
+    }
+}
+#endif
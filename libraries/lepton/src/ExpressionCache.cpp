@@ -0,0 +1,162 @@
+/* -------------------------------------------------------------------------- *
+ *                                   Lepton                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the Lepton expression parser originating from              *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.      *
+ * Authors: agent                                                             *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "lepton/ExpressionCache.h"
+#include "lepton/CustomFunction.h"
+#include "lepton/ExpressionTreeNode.h"
+#include "lepton/Operation.h"
+#include "lepton/Parser.h"
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+using namespace Lepton;
+using namespace std;
+
+namespace {
+
+/**
+ * The cached information about one expression.  The trees contain PlaceholderFunctions in place of the
+ * custom functions, so the cache does not keep the caller's functions alive.
+ */
+struct CacheEntry {
+    ParsedExpression expression;
+    map<string, ParsedExpression> derivatives;
+};
+
+mutex& getCacheLock() {
+    static mutex lock;
+    return lock;
+}
+
+map<string, CacheEntry>& getCache() {
+    static map<string, CacheEntry> cache;
+    return cache;
+}
+
+/**
+ * Get the key that identifies an expression in the cache.
+ */
+string getKey(const string& expression, const map<string, CustomFunction*>& customFunctions) {
+    stringstream key;
+    key << expression;
+    for (auto& function : customFunctions)
+        key << '\n' << function.first << '(' << function.second->getNumArguments() << ')';
+    return key.str();
+}
+
+/**
+ * Copy an expression tree, replacing every custom function with a copy of the one of the same name.
+ */
+ExpressionTreeNode replaceFunctions(const ExpressionTreeNode& node, const map<string, CustomFunction*>& customFunctions, map<const void*, ExpressionTreeNode>& nodeCache) {
+    map<const void*, ExpressionTreeNode>::const_iterator cached = nodeCache.find(node.getStorage());
+    if (cached != nodeCache.end())
+        return cached->second;
+    vector<ExpressionTreeNode> children;
+    for (const ExpressionTreeNode& child : node.getChildren())
+        children.push_back(replaceFunctions(child, customFunctions, nodeCache));
+    const Operation& op = node.getOperation();
+    ExpressionTreeNode result;
+    if (op.getId() == Operation::CUSTOM) {
+        const Operation::Custom& custom = dynamic_cast<const Operation::Custom&>(op);
+        CustomFunction* function = customFunctions.find(custom.getName())->second->clone();
+        result = ExpressionTreeNode(new Operation::Custom(custom.getName(), function, custom.getDerivOrder()), children);
+    }
+    else
+        result = ExpressionTreeNode(op.clone(), children);
+    nodeCache[node.getStorage()] = result;
+    return result;
+}
+
+ExpressionTreeNode replaceFunctions(const ExpressionTreeNode& node, const map<string, CustomFunction*>& customFunctions) {
+    map<const void*, ExpressionTreeNode> nodeCache;
+    return replaceFunctions(node, customFunctions, nodeCache);
+}
+
+/**
+ * Create the copy of an expression that gets stored in the cache.
+ */
+ParsedExpression createCacheCopy(const ParsedExpression& expression, const map<string, CustomFunction*>& customFunctions) {
+    map<string, CustomFunction*> placeholders;
+    vector<unique_ptr<CustomFunction> > placeholderStorage;
+    for (auto& function : customFunctions) {
+        placeholderStorage.push_back(unique_ptr<CustomFunction>(new PlaceholderFunction(function.second->getNumArguments())));
+        placeholders[function.first] = placeholderStorage.back().get();
+    }
+    return ParsedExpression(replaceFunctions(expression.getRootNode(), placeholders));
+}
+
+}
+
+ParsedExpression ExpressionCache::parse(const string& expression, const map<string, CustomFunction*>& customFunctions) {
+    string key = getKey(expression, customFunctions);
+    {
+        lock_guard<mutex> lock(getCacheLock());
+        map<string, CacheEntry>::const_iterator entry = getCache().find(key);
+        if (entry != getCache().end())
+            return ParsedExpression(replaceFunctions(entry->second.expression.getRootNode(), customFunctions));
+    }
+
+    // Process the expression without holding the lock, so other threads are not blocked.  If two threads
+    // process the same expression at once they compute identical results, so it does not matter which is kept.
+
+    ParsedExpression result = Parser::parse(expression, customFunctions).optimize();
+    ParsedExpression cached = createCacheCopy(result, customFunctions);
+    lock_guard<mutex> lock(getCacheLock());
+    if (getCache().find(key) == getCache().end())
+        getCache()[key].expression = cached;
+    return result;
+}
+
+ParsedExpression ExpressionCache::differentiate(const string& expression, const map<string, CustomFunction*>& customFunctions, const string& variable) {
+    string key = getKey(expression, customFunctions);
+    {
+        lock_guard<mutex> lock(getCacheLock());
+        map<string, CacheEntry>::const_iterator entry = getCache().find(key);
+        if (entry != getCache().end()) {
+            map<string, ParsedExpression>::const_iterator deriv = entry->second.derivatives.find(variable);
+            if (deriv != entry->second.derivatives.end())
+                return ParsedExpression(replaceFunctions(deriv->second.getRootNode(), customFunctions));
+        }
+    }
+    ParsedExpression result = parse(expression, customFunctions).differentiate(variable).optimize();
+    ParsedExpression cached = createCacheCopy(result, customFunctions);
+    lock_guard<mutex> lock(getCacheLock());
+    map<string, CacheEntry>::iterator entry = getCache().find(key);
+    if (entry != getCache().end())
+        entry->second.derivatives[variable] = cached;
+    return result;
+}
+
+void ExpressionCache::clear() {
+    lock_guard<mutex> lock(getCacheLock());
+    getCache().clear();
+}
@@ -30,8 +30,11 @@
  * -------------------------------------------------------------------------- */
 
 #include "lepton/ExpressionProgram.h"
+#include "lepton/Exception.h"
 #include "lepton/Operation.h"
 #include "lepton/ParsedExpression.h"
+#include <algorithm>
+#include <cmath>
 
 using namespace Lepton;
 using namespace std;
@@ -108,3 +111,125 @@ double ExpressionProgram::evaluate(const std::map<std::string, double>& variable
     }
     return stack[stackSize-1];
 }
+
+void ExpressionProgram::evaluate(int numPoints, const vector<string>& variableNames, const vector<const double*>& variableValues, double* results) const {
+    if (variableNames.size() != variableValues.size())
+        throw Exception("The number of variable names and value arrays must be the same");
+
+    // Find the input array for every VARIABLE operation before starting, so the loop
+    // below does not need to look anything up by name.
+
+    int numOps = operations.size();
+    vector<const double*> inputs(numOps, NULL);
+    for (int i = 0; i < numOps; i++)
+        if (operations[i]->getId() == Operation::VARIABLE) {
+            const string& name = dynamic_cast<Operation::Variable*>(operations[i])->getName();
+            for (int j = 0; j < (int) variableNames.size(); j++)
+                if (variableNames[j] == name)
+                    inputs[i] = variableValues[j];
+            if (inputs[i] == NULL)
+                throw Exception("No value specified for variable "+name);
+        }
+
+    // Process the points in blocks.  Each row of the stack holds one value for every point in
+    // the block, so every operation becomes a simple loop over the block.
+
+    const int blockSize = 64;
+    vector<double> stack((stackSize+1)*blockSize);
+    vector<double> args(maxArgs);
+    map<string, double> noVariables;
+    for (int start = 0; start < numPoints; start += blockSize) {
+        int count = min(blockSize, numPoints-start);
+        int stackPointer = stackSize;
+        for (int i = 0; i < numOps; i++) {
+            const Operation& op = *operations[i];
+            int numArgs = op.getNumArguments();
+            double* arg0 = &stack[stackPointer*blockSize];
+            double* arg1 = arg0+blockSize;
+            stackPointer += numArgs-1;
+            double* result = &stack[stackPointer*blockSize];
+            switch (op.getId()) {
+                case Operation::CONSTANT: {
+                    double value = dynamic_cast<const Operation::Constant&>(op).getValue();
+                    for (int j = 0; j < count; j++)
+                        result[j] = value;
+                    break;
+                }
+                case Operation::VARIABLE: {
+                    const double* input = inputs[i]+start;
+                    for (int j = 0; j < count; j++)
+                        result[j] = input[j];
+                    break;
+                }
+                case Operation::ADD:
+                    for (int j = 0; j < count; j++)
+                        result[j] = arg0[j]+arg1[j];
+                    break;
+                case Operation::SUBTRACT:
+                    for (int j = 0; j < count; j++)
+                        result[j] = arg0[j]-arg1[j];
+                    break;
+                case Operation::MULTIPLY:
+                    for (int j = 0; j < count; j++)
+                        result[j] = arg0[j]*arg1[j];
+                    break;
+                case Operation::DIVIDE:
+                    for (int j = 0; j < count; j++)
+                        result[j] = arg0[j]/arg1[j];
+                    break;
+                case Operation::NEGATE:
+                    for (int j = 0; j < count; j++)
+                        result[j] = -arg0[j];
+                    break;
+                case Operation::SQUARE:
+                    for (int j = 0; j < count; j++)
+                        result[j] = arg0[j]*arg0[j];
+                    break;
+                case Operation::CUBE:
+                    for (int j = 0; j < count; j++)
+                        result[j] = arg0[j]*arg0[j]*arg0[j];
+                    break;
+                case Operation::RECIPROCAL:
+                    for (int j = 0; j < count; j++)
+                        result[j] = 1.0/arg0[j];
+                    break;
+                case Operation::ADD_CONSTANT: {
+                    double value = dynamic_cast<const Operation::AddConstant&>(op).getValue();
+                    for (int j = 0; j < count; j++)
+                        result[j] = arg0[j]+value;
+                    break;
+                }
+                case Operation::MULTIPLY_CONSTANT: {
+                    double value = dynamic_cast<const Operation::MultiplyConstant&>(op).getValue();
+                    for (int j = 0; j < count; j++)
+                        result[j] = arg0[j]*value;
+                    break;
+                }
+                case Operation::SQRT:
+                    for (int j = 0; j < count; j++)
+                        result[j] = std::sqrt(arg0[j]);
+                    break;
+                case Operation::EXP:
+                    for (int j = 0; j < count; j++)
+                        result[j] = std::exp(arg0[j]);
+                    break;
+                case Operation::LOG:
+                    for (int j = 0; j < count; j++)
+                        result[j] = std::log(arg0[j]);
+                    break;
+                default:
+                    // Any other operation is evaluated one point at a time.  The arguments are
+                    // gathered first, since the result may overwrite the first of them.
+
+                    for (int j = 0; j < count; j++) {
+                        for (int k = 0; k < numArgs; k++)
+                            args[k] = arg0[k*blockSize+j];
+                        result[j] = op.evaluate(args.data(), noVariables);
+                    }
+            }
+        }
+        const double* value = &stack[(stackSize-1)*blockSize];
+        for (int j = 0; j < count; j++)
+            results[start+j] = value[j];
+    }
+}
@@ -36,41 +36,51 @@
 using namespace Lepton;
 using namespace std;
 
-ExpressionTreeNode::ExpressionTreeNode(Operation* operation, const vector<ExpressionTreeNode>& children) : operation(operation), children(children) {
+/**
+ * This holds the operation and children of a node.  It is shared by all copies of the node.
+ */
+class ExpressionTreeNode::NodeData {
+public:
+    NodeData(Operation* operation, const vector<ExpressionTreeNode>& children) : operation(operation), children(children) {
+    }
+    ~NodeData() {
+        delete operation;
+    }
+    Operation* operation;
+    vector<ExpressionTreeNode> children;
+};
+
+ExpressionTreeNode::ExpressionTreeNode(Operation* operation, const vector<ExpressionTreeNode>& children) {
+    // Only take ownership of the operation once the node is known to be valid.  If this throws an
+    // exception, the caller is still responsible for deleting it.
+
     if (operation->getNumArguments() != children.size())
         throw Exception("wrong number of arguments to function: "+operation->getName());
+    data.reset(new NodeData(operation, children));
 }
 
-ExpressionTreeNode::ExpressionTreeNode(Operation* operation, const ExpressionTreeNode& child1, const ExpressionTreeNode& child2) : operation(operation) {
-    children.push_back(child1);
-    children.push_back(child2);
-    if (operation->getNumArguments() != children.size())
-        throw Exception("wrong number of arguments to function: "+operation->getName());
+ExpressionTreeNode::ExpressionTreeNode(Operation* operation, const ExpressionTreeNode& child1, const ExpressionTreeNode& child2) :
+        ExpressionTreeNode(operation, vector<ExpressionTreeNode>{child1, child2}) {
 }
 
-ExpressionTreeNode::ExpressionTreeNode(Operation* operation, const ExpressionTreeNode& child) : operation(operation) {
-    children.push_back(child);
-    if (operation->getNumArguments() != children.size())
-        throw Exception("wrong number of arguments to function: "+operation->getName());
+ExpressionTreeNode::ExpressionTreeNode(Operation* operation, const ExpressionTreeNode& child) : ExpressionTreeNode(operation, vector<ExpressionTreeNode>{child}) {
 }
 
-ExpressionTreeNode::ExpressionTreeNode(Operation* operation) : operation(operation) {
-    if (operation->getNumArguments() != children.size())
-        throw Exception("wrong number of arguments to function: "+operation->getName());
+ExpressionTreeNode::ExpressionTreeNode(Operation* operation) : ExpressionTreeNode(operation, vector<ExpressionTreeNode>()) {
 }
 
-ExpressionTreeNode::ExpressionTreeNode(const ExpressionTreeNode& node) : operation(node.operation == NULL ? NULL : node.operation->clone()), children(node.getChildren()) {
+ExpressionTreeNode::ExpressionTreeNode(const ExpressionTreeNode& node) : data(node.data) {
 }
 
-ExpressionTreeNode::ExpressionTreeNode() : operation(NULL) {
+ExpressionTreeNode::ExpressionTreeNode() {
 }
 
 ExpressionTreeNode::~ExpressionTreeNode() {
-    if (operation != NULL)
-        delete operation;
 }
 
 bool ExpressionTreeNode::operator!=(const ExpressionTreeNode& node) const {
+    if (data == node.data)
+        return false; // They share storage, so they must be identical.
     if (node.getOperation() != getOperation())
         return true;
     if (getOperation().isSymmetric() && getChildren().size() == 2) {
@@ -91,17 +101,21 @@ bool ExpressionTreeNode::operator==(const ExpressionTreeNode& node) const {
 }
 
 ExpressionTreeNode& ExpressionTreeNode::operator=(const ExpressionTreeNode& node) {
-    if (operation != NULL)
-        delete operation;
-    operation = node.getOperation().clone();
-    children = node.getChildren();
+    data = node.data;
     return *this;
 }
 
 const Operation& ExpressionTreeNode::getOperation() const {
-    return *operation;
+    return *data->operation;
 }
 
 const vector<ExpressionTreeNode>& ExpressionTreeNode::getChildren() const {
-    return children;
+    static const vector<ExpressionTreeNode> noChildren;
+    if (data == NULL)
+        return noChildren;
+    return data->children;
+}
+
+const void* ExpressionTreeNode::getStorage() const {
+    return data.get();
 }
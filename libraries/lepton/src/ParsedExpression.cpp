@@ -31,6 +31,7 @@
 
 #include "lepton/ParsedExpression.h"
 #include "lepton/CompiledExpression.h"
+#include "lepton/CompiledVectorExpression.h"
 #include "lepton/ExpressionProgram.h"
 #include "lepton/Operation.h"
 #include <limits>
@@ -68,9 +69,11 @@ double ParsedExpression::evaluate(const ExpressionTreeNode& node, const map<stri
 }
 
 ParsedExpression ParsedExpression::optimize() const {
-    ExpressionTreeNode result = precalculateConstantSubexpressions(getRootNode());
+    map<const void*, ExpressionTreeNode> nodeCache;
+    ExpressionTreeNode result = precalculateConstantSubexpressions(getRootNode(), nodeCache);
     while (true) {
-        ExpressionTreeNode simplified = substituteSimplerExpression(result);
+        nodeCache.clear();
+        ExpressionTreeNode simplified = substituteSimplerExpression(result, nodeCache);
         if (simplified == result)
             break;
         result = simplified;
@@ -79,10 +82,13 @@ ParsedExpression ParsedExpression::optimize() const {
 }
 
 ParsedExpression ParsedExpression::optimize(const map<string, double>& variables) const {
-    ExpressionTreeNode result = preevaluateVariables(getRootNode(), variables);
-    result = precalculateConstantSubexpressions(result);
+    map<const void*, ExpressionTreeNode> nodeCache;
+    ExpressionTreeNode result = preevaluateVariables(getRootNode(), variables, nodeCache);
+    nodeCache.clear();
+    result = precalculateConstantSubexpressions(result, nodeCache);
     while (true) {
-        ExpressionTreeNode simplified = substituteSimplerExpression(result);
+        nodeCache.clear();
+        ExpressionTreeNode simplified = substituteSimplerExpression(result, nodeCache);
         if (simplified == result)
             break;
         result = simplified;
@@ -90,7 +96,7 @@ ParsedExpression ParsedExpression::optimize(const map<string, double>& variables
     return ParsedExpression(result);
 }
 
-ExpressionTreeNode ParsedExpression::preevaluateVariables(const ExpressionTreeNode& node, const map<string, double>& variables) {
+ExpressionTreeNode ParsedExpression::preevaluateVariables(const ExpressionTreeNode& node, const map<string, double>& variables, map<const void*, ExpressionTreeNode>& nodeCache) {
     if (node.getOperation().getId() == Operation::VARIABLE) {
         const Operation::Variable& var = dynamic_cast<const Operation::Variable&>(node.getOperation());
         map<string, double>::const_iterator iter = variables.find(var.getName());
@@ -98,30 +104,52 @@ ExpressionTreeNode ParsedExpression::preevaluateVariables(const ExpressionTreeNo
             return node;
         return ExpressionTreeNode(new Operation::Constant(iter->second));
     }
+    map<const void*, ExpressionTreeNode>::const_iterator cached = nodeCache.find(node.getStorage());
+    if (cached != nodeCache.end())
+        return cached->second;
     vector<ExpressionTreeNode> children(node.getChildren().size());
     for (int i = 0; i < (int) children.size(); i++)
-        children[i] = preevaluateVariables(node.getChildren()[i], variables);
-    return ExpressionTreeNode(node.getOperation().clone(), children);
+        children[i] = preevaluateVariables(node.getChildren()[i], variables, nodeCache);
+    ExpressionTreeNode result = (children == node.getChildren() ? node : ExpressionTreeNode(node.getOperation().clone(), children));
+    nodeCache[node.getStorage()] = result;
+    return result;
 }
 
-ExpressionTreeNode ParsedExpression::precalculateConstantSubexpressions(const ExpressionTreeNode& node) {
+ExpressionTreeNode ParsedExpression::precalculateConstantSubexpressions(const ExpressionTreeNode& node, map<const void*, ExpressionTreeNode>& nodeCache) {
+    map<const void*, ExpressionTreeNode>::const_iterator cached = nodeCache.find(node.getStorage());
+    if (cached != nodeCache.end())
+        return cached->second;
     vector<ExpressionTreeNode> children(node.getChildren().size());
     for (int i = 0; i < (int) children.size(); i++)
-        children[i] = precalculateConstantSubexpressions(node.getChildren()[i]);
-    ExpressionTreeNode result = ExpressionTreeNode(node.getOperation().clone(), children);
-    if (node.getOperation().getId() == Operation::VARIABLE || node.getOperation().getId() == Operation::CUSTOM)
-        return result;
-    for (int i = 0; i < (int) children.size(); i++)
-        if (children[i].getOperation().getId() != Operation::CONSTANT)
-            return result;
-    return ExpressionTreeNode(new Operation::Constant(evaluate(result, map<string, double>())));
+        children[i] = precalculateConstantSubexpressions(node.getChildren()[i], nodeCache);
+    ExpressionTreeNode result = (children == node.getChildren() ? node : ExpressionTreeNode(node.getOperation().clone(), children));
+    if (node.getOperation().getId() != Operation::VARIABLE && node.getOperation().getId() != Operation::CUSTOM) {
+        bool allConstant = true;
+        for (int i = 0; i < (int) children.size(); i++)
+            if (children[i].getOperation().getId() != Operation::CONSTANT)
+                allConstant = false;
+        if (allConstant)
+            result = ExpressionTreeNode(new Operation::Constant(evaluate(result, map<string, double>())));
+    }
+    nodeCache[node.getStorage()] = result;
+    return result;
 }
 
-ExpressionTreeNode ParsedExpression::substituteSimplerExpression(const ExpressionTreeNode& node) {
+ExpressionTreeNode ParsedExpression::substituteSimplerExpression(const ExpressionTreeNode& node, map<const void*, ExpressionTreeNode>& nodeCache) {
+    // A subexpression that appears in several places only needs to be simplified once.
+
+    map<const void*, ExpressionTreeNode>::const_iterator cached = nodeCache.find(node.getStorage());
+    if (cached != nodeCache.end())
+        return cached->second;
     vector<ExpressionTreeNode> children(node.getChildren().size());
     for (int i = 0; i < (int) children.size(); i++)
-        children[i] = substituteSimplerExpression(node.getChildren()[i]);
-    
+        children[i] = substituteSimplerExpression(node.getChildren()[i], nodeCache);
+    ExpressionTreeNode result = substituteSimplerNode(node, children);
+    nodeCache[node.getStorage()] = result;
+    return result;
+}
+
+ExpressionTreeNode ParsedExpression::substituteSimplerNode(const ExpressionTreeNode& node, const vector<ExpressionTreeNode>& children) {
     // Collect some info on constant expressions in children
     bool first_const = children.size() > 0 && isConstant(children[0]); // is first child constant?
     bool second_const = children.size() > 1 && isConstant(children[1]); ; // is second child constant?   
@@ -302,18 +330,37 @@ ExpressionTreeNode ParsedExpression::substituteSimplerExpression(const Expressio
         }
 
     }
+    if (children == node.getChildren())
+        return node; // Nothing has changed, so keep sharing the original node.
     return ExpressionTreeNode(node.getOperation().clone(), children);
 }
 
 ParsedExpression ParsedExpression::differentiate(const string& variable) const {
-    return differentiate(getRootNode(), variable);
+    map<const void*, ExpressionTreeNode> nodeCache;
+    return differentiate(getRootNode(), variable, nodeCache);
 }
 
-ExpressionTreeNode ParsedExpression::differentiate(const ExpressionTreeNode& node, const string& variable) {
+ExpressionTreeNode ParsedExpression::differentiate(const ExpressionTreeNode& node, const string& variable, map<const void*, ExpressionTreeNode>& nodeCache) {
+    // The derivative of a subexpression that appears in several places only needs to be computed once.
+    // This keeps the cost from growing exponentially when the chain rule is applied to nested expressions.
+
+    map<const void*, ExpressionTreeNode>::const_iterator cached = nodeCache.find(node.getStorage());
+    if (cached != nodeCache.end())
+        return cached->second;
     vector<ExpressionTreeNode> childDerivs(node.getChildren().size());
-    for (int i = 0; i < (int) childDerivs.size(); i++)
-        childDerivs[i] = differentiate(node.getChildren()[i], variable);
-    return node.getOperation().differentiate(node.getChildren(),childDerivs, variable);
+    bool allZero = (childDerivs.size() > 0);
+    for (int i = 0; i < (int) childDerivs.size(); i++) {
+        childDerivs[i] = differentiate(node.getChildren()[i], variable, nodeCache);
+        if (!isConstant(childDerivs[i]) || getConstantValue(childDerivs[i]) != 0.0)
+            allZero = false;
+    }
+
+    // If none of the children depend on the variable, neither does this node.  Skip building a large
+    // tree that optimize() would just reduce to 0.
+
+    ExpressionTreeNode result = (allZero ? ExpressionTreeNode(new Operation::Constant(0.0)) : node.getOperation().differentiate(node.getChildren(), childDerivs, variable));
+    nodeCache[node.getStorage()] = result;
+    return result;
 }
 
 bool ParsedExpression::isConstant(const ExpressionTreeNode& node) {
@@ -335,20 +382,38 @@ CompiledExpression ParsedExpression::createCompiledExpression() const {
     return CompiledExpression(*this);
 }
 
+CompiledExpression ParsedExpression::createCompiledExpression(const vector<ParsedExpression>& expressions) {
+    return CompiledExpression(expressions);
+}
+
+CompiledVectorExpression ParsedExpression::createCompiledVectorExpression(int width) const {
+    return CompiledVectorExpression(*this, width);
+}
+
+CompiledVectorExpression ParsedExpression::createCompiledVectorExpression(const vector<ParsedExpression>& expressions, int width) {
+    return CompiledVectorExpression(expressions, width);
+}
+
 ParsedExpression ParsedExpression::renameVariables(const map<string, string>& replacements) const {
-    return ParsedExpression(renameNodeVariables(getRootNode(), replacements));
+    map<const void*, ExpressionTreeNode> nodeCache;
+    return ParsedExpression(renameNodeVariables(getRootNode(), replacements, nodeCache));
 }
 
-ExpressionTreeNode ParsedExpression::renameNodeVariables(const ExpressionTreeNode& node, const map<string, string>& replacements) {
+ExpressionTreeNode ParsedExpression::renameNodeVariables(const ExpressionTreeNode& node, const map<string, string>& replacements, map<const void*, ExpressionTreeNode>& nodeCache) {
     if (node.getOperation().getId() == Operation::VARIABLE) {
         map<string, string>::const_iterator replace = replacements.find(node.getOperation().getName());
         if (replace != replacements.end())
             return ExpressionTreeNode(new Operation::Variable(replace->second));
     }
+    map<const void*, ExpressionTreeNode>::const_iterator cached = nodeCache.find(node.getStorage());
+    if (cached != nodeCache.end())
+        return cached->second;
     vector<ExpressionTreeNode> children;
     for (int i = 0; i < (int) node.getChildren().size(); i++)
-        children.push_back(renameNodeVariables(node.getChildren()[i], replacements));
-    return ExpressionTreeNode(node.getOperation().clone(), children);
+        children.push_back(renameNodeVariables(node.getChildren()[i], replacements, nodeCache));
+    ExpressionTreeNode result(node.getOperation().clone(), children);
+    nodeCache[node.getStorage()] = result;
+    return result;
 }
 
 ostream& Lepton::operator<<(ostream& out, const ExpressionTreeNode& node) {
@@ -35,6 +35,8 @@
 #include "Integrator.h"
 #include "State.h"
 #include "System.h"
+#include <functional>
+#include <future>
 #include <iosfwd>
 #include <map>
 #include <string>
@@ -125,6 +127,47 @@ public:
      * and energies.  Group i will be included if (groups&(1<<i)) != 0.  The default value includes all groups.
      */
     State getState(int types, bool enforcePeriodicBox=false, int groups=0xFFFFFFFF) const;
+    /**
+     * Store the current state information in an existing State object.  This is equivalent to
+     * getState(), except that the State's memory is reused.  After the first call, retrieving the
+     * same information again does not need to allocate any memory, which makes this the preferred
+     * way to retrieve data repeatedly from large systems.  Any information from the previous contents
+     * of the State that is not requested in this call is discarded.
+     *
+     * @param[out] state the State object in which to store the information
+     * @param types the set of data types which should be stored in the State object.  This
+     * should be a union of DataType values, e.g. (State::Positions | State::Velocities).
+     * @param enforcePeriodicBox if false, the position of each particle will be whatever position
+     * is stored in the Context, regardless of periodic boundary conditions.  If true, particle
+     * positions will be translated so the center of every molecule lies in the same periodic box.
+     * @param groups a set of bit flags for which force groups to include when computing forces
+     * and energies.  Group i will be included if (groups&(1<<i)) != 0.  The default value includes all groups.
+     */
+    void getState(State& state, int types, bool enforcePeriodicBox=false, int groups=0xFFFFFFFF) const;
+    /**
+     * Get a State object without waiting for it to be processed.  The requested data is copied out of
+     * the Context before this method returns, so the simulation may continue immediately.  All further
+     * processing happens on a background thread: translating molecules into the periodic box if
+     * enforcePeriodicBox is true, then invoking the callback, if one is specified.  This lets you write
+     * the State to disk while the simulation continues running.
+     *
+     * Requests are processed in the order they are made, so callbacks see States in the order they were
+     * created.  A callback must not access this Context.  If the Context is deleted or reinitialized,
+     * all pending requests are completed first.
+     *
+     * @param types the set of data types which should be stored in the State object.  This
+     * should be a union of DataType values, e.g. (State::Positions | State::Velocities).
+     * @param enforcePeriodicBox if false, the position of each particle will be whatever position
+     * is stored in the Context, regardless of periodic boundary conditions.  If true, particle
+     * positions will be translated so the center of every molecule lies in the same periodic box.
+     * @param groups a set of bit flags for which force groups to include when computing forces
+     * and energies.  Group i will be included if (groups&(1<<i)) != 0.  The default value includes all groups.
+     * @param callback an optional function to invoke on the background thread once the State is complete
+     * @return a future that becomes ready once the State is complete and the callback has returned.  If the
+     * callback throws an exception, it is rethrown when get() is called on the future.
+     */
+    std::future<State> getStateAsync(int types, bool enforcePeriodicBox=false, int groups=0xFFFFFFFF,
+            std::function<void(const State&)> callback=std::function<void(const State&)>()) const;
     /**
      * Copy information from a State object into this Context.  This restores the Context to
      * approximately the same state it was in when the State was created.  If the State does not include
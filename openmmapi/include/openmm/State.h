@@ -79,6 +79,60 @@ public:
      * Get the force acting on each particle.  If this State does not contain forces, this will throw an exception.
      */
     const std::vector<Vec3>& getForces() const;
+    /**
+     * Copy the positions of particles into an array supplied by the caller.  If this State does not contain
+     * positions, this will throw an exception.
+     *
+     * @param[out] positions   on exit, contains the x, y, and z coordinates of each requested particle in order.
+     *                         It must have length at least 3 times the number of particles being copied.
+     * @param particles        the indices of the particles to copy.  If this is empty, all particles are copied.
+     */
+    void getPositions(double* positions, const std::vector<int>& particles=std::vector<int>()) const;
+    /**
+     * Copy the positions of particles into an array supplied by the caller, converting them to single precision.
+     * If this State does not contain positions, this will throw an exception.
+     *
+     * @param[out] positions   on exit, contains the x, y, and z coordinates of each requested particle in order.
+     *                         It must have length at least 3 times the number of particles being copied.
+     * @param particles        the indices of the particles to copy.  If this is empty, all particles are copied.
+     */
+    void getPositions(float* positions, const std::vector<int>& particles=std::vector<int>()) const;
+    /**
+     * Copy the velocities of particles into an array supplied by the caller.  If this State does not contain
+     * velocities, this will throw an exception.
+     *
+     * @param[out] velocities  on exit, contains the x, y, and z components of the velocity of each requested particle
+     *                         in order.  It must have length at least 3 times the number of particles being copied.
+     * @param particles        the indices of the particles to copy.  If this is empty, all particles are copied.
+     */
+    void getVelocities(double* velocities, const std::vector<int>& particles=std::vector<int>()) const;
+    /**
+     * Copy the velocities of particles into an array supplied by the caller, converting them to single precision.
+     * If this State does not contain velocities, this will throw an exception.
+     *
+     * @param[out] velocities  on exit, contains the x, y, and z components of the velocity of each requested particle
+     *                         in order.  It must have length at least 3 times the number of particles being copied.
+     * @param particles        the indices of the particles to copy.  If this is empty, all particles are copied.
+     */
+    void getVelocities(float* velocities, const std::vector<int>& particles=std::vector<int>()) const;
+    /**
+     * Copy the forces acting on particles into an array supplied by the caller.  If this State does not contain
+     * forces, this will throw an exception.
+     *
+     * @param[out] forces      on exit, contains the x, y, and z components of the force on each requested particle
+     *                         in order.  It must have length at least 3 times the number of particles being copied.
+     * @param particles        the indices of the particles to copy.  If this is empty, all particles are copied.
+     */
+    void getForces(double* forces, const std::vector<int>& particles=std::vector<int>()) const;
+    /**
+     * Copy the forces acting on particles into an array supplied by the caller, converting them to single precision.
+     * If this State does not contain forces, this will throw an exception.
+     *
+     * @param[out] forces      on exit, contains the x, y, and z components of the force on each requested particle
+     *                         in order.  It must have length at least 3 times the number of particles being copied.
+     * @param particles        the indices of the particles to copy.  If this is empty, all particles are copied.
+     */
+    void getForces(float* forces, const std::vector<int>& particles=std::vector<int>()) const;
     /**
      * Get the total kinetic energy of the system.  If this State does not contain energies, this will throw an exception.
      *
@@ -124,6 +178,7 @@ public:
      */
     int getDataTypes() const;
 private:
+    friend class Context;
     State(double time);
     void setPositions(const std::vector<Vec3>& pos);
     void setVelocities(const std::vector<Vec3>& vel);
@@ -0,0 +1,132 @@
+#ifndef OPENMM_COMPILED_VEC3_EXPRESSION_H_
+#define OPENMM_COMPILED_VEC3_EXPRESSION_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: agent                                                             *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/Vec3.h"
+#include "lepton/CompiledExpression.h"
+#include "lepton/CustomFunction.h"
+#include "lepton/ParsedExpression.h"
+#include "windowsExport.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * This class compiles an expression that operates on Vec3s, using the same functions as VectorExpression.
+ * The expression is split into three scalar expressions, one for each component, which are compiled
+ * together into a single Lepton::CompiledExpression.  That lets subexpressions such as dot products be
+ * computed only once, and lets the expressions be evaluated with JIT compiled code.
+ *
+ * Rather than passing the variables to every evaluation, you tell it where to find the value of each
+ * variable for every particle, then evaluate the expression for a range of particles at once.  Variables
+ * can be Vec3s that differ for each particle, scalars that differ for each particle, or scalars that are
+ * the same for all particles.  Scalars are treated as vectors with the same value for every component.
+ * Each call to evaluate() reads the current values from the locations you specified, so they can be
+ * changed between calls without doing anything else.
+ */
+class OPENMM_EXPORT CompiledVec3Expression {
+public:
+    /**
+     * Create a CompiledVec3Expression by parsing a mathematical expression.
+     *
+     * @param expression        the mathematical expression to parse
+     * @param customFunctions   a map specifying user defined functions that may appear in the expression.
+     *                          The keys are function names, and the values are corresponding CustomFunction objects.
+     */
+    CompiledVec3Expression(const std::string& expression, const std::map<std::string, Lepton::CustomFunction*>& customFunctions);
+    /**
+     * Create a CompiledVec3Expression for evaluating a ParsedExpression.
+     *
+     * @param expression        the mathematical expression to evaluate
+     */
+    CompiledVec3Expression(const Lepton::ParsedExpression& expression);
+    CompiledVec3Expression(const CompiledVec3Expression& expression);
+    CompiledVec3Expression& operator=(const CompiledVec3Expression& expression);
+    /**
+     * Get the names of all variables used by this expression.
+     */
+    const std::set<std::string>& getVariables() const;
+    /**
+     * Specify that a variable is a Vec3 that differs for each particle.  If the expression does not use
+     * the variable, this does nothing.
+     *
+     * @param name      the name of the variable
+     * @param values    element i of this array contains the value for particle i
+     */
+    void setPerParticleVariable(const std::string& name, const Vec3* values);
+    /**
+     * Specify that a variable is a scalar that differs for each particle.  If the expression does not use
+     * the variable, this does nothing.
+     *
+     * @param name      the name of the variable
+     * @param values    element i of this array contains the value for particle i
+     */
+    void setPerParticleVariable(const std::string& name, const double* values);
+    /**
+     * Specify that a variable is a scalar that is the same for all particles.  If the expression does not use
+     * the variable, this does nothing.
+     *
+     * @param name      the name of the variable
+     * @param value     a pointer to the location containing the variable's value
+     */
+    void setGlobalVariable(const std::string& name, const double* value);
+    /**
+     * Evaluate the expression for a range of particles.  An exception is thrown if the location of any variable
+     * has not been specified.
+     *
+     * @param start     the index of the first particle to evaluate it for
+     * @param end       the index after the last particle to evaluate it for
+     * @param results   on exit, element i of this array contains the value for particle i, for start <= i < end.
+     *                  Other elements are not modified.  This may be the same array as one of the variables, since
+     *                  each particle's variables are read before its result is written.
+     */
+    void evaluate(int start, int end, Vec3* results) const;
+private:
+    enum VariableType {Unset, PerParticleVector, PerParticleScalar, Global};
+    void compile(const Lepton::ParsedExpression& expression);
+    void updateVariableLocations();
+    Lepton::ParsedExpression parsed;
+    Lepton::CompiledExpression compiled;
+    std::set<std::string> variables;
+    std::vector<std::string> variableNames;
+    std::vector<VariableType> variableTypes;
+    std::vector<const double*> variableSources;
+    mutable std::vector<double> values;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_COMPILED_VEC3_EXPRESSION_H_*/
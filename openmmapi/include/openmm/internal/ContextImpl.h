@@ -35,8 +35,13 @@
 #include "openmm/Kernel.h"
 #include "openmm/Platform.h"
 #include "openmm/Vec3.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <iosfwd>
 #include <map>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 namespace OpenMM {
@@ -240,6 +245,12 @@ public:
      * same molecule if they are connected by constraints or bonds.
      */
     const std::vector<std::vector<int> >& getMolecules() const;
+    /**
+     * Add a task to be executed on a background thread.  Tasks are executed one at a time, in the order
+     * they were added.  The thread is created the first time this is called.  Any tasks that are still
+     * pending when the ContextImpl is deleted are completed first.
+     */
+    void runInBackground(std::function<void()> task);
     /**
      * Create a checkpoint recording the current state of the Context.
      * 
@@ -280,6 +291,7 @@ public:
 private:
     friend class Context;
     void initialize();
+    void processBackgroundTasks();
     Context& owner;
     const System& system;
     Integrator& integrator;
@@ -291,6 +303,11 @@ private:
     Platform* platform;
     Kernel initializeForcesKernel, updateStateDataKernel, applyConstraintsKernel, virtualSitesKernel;
     void* platformData;
+    std::thread backgroundThread;
+    std::mutex backgroundLock;
+    std::condition_variable backgroundCondition;
+    std::deque<std::function<void()> > backgroundTasks;
+    bool stopBackgroundThread;
 };
 
 } // namespace OpenMM
@@ -34,8 +34,10 @@
 
 #define NOMINMAX
 #include "windowsExport.h"
+#include <atomic>
 #include <functional>
 #include <pthread.h>
+#include <string>
 #include <vector>
 
 namespace OpenMM {
@@ -49,6 +51,16 @@ namespace OpenMM {
  * next syncThreads(), and the final call waits until they exit from the Task's execute() method.
  * After calling waitForThreads() to block at a synchronization point, the parent thread should
  * call resumeThreads() to instruct the worker threads to resume.
+ *
+ * By default, a thread that has to wait goes to sleep immediately.  When the pool is used for many
+ * short tasks in a row, the time to wake the threads up again can dominate.  In that case you can
+ * enable spin waiting, which makes waiting threads poll for a while before they go to sleep.  This
+ * greatly reduces the latency of each synchronization, at the cost of keeping the cores busy while
+ * they wait.
+ *
+ * You can optionally pin each worker thread to a specific logical processor.  This keeps the
+ * operating system from migrating threads between cores, and on NUMA systems it keeps each thread
+ * close to the memory it first wrote to.
  */
 class OPENMM_EXPORT ThreadPool {
 public:
@@ -59,8 +71,12 @@ public:
      *
      * @param numThreads  the number of worker threads to create.  If this is 0 (the default), the
      *                    number of threads is set equal to the number of logical CPU cores available
+     * @param spinWait    if true, threads spin for a limited time before sleeping when they have to wait
+     * @param cpuAffinity the logical processors to pin the worker threads to.  Thread i is pinned to
+     *                    element i%cpuAffinity.size().  If this is empty (the default), threads are not
+     *                    pinned.  Pinning is only supported on Linux, and is ignored on other platforms.
      */
-    ThreadPool(int numThreads=0);
+    ThreadPool(int numThreads=0, bool spinWait=false, const std::vector<int>& cpuAffinity=std::vector<int>());
     ~ThreadPool();
     /**
      * Get the number of worker threads in the pool.
@@ -88,9 +104,37 @@ public:
      * Instruct the threads to resume running after blocking at a synchronization point.
      */
     void resumeThreads();
+    /**
+     * Get whether threads spin for a limited time before sleeping when they have to wait.
+     */
+    bool getSpinWait() const;
+    /**
+     * Get the logical processors the worker threads are pinned to.  This is empty if they are not pinned.
+     */
+    const std::vector<int>& getCpuAffinity() const;
+    /**
+     * Convert a description of how to place threads into the list of logical processors to pin them to.
+     *
+     * @param setting     either "compact", "scatter", or an explicit list of processor indices such as "0,2,8-15".
+     *                    "compact" fills one socket before moving to the next, with the hyperthreads of each
+     *                    core next to each other.  "scatter" places consecutive threads on different sockets,
+     *                    then on different cores, and only uses the extra hyperthreads of a core once every
+     *                    core has a thread.  An empty string means threads should not be pinned.
+     * @param cpuAffinity on exit, the processors to pin threads to.  For "compact" and "scatter" this is empty
+     *                    if the topology cannot be determined.
+     * @return false if the setting is not valid
+     */
+    static bool getCpuAffinity(const std::string& setting, std::vector<int>& cpuAffinity);
 private:
-    bool isDeleted;
-    int numThreads, waitCount;
+    bool isDeleted, spinWait;
+    int numThreads;
+    // epoch is incremented each time the threads are told to resume, and waitCount is the number of
+    // threads that have reached the current synchronization point.  Waiting normally happens by polling
+    // these.  The mutex and condition variables are only used by threads that go to sleep, which is
+    // recorded in numSleeping and parentSleeping so the other side knows whether it must wake them.
+    std::atomic<int> epoch, waitCount, numSleeping;
+    std::atomic<bool> parentSleeping;
+    std::vector<int> cpuAffinity;
     std::vector<pthread_t> thread;
     std::vector<ThreadData*> threadData;
     pthread_cond_t startCondition, endCondition;
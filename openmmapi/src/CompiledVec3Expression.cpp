@@ -0,0 +1,224 @@
+/* Portions copyright (c) 2026 Stanford University and Simbios.
+ * Contributors: agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "openmm/internal/CompiledVec3Expression.h"
+#include "lepton/Operation.h"
+#include "lepton/Parser.h"
+#include "openmm/OpenMMException.h"
+#include <utility>
+
+using namespace OpenMM;
+using namespace Lepton;
+using namespace std;
+
+/**
+ * Get the name of the scalar variable that holds one component of a vector variable.
+ */
+static string getComponentName(const string& name, int component) {
+    return name+"["+to_string(component)+"]";
+}
+
+/**
+ * Build a scalar expression that computes one component of a vector expression.
+ */
+static ExpressionTreeNode getComponent(const ExpressionTreeNode& node, int component, map<pair<const void*, int>, ExpressionTreeNode>& cache) {
+    pair<const void*, int> key = make_pair(node.getStorage(), component);
+    map<pair<const void*, int>, ExpressionTreeNode>::const_iterator cached = cache.find(key);
+    if (cached != cache.end())
+        return cached->second;
+    const Operation& op = node.getOperation();
+    const vector<ExpressionTreeNode>& children = node.getChildren();
+    ExpressionTreeNode result;
+    if (op.getId() == Operation::VARIABLE)
+        result = ExpressionTreeNode(new Operation::Variable(getComponentName(op.getName(), component)));
+    else if (op.getId() == Operation::CUSTOM && op.getName() == "dot") {
+        vector<ExpressionTreeNode> terms;
+        for (int i = 0; i < 3; i++)
+            terms.push_back(ExpressionTreeNode(new Operation::Multiply(), getComponent(children[0], i, cache), getComponent(children[1], i, cache)));
+        result = ExpressionTreeNode(new Operation::Add(), ExpressionTreeNode(new Operation::Add(), terms[0], terms[1]), terms[2]);
+    }
+    else if (op.getId() == Operation::CUSTOM && op.getName() == "cross") {
+        int a = (component+1)%3;
+        int b = (component+2)%3;
+        result = ExpressionTreeNode(new Operation::Subtract(),
+                ExpressionTreeNode(new Operation::Multiply(), getComponent(children[0], a, cache), getComponent(children[1], b, cache)),
+                ExpressionTreeNode(new Operation::Multiply(), getComponent(children[0], b, cache), getComponent(children[1], a, cache)));
+    }
+    else if (op.getId() == Operation::CUSTOM && op.getName() == "_x")
+        result = getComponent(children[0], 0, cache);
+    else if (op.getId() == Operation::CUSTOM && op.getName() == "_y")
+        result = getComponent(children[0], 1, cache);
+    else if (op.getId() == Operation::CUSTOM && op.getName() == "_z")
+        result = getComponent(children[0], 2, cache);
+    else if (op.getId() == Operation::CUSTOM && op.getName() == "vector")
+        result = getComponent(children[component], component, cache);
+    else {
+        // Any other operation is applied to each component separately.
+
+        vector<ExpressionTreeNode> args;
+        for (const ExpressionTreeNode& child : children)
+            args.push_back(getComponent(child, component, cache));
+        result = ExpressionTreeNode(op.clone(), args);
+    }
+    cache[key] = result;
+    return result;
+}
+
+/**
+ * Find the names of all variables in a vector expression.
+ */
+static void findVariables(const ExpressionTreeNode& node, set<string>& variables, set<const void*>& visited) {
+    if (!visited.insert(node.getStorage()).second)
+        return;
+    if (node.getOperation().getId() == Operation::VARIABLE)
+        variables.insert(node.getOperation().getName());
+    for (const ExpressionTreeNode& child : node.getChildren())
+        findVariables(child, variables, visited);
+}
+
+CompiledVec3Expression::CompiledVec3Expression(const string& expression, const map<string, CustomFunction*>& customFunctions) {
+    PlaceholderFunction fn1(1), fn2(2), fn3(3);
+    map<string, CustomFunction*> functions = customFunctions;
+    functions["dot"] = &fn2;
+    functions["cross"] = &fn2;
+    functions["_x"] = &fn1;
+    functions["_y"] = &fn1;
+    functions["_z"] = &fn1;
+    functions["vector"] = &fn3;
+    compile(Parser::parse(expression, functions));
+}
+
+CompiledVec3Expression::CompiledVec3Expression(const ParsedExpression& expression) {
+    compile(expression);
+}
+
+CompiledVec3Expression::CompiledVec3Expression(const CompiledVec3Expression& expression) {
+    *this = expression;
+}
+
+CompiledVec3Expression& CompiledVec3Expression::operator=(const CompiledVec3Expression& expression) {
+    parsed = expression.parsed;
+    compiled = expression.compiled;
+    variables = expression.variables;
+    variableNames = expression.variableNames;
+    variableTypes = expression.variableTypes;
+    variableSources = expression.variableSources;
+    values.resize(expression.values.size());
+    updateVariableLocations();
+    return *this;
+}
+
+void CompiledVec3Expression::compile(const ParsedExpression& expression) {
+    parsed = expression.optimize();
+    set<const void*> visited;
+    findVariables(parsed.getRootNode(), variables, visited);
+    variableNames.insert(variableNames.end(), variables.begin(), variables.end());
+    variableTypes.resize(variableNames.size(), Unset);
+    variableSources.resize(variableNames.size(), NULL);
+    values.resize(3*variableNames.size());
+    map<pair<const void*, int>, ExpressionTreeNode> cache;
+    vector<ParsedExpression> components;
+    for (int i = 0; i < 3; i++)
+        components.push_back(ParsedExpression(getComponent(parsed.getRootNode(), i, cache)).optimize());
+    compiled = ParsedExpression::createCompiledExpression(components);
+    updateVariableLocations();
+}
+
+const set<string>& CompiledVec3Expression::getVariables() const {
+    return variables;
+}
+
+void CompiledVec3Expression::setPerParticleVariable(const string& name, const Vec3* values) {
+    for (int i = 0; i < (int) variableNames.size(); i++)
+        if (variableNames[i] == name) {
+            bool changed = (variableTypes[i] != PerParticleVector);
+            variableTypes[i] = PerParticleVector;
+            variableSources[i] = (const double*) values;
+            if (changed)
+                updateVariableLocations();
+        }
+}
+
+void CompiledVec3Expression::setPerParticleVariable(const string& name, const double* values) {
+    for (int i = 0; i < (int) variableNames.size(); i++)
+        if (variableNames[i] == name) {
+            bool changed = (variableTypes[i] != PerParticleScalar);
+            variableTypes[i] = PerParticleScalar;
+            variableSources[i] = values;
+            if (changed)
+                updateVariableLocations();
+        }
+}
+
+void CompiledVec3Expression::setGlobalVariable(const string& name, const double* value) {
+    for (int i = 0; i < (int) variableNames.size(); i++)
+        if (variableNames[i] == name) {
+            bool changed = (variableTypes[i] != Global || variableSources[i] != value);
+            variableTypes[i] = Global;
+            variableSources[i] = value;
+            if (changed)
+                updateVariableLocations();
+        }
+}
+
+void CompiledVec3Expression::updateVariableLocations() {
+    // Global variables are read directly from where they are stored.  Per-particle variables are copied into
+    // values before evaluating the expression for each particle.  All components of a scalar use the same element.
+
+    map<string, double*> locations;
+    for (int i = 0; i < (int) variableNames.size(); i++)
+        for (int j = 0; j < 3; j++) {
+            double* location;
+            if (variableTypes[i] == Global)
+                location = const_cast<double*>(variableSources[i]);
+            else if (variableTypes[i] == PerParticleScalar)
+                location = &values[3*i];
+            else
+                location = &values[3*i+j];
+            locations[getComponentName(variableNames[i], j)] = location;
+        }
+    compiled.setVariableLocations(locations);
+}
+
+void CompiledVec3Expression::evaluate(int start, int end, Vec3* results) const {
+    vector<pair<const double*, double*> > vectorsToCopy, scalarsToCopy;
+    for (int i = 0; i < (int) variableNames.size(); i++) {
+        if (variableTypes[i] == Unset)
+            throw OpenMMException("No value specified for variable "+variableNames[i]);
+        if (variableTypes[i] == PerParticleVector)
+            vectorsToCopy.push_back(make_pair(variableSources[i], &values[3*i]));
+        else if (variableTypes[i] == PerParticleScalar)
+            scalarsToCopy.push_back(make_pair(variableSources[i], &values[3*i]));
+    }
+    for (int particle = start; particle < end; particle++) {
+        for (auto& copy : vectorsToCopy) {
+            copy.second[0] = copy.first[3*particle];
+            copy.second[1] = copy.first[3*particle+1];
+            copy.second[2] = copy.first[3*particle+2];
+        }
+        for (auto& copy : scalarsToCopy)
+            copy.second[0] = copy.first[particle];
+        compiled.evaluate();
+        results[particle] = Vec3(compiled.getResult(0), compiled.getResult(1), compiled.getResult(2));
+    }
+}
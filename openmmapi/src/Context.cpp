@@ -37,7 +37,9 @@
 #include "sfmt/SFMT.h"
 #include <cmath>
 #include <iostream>
+#include <memory>
 #include <sstream>
+#include <utility>
 
 using namespace OpenMM;
 using namespace std;
@@ -88,11 +90,47 @@ Platform& Context::getPlatform() {
     return impl->getPlatform();
 }
 
+/**
+ * Translate each molecule so its center lies in the first periodic box.
+ */
+static void translateIntoPeriodicBox(vector<Vec3>& positions, const vector<vector<int> >& molecules, const Vec3* periodicBoxSize) {
+    for (auto& mol : molecules) {
+        // Find the molecule center.
+
+        Vec3 center;
+        for (int j : mol)
+            center += positions[j];
+        center *= 1.0/mol.size();
+
+        // Find the displacement to move it into the first periodic box.
+        Vec3 diff;
+        diff += periodicBoxSize[2]*floor(center[2]/periodicBoxSize[2][2]);
+        diff += periodicBoxSize[1]*floor((center[1]-diff[1])/periodicBoxSize[1][1]);
+        diff += periodicBoxSize[0]*floor((center[0]-diff[0])/periodicBoxSize[0][0]);
+
+        // Translate all the particles in the molecule.
+        for (int j : mol)
+            positions[j] -= diff;
+    }
+}
+
 State Context::getState(int types, bool enforcePeriodicBox, int groups) const {
-    State::StateBuilder builder(impl->getTime());
-    Vec3 periodicBoxSize[3];
+    State state;
+    getState(state, types, enforcePeriodicBox, groups);
+    return state;
+}
+
+void Context::getState(State& state, int types, bool enforcePeriodicBox, int groups) const {
+    // Reset the State but keep its arrays, so they can be filled in without allocating memory.
+
+    state.types = 0;
+    state.time = impl->getTime();
+    state.ke = 0;
+    state.pe = 0;
+    state.parameters.clear();
+    state.energyParameterDerivatives.clear();
+    Vec3* periodicBoxSize = state.periodicBoxVectors;
     impl->getPeriodicBoxVectors(periodicBoxSize[0], periodicBoxSize[1], periodicBoxSize[2]);
-    builder.setPeriodicBoxVectors(periodicBoxSize[0], periodicBoxSize[1], periodicBoxSize[2]);
     bool includeForces = types&State::Forces;
     bool includeEnergy = types&State::Energy;
     bool includeParameterDerivs = types&State::ParameterDerivatives;
@@ -100,56 +138,59 @@ State Context::getState(int types, bool enforcePeriodicBox, int groups) const {
     if (includeForces || includeEnergy || includeParameterDerivs) {
         double energy = impl->calcForcesAndEnergy(includeForces || needForcesForEnergy || includeParameterDerivs, includeEnergy, groups);
         if (includeEnergy)
-            builder.setEnergy(impl->calcKineticEnergy(), energy);
+            state.setEnergy(impl->calcKineticEnergy(), energy);
         if (includeForces) {
-            vector<Vec3> forces;
-            impl->getForces(forces);
-            builder.setForces(forces);
+            impl->getForces(state.forces);
+            state.types |= State::Forces;
         }
     }
     if (types&State::Parameters) {
-        map<string, double> params;
         for (auto& param : impl->parameters)
-            params[param.first] = param.second;
-        builder.setParameters(params);
+            state.parameters[param.first] = param.second;
+        state.types |= State::Parameters;
     }
     if (types&State::ParameterDerivatives) {
-        map<string, double> derivs;
-        impl->getEnergyParameterDerivatives(derivs);
-        builder.setEnergyParameterDerivatives(derivs);
+        impl->getEnergyParameterDerivatives(state.energyParameterDerivatives);
+        state.types |= State::ParameterDerivatives;
     }
     if (types&State::Positions) {
-        vector<Vec3> positions;
+        vector<Vec3>& positions = state.positions;
         impl->getPositions(positions);
-        if (enforcePeriodicBox) {
-            const vector<vector<int> >& molecules = impl->getMolecules();
-            for (auto& mol : molecules) {
-                // Find the molecule center.
-
-                Vec3 center;
-                for (int j : mol)
-                    center += positions[j];
-                center *= 1.0/mol.size();
-
-                // Find the displacement to move it into the first periodic box.
-                Vec3 diff;
-                diff += periodicBoxSize[2]*floor(center[2]/periodicBoxSize[2][2]);
-                diff += periodicBoxSize[1]*floor((center[1]-diff[1])/periodicBoxSize[1][1]);
-                diff += periodicBoxSize[0]*floor((center[0]-diff[0])/periodicBoxSize[0][0]);
-
-                // Translate all the particles in the molecule.
-                for (int j : mol)
-                    positions[j] -= diff;
-            }
-        }
-        builder.setPositions(positions);
+        if (enforcePeriodicBox)
+            translateIntoPeriodicBox(positions, impl->getMolecules(), periodicBoxSize);
+        state.types |= State::Positions;
     }
     if (types&State::Velocities) {
-        vector<Vec3> velocities;
-        impl->getVelocities(velocities);
-        builder.setVelocities(velocities);
+        impl->getVelocities(state.velocities);
+        state.types |= State::Velocities;
     }
-    return builder.getState();
+}
+
+future<State> Context::getStateAsync(int types, bool enforcePeriodicBox, int groups, function<void(const State&)> callback) const {
+    // Copy the data out of the Context now, since it may change as soon as this method returns.
+
+    auto state = make_shared<State>();
+    getState(*state, types, false, groups);
+    const vector<vector<int> >* molecules = NULL;
+    if (enforcePeriodicBox && (types&State::Positions) != 0)
+        molecules = &impl->getMolecules();
+
+    // Do everything else on the background thread.
+
+    auto result = make_shared<promise<State> >();
+    impl->runInBackground([state, molecules, callback, result] () {
+        try {
+            if (molecules != NULL)
+                translateIntoPeriodicBox(state->positions, *molecules, state->periodicBoxVectors);
+            if (callback)
+                callback(*state);
+            result->set_value(move(*state));
+        }
+        catch (...) {
+            result->set_exception(current_exception());
+        }
+    });
+    return result->get_future();
 }
 
 void Context::setState(const State& state) {
@@ -55,7 +55,7 @@ const static char CHECKPOINT_MAGIC_BYTES[] = "OpenMM Binary Checkpoint\n";
 
 ContextImpl::ContextImpl(Context& owner, const System& system, Integrator& integrator, Platform* platform, const map<string, string>& properties, ContextImpl* originalContext) :
         owner(owner), system(system), integrator(integrator), hasInitializedForces(false), hasSetPositions(false), integratorIsDeleted(false),
-        lastForceGroups(-1), platform(platform), platformData(NULL) {
+        lastForceGroups(-1), platform(platform), platformData(NULL), stopBackgroundThread(false) {
     int numParticles = system.getNumParticles();
     if (numParticles == 0)
         throw OpenMMException("Cannot create a Context for a System with no particles");
@@ -190,6 +190,16 @@ void ContextImpl::initialize() {
 }
 
 ContextImpl::~ContextImpl() {
+    // Finish any background tasks first, since they may refer to data stored in this object.
+
+    if (backgroundThread.joinable()) {
+        {
+            lock_guard<mutex> lock(backgroundLock);
+            stopBackgroundThread = true;
+        }
+        backgroundCondition.notify_one();
+        backgroundThread.join();
+    }
     for (auto force : forceImpls)
         delete force;
     
@@ -208,6 +218,31 @@ ContextImpl::~ContextImpl() {
     platform->contextDestroyed(*this);
 }
 
+void ContextImpl::runInBackground(function<void()> task) {
+    {
+        lock_guard<mutex> lock(backgroundLock);
+        backgroundTasks.push_back(task);
+    }
+    if (!backgroundThread.joinable())
+        backgroundThread = thread(&ContextImpl::processBackgroundTasks, this);
+    backgroundCondition.notify_one();
+}
+
+void ContextImpl::processBackgroundTasks() {
+    while (true) {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock(backgroundLock);
+            backgroundCondition.wait(lock, [this] () { return stopBackgroundThread || !backgroundTasks.empty(); });
+            if (backgroundTasks.empty())
+                return;
+            task = backgroundTasks.front();
+            backgroundTasks.pop_front();
+        }
+        task();
+    }
+}
+
 double ContextImpl::getTime() const {
     return updateStateDataKernel.getAs<const UpdateStateDataKernel>().getTime(*this);
 }
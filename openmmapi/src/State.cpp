@@ -35,6 +35,23 @@
 using namespace OpenMM;
 using namespace std;
 
+template <class T>
+static void copyVectors(const vector<Vec3>& source, T* dest, const vector<int>& particles) {
+    if (particles.size() == 0) {
+        for (int i = 0; i < (int) source.size(); i++)
+            for (int j = 0; j < 3; j++)
+                dest[3*i+j] = (T) source[i][j];
+        return;
+    }
+    for (int i = 0; i < (int) particles.size(); i++) {
+        int index = particles[i];
+        if (index < 0 || index >= (int) source.size())
+            throw OpenMMException("State: Illegal particle index");
+        for (int j = 0; j < 3; j++)
+            dest[3*i+j] = (T) source[index][j];
+    }
+}
+
 double State::getTime() const {
     return time;
 }
@@ -53,6 +70,24 @@ const vector<Vec3>& State::getForces() const {
         throw OpenMMException("Invoked getForces() on a State which does not contain forces.");
     return forces;
 }
+void State::getPositions(double* dest, const vector<int>& particles) const {
+    copyVectors(getPositions(), dest, particles);
+}
+void State::getPositions(float* dest, const vector<int>& particles) const {
+    copyVectors(getPositions(), dest, particles);
+}
+void State::getVelocities(double* dest, const vector<int>& particles) const {
+    copyVectors(getVelocities(), dest, particles);
+}
+void State::getVelocities(float* dest, const vector<int>& particles) const {
+    copyVectors(getVelocities(), dest, particles);
+}
+void State::getForces(double* dest, const vector<int>& particles) const {
+    copyVectors(getForces(), dest, particles);
+}
+void State::getForces(float* dest, const vector<int>& particles) const {
+    copyVectors(getForces(), dest, particles);
+}
 double State::getKineticEnergy() const {
     if ((types&Energy) == 0)
         throw OpenMMException("Invoked getKineticEnergy() on a State which does not contain energies.");
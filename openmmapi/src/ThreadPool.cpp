@@ -31,6 +31,17 @@
 
 #include "openmm/internal/ThreadPool.h"
 #include "openmm/internal/hardware.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <thread>
+#ifdef __linux__
+    #include <sched.h>
+#endif
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+    #include <immintrin.h>
+#endif
 
 using namespace std;
 
@@ -38,7 +49,7 @@ namespace OpenMM {
 
 class ThreadPool::ThreadData {
 public:
-    ThreadData(ThreadPool& owner, int index) : owner(owner), index(index), isDeleted(false) {
+    ThreadData(ThreadPool& owner, int index, int cpu) : owner(owner), index(index), cpu(cpu), isDeleted(false) {
     }
     void executeTask() {
         if (owner.currentTask != NULL)
@@ -47,7 +58,7 @@ public:
             owner.currentFunction(owner, index);
     }
     ThreadPool& owner;
-    int index;
+    int index, cpu;
     bool isDeleted;
     Task* currentTask;
     function<void (ThreadPool& pool, int)> currentFunction;
@@ -55,6 +66,16 @@ public:
 
 static void* threadBody(void* args) {
     ThreadPool::ThreadData& data = *reinterpret_cast<ThreadPool::ThreadData*>(args);
+#ifdef __linux__
+    if (data.cpu >= 0 && data.cpu < CPU_SETSIZE) {
+        // Pin the thread before it does anything else, so all memory it touches is placed near it.
+
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(data.cpu, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+#endif
     while (true) {
         // Wait for the signal to start running.
         
@@ -67,7 +88,30 @@ static void* threadBody(void* args) {
     return 0;
 }
 
-ThreadPool::ThreadPool(int numThreads) : currentTask(NULL) {
+/**
+ * When spin waiting is enabled, this is the number of times a thread checks whether it can continue
+ * before going to sleep.  It corresponds to somewhere between tens and hundreds of microseconds,
+ * depending on the processor.
+ */
+static const int SPIN_ITERATIONS = 20000;
+
+/**
+ * This is called on each iteration of a spin loop.  It tells the processor this thread is spinning, and
+ * periodically yields in case there are more threads than cores, so a spinning thread does not keep
+ * the thread it is waiting for from running.
+ */
+static inline void spinPause(int iteration) {
+    if (iteration%32 == 31)
+        this_thread::yield();
+    else {
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+        _mm_pause();
+#endif
+    }
+}
+
+ThreadPool::ThreadPool(int numThreads, bool spinWait, const vector<int>& cpuAffinity) : spinWait(spinWait), epoch(0), waitCount(0), numSleeping(0),
+        parentSleeping(false), cpuAffinity(cpuAffinity), currentTask(NULL) {
     if (numThreads <= 0)
         numThreads = getNumProcessors();
     this->numThreads = numThreads;
@@ -75,25 +119,20 @@ ThreadPool::ThreadPool(int numThreads) : currentTask(NULL) {
     pthread_cond_init(&endCondition, NULL);
     pthread_mutex_init(&lock, NULL);
     thread.resize(numThreads);
-    pthread_mutex_lock(&lock);
-    waitCount = 0;
     for (int i = 0; i < numThreads; i++) {
-        ThreadData* data = new ThreadData(*this, i);
+        int cpu = (cpuAffinity.size() == 0 ? -1 : cpuAffinity[i%cpuAffinity.size()]);
+        ThreadData* data = new ThreadData(*this, i, cpu);
         data->isDeleted = false;
         threadData.push_back(data);
         pthread_create(&thread[i], NULL, threadBody, data);
     }
-    while (waitCount < numThreads)
-        pthread_cond_wait(&endCondition, &lock);
-    pthread_mutex_unlock(&lock);
+    waitForThreads();
 }
 
 ThreadPool::~ThreadPool() {
     for (auto data : threadData)
         data->isDeleted = true;
-    pthread_mutex_lock(&lock);
-    pthread_cond_broadcast(&startCondition);
-    pthread_mutex_unlock(&lock);
+    resumeThreads();
     for (auto t : thread)
         pthread_join(t, NULL);
     pthread_mutex_destroy(&lock);
@@ -105,6 +144,101 @@ int ThreadPool::getNumThreads() const {
     return numThreads;
 }
 
+bool ThreadPool::getSpinWait() const {
+    return spinWait;
+}
+
+const vector<int>& ThreadPool::getCpuAffinity() const {
+    return cpuAffinity;
+}
+
+/**
+ * Read one of the values describing the position of a logical processor in the machine's topology.
+ */
+static int readTopologyValue(int cpu, const string& name, int defaultValue) {
+    stringstream path;
+    path << "/sys/devices/system/cpu/cpu" << cpu << "/topology/" << name;
+    ifstream file(path.str().c_str());
+    int value;
+    if (file >> value)
+        return value;
+    return defaultValue;
+}
+
+/**
+ * Get the logical processors this process may run on, in the order threads should be assigned to them.
+ * If the topology cannot be determined, this returns an empty list and threads are not pinned.
+ */
+static vector<int> getProcessorOrder(const string& policy) {
+    vector<int> order;
+#ifdef __linux__
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return order;
+    vector<vector<int> > processors; // Each element is (socket, core, hyperthread, processor index)
+    map<pair<int, int>, int> threadsInCore;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &allowed)) {
+            int socket = readTopologyValue(cpu, "physical_package_id", 0);
+            int core = readTopologyValue(cpu, "core_id", cpu);
+            int thread = threadsInCore[make_pair(socket, core)]++;
+            processors.push_back({socket, core, thread, cpu});
+        }
+
+    // Core IDs need not be contiguous, so replace them with the index of the core within its socket.
+
+    map<int, int> coresInSocket;
+    for (auto& core : threadsInCore)
+        core.second = coresInSocket[core.first.first]++;
+    for (auto& p : processors)
+        p[1] = threadsInCore[make_pair(p[0], p[1])];
+    if (policy == "scatter")
+        for (auto& p : processors)
+            p = {p[2], p[1], p[0], p[3]};
+    sort(processors.begin(), processors.end());
+    for (auto& p : processors)
+        order.push_back(p[3]);
+#endif
+    return order;
+}
+
+/**
+ * Parse a list of processor indices, such as "0,2,8-15".  Returns false if it is not a valid list.
+ */
+static bool parseProcessorList(const string& list, vector<int>& processors) {
+    stringstream stream(list);
+    string item;
+    while (getline(stream, item, ',')) {
+        int first, last;
+        char separator, extra;
+        stringstream itemStream(item);
+        if (!(itemStream >> first))
+            return false;
+        if (itemStream >> separator) {
+            if (separator != '-' || !(itemStream >> last) || itemStream >> extra)
+                return false;
+        }
+        else
+            last = first;
+        if (first < 0 || last < first)
+            return false;
+        for (int i = first; i <= last; i++)
+            processors.push_back(i);
+    }
+    return (processors.size() > 0);
+}
+
+bool ThreadPool::getCpuAffinity(const string& setting, vector<int>& cpuAffinity) {
+    cpuAffinity.clear();
+    if (setting == "")
+        return true;
+    if (setting == "compact" || setting == "scatter") {
+        cpuAffinity = getProcessorOrder(setting);
+        return true;
+    }
+    return parseProcessorList(setting, cpuAffinity);
+}
+
 void ThreadPool::execute(Task& task) {
     currentTask = &task;
     resumeThreads();
@@ -117,25 +251,50 @@ void ThreadPool::execute(function<void (ThreadPool&, int)> task) {
 }
 
 void ThreadPool::syncThreads() {
-    pthread_mutex_lock(&lock);
-    waitCount++;
-    pthread_cond_signal(&endCondition);
-    pthread_cond_wait(&startCondition, &lock);
-    pthread_mutex_unlock(&lock);
+    // The parent thread cannot start a new epoch until every thread has arrived, so the current value
+    // is the one this thread must wait to see change.
+
+    int currentEpoch = epoch.load();
+    if (waitCount.fetch_add(1)+1 == numThreads && parentSleeping.load()) {
+        pthread_mutex_lock(&lock);
+        pthread_cond_signal(&endCondition);
+        pthread_mutex_unlock(&lock);
+    }
+    if (spinWait)
+        for (int i = 0; i < SPIN_ITERATIONS && epoch.load() == currentEpoch; i++)
+            spinPause(i);
+    if (epoch.load() == currentEpoch) {
+        pthread_mutex_lock(&lock);
+        numSleeping++;
+        while (epoch.load() == currentEpoch)
+            pthread_cond_wait(&startCondition, &lock);
+        numSleeping--;
+        pthread_mutex_unlock(&lock);
+    }
 }
 
 void ThreadPool::waitForThreads() {
-    pthread_mutex_lock(&lock);
-    while (waitCount < numThreads)
-        pthread_cond_wait(&endCondition, &lock);
-    pthread_mutex_unlock(&lock);
+    if (spinWait)
+        for (int i = 0; i < SPIN_ITERATIONS && waitCount.load() < numThreads; i++)
+            spinPause(i);
+    if (waitCount.load() < numThreads) {
+        parentSleeping.store(true);
+        pthread_mutex_lock(&lock);
+        while (waitCount.load() < numThreads)
+            pthread_cond_wait(&endCondition, &lock);
+        pthread_mutex_unlock(&lock);
+        parentSleeping.store(false);
+    }
 }
 
 void ThreadPool::resumeThreads() {
-    pthread_mutex_lock(&lock);
-    waitCount = 0;
-    pthread_cond_broadcast(&startCondition);
-    pthread_mutex_unlock(&lock);
+    waitCount.store(0);
+    epoch++;
+    if (numSleeping.load() > 0) {
+        pthread_mutex_lock(&lock);
+        pthread_cond_broadcast(&startCondition);
+        pthread_mutex_unlock(&lock);
+    }
 }
 
 } // namespace OpenMM
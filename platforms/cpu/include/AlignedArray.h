@@ -32,6 +32,9 @@
  * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
  * -------------------------------------------------------------------------- */
 
+#include "openmm/internal/ThreadPool.h"
+#include <cstring>
+
 namespace OpenMM {
 
 /**
@@ -73,6 +76,30 @@ public:
             delete[] baseData;
         allocate(size);
     }
+    /**
+     * Change the size of the array and set every element to zero, dividing the work between the
+     * threads in a ThreadPool so each one clears a contiguous block.  Operating systems usually place
+     * a page of memory on the NUMA node of the thread that first writes to it, so when the threads
+     * are pinned, this puts each block near the thread that clears it.
+     */
+    void resize(int size, ThreadPool& threads) {
+        resize(size);
+        int numThreads = threads.getNumThreads();
+        threads.execute([&] (ThreadPool& threads, int threadIndex) {
+            zero((int) ((threadIndex*(long long) size)/numThreads), (int) (((threadIndex+1)*(long long) size)/numThreads));
+        });
+        threads.waitForThreads();
+    }
+    /**
+     * Set a range of elements to zero.
+     *
+     * @param start   the index of the first element to clear
+     * @param end     the index after the last element to clear
+     */
+    void zero(int start, int end) {
+        if (end > start)
+            memset(data+start, 0, (end-start)*sizeof(T));
+    }
     /**
      * Get a reference to an element of the array.
      */
@@ -182,20 +182,26 @@ private:
 public:
 
     /**
-     * Construct a new CpuCustomGBForce.
+     * Construct a new CpuCustomGBForce.  Several of the expressions are compiled from a list of expressions,
+     * so they can share subexpressions:
+     *
+     * - Each element of valueExpressions computes a value, followed by its derivatives with respect to the
+     *   parameters that energy derivatives are requested for.
+     * - Each element of valueGradientExpressions computes the derivatives of a value with respect to x, y, and z.
+     * - Each element of energyExpressions computes the energy of one term, then its derivatives.  For a
+     *   SingleParticle term these are the derivatives with respect to each value, followed by x, y, and z.
+     *   For a pair term they are the derivative with respect to r, followed by the derivatives with respect
+     *   to each value of the first and second particle in turn.  Either kind ends with the derivatives with
+     *   respect to parameters.
      */
 
      CpuCustomGBForce(int numAtoms, const std::vector<std::set<int> >& exclusions,
                         const std::vector<Lepton::CompiledExpression>& valueExpressions,
                         const std::vector<std::vector<Lepton::CompiledExpression> >& valueDerivExpressions,
-                        const std::vector<std::vector<Lepton::CompiledExpression> >& valueGradientExpressions,
-                        const std::vector<std::vector<Lepton::CompiledExpression> >& valueParamDerivExpressions,
+                        const std::vector<Lepton::CompiledExpression>& valueGradientExpressions,
                         const std::vector<std::string>& valueNames,
                         const std::vector<CustomGBForce::ComputationType>& valueTypes,
                         const std::vector<Lepton::CompiledExpression>& energyExpressions,
-                        const std::vector<std::vector<Lepton::CompiledExpression> >& energyDerivExpressions,
-                        const std::vector<std::vector<Lepton::CompiledExpression> >& energyGradientExpressions,
-                        const std::vector<std::vector<Lepton::CompiledExpression> >& energyParamDerivExpressions,
                         const std::vector<CustomGBForce::ComputationType>& energyTypes,
                         const std::vector<std::string>& parameterNames, ThreadPool& threads);
 
@@ -241,24 +247,16 @@ public:
     ThreadData(int numAtoms, int numThreads, int threadIndex,
                const std::vector<Lepton::CompiledExpression>& valueExpressions,
                const std::vector<std::vector<Lepton::CompiledExpression> >& valueDerivExpressions,
-               const std::vector<std::vector<Lepton::CompiledExpression> >& valueGradientExpressions,
-               const std::vector<std::vector<Lepton::CompiledExpression> >& valueParamDerivExpressions,
+               const std::vector<Lepton::CompiledExpression>& valueGradientExpressions,
                const std::vector<std::string>& valueNames,
                const std::vector<Lepton::CompiledExpression>& energyExpressions,
-               const std::vector<std::vector<Lepton::CompiledExpression> >& energyDerivExpressions,
-               const std::vector<std::vector<Lepton::CompiledExpression> >& energyGradientExpressions,
-               const std::vector<std::vector<Lepton::CompiledExpression> >& energyParamDerivExpressions,
                const std::vector<std::string>& parameterNames);
     CompiledExpressionSet expressionSet;
     std::vector<Lepton::CompiledExpression> valueExpressions;
     std::vector<std::vector<Lepton::CompiledExpression> > valueDerivExpressions;
-    std::vector<std::vector<Lepton::CompiledExpression> > valueGradientExpressions;
-    std::vector<std::vector<Lepton::CompiledExpression> > valueParamDerivExpressions;
+    std::vector<Lepton::CompiledExpression> valueGradientExpressions;
     std::vector<double> value;
     std::vector<Lepton::CompiledExpression> energyExpressions;
-    std::vector<std::vector<Lepton::CompiledExpression> > energyDerivExpressions;
-    std::vector<std::vector<Lepton::CompiledExpression> > energyGradientExpressions;
-    std::vector<std::vector<Lepton::CompiledExpression> > energyParamDerivExpressions;
     std::vector<double> param;
     std::vector<double> particleParam;
     std::vector<double> particleValue;
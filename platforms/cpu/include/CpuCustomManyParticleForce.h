@@ -163,42 +163,46 @@ class CpuCustomManyParticleForce::ParticleTermInfo {
 public:
     std::string name;
     int atom, component, variableIndex;
-    Lepton::CompiledExpression forceExpression;
-    ParticleTermInfo(const std::string& name, int atom, int component, const Lepton::CompiledExpression& forceExpression, ThreadData& data);
+    int resultIndex;
+    ParticleTermInfo(const std::string& name, int atom, int component, int resultIndex, ThreadData& data);
 };
 
 class CpuCustomManyParticleForce::DistanceTermInfo {
 public:
     std::string name;
     int p1, p2, variableIndex;
-    Lepton::CompiledExpression forceExpression;
+    int resultIndex;
     int delta;
     float deltaSign;
-    DistanceTermInfo(const std::string& name, const std::vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data);
+    DistanceTermInfo(const std::string& name, const std::vector<int>& atoms, int resultIndex, ThreadData& data);
 };
 
 class CpuCustomManyParticleForce::AngleTermInfo {
 public:
     std::string name;
     int p1, p2, p3, variableIndex;
-    Lepton::CompiledExpression forceExpression;
+    int resultIndex;
     int delta1, delta2;
     float delta1Sign, delta2Sign;
-    AngleTermInfo(const std::string& name, const std::vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data);
+    AngleTermInfo(const std::string& name, const std::vector<int>& atoms, int resultIndex, ThreadData& data);
 };
 
 class CpuCustomManyParticleForce::DihedralTermInfo {
 public:
     std::string name;
     int p1, p2, p3, p4, variableIndex;
-    Lepton::CompiledExpression forceExpression;
+    int resultIndex;
     int delta1, delta2, delta3;
-    DihedralTermInfo(const std::string& name, const std::vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data);
+    DihedralTermInfo(const std::string& name, const std::vector<int>& atoms, int resultIndex, ThreadData& data);
 };
 
 class CpuCustomManyParticleForce::ThreadData {
 public:
     CompiledExpressionSet expressionSet;
+    /**
+     * The energy, compiled together with its derivative with respect to the variable of each term.
+     * Result 0 is the energy, and each term's resultIndex gives the location of its derivative.
+     */
     Lepton::CompiledExpression energyExpression;
     std::vector<std::vector<int> > particleParamIndices;
     std::vector<int> permutedParticles;
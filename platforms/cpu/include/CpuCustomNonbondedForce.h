@@ -30,6 +30,7 @@
 #include "openmm/internal/CompiledExpressionSet.h"
 #include "openmm/internal/ThreadPool.h"
 #include "openmm/internal/vectorize.h"
+#include "lepton/CompiledVectorExpression.h"
 #include <atomic>
 #include <map>
 #include <set>
@@ -45,11 +46,14 @@ class CpuCustomNonbondedForce {
 
          Constructor
 
+         @param pairExpression    an expression compiled from several expressions, which computes in order the
+                                  derivative of the energy with respect to r, the energy, and the derivatives of
+                                  the energy with respect to parameters
+
          --------------------------------------------------------------------------------------- */
 
-       CpuCustomNonbondedForce(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& forceExpression,
-                               const std::vector<std::string>& parameterNames, const std::vector<std::set<int> >& exclusions,
-                               const std::vector<Lepton::CompiledExpression> energyParamDerivExpressions, ThreadPool& threads);
+       CpuCustomNonbondedForce(const Lepton::CompiledExpression& pairExpression, const std::vector<std::string>& parameterNames,
+                               const std::vector<std::set<int> >& exclusions, ThreadPool& threads);
 
       /**---------------------------------------------------------------------------------------
 
@@ -81,6 +85,32 @@ class CpuCustomNonbondedForce {
 
       void setInteractionGroups(const std::vector<std::pair<std::set<int>, std::set<int> > >& groups);
 
+      /**---------------------------------------------------------------------------------------
+
+         Find the interactions between interaction groups with a cell list, rather than evaluating
+         every pair of atoms in the groups.  The list contains all pairs within the cutoff plus a
+         padding distance, and is rebuilt only when some atom in the groups has moved more than
+         half the padding.  This only has an effect when a cutoff is used.
+
+         @param padding             the padding distance
+
+         --------------------------------------------------------------------------------------- */
+
+      void setUseGroupNeighborList(double padding);
+
+      /**---------------------------------------------------------------------------------------
+
+         Evaluate the expressions in single precision.  If their width equals the block size of
+         the neighbor list, each call evaluates the interactions of one neighbor with every atom of
+         a block.  If their width is 1, they replace the double precision expressions for
+         interactions that are computed one pair at a time.
+
+         @param pairExpression    computes the same values as the expression passed to the constructor
+
+         --------------------------------------------------------------------------------------- */
+
+      void setUseVectorExpressions(const Lepton::CompiledVectorExpression& pairExpression);
+
       /**---------------------------------------------------------------------------------------
       
          Set the force to use a switching function.
@@ -129,7 +159,11 @@ private:
     bool periodic;
     bool triclinic;
     bool useInteractionGroups;
+    bool useVectorExpressions;
+    bool useGroupNeighborList;
+    bool hasFoundAllGroupInteractions;
     const CpuNeighborList* neighborList;
+    int neighborTier;
     float recipBoxSize[3];
     Vec3 periodicBoxVectors[3];
     AlignedArray<fvec4> periodicBoxVec4;
@@ -138,7 +172,13 @@ private:
     const std::vector<std::set<int> > exclusions;
     std::vector<ThreadData*> threadData;
     std::vector<std::string> paramNames;
+    std::vector<std::pair<std::set<int>, std::set<int> > > interactionGroups;
     std::vector<std::pair<int, int> > groupInteractions;
+    std::vector<std::vector<std::pair<int, int> > > threadGroupInteractions;
+    std::vector<int> groupAtoms;
+    std::vector<float> lastGroupPositions;
+    Vec3 lastGroupBoxVectors[3];
+    double groupNeighborListPadding;
     std::vector<double> threadEnergy;
     // The following variables are used to make information accessible to the individual threads.
     int numberOfAtoms;
@@ -155,6 +195,22 @@ private:
      */
     void threadComputeForce(ThreadPool& threads, int threadIndex);
 
+    /**
+     * Build the list of all pairs of atoms that interact through the interaction groups.
+     */
+    void findAllGroupInteractions();
+
+    /**
+     * Rebuild the list of pairs in the interaction groups that are within the cutoff plus padding, if any atom
+     * has moved far enough to require it.
+     */
+    void updateGroupNeighborList();
+
+    /**
+     * Find the pairs within the cutoff plus padding for one interaction group, using a cell list.
+     */
+    void findGroupNeighbors(const std::pair<std::set<int>, std::set<int> >& group);
+
     /**
      * Calculate the interaction between two atoms.
      * 
@@ -168,6 +224,19 @@ private:
      */
     void calculateOneIxn(int atom1, int atom2, ThreadData& data, float* forces, double& totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
 
+    /**
+     * Calculate the interactions between all atoms in one block of the neighbor list and their neighbors,
+     * using the vector expressions.
+     * 
+     * @param blockIndex       the index of the block within the neighbor list
+     * @param data             workspace for the current thread
+     * @param forces           force array (forces added)
+     * @param totalEnergy      total energy
+     * @param boxSize          the size of the periodic box
+     * @param boxSize          the inverse size of the periodic box
+     */
+    void calculateBlockIxn(int blockIndex, ThreadData& data, float* forces, double& totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
+
     /**
      * Compute the displacement and squared distance between two points, optionally using
      * periodic boundary conditions.
@@ -177,15 +246,18 @@ private:
 
 class CpuCustomNonbondedForce::ThreadData {
 public:
-    ThreadData(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& forceExpression, const std::vector<std::string>& parameterNames,
-            const std::vector<Lepton::CompiledExpression> energyParamDerivExpressions);
-    Lepton::CompiledExpression energyExpression;
-    Lepton::CompiledExpression forceExpression;
-    std::vector<Lepton::CompiledExpression> energyParamDerivExpressions;
+    ThreadData(const Lepton::CompiledExpression& pairExpression, const std::vector<std::string>& parameterNames);
+    Lepton::CompiledExpression pairExpression;
     CompiledExpressionSet expressionSet;
     std::vector<double> particleParam;
     double r;
     std::vector<double> energyParamDerivs; 
+    void setVectorExpression(const Lepton::CompiledVectorExpression& pairExpression, const std::vector<std::string>& parameterNames);
+    Lepton::CompiledVectorExpression pairVecExpression;
+    std::vector<float> vecR;
+    std::vector<float> vecParticleParam;
+    std::vector<std::string> vecGlobalNames;
+    std::vector<float> vecGlobalValues;
 };
 
 } // namespace OpenMM
@@ -46,6 +46,7 @@
 #include "openmm/kernels.h"
 #include "openmm/System.h"
 #include <array>
+#include <memory>
 #include <tuple>
 
 namespace OpenMM {
@@ -90,9 +91,17 @@ public:
      */
     double finishComputation(ContextImpl& context, bool includeForce, bool includeEnergy, int groups, bool& valid);
 private:
+    /**
+     * This is called whenever the neighbor list is about to be rebuilt when adaptive padding is enabled.  It
+     * records the time per step with the current padding and, once enough data has been collected, selects
+     * a new padding to try.
+     */
+    void tuneNeighborListPadding();
     CpuPlatform::PlatformData& data;
     Kernel referenceKernel;
     std::vector<Vec3> lastPositions;
+    double computationStartTime, windowTime, bestPaddingTime, bestPadding, paddingStep;
+    int windowSteps, windowRebuilds, paddingDirection;
 };
 
 /**
@@ -268,13 +277,19 @@ public:
 private:
     class PmeIO;
     void computeParameters(ContextImpl& context, bool offsetsOnly);
+    void beginOverlappedPme(ContextImpl& context, bool includeEnergy);
+    void createOptimizedPme(ContextImpl& context);
+    void setPmeGridScale(ContextImpl& context, double scale);
+    void tunePmeGrid(ContextImpl& context, double time);
     CpuPlatform::PlatformData& data;
-    int numParticles, num14, chargePosqIndex, ljPosqIndex;
+    int numParticles, num14, chargePosqIndex, ljPosqIndex, tuningCandidate, tuningSteps;
     std::vector<std::vector<int> > bonded14IndexArray;
     std::vector<std::vector<double> > bonded14ParamArray;
     double nonbondedCutoff, switchingDistance, rfDielectric, ewaldAlpha, ewaldDispersionAlpha, ewaldSelfEnergy, dispersionCoefficient;
-    int kmax[3], gridSize[3], dispersionGridSize[3];
-    bool useSwitchingFunction, exceptionsArePeriodic, useOptimizedPme, hasInitializedPme, hasInitializedDispersionPme, hasParticleOffsets, hasExceptionOffsets;
+    double tuningTime, bestTuningTime, bestTuningScale;
+    int kmax[3], gridSize[3], dispersionGridSize[3], baseGridSize[3], baseDispersionGridSize[3];
+    bool useSwitchingFunction, exceptionsArePeriodic, useOptimizedPme, hasInitializedPme, hasInitializedDispersionPme, hasParticleOffsets, hasExceptionOffsets, isTuningPme;
+    std::vector<std::array<int, 6> > tunedGrids;
     std::vector<std::set<int> > exclusions;
     std::vector<std::pair<float, float> > particleParams;
     std::vector<float> C6params;
@@ -287,6 +302,8 @@ private:
     CpuNonbondedForce* nonbonded;
     Kernel optimizedPme, optimizedDispersionPme;
     CpuBondForce bondForce;
+    AlignedArray<float> pmePosq, dispersionPmePosq;
+    std::unique_ptr<PmeIO> pmeIO;
 };
 
 /**
@@ -412,10 +429,11 @@ private:
     int numParticles;
     bool isPeriodic;
     std::vector<std::vector<double> > particleParamArray;
-    double nonbondedCutoff;
+    double nonbondedCutoff, neighborListPadding;
     CpuCustomGBForce* ixn;
     CpuNeighborList* neighborList;
-    std::vector<std::set<int> > exclusions;
+    std::vector<std::set<int> > exclusions, noExclusions;
+    std::vector<Vec3> lastPositions;
     std::vector<std::string> particleParameterNames, globalParameterNames, energyParamDerivNames, valueNames;
     std::vector<OpenMM::CustomGBForce::ComputationType> valueTypes;
     std::vector<OpenMM::CustomGBForce::ComputationType> energyTypes;
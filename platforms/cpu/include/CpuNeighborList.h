@@ -49,11 +49,30 @@ public:
     CpuNeighborList(int blockSize);
     void computeNeighborList(int numAtoms, const AlignedArray<float>& atomLocations, const std::vector<std::set<int> >& exclusions,
             const Vec3* periodicBoxVectors, bool usePeriodic, float maxDistance, ThreadPool& threads);
+    /**
+     * Build a tiered neighbor list for several cutoff distances in a single pass.  The neighbors of each
+     * block are sorted by the smallest cutoff they may interact within, so a force with a shorter cutoff
+     * can loop over only the first getNumBlockNeighbors() entries.
+     *
+     * @param tierCutoffs   the cutoff distances, sorted in increasing order
+     * @param padding       the padding to add to each cutoff when deciding which tier a neighbor belongs to
+     */
+    void computeNeighborList(int numAtoms, const AlignedArray<float>& atomLocations, const std::vector<std::set<int> >& exclusions,
+            const Vec3* periodicBoxVectors, bool usePeriodic, const std::vector<float>& tierCutoffs, float padding, ThreadPool& threads);
     int getNumBlocks() const;
     int getBlockSize() const;
     const std::vector<int>& getSortedAtoms() const;
     const std::vector<int>& getBlockNeighbors(int blockIndex) const;
     const std::vector<char>& getBlockExclusions(int blockIndex) const;
+    /**
+     * Get the index of the first tier whose cutoff is at least as large as a given cutoff distance.  If
+     * the distance is larger than every tier, this returns the last tier.
+     */
+    int getTierIndex(float cutoff) const;
+    /**
+     * Get the number of neighbors of a block that belong to a tier or any tier before it.
+     */
+    int getNumBlockNeighbors(int blockIndex, int tier) const;
     /**
      * This routine contains the code executed by each thread.
      */
@@ -65,6 +84,8 @@ private:
     std::vector<float> sortedPositions;
     std::vector<std::vector<int> > blockNeighbors;
     std::vector<std::vector<char> > blockExclusions;
+    std::vector<float> tierCutoffs;
+    std::vector<int> blockTierEnd;
     // The following variables are used to make information accessible to the individual threads.
     float minx, maxx, miny, maxy, minz, maxz;
     std::vector<std::pair<int, int> > atomBins;
@@ -74,7 +95,7 @@ private:
     Vec3 periodicBoxVectors[3];
     int numAtoms;
     bool usePeriodic;
-    float maxDistance;
+    float maxDistance, padding;
     std::atomic<int> atomicCounter;
 };
 
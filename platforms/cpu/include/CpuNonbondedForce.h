@@ -125,6 +125,16 @@ class CpuNonbondedForce {
 
       void setUseLJPME(float alpha, int meshSize[3]);
 
+      /**---------------------------------------------------------------------------------------
+
+         Set the order of the B-splines used for PME.  The default is 5.
+
+         @param order    the interpolation order
+
+         --------------------------------------------------------------------------------------- */
+
+      void setPmeOrder(int order);
+
       /**---------------------------------------------------------------------------------------
       
          Calculate Ewald ixn
@@ -138,12 +148,13 @@ class CpuNonbondedForce {
                                  exclusions[atomIndex] contains the list of exclusions for that atom
          @param forces           force array (forces added)
          @param totalEnergy      total energy
+         @param threads          the thread pool to use
             
          --------------------------------------------------------------------------------------- */
 
       void calculateReciprocalIxn(int numberOfAtoms, float* posq, const std::vector<Vec3>& atomCoordinates,
                                   const std::vector<std::pair<float, float> >& atomParameters, const std::vector<float> &C6params,
-                                  const std::vector<std::set<int> >& exclusions, std::vector<Vec3>& forces, double* totalEnergy) const;
+                                  const std::vector<std::set<int> >& exclusions, std::vector<Vec3>& forces, double* totalEnergy, ThreadPool& threads);
       
       /**---------------------------------------------------------------------------------------
       
@@ -178,6 +189,7 @@ protected:
         bool ljpme, pme;
         bool tableIsValid, expTableIsValid;
         const CpuNeighborList* neighborList;
+        int neighborTier;
         float recipBoxSize[3];
         Vec3 periodicBoxVectors[3];
         AlignedArray<fvec4> periodicBoxVec4;
@@ -185,11 +197,13 @@ protected:
         float krf, crf;
         float alphaEwald, alphaDispersionEwald;
         int numRx, numRy, numRz;
-        int meshDim[3], dispersionMeshDim[3];
+        int meshDim[3], dispersionMeshDim[3], pmeOrder;
         std::vector<float> erfcTable, ewaldScaleTable;
         std::vector<float> exptermsTable, dExptermsTable;
         float ewaldDX, ewaldDXInv, erfcDXInv, exptermsDX, exptermsDXInv;
         std::vector<double> threadEnergy;
+        AlignedArray<fvec4> ewaldThreadSums;
+        std::vector<float> ewaldCoefficients;
         // The following variables are used to make information accessible to the individual threads.
         int numberOfAtoms;
         float* posq;
@@ -218,6 +232,20 @@ protected:
          --------------------------------------------------------------------------------------- */
           
       void calculateOneIxn(int atom1, int atom2, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
+
+      /**---------------------------------------------------------------------------------------
+      
+         Compute exp(i*k*r) along each axis for one block of four atoms, as used by Ewald summation.
+      
+         @param block            the index of the atom block
+         @param posq             atom coordinates and charges
+         @param recipBoxSize     2*pi divided by the size of the periodic box along each axis
+         @param charge           on exit, the charges of the atoms in the block
+         @param phases           on exit, the phases for each atom along each axis
+            
+         --------------------------------------------------------------------------------------- */
+          
+      void computeEwaldPhases(int block, const float* posq, const float* recipBoxSize, fvec4& charge, std::vector<fvec4>& phases) const;
             
       /**---------------------------------------------------------------------------------------
       
@@ -39,6 +39,7 @@
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/internal/ThreadPool.h"
 #include "windowsExportCpu.h"
+#include <functional>
 #include <map>
 
 namespace OpenMM {
@@ -77,6 +78,101 @@ public:
         static const std::string key = "DeterministicForces";
         return key;
     }
+    /**
+     * This is the name of the parameter for selecting the padding (in nm) added to the cutoff when building
+     * neighbor lists.  If this is left blank, a padding suited to the cutoff is chosen automatically.  When
+     * querying the value of this property for a Context, it reports the padding currently in use.
+     */
+    static const std::string& CpuNeighborListPadding() {
+        static const std::string key = "NeighborListPadding";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for requesting that the neighbor list padding be tuned at runtime.
+     * If this is set to "true", the cost of rebuilding the neighbor list is periodically measured against
+     * the cost of computing forces, and the padding is adjusted to minimize the total time per step.
+     */
+    static const std::string& CpuAdaptivePadding() {
+        static const std::string key = "AdaptivePadding";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for specifying a file in which to store FFTW wisdom for PME.  If this
+     * is set, plans found by FFTW are saved to the file and loaded from it the next time a Context with the
+     * same grid size and number of threads is created, which greatly reduces the time to create it.
+     */
+    static const std::string& CpuPmeWisdomFile() {
+        static const std::string key = "PmeWisdomFile";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting which FFT implementation to use for PME.  Allowed
+     * values are "FFTW" and "Builtin".  If it is empty, FFTW is used when it is available.
+     */
+    static const std::string& CpuPmeFFT() {
+        static const std::string key = "PmeFFT";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting whether to tune the dimensions of the PME grid for FFT
+     * speed at runtime.  If this is "true", several grids that satisfy the error tolerance are timed during
+     * the first steps of a simulation, and the fastest one is then used for the rest of it.  The cutoff and
+     * separation parameter are not changed.
+     */
+    static const std::string& CpuPmeGridAutotune() {
+        static const std::string key = "PmeGridAutotune";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for specifying how many threads to dedicate to reciprocal space PME.
+     * If this is greater than 0, those threads compute reciprocal space while the remaining ones compute
+     * direct space and bonded forces at the same time.  If it is 0, all threads are used for each
+     * calculation in turn.
+     */
+    static const std::string& CpuPmeThreads() {
+        static const std::string key = "PmeThreads";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting the order of the B-splines used by PME.  Allowed values
+     * are 4 through 8.  Higher orders are more accurate for a given grid, so unless the PME parameters were
+     * set explicitly, a coarser grid is used with them.
+     */
+    static const std::string& CpuPmeOrder() {
+        static const std::string key = "PmeOrder";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting whether worker threads spin while waiting.  If this
+     * is "true", threads poll for a short time before going to sleep whenever they wait for each other.
+     * This reduces the overhead of every parallel operation, which matters most for small systems.
+     */
+    static const std::string& CpuSpinWait() {
+        static const std::string key = "SpinWait";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for pinning worker threads to logical processors.  It may be
+     * "compact" to keep consecutive threads on the same socket and core, "scatter" to spread them across
+     * sockets and cores, or a comma separated list of processor indices and ranges such as "0,2,8-15".
+     * If it is blank (the default), threads are not pinned.  This also applies to the threads that compute
+     * reciprocal space PME.  If PmeThreads is set, they are placed on the processors following the ones
+     * used by the other threads.
+     */
+    static const std::string& CpuThreadAffinity() {
+        static const std::string key = "ThreadAffinity";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for evaluating custom nonbonded expressions in single precision.  If
+     * this is "true" and there is a cutoff, CustomNonbondedForce evaluates the pairs it computes one at a time,
+     * such as those in interaction groups, with single precision compiled expressions instead of double
+     * precision ones.  This is faster, but less accurate.  The default is "false".
+     */
+    static const std::string& CpuSinglePrecisionExpressions() {
+        static const std::string key = "SinglePrecisionExpressions";
+        return key;
+    }
     /**
      * We cannot use the standard mechanism for platform data, because that is already used by the superclass.
      * Instead, we maintain a table of ContextImpls to PlatformDatas.
@@ -89,10 +185,16 @@ private:
 
 class CpuPlatform::PlatformData {
 public:
-    PlatformData(int numParticles, int numThreads, bool deterministicForces);
+    PlatformData(int numParticles, int numThreads, bool deterministicForces, double padding, bool adaptivePadding, bool tunePme, int pmeThreads, int pmeOrder, bool spinWait,
+            const std::vector<int>& cpuAffinity);
     ~PlatformData();
     void requestNeighborList(double cutoffDistance, double padding, bool useExclusions, const std::vector<std::set<int> >& exclusionList);
     int requestPosqIndex();
+    /**
+     * Set the padding used when building the neighbor list.  This must only be called immediately before
+     * the neighbor list is rebuilt.
+     */
+    void setNeighborListPadding(double padding);
     AlignedArray<float> posq;
     std::vector<AlignedArray<float> > threadForce;
     ThreadPool threads;
@@ -100,10 +202,17 @@ public:
     CpuRandom random;
     std::map<std::string, std::string> propertyValues;
     CpuNeighborList* neighborList;
-    double cutoff, paddedCutoff;
-    bool anyExclusions, deterministicForces;
-    int currentPosqIndex, nextPosqIndex;
+    double cutoff, paddedCutoff, requestedPadding;
+    bool anyExclusions, deterministicForces, adaptivePadding, tunePme, singlePrecisionExpressions;
+    int currentPosqIndex, nextPosqIndex, pmeThreads, pmeOrder;
     std::vector<std::set<int> > exclusions;
+    /**
+     * Computations that were started asynchronously, such as reciprocal space PME running on its own threads.
+     * CpuCalcForcesAndEnergyKernel calls each one before it sums the forces, and adds the energy it returns
+     * to the total.
+     */
+    std::vector<std::function<double ()> > pendingComputations;
+    std::vector<float> tierCutoffs;
 };
 
 } // namespace OpenMM
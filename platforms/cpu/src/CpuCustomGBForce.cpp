@@ -35,17 +35,12 @@ using namespace std;
 CpuCustomGBForce::ThreadData::ThreadData(int numAtoms, int numThreads, int threadIndex,
                       const vector<Lepton::CompiledExpression>& valueExpressions,
                       const vector<vector<Lepton::CompiledExpression> >& valueDerivExpressions,
-                      const vector<vector<Lepton::CompiledExpression> >& valueGradientExpressions,
-                      const vector<vector<Lepton::CompiledExpression> >& valueParamDerivExpressions,
+                      const vector<Lepton::CompiledExpression>& valueGradientExpressions,
                       const vector<string>& valueNames,
                       const vector<Lepton::CompiledExpression>& energyExpressions,
-                      const vector<vector<Lepton::CompiledExpression> >& energyDerivExpressions,
-                      const vector<vector<Lepton::CompiledExpression> >& energyGradientExpressions,
-                      const vector<vector<Lepton::CompiledExpression> >& energyParamDerivExpressions,
                       const vector<string>& parameterNames) :
             valueExpressions(valueExpressions), valueDerivExpressions(valueDerivExpressions), valueGradientExpressions(valueGradientExpressions),
-            valueParamDerivExpressions(valueParamDerivExpressions), energyExpressions(energyExpressions), energyDerivExpressions(energyDerivExpressions),
-            energyGradientExpressions(energyGradientExpressions), energyParamDerivExpressions(energyParamDerivExpressions) {
+            energyExpressions(energyExpressions) {
     firstAtom = (threadIndex*(long long) numAtoms)/numThreads;
     lastAtom = ((threadIndex+1)*(long long) numAtoms)/numThreads;
     map<string, double*> variableLocations;
@@ -82,35 +77,14 @@ CpuCustomGBForce::ThreadData::ThreadData(int numAtoms, int numThreads, int threa
             expression.setVariableLocations(variableLocations);
             expressionSet.registerExpression(expression);
         }
-    for (auto& expressions : this->valueGradientExpressions)
-        for (auto& expression : expressions) {
-            expression.setVariableLocations(variableLocations);
-            expressionSet.registerExpression(expression);
-        }
-    for (auto& expressions : this->valueParamDerivExpressions)
-        for (auto& expression : expressions) {
-            expression.setVariableLocations(variableLocations);
-            expressionSet.registerExpression(expression);
-        }
+    for (auto& expression : this->valueGradientExpressions) {
+        expression.setVariableLocations(variableLocations);
+        expressionSet.registerExpression(expression);
+    }
     for (auto& expression : this->energyExpressions) {
         expression.setVariableLocations(variableLocations);
         expressionSet.registerExpression(expression);
     }
-    for (auto& expressions : this->energyDerivExpressions)
-        for (auto& expression : expressions) {
-            expression.setVariableLocations(variableLocations);
-            expressionSet.registerExpression(expression);
-        }
-    for (auto& expressions : this->energyGradientExpressions)
-        for (auto& expression : expressions) {
-            expression.setVariableLocations(variableLocations);
-            expressionSet.registerExpression(expression);
-        }
-    for (auto& expressions : this->energyParamDerivExpressions)
-        for (auto& expression : expressions) {
-            expression.setVariableLocations(variableLocations);
-            expressionSet.registerExpression(expression);
-        }
     value0.resize(numAtoms);
     dEdV.resize(valueNames.size());
     for (auto& v : dEdV)
@@ -120,28 +94,25 @@ CpuCustomGBForce::ThreadData::ThreadData(int numAtoms, int numThreads, int threa
     dVdZ.resize(valueDerivExpressions.size());
     dVdR1.resize(valueDerivExpressions.size());
     dVdR2.resize(valueDerivExpressions.size());
-    dValue0dParam.resize(valueParamDerivExpressions[0].size(), vector<float>(numAtoms));
-    energyParamDerivs.resize(valueParamDerivExpressions[0].size());
+    int numParamDerivs = this->valueExpressions[0].getNumResults()-1;
+    dValue0dParam.resize(numParamDerivs, vector<float>(numAtoms));
+    energyParamDerivs.resize(numParamDerivs);
 }
 
 CpuCustomGBForce::CpuCustomGBForce(int numAtoms, const std::vector<std::set<int> >& exclusions,
                      const vector<Lepton::CompiledExpression>& valueExpressions,
                      const vector<vector<Lepton::CompiledExpression> >& valueDerivExpressions,
-                     const vector<vector<Lepton::CompiledExpression> >& valueGradientExpressions,
-                     const vector<vector<Lepton::CompiledExpression> >& valueParamDerivExpressions,
+                     const vector<Lepton::CompiledExpression>& valueGradientExpressions,
                      const vector<string>& valueNames,
                      const vector<CustomGBForce::ComputationType>& valueTypes,
                      const vector<Lepton::CompiledExpression>& energyExpressions,
-                     const vector<vector<Lepton::CompiledExpression> >& energyDerivExpressions,
-                     const vector<vector<Lepton::CompiledExpression> >& energyGradientExpressions,
-                     const vector<vector<Lepton::CompiledExpression> >& energyParamDerivExpressions,
                      const vector<CustomGBForce::ComputationType>& energyTypes,
                      const vector<string>& parameterNames, ThreadPool& threads) :
             exclusions(exclusions), cutoff(false), periodic(false), valueTypes(valueTypes), energyTypes(energyTypes), numValues(valueNames.size()),
             numParams(parameterNames.size()), threads(threads) {
     for (int i = 0; i < threads.getNumThreads(); i++)
         threadData.push_back(new ThreadData(numAtoms, threads.getNumThreads(), i, valueExpressions, valueDerivExpressions, valueGradientExpressions,
-                valueParamDerivExpressions, valueNames, energyExpressions, energyDerivExpressions, energyGradientExpressions, energyParamDerivExpressions, parameterNames));
+                valueNames, energyExpressions, parameterNames));
     values.resize(numValues);
     dEdV.resize(numValues);
     for (int i = 0; i < (int) values.size(); i++) {
@@ -150,7 +121,7 @@ CpuCustomGBForce::CpuCustomGBForce(int numAtoms, const std::vector<std::set<int>
     }
     dValuedParam.resize(numValues);
     for (int i = 0; i < numValues; i++)
-        dValuedParam[i].resize(valueParamDerivExpressions[0].size(), vector<float>(numAtoms));
+        dValuedParam[i].resize(valueExpressions[0].getNumResults()-1, vector<float>(numAtoms));
 }
 
 CpuCustomGBForce::~CpuCustomGBForce() {
@@ -303,11 +274,12 @@ void CpuCustomGBForce::threadComputeForce(ThreadPool& threads, int threadIndex)
             // Calculate derivatives with respect to parameters.
 
             if (hasParamDerivs) {
-                for (int j = 0; j < data.valueParamDerivExpressions[i].size(); j++)
-                    dValuedParam[i][j][atom] = data.valueParamDerivExpressions[i][j].evaluate();
+                int numParamDerivs = dValuedParam[i].size();
+                for (int j = 0; j < numParamDerivs; j++)
+                    dValuedParam[i][j][atom] = data.valueExpressions[i].getResult(j+1);
                 for (int j = 0; j < i; j++) {
                     float dVdV = data.valueDerivExpressions[i][j].evaluate();
-                    for (int k = 0; k < data.valueParamDerivExpressions[i].size(); k++)
+                    for (int k = 0; k < numParamDerivs; k++)
                         dValuedParam[i][k][atom] += dVdV*dValuedParam[j][k][atom];
                 }
             }
@@ -418,8 +390,8 @@ void CpuCustomGBForce::calculateOnePairValue(int index, int atom1, int atom2, Th
     
     // Calculate derivatives with respect to parameters.
     
-    for (int i = 0; i < data.valueParamDerivExpressions[index].size(); i++)
-        data.dValue0dParam[i][atom1] += data.valueParamDerivExpressions[index][i].evaluate();
+    for (int i = 0; i < data.dValue0dParam.size(); i++)
+        data.dValue0dParam[i][atom1] += data.valueExpressions[index].getResult(i+1);
 }
 
 void CpuCustomGBForce::calculateSingleParticleEnergyTerm(int index, ThreadData& data, int numAtoms, float* posq,
@@ -432,18 +404,21 @@ void CpuCustomGBForce::calculateSingleParticleEnergyTerm(int index, ThreadData&
             data.param[j] = atomParameters[i][j];
         for (int j = 0; j < (int) values.size(); j++)
             data.value[j] = values[j][i];
+        Lepton::CompiledExpression& expression = data.energyExpressions[index];
+        double energy = expression.evaluate();
         if (includeEnergy)
-            totalEnergy += (float) data.energyExpressions[index].evaluate();
-        for (int j = 0; j < (int) values.size(); j++)
-            data.dEdV[j][i] += (float) data.energyDerivExpressions[index][j].evaluate();
-        forces[4*i+0] -= (float) data.energyGradientExpressions[index][0].evaluate();
-        forces[4*i+1] -= (float) data.energyGradientExpressions[index][1].evaluate();
-        forces[4*i+2] -= (float) data.energyGradientExpressions[index][2].evaluate();
+            totalEnergy += (float) energy;
+        int numValues = values.size();
+        for (int j = 0; j < numValues; j++)
+            data.dEdV[j][i] += (float) expression.getResult(j+1);
+        forces[4*i+0] -= (float) expression.getResult(numValues+1);
+        forces[4*i+1] -= (float) expression.getResult(numValues+2);
+        forces[4*i+2] -= (float) expression.getResult(numValues+3);
         
         // Compute derivatives with respect to parameters.
         
-        for (int k = 0; k < data.energyParamDerivExpressions[index].size(); k++)
-            data.energyParamDerivs[k] += data.energyParamDerivExpressions[index][k].evaluate();
+        for (int k = 0; k < data.energyParamDerivs.size(); k++)
+            data.energyParamDerivs[k] += expression.getResult(numValues+4+k);
     }
 }
 
@@ -516,22 +491,25 @@ void CpuCustomGBForce::calculateOnePairEnergyTerm(int index, int atom1, int atom
 
     // Evaluate the energy and its derivatives.
 
+    Lepton::CompiledExpression& expression = data.energyExpressions[index];
+    double energy = expression.evaluate();
     if (includeEnergy)
-        totalEnergy += (float) data.energyExpressions[index].evaluate();
-    float dEdR = (float) data.energyDerivExpressions[index][0].evaluate();
+        totalEnergy += (float) energy;
+    float dEdR = (float) expression.getResult(1);
     dEdR *= 1/r;
     fvec4 result = deltaR*dEdR;
     (fvec4(forces+4*atom1)-result).store(forces+4*atom1);
     (fvec4(forces+4*atom2)+result).store(forces+4*atom2);
-    for (int i = 0; i < (int) values.size(); i++) {
-        data.dEdV[i][atom1] += (float) data.energyDerivExpressions[index][2*i+1].evaluate();
-        data.dEdV[i][atom2] += (float) data.energyDerivExpressions[index][2*i+2].evaluate();
+    int numValues = values.size();
+    for (int i = 0; i < numValues; i++) {
+        data.dEdV[i][atom1] += (float) expression.getResult(2*i+2);
+        data.dEdV[i][atom2] += (float) expression.getResult(2*i+3);
     }
         
     // Compute derivatives with respect to parameters.
 
-    for (int i = 0; i < data.energyParamDerivExpressions[index].size(); i++)
-        data.energyParamDerivs[i] += data.energyParamDerivExpressions[index][i].evaluate();
+    for (int i = 0; i < data.energyParamDerivs.size(); i++)
+        data.energyParamDerivs[i] += expression.getResult(2*numValues+2+i);
 }
 
 void CpuCustomGBForce::calculateChainRuleForces(ThreadData& data, int numAtoms, float* posq, vector<double>* atomParameters,
@@ -594,9 +572,10 @@ void CpuCustomGBForce::calculateChainRuleForces(ThreadData& data, int numAtoms,
                 data.dVdY[j] += dVdV*data.dVdY[k];
                 data.dVdZ[j] += dVdV*data.dVdZ[k];
             }
-            data.dVdX[j] += (float) data.valueGradientExpressions[j][0].evaluate();
-            data.dVdY[j] += (float) data.valueGradientExpressions[j][1].evaluate();
-            data.dVdZ[j] += (float) data.valueGradientExpressions[j][2].evaluate();
+            Lepton::CompiledExpression& gradient = data.valueGradientExpressions[j];
+            data.dVdX[j] += (float) gradient.evaluate();
+            data.dVdY[j] += (float) gradient.getResult(1);
+            data.dVdZ[j] += (float) gradient.getResult(2);
             forces[4*i+0] -= dEdV[j][i]*data.dVdX[j];
             forces[4*i+1] -= dEdV[j][i]*data.dVdY[j];
             forces[4*i+2] -= dEdV[j][i]*data.dVdZ[j];
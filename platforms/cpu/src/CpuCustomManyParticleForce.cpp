@@ -295,6 +295,10 @@ void CpuCustomManyParticleForce::calculateOneIxn(vector<int>& particleSet, vecto
         expressionSet.setVariable(term.variableIndex, getDihedralAngleBetweenThreeVectors(delta[term.delta1], delta[term.delta2], delta[term.delta3], cross1[i], cross2[i], delta[term.delta1]));
     }
     
+    // Evaluate the energy and its derivatives.
+
+    Lepton::CompiledExpression& expression = data.energyExpression;
+    double energy = expression.evaluate();
     if (includeForces) {
         // Apply forces based on individual particle coordinates.
 
@@ -304,14 +308,14 @@ void CpuCustomManyParticleForce::calculateOneIxn(vector<int>& particleSet, vecto
         for (auto& term : data.particleTerms) {
             float temp[4];
             f[term.atom].store(temp);
-            temp[term.component] -= term.forceExpression.evaluate();
+            temp[term.component] -= expression.getResult(term.resultIndex);
             f[term.atom] = fvec4(temp);
         }
 
         // Apply forces based on distances.
 
         for (auto& term : data.distanceTerms) {
-            float dEdR = (float) (term.forceExpression.evaluate()*term.deltaSign/(normDelta[term.delta]));
+            float dEdR = (float) (expression.getResult(term.resultIndex)*term.deltaSign/(normDelta[term.delta]));
             fvec4 force = -dEdR*delta[term.delta];
             f[term.p1] -= force;
             f[term.p2] += force;
@@ -320,7 +324,7 @@ void CpuCustomManyParticleForce::calculateOneIxn(vector<int>& particleSet, vecto
         // Apply forces based on angles.
 
         for (auto& term : data.angleTerms) {
-            float dEdTheta = (float) term.forceExpression.evaluate();
+            float dEdTheta = (float) expression.getResult(term.resultIndex);
             fvec4 thetaCross = cross(delta[term.delta1], delta[term.delta2]);
             float lengthThetaCross = sqrtf(dot3(thetaCross, thetaCross));
             if (lengthThetaCross < 1.0e-6f)
@@ -341,7 +345,7 @@ void CpuCustomManyParticleForce::calculateOneIxn(vector<int>& particleSet, vecto
 
         for (int i = 0; i < (int) data.dihedralTerms.size(); i++) {
             const DihedralTermInfo& term = data.dihedralTerms[i];
-            float dEdTheta = (float) term.forceExpression.evaluate();
+            float dEdTheta = (float) expression.getResult(term.resultIndex);
             float normCross1 = dot3(cross1[i], cross1[i]);
             float normBC = normDelta[term.delta2];
             float forceFactors[4];
@@ -372,7 +376,7 @@ void CpuCustomManyParticleForce::calculateOneIxn(vector<int>& particleSet, vecto
     // Add the energy
 
     if (includeEnergy)
-        data.energy += data.energyExpression.evaluate();
+        data.energy += energy;
 }
 
 void CpuCustomManyParticleForce::computeDelta(const fvec4& posI, const fvec4& posJ, fvec4& deltaR, float& r2, const fvec4& boxSize, const fvec4& invBoxSize) const {
@@ -417,26 +421,26 @@ float CpuCustomManyParticleForce::getDihedralAngleBetweenThreeVectors(const fvec
     return angle;
 }
 
-CpuCustomManyParticleForce::ParticleTermInfo::ParticleTermInfo(const string& name, int atom, int component, const Lepton::CompiledExpression& forceExpression, ThreadData& data) :
-        name(name), atom(atom), component(component), forceExpression(forceExpression) {
+CpuCustomManyParticleForce::ParticleTermInfo::ParticleTermInfo(const string& name, int atom, int component, int resultIndex, ThreadData& data) :
+        name(name), atom(atom), component(component), resultIndex(resultIndex) {
     variableIndex = data.expressionSet.getVariableIndex(name);
 }
 
-CpuCustomManyParticleForce::DistanceTermInfo::DistanceTermInfo(const string& name, const vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data) :
-        name(name), p1(atoms[0]), p2(atoms[1]), forceExpression(forceExpression) {
+CpuCustomManyParticleForce::DistanceTermInfo::DistanceTermInfo(const string& name, const vector<int>& atoms, int resultIndex, ThreadData& data) :
+        name(name), p1(atoms[0]), p2(atoms[1]), resultIndex(resultIndex) {
     variableIndex = data.expressionSet.getVariableIndex(name);
     data.requestDeltaPair(p1, p2, delta, deltaSign, true);
 }
 
-CpuCustomManyParticleForce::AngleTermInfo::AngleTermInfo(const string& name, const vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data) :
-        name(name), p1(atoms[0]), p2(atoms[1]), p3(atoms[2]), forceExpression(forceExpression) {
+CpuCustomManyParticleForce::AngleTermInfo::AngleTermInfo(const string& name, const vector<int>& atoms, int resultIndex, ThreadData& data) :
+        name(name), p1(atoms[0]), p2(atoms[1]), p3(atoms[2]), resultIndex(resultIndex) {
     variableIndex = data.expressionSet.getVariableIndex(name);
     data.requestDeltaPair(p1, p2,delta1, delta1Sign, true);
     data.requestDeltaPair(p3, p2, delta2, delta2Sign, true);
 }
 
-CpuCustomManyParticleForce::DihedralTermInfo::DihedralTermInfo(const string& name, const vector<int>& atoms, const Lepton::CompiledExpression& forceExpression, ThreadData& data) :
-        name(name), p1(atoms[0]), p2(atoms[1]), p3(atoms[2]), p4(atoms[3]), forceExpression(forceExpression) {
+CpuCustomManyParticleForce::DihedralTermInfo::DihedralTermInfo(const string& name, const vector<int>& atoms, int resultIndex, ThreadData& data) :
+        name(name), p1(atoms[0]), p2(atoms[1]), p3(atoms[2]), p4(atoms[3]), resultIndex(resultIndex) {
     variableIndex = data.expressionSet.getVariableIndex(name);
     float sign;
     data.requestDeltaPair(p2, p1, delta1, sign, false);
@@ -451,39 +455,43 @@ CpuCustomManyParticleForce::ThreadData::ThreadData(const CustomManyParticleForce
     particleParamIndices.resize(numParticlesPerSet);
     permutedParticles.resize(numParticlesPerSet);
     f.resize(numParticlesPerSet);
-    energyExpression = energyExpr.createCompiledExpression();
-    expressionSet.registerExpression(energyExpression);
 
-    // Differentiate the energy to get expressions for the force.
+    // Differentiate the energy to get expressions for the force.  They are compiled together with
+    // the energy, so all of them can share subexpressions.
+
+    vector<Lepton::ParsedExpression> expressions = {energyExpr};
 
     for (int i = 0; i < numParticlesPerSet; i++) {
         stringstream xname, yname, zname;
         xname << 'x' << (i+1);
         yname << 'y' << (i+1);
         zname << 'z' << (i+1);
-        particleTerms.push_back(CpuCustomManyParticleForce::ParticleTermInfo(xname.str(), i, 0, energyExpr.differentiate(xname.str()).optimize().createCompiledExpression(), *this));
-        particleTerms.push_back(CpuCustomManyParticleForce::ParticleTermInfo(yname.str(), i, 1, energyExpr.differentiate(yname.str()).optimize().createCompiledExpression(), *this));
-        particleTerms.push_back(CpuCustomManyParticleForce::ParticleTermInfo(zname.str(), i, 2, energyExpr.differentiate(zname.str()).optimize().createCompiledExpression(), *this));
+        particleTerms.push_back(CpuCustomManyParticleForce::ParticleTermInfo(xname.str(), i, 0, expressions.size(), *this));
+        expressions.push_back(energyExpr.differentiate(xname.str()).optimize());
+        particleTerms.push_back(CpuCustomManyParticleForce::ParticleTermInfo(yname.str(), i, 1, expressions.size(), *this));
+        expressions.push_back(energyExpr.differentiate(yname.str()).optimize());
+        particleTerms.push_back(CpuCustomManyParticleForce::ParticleTermInfo(zname.str(), i, 2, expressions.size(), *this));
+        expressions.push_back(energyExpr.differentiate(zname.str()).optimize());
         for (int j = 0; j < numPerParticleParameters; j++) {
             stringstream paramname;
             paramname << force.getPerParticleParameterName(j) << (i+1);
             particleParamIndices[i].push_back(expressionSet.getVariableIndex(paramname.str()));
         }
     }
-    for (auto& term : dihedrals)
-        dihedralTerms.push_back(CpuCustomManyParticleForce::DihedralTermInfo(term.first, term.second, energyExpr.differentiate(term.first).optimize().createCompiledExpression(), *this));
-    for (auto& term : distances)
-        distanceTerms.push_back(CpuCustomManyParticleForce::DistanceTermInfo(term.first, term.second, energyExpr.differentiate(term.first).optimize().createCompiledExpression(), *this));
-    for (auto& term : angles)
-        angleTerms.push_back(CpuCustomManyParticleForce::AngleTermInfo(term.first, term.second, energyExpr.differentiate(term.first).optimize().createCompiledExpression(), *this));
-    for (auto& term : particleTerms)
-        expressionSet.registerExpression(term.forceExpression);
-    for (auto& term : distanceTerms)
-        expressionSet.registerExpression(term.forceExpression);
-    for (auto& term : angleTerms)
-        expressionSet.registerExpression(term.forceExpression);
-    for (auto& term : dihedralTerms)
-        expressionSet.registerExpression(term.forceExpression);
+    for (auto& term : dihedrals) {
+        dihedralTerms.push_back(CpuCustomManyParticleForce::DihedralTermInfo(term.first, term.second, expressions.size(), *this));
+        expressions.push_back(energyExpr.differentiate(term.first).optimize());
+    }
+    for (auto& term : distances) {
+        distanceTerms.push_back(CpuCustomManyParticleForce::DistanceTermInfo(term.first, term.second, expressions.size(), *this));
+        expressions.push_back(energyExpr.differentiate(term.first).optimize());
+    }
+    for (auto& term : angles) {
+        angleTerms.push_back(CpuCustomManyParticleForce::AngleTermInfo(term.first, term.second, expressions.size(), *this));
+        expressions.push_back(energyExpr.differentiate(term.first).optimize());
+    }
+    energyExpression = Lepton::ParsedExpression::createCompiledExpression(expressions);
+    expressionSet.registerExpression(energyExpression);
     int numDeltas = deltaPairs.size();
     delta.resize(numDeltas);
     normDelta.resize(numDeltas);
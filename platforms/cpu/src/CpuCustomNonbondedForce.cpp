@@ -32,9 +32,8 @@
 using namespace OpenMM;
 using namespace std;
 
-CpuCustomNonbondedForce::ThreadData::ThreadData(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& forceExpression,
-            const vector<string>& parameterNames, const std::vector<Lepton::CompiledExpression> energyParamDerivExpressions) :
-            energyExpression(energyExpression), forceExpression(forceExpression), energyParamDerivExpressions(energyParamDerivExpressions) {
+CpuCustomNonbondedForce::ThreadData::ThreadData(const Lepton::CompiledExpression& pairExpression, const vector<string>& parameterNames) :
+            pairExpression(pairExpression) {
     map<string, double*> variableLocations;
     variableLocations["r"] = &r;
     particleParam.resize(2*parameterNames.size());
@@ -45,23 +44,49 @@ CpuCustomNonbondedForce::ThreadData::ThreadData(const Lepton::CompiledExpression
             variableLocations[name.str()] = &particleParam[i*2+j];
         }
     }
-    energyParamDerivs.resize(energyParamDerivExpressions.size());
-    this->energyExpression.setVariableLocations(variableLocations);
-    this->forceExpression.setVariableLocations(variableLocations);
-    expressionSet.registerExpression(this->energyExpression);
-    expressionSet.registerExpression(this->forceExpression);
-    for (auto& expression : this->energyParamDerivExpressions) {
-        expression.setVariableLocations(variableLocations);
-        expressionSet.registerExpression(expression);
+    energyParamDerivs.resize(pairExpression.getNumResults()-2);
+    this->pairExpression.setVariableLocations(variableLocations);
+    expressionSet.registerExpression(this->pairExpression);
+}
+
+void CpuCustomNonbondedForce::ThreadData::setVectorExpression(const Lepton::CompiledVectorExpression& pairExpression, const vector<string>& parameterNames) {
+    pairVecExpression = pairExpression;
+    int width = pairExpression.getWidth();
+    
+    // Every variable other than r and the per-particle parameters is a global parameter.
+    
+    set<string> names = pairVecExpression.getVariables();
+    names.erase("r");
+    for (int i = 0; i < (int) parameterNames.size(); i++)
+        for (int j = 0; j < 2; j++) {
+            stringstream name;
+            name << parameterNames[i] << (j+1);
+            names.erase(name.str());
+        }
+    vecGlobalNames.assign(names.begin(), names.end());
+    vecR.resize(width);
+    vecParticleParam.resize(2*parameterNames.size()*width);
+    vecGlobalValues.resize(vecGlobalNames.size()*width);
+    map<string, float*> variableLocations;
+    variableLocations["r"] = &vecR[0];
+    for (int i = 0; i < (int) parameterNames.size(); i++) {
+        for (int j = 0; j < 2; j++) {
+            stringstream name;
+            name << parameterNames[i] << (j+1);
+            variableLocations[name.str()] = &vecParticleParam[(i*2+j)*width];
+        }
     }
+    for (int i = 0; i < (int) vecGlobalNames.size(); i++)
+        variableLocations[vecGlobalNames[i]] = &vecGlobalValues[i*width];
+    pairVecExpression.setVariableLocations(variableLocations);
 }
 
-CpuCustomNonbondedForce::CpuCustomNonbondedForce(const Lepton::CompiledExpression& energyExpression,
-            const Lepton::CompiledExpression& forceExpression, const vector<string>& parameterNames, const vector<set<int> >& exclusions,
-            const std::vector<Lepton::CompiledExpression> energyParamDerivExpressions, ThreadPool& threads) :
-            cutoff(false), useSwitch(false), periodic(false), useInteractionGroups(false), paramNames(parameterNames), exclusions(exclusions), threads(threads) {
+CpuCustomNonbondedForce::CpuCustomNonbondedForce(const Lepton::CompiledExpression& pairExpression, const vector<string>& parameterNames,
+            const vector<set<int> >& exclusions, ThreadPool& threads) :
+            cutoff(false), useSwitch(false), periodic(false), useInteractionGroups(false), useVectorExpressions(false),
+            useGroupNeighborList(false), hasFoundAllGroupInteractions(false), paramNames(parameterNames), exclusions(exclusions), threads(threads) {
     for (int i = 0; i < threads.getNumThreads(); i++)
-        threadData.push_back(new ThreadData(energyExpression, forceExpression, parameterNames, energyParamDerivExpressions));
+        threadData.push_back(new ThreadData(pairExpression, parameterNames));
 }
 
 CpuCustomNonbondedForce::~CpuCustomNonbondedForce() {
@@ -73,11 +98,28 @@ void CpuCustomNonbondedForce::setUseCutoff(double distance, const CpuNeighborLis
     cutoff = true;
     cutoffDistance = distance;
     neighborList = &neighbors;
+    neighborTier = neighbors.getTierIndex(distance);
   }
 
 void CpuCustomNonbondedForce::setInteractionGroups(const vector<pair<set<int>, set<int> > >& groups) {
     useInteractionGroups = true;
+    interactionGroups = groups;
+    set<int> atoms;
     for (auto& group : groups) {
+        atoms.insert(group.first.begin(), group.first.end());
+        atoms.insert(group.second.begin(), group.second.end());
+    }
+    groupAtoms.assign(atoms.begin(), atoms.end());
+}
+
+void CpuCustomNonbondedForce::setUseGroupNeighborList(double padding) {
+    useGroupNeighborList = true;
+    groupNeighborListPadding = padding;
+}
+
+void CpuCustomNonbondedForce::findAllGroupInteractions() {
+    groupInteractions.clear();
+    for (auto& group : interactionGroups) {
         const set<int>& set1 = group.first;
         const set<int>& set2 = group.second;
         for (set<int>::const_iterator atom1 = set1.begin(); atom1 != set1.end(); ++atom1) {
@@ -90,6 +132,184 @@ void CpuCustomNonbondedForce::setInteractionGroups(const vector<pair<set<int>, s
             }
         }
     }
+    hasFoundAllGroupInteractions = true;
+}
+
+void CpuCustomNonbondedForce::updateGroupNeighborList() {
+    // See whether the box has changed or any atom has moved more than half the padding since the last build.
+
+    fvec4 boxSize(periodicBoxVectors[0][0], periodicBoxVectors[1][1], periodicBoxVectors[2][2], 0);
+    fvec4 invBoxSize(recipBoxSize[0], recipBoxSize[1], recipBoxSize[2], 0);
+    int numGroupAtoms = groupAtoms.size();
+    bool needRebuild = (lastGroupPositions.size() != 4*numGroupAtoms);
+    if (periodic)
+        for (int i = 0; i < 3; i++)
+            if (lastGroupBoxVectors[i] != periodicBoxVectors[i])
+                needRebuild = true;
+    float maxMove2 = (float) (0.25*groupNeighborListPadding*groupNeighborListPadding);
+    for (int i = 0; i < numGroupAtoms && !needRebuild; i++) {
+        fvec4 delta;
+        float r2;
+        getDeltaR(fvec4(&lastGroupPositions[4*i]), fvec4(posq+4*groupAtoms[i]), delta, r2, boxSize, invBoxSize);
+        if (r2 > maxMove2)
+            needRebuild = true;
+    }
+    if (!needRebuild)
+        return;
+    
+    // Record the positions and box, then rebuild the list.
+    
+    lastGroupPositions.resize(4*numGroupAtoms);
+    for (int i = 0; i < numGroupAtoms; i++)
+        for (int j = 0; j < 4; j++)
+            lastGroupPositions[4*i+j] = posq[4*groupAtoms[i]+j];
+    if (periodic)
+        for (int i = 0; i < 3; i++)
+            lastGroupBoxVectors[i] = periodicBoxVectors[i];
+    groupInteractions.clear();
+    for (auto& group : interactionGroups)
+        findGroupNeighbors(group);
+}
+
+void CpuCustomNonbondedForce::findGroupNeighbors(const pair<set<int>, set<int> >& group) {
+    const set<int>& set1 = group.first;
+    const set<int>& set2 = group.second;
+    if (set1.size() == 0 || set2.size() == 0)
+        return;
+    const float maxDistance = (float) (cutoffDistance+groupNeighborListPadding);
+    const int maxCellsPerAxis = 64;
+    vector<int> atoms1(set1.begin(), set1.end());
+    vector<int> atoms2(set2.begin(), set2.end());
+    
+    // Decide how to divide space into cells.  Positions are converted to fractional coordinates along
+    // three axes.  The thickness of each cell along each axis is at least maxDistance, so interacting
+    // atoms are always in the same or adjacent cells.  With periodic boundary conditions the axes are
+    // the box vectors.  Otherwise they are the Cartesian axes, spanning the bounding box of the second set.
+    
+    Vec3 axis[3], origin;
+    double thickness[3];
+    if (periodic) {
+        Vec3* box = periodicBoxVectors;
+        double volume = box[0][0]*box[1][1]*box[2][2];
+        for (int i = 0; i < 3; i++)
+            thickness[i] = volume/sqrt(box[(i+1)%3].cross(box[(i+2)%3]).dot(box[(i+1)%3].cross(box[(i+2)%3])));
+    }
+    else {
+        Vec3 minPos(posq[4*atoms2[0]], posq[4*atoms2[0]+1], posq[4*atoms2[0]+2]);
+        Vec3 maxPos = minPos;
+        for (int atom : atoms2)
+            for (int j = 0; j < 3; j++) {
+                minPos[j] = min(minPos[j], (double) posq[4*atom+j]);
+                maxPos[j] = max(maxPos[j], (double) posq[4*atom+j]);
+            }
+        origin = minPos;
+        for (int i = 0; i < 3; i++)
+            thickness[i] = maxPos[i]-minPos[i]+1e-3;
+    }
+    int numCells[3];
+    for (int i = 0; i < 3; i++)
+        numCells[i] = max(1, min(maxCellsPerAxis, (int) floor(thickness[i]/maxDistance)));
+    auto getCell = [&] (int atom, int* cell) {
+        double pos[3] = {posq[4*atom]-origin[0], posq[4*atom+1]-origin[1], posq[4*atom+2]-origin[2]};
+        double frac[3];
+        if (periodic) {
+            Vec3* box = periodicBoxVectors;
+            frac[2] = pos[2]/box[2][2];
+            frac[1] = (pos[1]-frac[2]*box[2][1])/box[1][1];
+            frac[0] = (pos[0]-frac[2]*box[2][0]-frac[1]*box[1][0])/box[0][0];
+            for (int i = 0; i < 3; i++) {
+                frac[i] -= floor(frac[i]);
+                cell[i] = min(numCells[i]-1, (int) (frac[i]*numCells[i]));
+            }
+        }
+        else {
+            for (int i = 0; i < 3; i++)
+                cell[i] = (int) floor(pos[i]*numCells[i]/thickness[i]);
+        }
+    };
+    
+    // Sort the atoms of the second set into cells.
+    
+    int totalCells = numCells[0]*numCells[1]*numCells[2];
+    vector<int> cellStart(totalCells+1, 0);
+    vector<int> atomCell(atoms2.size());
+    for (int i = 0; i < (int) atoms2.size(); i++) {
+        int cell[3];
+        getCell(atoms2[i], cell);
+        for (int j = 0; j < 3; j++)
+            cell[j] = max(0, min(numCells[j]-1, cell[j]));
+        atomCell[i] = (cell[2]*numCells[1]+cell[1])*numCells[0]+cell[0];
+        cellStart[atomCell[i]+1]++;
+    }
+    for (int i = 0; i < totalCells; i++)
+        cellStart[i+1] += cellStart[i];
+    vector<int> cellAtoms(atoms2.size());
+    vector<int> cellFill(cellStart.begin(), cellStart.end()-1);
+    for (int i = 0; i < (int) atoms2.size(); i++)
+        cellAtoms[cellFill[atomCell[i]]++] = atoms2[i];
+    
+    // Loop over atoms of the first set in parallel, checking the atoms in nearby cells.
+    
+    int numThreads = threads.getNumThreads();
+    threadGroupInteractions.resize(numThreads);
+    threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        vector<pair<int, int> >& pairs = threadGroupInteractions[threadIndex];
+        pairs.clear();
+        fvec4 boxSize(periodicBoxVectors[0][0], periodicBoxVectors[1][1], periodicBoxVectors[2][2], 0);
+        fvec4 invBoxSize(recipBoxSize[0], recipBoxSize[1], recipBoxSize[2], 0);
+        float maxDistance2 = maxDistance*maxDistance;
+        for (int i = threadIndex; i < (int) atoms1.size(); i += numThreads) {
+            int atom1 = atoms1[i];
+            fvec4 pos1(posq+4*atom1);
+            int cell[3], first[3], last[3];
+            getCell(atom1, cell);
+            for (int j = 0; j < 3; j++) {
+                if (periodic && numCells[j] < 3) {
+                    first[j] = 0;
+                    last[j] = numCells[j]-1;
+                }
+                else if (periodic) {
+                    first[j] = cell[j]-1;
+                    last[j] = cell[j]+1;
+                }
+                else {
+                    first[j] = max(0, cell[j]-1);
+                    last[j] = min(numCells[j]-1, cell[j]+1);
+                }
+            }
+            for (int z = first[2]; z <= last[2]; z++) {
+                int cellz = (z+numCells[2])%numCells[2];
+                for (int y = first[1]; y <= last[1]; y++) {
+                    int celly = (y+numCells[1])%numCells[1];
+                    for (int x = first[0]; x <= last[0]; x++) {
+                        int cellIndex = (cellz*numCells[1]+celly)*numCells[0]+(x+numCells[0])%numCells[0];
+                        for (int k = cellStart[cellIndex]; k < cellStart[cellIndex+1]; k++) {
+                            int atom2 = cellAtoms[k];
+                            fvec4 delta;
+                            float r2;
+                            getDeltaR(pos1, fvec4(posq+4*atom2), delta, r2, boxSize, invBoxSize);
+                            if (r2 >= maxDistance2)
+                                continue;
+                            if (atom1 == atom2 || exclusions[atom1].find(atom2) != exclusions[atom1].end())
+                                continue; // This is an excluded interaction.
+                            if (atom1 > atom2 && set1.find(atom2) != set1.end() && set2.find(atom1) != set2.end())
+                                continue; // Both atoms are in both sets, so skip duplicate interactions.
+                            pairs.push_back(make_pair(atom1, atom2));
+                        }
+                    }
+                }
+            }
+        }
+    });
+    threads.waitForThreads();
+    for (auto& pairs : threadGroupInteractions)
+        groupInteractions.insert(groupInteractions.end(), pairs.begin(), pairs.end());
+}
+
+void CpuCustomNonbondedForce::setUseVectorExpressions(const Lepton::CompiledVectorExpression& pairExpression) {
+    useVectorExpressions = true;
+    for (auto data : threadData)
+        data->setVectorExpression(pairExpression, paramNames);
 }
 
 void CpuCustomNonbondedForce::setUseSwitchingFunction(double distance) {
@@ -134,6 +354,15 @@ void CpuCustomNonbondedForce::calculatePairIxn(int numberOfAtoms, float* posq, v
     this->includeEnergy = includeEnergy;
     threadEnergy.resize(threads.getNumThreads());
     atomicCounter = 0;
+
+    // If necessary, find the pairs of atoms that interact through the interaction groups.
+
+    if (useInteractionGroups) {
+        if (cutoff && useGroupNeighborList)
+            updateGroupNeighborList();
+        else if (!hasFoundAllGroupInteractions)
+            findAllGroupInteractions();
+    }
     
     // Signal the threads to start running and wait for them to finish.
     
@@ -168,6 +397,12 @@ void CpuCustomNonbondedForce::threadComputeForce(ThreadPool& threads, int thread
         data.expressionSet.setVariable(data.expressionSet.getVariableIndex(param.first), param.second);
     for (auto& deriv : data.energyParamDerivs)
         deriv = 0.0;
+    for (int i = 0; i < (int) data.vecGlobalNames.size(); i++) {
+        float value = (float) globalParameters->at(data.vecGlobalNames[i]);
+        int width = data.pairVecExpression.getWidth();
+        for (int j = 0; j < width; j++)
+            data.vecGlobalValues[i*width+j] = value;
+    }
     fvec4 boxSize(periodicBoxVectors[0][0], periodicBoxVectors[1][1], periodicBoxVectors[2][2], 0);
     fvec4 invBoxSize(recipBoxSize[0], recipBoxSize[1], recipBoxSize[2], 0);
     if (useInteractionGroups) {
@@ -193,10 +428,15 @@ void CpuCustomNonbondedForce::threadComputeForce(ThreadPool& threads, int thread
             if (blockIndex >= neighborList->getNumBlocks())
                 break;
             const int blockSize = neighborList->getBlockSize();
+            if (useVectorExpressions && data.pairVecExpression.getWidth() == blockSize) {
+                calculateBlockIxn(blockIndex, data, forces, energy, boxSize, invBoxSize);
+                continue;
+            }
             const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
             const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
             const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
-            for (int i = 0; i < (int) neighbors.size(); i++) {
+            const int numNeighbors = neighborList->getNumBlockNeighbors(blockIndex, neighborTier);
+            for (int i = 0; i < numNeighbors; i++) {
                 int first = neighbors[i];
                 for (int j = 0; j < (int) paramNames.size(); j++)
                     data.particleParam[j*2] = atomParameters[first][j];
@@ -243,14 +483,26 @@ void CpuCustomNonbondedForce::calculateOneIxn(int ii, int jj, ThreadData& data,
     if (cutoff && r2 >= cutoffDistance*cutoffDistance)
         return;
     float r = sqrtf(r2);
-    data.r = r;
+    bool useFloat = (useVectorExpressions && data.pairVecExpression.getWidth() == 1);
+    if (useFloat) {
+        data.vecR[0] = r;
+        for (int i = 0; i < (int) data.particleParam.size(); i++)
+            data.vecParticleParam[i] = (float) data.particleParam[i];
+        data.pairVecExpression.evaluate();
+    }
+    else {
+        data.r = r;
+        data.pairExpression.evaluate();
+    }
 
     // accumulate forces
 
-    double dEdR = (includeForce ? data.forceExpression.evaluate()/r : 0.0);
+    double dEdR = 0.0;
+    if (includeForce)
+        dEdR = (useFloat ? data.pairVecExpression.getResult(0)[0] : data.pairExpression.getResult(0))/r;
     double energy = 0.0;
     if (includeEnergy || (useSwitch && r > switchingDistance))
-        energy = data.energyExpression.evaluate();
+        energy = (useFloat ? data.pairVecExpression.getResult(1)[0] : data.pairExpression.getResult(1));
     double switchValue = 1.0;
     if (useSwitch) {
         if (r > switchingDistance) {
@@ -271,8 +523,93 @@ void CpuCustomNonbondedForce::calculateOneIxn(int ii, int jj, ThreadData& data,
     
     // Accumulate energy derivatives.
 
-    for (int i = 0; i < data.energyParamDerivExpressions.size(); i++)
-        data.energyParamDerivs[i] += switchValue*data.energyParamDerivExpressions[i].evaluate();
+    for (int i = 0; i < data.energyParamDerivs.size(); i++) {
+        double deriv = (useFloat ? data.pairVecExpression.getResult(i+2)[0] : data.pairExpression.getResult(i+2));
+        data.energyParamDerivs[i] += switchValue*deriv;
+    }
+}
+
+void CpuCustomNonbondedForce::calculateBlockIxn(int blockIndex, ThreadData& data, float* forces, double& totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
+    const int blockSize = neighborList->getBlockSize();
+    const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
+    const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+    const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
+    const int numNeighbors = neighborList->getNumBlockNeighbors(blockIndex, neighborTier);
+    const int numParams = paramNames.size();
+    const int numDerivs = data.energyParamDerivs.size();
+    const float cutoff2 = (float) (cutoffDistance*cutoffDistance);
+    
+    // The parameters of the atoms in the block are the same for every neighbor.
+    
+    for (int j = 0; j < numParams; j++)
+        for (int k = 0; k < blockSize; k++)
+            data.vecParticleParam[(j*2+1)*blockSize+k] = (float) atomParameters[blockAtom[k]][j];
+    fvec4 deltaR[8];
+    bool include[8];
+    vector<const float*> derivs(numDerivs);
+    for (int i = 0; i < numNeighbors; i++) {
+        // Compute the distances from this neighbor to every atom in the block.
+        
+        int first = neighbors[i];
+        fvec4 posI(posq+4*first);
+        bool anyIncluded = false;
+        for (int k = 0; k < blockSize; k++) {
+            include[k] = false;
+            if ((exclusions[i] & (1<<k)) == 0) {
+                float r2;
+                getDeltaR(posI, fvec4(posq+4*blockAtom[k]), deltaR[k], r2, boxSize, invBoxSize);
+                if (r2 < cutoff2) {
+                    include[k] = true;
+                    anyIncluded = true;
+                    data.vecR[k] = sqrtf(r2);
+                }
+            }
+            if (!include[k])
+                data.vecR[k] = (float) cutoffDistance; // A harmless value for elements whose results get ignored.
+        }
+        if (!anyIncluded)
+            continue;
+        for (int j = 0; j < numParams; j++) {
+            float param = (float) atomParameters[first][j];
+            for (int k = 0; k < blockSize; k++)
+                data.vecParticleParam[j*2*blockSize+k] = param;
+        }
+        
+        // Evaluate the expressions for the whole block at once.
+        
+        data.pairVecExpression.evaluate();
+        const float* dEdRValues = (includeForce ? data.pairVecExpression.getResult(0) : NULL);
+        const float* energyValues = (includeEnergy || useSwitch ? data.pairVecExpression.getResult(1) : NULL);
+        for (int j = 0; j < numDerivs; j++)
+            derivs[j] = data.pairVecExpression.getResult(j+2);
+        
+        // Accumulate the results.
+        
+        for (int k = 0; k < blockSize; k++) {
+            if (!include[k])
+                continue;
+            float r = data.vecR[k];
+            double dEdR = (includeForce ? dEdRValues[k]/r : 0.0);
+            double energy = (energyValues == NULL ? 0.0 : energyValues[k]);
+            double switchValue = 1.0;
+            if (useSwitch) {
+                if (r > switchingDistance) {
+                    double t = (r-switchingDistance)/(cutoffDistance-switchingDistance);
+                    switchValue = 1+t*t*t*(-10+t*(15-t*6));
+                    double switchDeriv = t*t*(-30+t*(60-t*30))/(cutoffDistance-switchingDistance);
+                    dEdR = switchValue*dEdR + energy*switchDeriv/r;
+                    energy *= switchValue;
+                }
+            }
+            int second = blockAtom[k];
+            fvec4 result = deltaR[k]*dEdR;
+            (fvec4(forces+4*first)+result).store(forces+4*first);
+            (fvec4(forces+4*second)-result).store(forces+4*second);
+            totalEnergy += energy;
+            for (int j = 0; j < numDerivs; j++)
+                data.energyParamDerivs[j] += switchValue*derivs[j][k];
+        }
+    }
 }
 
 void CpuCustomNonbondedForce::getDeltaR(const fvec4& posI, const fvec4& posJ, fvec4& deltaR, float& r2, const fvec4& boxSize, const fvec4& invBoxSize) const {
@@ -176,6 +176,7 @@ void CpuGayBerneForce::threadComputeForce(ThreadPool& threads, int threadIndex,
         }
     }
     else {
+        const int tier = neighborList->getTierIndex(cutoffDistance);
         while (true) {
             int blockIndex = atomicCounter++;
             if (blockIndex >= neighborList->getNumBlocks())
@@ -184,7 +185,8 @@ void CpuGayBerneForce::threadComputeForce(ThreadPool& threads, int threadIndex,
             const int* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
             const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
             const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
-            for (int i = 0; i < (int) neighbors.size(); i++) {
+            const int numNeighbors = neighborList->getNumBlockNeighbors(blockIndex, tier);
+            for (int i = 0; i < numNeighbors; i++) {
                 int first = neighbors[i];
                 if (particles[first].sqrtEpsilon == 0.0f)
                     continue;
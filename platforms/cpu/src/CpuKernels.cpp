@@ -45,11 +45,15 @@
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/internal/CustomNonbondedForceImpl.h"
 #include "openmm/internal/NonbondedForceImpl.h"
+#include "openmm/internal/timer.h"
 #include "openmm/internal/vectorize.h"
 #include "lepton/CompiledExpression.h"
+#include "lepton/CompiledVectorExpression.h"
 #include "lepton/CustomFunction.h"
+#include "lepton/ExpressionCache.h"
 #include "lepton/Operation.h"
 #include "lepton/Parser.h"
+#include <algorithm>
 #include <iostream>
 #include "lepton/ParsedExpression.h"
 
@@ -152,7 +156,8 @@ static void copyChargesToPosq(ContextImpl& context, const vector<float>& charges
 }
 
 CpuCalcForcesAndEnergyKernel::CpuCalcForcesAndEnergyKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data, ContextImpl& context) :
-        CalcForcesAndEnergyKernel(name, platform), data(data) {
+        CalcForcesAndEnergyKernel(name, platform), data(data), windowTime(0.0), bestPaddingTime(-1.0), bestPadding(0.0), paddingStep(0.2),
+        windowSteps(0), windowRebuilds(0), paddingDirection(1) {
     // Create a Reference platform version of this kernel.
     
     ReferenceKernelFactory referenceFactory;
@@ -165,6 +170,14 @@ void CpuCalcForcesAndEnergyKernel::initialize(const System& system) {
 }
 
 void CpuCalcForcesAndEnergyKernel::beginComputation(ContextImpl& context, bool includeForce, bool includeEnergy, int groups) {
+    // If the previous computation was interrupted by an exception, let anything it started finish
+    // before beginning a new one.
+
+    for (auto& computation : data.pendingComputations)
+        computation();
+    data.pendingComputations.clear();
+    if (data.adaptivePadding)
+        computationStartTime = getCurrentTime();
     referenceKernel.getAs<ReferenceCalcForcesAndEnergyKernel>().beginComputation(context, includeForce, includeEnergy, groups);
     
     // Convert positions to single precision and clear the forces.
@@ -232,7 +245,7 @@ void CpuCalcForcesAndEnergyKernel::beginComputation(ContextImpl& context, bool i
     // Determine whether we need to recompute the neighbor list.
         
     if (data.neighborList != NULL) {
-        double padding = data.paddedCutoff-data.cutoff;;
+        double padding = data.paddedCutoff-data.cutoff;
         bool needRecompute = false;
         double closeCutoff2 = 0.25*padding*padding;
         double farCutoff2 = 0.5*padding*padding;
@@ -256,29 +269,43 @@ void CpuCalcForcesAndEnergyKernel::beginComputation(ContextImpl& context, bool i
 
             int numMoved = moved.size();
             double cutoff2 = data.cutoff*data.cutoff;
-            double paddedCutoff2 = data.paddedCutoff*data.paddedCutoff;
             for (int i = 1; i < numMoved && !needRecompute; i++)
-                for (int j = 0; j < i; j++) {
+                for (int j = 0; j < i && !needRecompute; j++) {
                     Vec3 delta = posData[moved[i]]-posData[moved[j]];
-                    if (delta.dot(delta) < cutoff2) {
-                        // These particles should interact.  See if they are in the neighbor list.
+                    double r2 = delta.dot(delta);
+                    if (r2 < cutoff2) {
+                        // These particles should interact.  See if they are in the neighbor list, in the
+                        // innermost tier whose cutoff they are within.
                         
                         Vec3 oldDelta = lastPositions[moved[i]]-lastPositions[moved[j]];
-                        if (oldDelta.dot(oldDelta) > paddedCutoff2) {
-                            needRecompute = true;
-                            break;
-                        }
+                        for (float tierCutoff : data.tierCutoffs)
+                            if (r2 < tierCutoff*tierCutoff) {
+                                double tierPaddedCutoff = tierCutoff+padding;
+                                if (oldDelta.dot(oldDelta) > tierPaddedCutoff*tierPaddedCutoff)
+                                    needRecompute = true;
+                                break;
+                            }
                     }
                 }
         }
         if (needRecompute) {
-            data.neighborList->computeNeighborList(numParticles, data.posq, data.exclusions, extractBoxVectors(context), data.isPeriodic, data.paddedCutoff, data.threads);
+            if (data.adaptivePadding)
+                tuneNeighborListPadding();
+            data.neighborList->computeNeighborList(numParticles, data.posq, data.exclusions, extractBoxVectors(context), data.isPeriodic, data.tierCutoffs,
+                    (float) (data.paddedCutoff-data.cutoff), data.threads);
             lastPositions = posData;
         }
     }
 }
 
 double CpuCalcForcesAndEnergyKernel::finishComputation(ContextImpl& context, bool includeForce, bool includeEnergy, int groups, bool& valid) {
+    // Wait for any computations that are running asynchronously.
+
+    double energy = 0.0;
+    for (auto& computation : data.pendingComputations)
+        energy += computation();
+    data.pendingComputations.clear();
+
     // Sum the forces from all the threads.
     
     data.threads.execute([&] (ThreadPool& threads, int threadIndex) {
@@ -299,7 +326,59 @@ double CpuCalcForcesAndEnergyKernel::finishComputation(ContextImpl& context, boo
         }
     });
     data.threads.waitForThreads();
-    return referenceKernel.getAs<ReferenceCalcForcesAndEnergyKernel>().finishComputation(context, includeForce, includeEnergy, groups, valid);
+    if (data.adaptivePadding && windowRebuilds > 0) {
+        windowTime += getCurrentTime()-computationStartTime;
+        windowSteps++;
+    }
+    return energy+referenceKernel.getAs<ReferenceCalcForcesAndEnergyKernel>().finishComputation(context, includeForce, includeEnergy, groups, valid);
+}
+
+void CpuCalcForcesAndEnergyKernel::tuneNeighborListPadding() {
+    // Each measurement window begins with a rebuild of the neighbor list and spans a fixed number of
+    // rebuilds, so the average time per step includes both the amortized cost of building the list and
+    // the cost of evaluating the extra pairs inside the padding.
+
+    const int rebuildsPerWindow = 5;
+    const int minStepsPerWindow = 20;
+    const double minPaddingStep = 0.02;
+    if (paddingStep < minPaddingStep)
+        return;
+    if (windowRebuilds < rebuildsPerWindow || windowSteps < minStepsPerWindow) {
+        windowRebuilds++;
+        return;
+    }
+    double timePerStep = windowTime/windowSteps;
+    double padding = data.paddedCutoff-data.cutoff;
+    windowTime = 0.0;
+    windowSteps = 0;
+    windowRebuilds = 1;
+    if (bestPaddingTime < 0.0 || timePerStep < bestPaddingTime) {
+        // This is the best padding so far.  Keep moving in the same direction.
+
+        bestPaddingTime = timePerStep;
+        bestPadding = padding;
+    }
+    else {
+        // It got slower.  Search on the other side of the best value, using a smaller step.
+
+        paddingDirection = -paddingDirection;
+        paddingStep *= 0.5;
+        if (paddingStep < minPaddingStep) {
+            data.setNeighborListPadding(bestPadding);
+            windowRebuilds = 0;
+            return;
+        }
+    }
+    double minPadding = 0.05*data.cutoff;
+    double maxPadding = 0.5*data.cutoff;
+    double newPadding = bestPadding*(1.0+paddingDirection*paddingStep);
+    if (newPadding < minPadding || newPadding > maxPadding) {
+        // We have reached the limit of the allowed range, so turn around.
+
+        paddingDirection = -paddingDirection;
+        newPadding = bestPadding*(1.0+paddingDirection*paddingStep);
+    }
+    data.setNeighborListPadding(max(minPadding, min(maxPadding, newPadding)));
 }
 
 void CpuCalcHarmonicAngleForceKernel::initialize(const System& system, const HarmonicAngleForce& force) {
@@ -477,11 +556,12 @@ CpuNonbondedForce* createCpuNonbondedForceVec4();
 CpuNonbondedForce* createCpuNonbondedForceVec8();
 
 CpuCalcNonbondedForceKernel::CpuCalcNonbondedForceKernel(string name, const Platform& platform, CpuPlatform::PlatformData& data) : CalcNonbondedForceKernel(name, platform),
-        data(data), hasInitializedPme(false), hasInitializedDispersionPme(false), nonbonded(NULL) {
+        data(data), hasInitializedPme(false), hasInitializedDispersionPme(false), isTuningPme(false), nonbonded(NULL) {
     if (isVec8Supported())
         nonbonded = createCpuNonbondedForceVec8();
     else
         nonbonded = createCpuNonbondedForceVec4();
+    nonbonded->setPmeOrder(data.pmeOrder);
 }
 
 CpuCalcNonbondedForceKernel::~CpuCalcNonbondedForceKernel() {
@@ -609,6 +689,46 @@ void CpuCalcNonbondedForceKernel::initialize(const System& system, const Nonbond
         ewaldDispersionAlpha = alpha;
         useSwitchingFunction = false;
     }
+    if (nonbondedMethod == PME || nonbondedMethod == LJPME) {
+        double alpha;
+        int nx, ny, nz;
+        force.getPMEParameters(alpha, nx, ny, nz);
+        bool automaticGrid = (alpha == 0.0);
+        bool automaticDispersionGrid = (alpha == 0.0);
+        if (nonbondedMethod == LJPME) {
+            force.getLJPMEParameters(alpha, nx, ny, nz);
+            automaticDispersionGrid = (alpha == 0.0);
+        }
+
+        // calcPMEParameters() chooses grids for fifth order B-splines.  The error scales as the grid spacing
+        // to the power of the order, so other orders reach the same tolerance with a different grid.  No
+        // grid dimension may be smaller than the order.
+
+        double orderScale = pow(force.getEwaldErrorTolerance(), 0.2-1.0/data.pmeOrder);
+        for (int i = 0; i < 3; i++) {
+            if (automaticGrid)
+                gridSize[i] = (int) ceil(orderScale*gridSize[i]);
+            gridSize[i] = max(gridSize[i], data.pmeOrder);
+            if (nonbondedMethod == LJPME) {
+                if (automaticDispersionGrid)
+                    dispersionGridSize[i] = (int) ceil(orderScale*dispersionGridSize[i]);
+                dispersionGridSize[i] = max(dispersionGridSize[i], data.pmeOrder);
+            }
+        }
+
+        // Only tune the grid if the user has not specified the PME parameters explicitly.
+
+        isTuningPme = (data.tunePme && automaticGrid && automaticDispersionGrid);
+        for (int i = 0; i < 3; i++) {
+            baseGridSize[i] = gridSize[i];
+            baseDispersionGridSize[i] = (nonbondedMethod == LJPME ? dispersionGridSize[i] : 0);
+        }
+        tuningCandidate = 0;
+        tuningSteps = 0;
+        tuningTime = 0.0;
+        bestTuningTime = -1.0;
+        bestTuningScale = 1.0;
+    }
     if (nonbondedMethod == NoCutoff || nonbondedMethod == CutoffNonPeriodic)
         exceptionsArePeriodic = false;
     else
@@ -626,30 +746,23 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
         hasInitializedPme = true;
         useOptimizedPme = false;
         computeParameters(context, false);
-        if (nonbondedMethod == PME) {
-            // If available, use the optimized PME implementation.
-
-            vector<string> kernelNames;
-            kernelNames.push_back("CalcPmeReciprocalForce");
-            useOptimizedPme = getPlatform().supportsKernels(kernelNames);
-            if (useOptimizedPme) {
-                optimizedPme = getPlatform().createKernel(CalcPmeReciprocalForceKernel::Name(), context);
-                optimizedPme.getAs<CalcPmeReciprocalForceKernel>().initialize(gridSize[0], gridSize[1], gridSize[2], numParticles, ewaldAlpha, data.deterministicForces);
-            }
-        }
-        if (nonbondedMethod == LJPME) {
+        if (nonbondedMethod == PME || nonbondedMethod == LJPME) {
             // If available, use the optimized PME implementation.
 
             vector<string> kernelNames;
             kernelNames.push_back("CalcPmeReciprocalForce");
-            kernelNames.push_back("CalcDispersionPmeReciprocalForce");
+            if (nonbondedMethod == LJPME)
+                kernelNames.push_back("CalcDispersionPmeReciprocalForce");
             useOptimizedPme = getPlatform().supportsKernels(kernelNames);
-            if (useOptimizedPme) {
-                optimizedPme = getPlatform().createKernel(CalcPmeReciprocalForceKernel::Name(), context);
-                optimizedPme.getAs<CalcPmeReciprocalForceKernel>().initialize(gridSize[0], gridSize[1], gridSize[2], numParticles, ewaldAlpha, data.deterministicForces);
-                optimizedDispersionPme = getPlatform().createKernel(CalcDispersionPmeReciprocalForceKernel::Name(), context);
-                optimizedDispersionPme.getAs<CalcDispersionPmeReciprocalForceKernel>().initialize(dispersionGridSize[0], dispersionGridSize[1],
-                                                                                                  dispersionGridSize[2], numParticles, ewaldDispersionAlpha, data.deterministicForces);
+            if (useOptimizedPme)
+                createOptimizedPme(context);
+            if (isTuningPme) {
+                array<int, 6> grid = {};
+                double alpha;
+                getPMEParameters(alpha, grid[0], grid[1], grid[2]);
+                if (nonbondedMethod == LJPME)
+                    getLJPMEParameters(alpha, grid[3], grid[4], grid[5]);
+                tunedGrids.push_back(grid);
             }
         }
     }
@@ -682,10 +795,14 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
         nonbonded->setUsePME(ewaldAlpha, gridSize);
         nonbonded->setUseLJPME(ewaldDispersionAlpha, dispersionGridSize);
     }
+    bool overlapPme = (includeReciprocal && useOptimizedPme && data.pmeThreads > 0);
+    if (overlapPme)
+        beginOverlappedPme(context, includeEnergy);
     double nonbondedEnergy = 0;
     if (includeDirect)
         nonbonded->calculateDirectIxn(numParticles, &posq[0], posData, particleParams, C6params, exclusions, data.threadForce, includeEnergy ? &nonbondedEnergy : NULL, data.threads);
-    if (includeReciprocal) {
+    if (includeReciprocal && !overlapPme) {
+        double startTime = (isTuningPme ? getCurrentTime() : 0.0);
         if (useOptimizedPme) {
             PmeIO io(&posq[0], &data.threadForce[0][0], numParticles);
             Vec3 periodicBoxVectors[3] = {boxVectors[0], boxVectors[1], boxVectors[2]};
@@ -698,7 +815,9 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
             }
         }
         else
-            nonbonded->calculateReciprocalIxn(numParticles, &posq[0], posData, particleParams, C6params, exclusions, forceData, includeEnergy ? &nonbondedEnergy : NULL);
+            nonbonded->calculateReciprocalIxn(numParticles, &posq[0], posData, particleParams, C6params, exclusions, forceData, includeEnergy ? &nonbondedEnergy : NULL, data.threads);
+        if (isTuningPme)
+            tunePmeGrid(context, getCurrentTime()-startTime);
     }
     energy += nonbondedEnergy;
     if (includeDirect) {
@@ -773,6 +892,108 @@ void CpuCalcNonbondedForceKernel::getLJPMEParameters(double& alpha, int& nx, int
     }
 }
 
+void CpuCalcNonbondedForceKernel::beginOverlappedPme(ContextImpl& context, bool includeEnergy) {
+    // Other kernels may change the charges stored in posq before the reciprocal space calculation finishes,
+    // so it works from its own copy.
+
+    AlignedArray<float>& posq = data.posq;
+    pmePosq.resize(4*numParticles);
+    for (int i = 0; i < 4*numParticles; i++)
+        pmePosq[i] = posq[i];
+    if (nonbondedMethod == LJPME) {
+        dispersionPmePosq.resize(4*numParticles);
+        for (int i = 0; i < numParticles; i++) {
+            for (int j = 0; j < 3; j++)
+                dispersionPmePosq[4*i+j] = posq[4*i+j];
+            dispersionPmePosq[4*i+3] = C6params[i];
+        }
+    }
+    Vec3* boxVectors = extractBoxVectors(context);
+    Vec3 periodicBoxVectors[3] = {boxVectors[0], boxVectors[1], boxVectors[2]};
+    pmeIO.reset(new PmeIO(&pmePosq[0], &data.threadForce[0][0], numParticles));
+    double startTime = (isTuningPme ? getCurrentTime() : 0.0);
+    optimizedPme.getAs<CalcPmeReciprocalForceKernel>().beginComputation(*pmeIO, periodicBoxVectors, includeEnergy);
+
+    // The dispersion term is computed once the electrostatic one is finished, so the two do not compete
+    // for the same threads.
+
+    data.pendingComputations.push_back([&context, this, periodicBoxVectors, includeEnergy, startTime] () {
+        double energy = optimizedPme.getAs<CalcPmeReciprocalForceKernel>().finishComputation(*pmeIO);
+        if (nonbondedMethod == LJPME) {
+            PmeIO io(&dispersionPmePosq[0], &data.threadForce[0][0], numParticles);
+            optimizedDispersionPme.getAs<CalcDispersionPmeReciprocalForceKernel>().beginComputation(io, periodicBoxVectors, includeEnergy);
+            energy += optimizedDispersionPme.getAs<CalcDispersionPmeReciprocalForceKernel>().finishComputation(io);
+        }
+        if (isTuningPme)
+            tunePmeGrid(context, getCurrentTime()-startTime);
+        return energy;
+    });
+}
+
+void CpuCalcNonbondedForceKernel::createOptimizedPme(ContextImpl& context) {
+    optimizedPme = getPlatform().createKernel(CalcPmeReciprocalForceKernel::Name(), context);
+    optimizedPme.getAs<CalcPmeReciprocalForceKernel>().initialize(gridSize[0], gridSize[1], gridSize[2], numParticles, ewaldAlpha, data.deterministicForces);
+    if (nonbondedMethod == LJPME) {
+        optimizedDispersionPme = getPlatform().createKernel(CalcDispersionPmeReciprocalForceKernel::Name(), context);
+        optimizedDispersionPme.getAs<CalcDispersionPmeReciprocalForceKernel>().initialize(dispersionGridSize[0], dispersionGridSize[1],
+                                                                                          dispersionGridSize[2], numParticles, ewaldDispersionAlpha, data.deterministicForces);
+    }
+}
+
+void CpuCalcNonbondedForceKernel::setPmeGridScale(ContextImpl& context, double scale) {
+    for (int i = 0; i < 3; i++) {
+        gridSize[i] = (int) ceil(scale*baseGridSize[i]);
+        dispersionGridSize[i] = (int) ceil(scale*baseDispersionGridSize[i]);
+    }
+    if (useOptimizedPme)
+        createOptimizedPme(context);
+}
+
+void CpuCalcNonbondedForceKernel::tunePmeGrid(ContextImpl& context, double time) {
+    // This tunes how the grid dimensions factor, not the balance between direct and reciprocal space.
+    // The cutoff is left unchanged, since it also applies to Lennard-Jones interactions, and with a fixed
+    // cutoff the direct space cost does not depend on alpha, so alpha is left unchanged too.  Any grid at least as fine as the one
+    // computed from the error tolerance satisfies it, but the speed of the FFT depends strongly on how the
+    // grid dimensions factor, so a slightly larger grid is sometimes faster.  Time the reciprocal space
+    // calculation for each candidate, then keep the fastest one.
+
+    const double scales[] = {1.0, 1.1, 1.2, 1.3, 1.4, 1.5};
+    const int numScales = sizeof(scales)/sizeof(scales[0]);
+    const int stepsPerCandidate = 10;
+    if (tuningSteps++ == 0)
+        return; // Skip the first step, which may include one time setup costs.
+    tuningTime += time;
+    if (tuningSteps <= stepsPerCandidate)
+        return;
+    double timePerStep = tuningTime/stepsPerCandidate;
+    if (bestTuningTime < 0.0 || timePerStep < bestTuningTime) {
+        bestTuningTime = timePerStep;
+        bestTuningScale = scales[tuningCandidate];
+    }
+    tuningSteps = 0;
+    tuningTime = 0.0;
+
+    // Move on to the next candidate whose actual grid differs from all the ones tried so far.
+
+    while (++tuningCandidate < numScales) {
+        setPmeGridScale(context, scales[tuningCandidate]);
+        array<int, 6> grid = {};
+        double alpha;
+        getPMEParameters(alpha, grid[0], grid[1], grid[2]);
+        if (nonbondedMethod == LJPME)
+            getLJPMEParameters(alpha, grid[3], grid[4], grid[5]);
+        if (find(tunedGrids.begin(), tunedGrids.end(), grid) == tunedGrids.end()) {
+            tunedGrids.push_back(grid);
+            return;
+        }
+    }
+
+    // All candidates have been tried, so lock in the fastest one.
+
+    setPmeGridScale(context, bestTuningScale);
+    isTuningPme = false;
+}
+
 void CpuCalcNonbondedForceKernel::computeParameters(ContextImpl& context, bool offsetsOnly) {
     bool paramChanged = false;
     for (int i = 0; i < paramNames.size(); i++) {
@@ -882,22 +1103,24 @@ void CpuCalcCustomNonbondedForceKernel::initialize(const System& system, const C
     for (int i = 0; i < force.getNumFunctions(); i++)
         functions[force.getTabulatedFunctionName(i)] = createReferenceTabulatedFunction(force.getTabulatedFunction(i));
 
-    // Parse the various expressions used to calculate the force.
+    // Parse the various expressions used to calculate the force.  The derivative with respect to r, the energy,
+    // and the derivatives with respect to parameters are compiled together, so they can share subexpressions.
 
-    Lepton::ParsedExpression expression = Lepton::Parser::parse(force.getEnergyFunction(), functions).optimize();
-    Lepton::CompiledExpression energyExpression = expression.createCompiledExpression();
-    Lepton::CompiledExpression forceExpression = expression.differentiate("r").createCompiledExpression();
+    string energyFunction = force.getEnergyFunction();
+    Lepton::ParsedExpression expression = Lepton::ExpressionCache::parse(energyFunction, functions);
+    vector<Lepton::ParsedExpression> pairExpressions;
+    pairExpressions.push_back(Lepton::ExpressionCache::differentiate(energyFunction, functions, "r"));
+    pairExpressions.push_back(expression);
     for (int i = 0; i < numParameters; i++)
         parameterNames.push_back(force.getPerParticleParameterName(i));
     for (int i = 0; i < force.getNumGlobalParameters(); i++) {
         globalParameterNames.push_back(force.getGlobalParameterName(i));
         globalParamValues[force.getGlobalParameterName(i)] = force.getGlobalParameterDefaultValue(i);
     }
-    std::vector<Lepton::CompiledExpression> energyParamDerivExpressions;
     for (int i = 0; i < force.getNumEnergyParameterDerivatives(); i++) {
         string param = force.getEnergyParameterDerivativeName(i);
         energyParamDerivNames.push_back(param);
-        energyParamDerivExpressions.push_back(expression.differentiate(param).createCompiledExpression());
+        pairExpressions.push_back(Lepton::ExpressionCache::differentiate(energyFunction, functions, param));
     }
     set<string> variables;
     variables.insert("r");
@@ -932,9 +1155,27 @@ void CpuCalcCustomNonbondedForceKernel::initialize(const System& system, const C
         interactionGroups.push_back(make_pair(set1, set2));
     }
     data.isPeriodic |= (nonbondedMethod == CutoffPeriodic);
-    nonbonded = new CpuCustomNonbondedForce(energyExpression, forceExpression, parameterNames, exclusions, energyParamDerivExpressions, data.threads);
-    if (interactionGroups.size() > 0)
+    nonbonded = new CpuCustomNonbondedForce(Lepton::ParsedExpression::createCompiledExpression(pairExpressions), parameterNames, exclusions, data.threads);
+    if (interactionGroups.size() > 0) {
         nonbonded->setInteractionGroups(interactionGroups);
+        if (nonbondedMethod != NoCutoff)
+            nonbonded->setUseGroupNeighborList(data.requestedPadding > 0.0 ? data.requestedPadding : 0.25*nonbondedCutoff);
+    }
+
+    // When using a neighbor list, evaluate the expressions for a whole block of atoms at once.  Pairs that
+    // are computed one at a time, such as those in interaction groups, are evaluated in double precision
+    // unless the user has requested single precision expressions.
+
+    if (nonbondedMethod != NoCutoff) {
+        const vector<int>& allowedWidths = Lepton::CompiledVectorExpression::getAllowedWidths();
+        int width = 0;
+        if (interactionGroups.size() == 0 && find(allowedWidths.begin(), allowedWidths.end(), data.neighborList->getBlockSize()) != allowedWidths.end())
+            width = data.neighborList->getBlockSize();
+        else if (data.singlePrecisionExpressions)
+            width = 1;
+        if (width > 0)
+            nonbonded->setUseVectorExpressions(Lepton::ParsedExpression::createCompiledVectorExpression(pairExpressions, width));
+    }
 }
 
 double CpuCalcCustomNonbondedForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
@@ -1101,8 +1342,14 @@ void CpuCalcCustomGBForceKernel::initialize(const System& system, const CustomGB
         globalParameterNames.push_back(force.getGlobalParameterName(i));
     nonbondedMethod = CalcCustomGBForceKernel::NonbondedMethod(force.getNonbondedMethod());
     nonbondedCutoff = force.getCutoffDistance();
-    if (nonbondedMethod != NoCutoff)
+    if (nonbondedMethod != NoCutoff) {
+        // The neighbor list cannot be shared with other forces, since it must not include their exclusions.
+        // Build it with padding so it only needs to be rebuilt when atoms have moved far enough.
+
         neighborList = new CpuNeighborList(4);
+        neighborListPadding = (data.requestedPadding > 0.0 ? data.requestedPadding : 0.25*nonbondedCutoff);
+        noExclusions.resize(numParticles);
+    }
 
     // Create custom functions for the tabulated functions.
 
@@ -1110,11 +1357,13 @@ void CpuCalcCustomGBForceKernel::initialize(const System& system, const CustomGB
     for (int i = 0; i < force.getNumFunctions(); i++)
         functions[force.getTabulatedFunctionName(i)] = createReferenceTabulatedFunction(force.getTabulatedFunction(i));
 
-    // Parse the expressions for computed values.
+    // Parse the expressions for computed values.  They go through the expression cache, so creating another
+    // Context for the same force does not need to differentiate and optimize them again.  Each value is compiled
+    // together with its derivatives with respect to parameters, and its gradient is compiled as a single
+    // expression, so they can share subexpressions.
 
     vector<vector<Lepton::CompiledExpression> > valueDerivExpressions(force.getNumComputedValues());
-    vector<vector<Lepton::CompiledExpression> > valueGradientExpressions(force.getNumComputedValues());
-    vector<vector<Lepton::CompiledExpression> > valueParamDerivExpressions(force.getNumComputedValues());
+    vector<Lepton::CompiledExpression> valueGradientExpressions;
     vector<Lepton::CompiledExpression> valueExpressions;
     vector<Lepton::CompiledExpression> energyExpressions;
     set<string> particleVariables, pairVariables;
@@ -1133,71 +1382,72 @@ void CpuCalcCustomGBForceKernel::initialize(const System& system, const CustomGB
         string name, expression;
         CustomGBForce::ComputationType type;
         force.getComputedValueParameters(i, name, expression, type);
-        Lepton::ParsedExpression ex = Lepton::Parser::parse(expression, functions).optimize();
-        valueExpressions.push_back(ex.createCompiledExpression());
+        Lepton::ParsedExpression ex = Lepton::ExpressionCache::parse(expression, functions);
+        vector<Lepton::ParsedExpression> valueAndDerivs = {ex};
         valueTypes.push_back(type);
         valueNames.push_back(name);
+        vector<Lepton::ParsedExpression> gradient;
+        gradient.push_back(Lepton::ExpressionCache::differentiate(expression, functions, "x"));
+        gradient.push_back(Lepton::ExpressionCache::differentiate(expression, functions, "y"));
+        gradient.push_back(Lepton::ExpressionCache::differentiate(expression, functions, "z"));
+        valueGradientExpressions.push_back(Lepton::ParsedExpression::createCompiledExpression(gradient));
         if (i == 0) {
-            valueDerivExpressions[i].push_back(ex.differentiate("r").createCompiledExpression());
+            valueDerivExpressions[i].push_back(Lepton::ExpressionCache::differentiate(expression, functions, "r").createCompiledExpression());
             validateVariables(ex.getRootNode(), pairVariables);
         }
         else {
-            valueGradientExpressions[i].push_back(ex.differentiate("x").createCompiledExpression());
-            valueGradientExpressions[i].push_back(ex.differentiate("y").createCompiledExpression());
-            valueGradientExpressions[i].push_back(ex.differentiate("z").createCompiledExpression());
             for (int j = 0; j < i; j++)
-                valueDerivExpressions[i].push_back(ex.differentiate(valueNames[j]).createCompiledExpression());
+                valueDerivExpressions[i].push_back(Lepton::ExpressionCache::differentiate(expression, functions, valueNames[j]).createCompiledExpression());
             validateVariables(ex.getRootNode(), particleVariables);
         }
         for (int j = 0; j < force.getNumEnergyParameterDerivatives(); j++) {
             string param = force.getEnergyParameterDerivativeName(j);
             energyParamDerivNames.push_back(param);
-            valueParamDerivExpressions[i].push_back(ex.differentiate(param).createCompiledExpression());
+            valueAndDerivs.push_back(Lepton::ExpressionCache::differentiate(expression, functions, param));
         }
+        valueExpressions.push_back(Lepton::ParsedExpression::createCompiledExpression(valueAndDerivs));
         particleVariables.insert(name);
         pairVariables.insert(name+"1");
         pairVariables.insert(name+"2");
     }
 
-    // Parse the expressions for energy terms.
+    // Parse the expressions for energy terms.  Each term is compiled together with all of its derivatives,
+    // in the order expected by CpuCustomGBForce.
 
-    vector<vector<Lepton::CompiledExpression> > energyDerivExpressions(force.getNumEnergyTerms());
-    vector<vector<Lepton::CompiledExpression> > energyGradientExpressions(force.getNumEnergyTerms());
-    vector<vector<Lepton::CompiledExpression> > energyParamDerivExpressions(force.getNumEnergyTerms());
     for (int i = 0; i < force.getNumEnergyTerms(); i++) {
         string expression;
         CustomGBForce::ComputationType type;
         force.getEnergyTermParameters(i, expression, type);
-        Lepton::ParsedExpression ex = Lepton::Parser::parse(expression, functions).optimize();
-        energyExpressions.push_back(ex.createCompiledExpression());
+        Lepton::ParsedExpression ex = Lepton::ExpressionCache::parse(expression, functions);
+        vector<Lepton::ParsedExpression> energyAndDerivs = {ex};
         energyTypes.push_back(type);
-        if (type != CustomGBForce::SingleParticle)
-            energyDerivExpressions[i].push_back(ex.differentiate("r").createCompiledExpression());
-        for (int j = 0; j < force.getNumComputedValues(); j++) {
-            if (type == CustomGBForce::SingleParticle) {
-                energyDerivExpressions[i].push_back(ex.differentiate(valueNames[j]).createCompiledExpression());
-                energyGradientExpressions[i].push_back(ex.differentiate("x").createCompiledExpression());
-                energyGradientExpressions[i].push_back(ex.differentiate("y").createCompiledExpression());
-                energyGradientExpressions[i].push_back(ex.differentiate("z").createCompiledExpression());
-                validateVariables(ex.getRootNode(), particleVariables);
-            }
-            else {
-                energyDerivExpressions[i].push_back(ex.differentiate(valueNames[j]+"1").createCompiledExpression());
-                energyDerivExpressions[i].push_back(ex.differentiate(valueNames[j]+"2").createCompiledExpression());
-                validateVariables(ex.getRootNode(), pairVariables);
+        if (type == CustomGBForce::SingleParticle) {
+            for (int j = 0; j < force.getNumComputedValues(); j++)
+                energyAndDerivs.push_back(Lepton::ExpressionCache::differentiate(expression, functions, valueNames[j]));
+            energyAndDerivs.push_back(Lepton::ExpressionCache::differentiate(expression, functions, "x"));
+            energyAndDerivs.push_back(Lepton::ExpressionCache::differentiate(expression, functions, "y"));
+            energyAndDerivs.push_back(Lepton::ExpressionCache::differentiate(expression, functions, "z"));
+            validateVariables(ex.getRootNode(), particleVariables);
+        }
+        else {
+            energyAndDerivs.push_back(Lepton::ExpressionCache::differentiate(expression, functions, "r"));
+            for (int j = 0; j < force.getNumComputedValues(); j++) {
+                energyAndDerivs.push_back(Lepton::ExpressionCache::differentiate(expression, functions, valueNames[j]+"1"));
+                energyAndDerivs.push_back(Lepton::ExpressionCache::differentiate(expression, functions, valueNames[j]+"2"));
             }
+            validateVariables(ex.getRootNode(), pairVariables);
         }
         for (int j = 0; j < force.getNumEnergyParameterDerivatives(); j++)
-            energyParamDerivExpressions[i].push_back(ex.differentiate(force.getEnergyParameterDerivativeName(j)).createCompiledExpression());
+            energyAndDerivs.push_back(Lepton::ExpressionCache::differentiate(expression, functions, force.getEnergyParameterDerivativeName(j)));
+        energyExpressions.push_back(Lepton::ParsedExpression::createCompiledExpression(energyAndDerivs));
     }
 
     // Delete the custom functions.
 
     for (auto& function : functions)
         delete function.second;
-    ixn = new CpuCustomGBForce(numParticles, exclusions, valueExpressions, valueDerivExpressions, valueGradientExpressions, valueParamDerivExpressions,
-        valueNames, valueTypes, energyExpressions, energyDerivExpressions, energyGradientExpressions, energyParamDerivExpressions, energyTypes,
-        particleParameterNames, data.threads);
+    ixn = new CpuCustomGBForce(numParticles, exclusions, valueExpressions, valueDerivExpressions, valueGradientExpressions,
+        valueNames, valueTypes, energyExpressions, energyTypes, particleParameterNames, data.threads);
     data.isPeriodic |= (force.getNonbondedMethod() == CustomGBForce::CutoffPeriodic);
 }
 
@@ -1208,8 +1458,20 @@ double CpuCalcCustomGBForceKernel::execute(ContextImpl& context, bool includeFor
     if (data.isPeriodic)
         ixn->setPeriodic(extractBoxSize(context));
     if (nonbondedMethod != NoCutoff) {
-        vector<set<int> > noExclusions(numParticles);
-        neighborList->computeNeighborList(numParticles, data.posq, noExclusions, boxVectors, data.isPeriodic, nonbondedCutoff, data.threads);
+        // Rebuild the neighbor list only if some atom has moved more than half the padding distance.
+
+        vector<Vec3>& posData = extractPositions(context);
+        bool needRecompute = (lastPositions.size() != numParticles);
+        double maxMove2 = 0.25*neighborListPadding*neighborListPadding;
+        for (int i = 0; i < numParticles && !needRecompute; i++) {
+            Vec3 delta = posData[i]-lastPositions[i];
+            if (delta.dot(delta) > maxMove2)
+                needRecompute = true;
+        }
+        if (needRecompute) {
+            neighborList->computeNeighborList(numParticles, data.posq, noExclusions, boxVectors, data.isPeriodic, nonbondedCutoff+neighborListPadding, data.threads);
+            lastPositions = posData;
+        }
         ixn->setUseCutoff(nonbondedCutoff, *neighborList);
     }
     map<string, double> globalParameters;
@@ -164,9 +164,12 @@ public:
         return VoxelIndex(y, z);
     }
         
-    void getNeighbors(vector<int>& neighbors, int blockIndex, const fvec4& blockCenter, const fvec4& blockWidth, const vector<int>& sortedAtoms, vector<char>& exclusions, float maxDistance, const vector<int>& blockAtoms, const vector<float>& blockAtomX, const vector<float>& blockAtomY, const vector<float>& blockAtomZ, const vector<float>& sortedPositions, const vector<VoxelIndex>& atomVoxelIndex) const {
+    void getNeighbors(vector<int>& neighbors, int blockIndex, const fvec4& blockCenter, const fvec4& blockWidth, const vector<int>& sortedAtoms, vector<char>& exclusions, float maxDistance, const vector<int>& blockAtoms, const vector<float>& blockAtomX, const vector<float>& blockAtomY, const vector<float>& blockAtomZ, const vector<float>& sortedPositions, const vector<VoxelIndex>& atomVoxelIndex, const vector<float>& tierDistances2, vector<char>& neighborTiers) const {
         neighbors.resize(0);
         exclusions.resize(0);
+        neighborTiers.resize(0);
+        const int numTiers = tierDistances2.size();
+        const float innerDistanceSquared = tierDistances2[0];
         fvec4 boxSize(periodicBoxSize[0], periodicBoxSize[1], periodicBoxSize[2], 0);
         fvec4 invBoxSize(recipBoxSize[0], recipBoxSize[1], recipBoxSize[2], 0);
         fvec4 periodicBoxVec4[3];
@@ -347,11 +350,12 @@ public:
                         if (dSquared > maxDistanceSquared)
                             continue;
                         
-                        if (dSquared > refineCutoffSquared) {
-                            // The distance is large enough that there might not be any actual interactions.
-                            // Check individual atom pairs to be sure.
+                        int tier = numTiers-1;
+                        if (dSquared > refineCutoffSquared || (numTiers > 1 && dSquared < tierDistances2[numTiers-2])) {
+                            // The distance is large enough that there might not be any actual interactions,
+                            // or the atom might belong to an inner tier.  Check individual atom pairs to be sure.
                             
-                            bool anyInteraction = false;
+                            fvec4 minR2(maxDistanceSquared);
                             for (int k = 0; k < (int) blockAtoms.size(); k += 4) {
                                 fvec4 dx = fvec4(&blockAtomX[k])-atomPos[0];
                                 fvec4 dy = fvec4(&blockAtomY[k])-atomPos[1];
@@ -373,17 +377,20 @@ public:
                                     dx -= scale1*periodicBoxVectors[0][0];
                                 }
                                 fvec4 r2 = dx*dx + dy*dy + dz*dz;
-                                if (any(r2 < maxDistanceSquared)) {
-                                    anyInteraction = true;
-                                    break;
-                                }
+                                minR2 = min(minR2, r2);
+                                if (any(r2 < innerDistanceSquared))
+                                    break; // The atom is in the innermost tier, so there is no need to check further.
                             }
-                            if (!anyInteraction)
+                            float closestR2 = min(min(minR2[0], minR2[1]), min(minR2[2], minR2[3]));
+                            if (!(closestR2 < maxDistanceSquared))
                                 continue;
+                            while (tier > 0 && closestR2 < tierDistances2[tier-1])
+                                tier--;
                         }
                         
                         // Add this atom to the list of neighbors.
                         
+                        neighborTiers.push_back(tier);
                         neighbors.push_back(sortedAtoms[sortedIndex]);
                         if (sortedIndex < blockSize*blockIndex)
                             exclusions.push_back(0);
@@ -414,9 +421,19 @@ CpuNeighborList::CpuNeighborList(int blockSize) : blockSize(blockSize) {
 
 void CpuNeighborList::computeNeighborList(int numAtoms, const AlignedArray<float>& atomLocations, const vector<set<int> >& exclusions,
             const Vec3* periodicBoxVectors, bool usePeriodic, float maxDistance, ThreadPool& threads) {
+    vector<float> cutoffs(1, maxDistance);
+    computeNeighborList(numAtoms, atomLocations, exclusions, periodicBoxVectors, usePeriodic, cutoffs, 0.0f, threads);
+}
+
+void CpuNeighborList::computeNeighborList(int numAtoms, const AlignedArray<float>& atomLocations, const vector<set<int> >& exclusions,
+            const Vec3* periodicBoxVectors, bool usePeriodic, const vector<float>& tierCutoffs, float padding, ThreadPool& threads) {
     int numBlocks = (numAtoms+blockSize-1)/blockSize;
+    float maxDistance = tierCutoffs.back()+padding;
     blockNeighbors.resize(numBlocks);
     blockExclusions.resize(numBlocks);
+    blockTierEnd.resize(numBlocks*tierCutoffs.size());
+    this->tierCutoffs = tierCutoffs;
+    this->padding = padding;
     sortedAtoms.resize(numAtoms);
     sortedPositions.resize(4*numAtoms);
     
@@ -514,6 +531,20 @@ const std::vector<char>& CpuNeighborList::getBlockExclusions(int blockIndex) con
     
 }
 
+int CpuNeighborList::getTierIndex(float cutoff) const {
+    int numTiers = tierCutoffs.size();
+    if (numTiers == 0)
+        return 0;
+    for (int i = 0; i < numTiers-1; i++)
+        if (tierCutoffs[i] >= cutoff*(1.0f-1e-6f))
+            return i;
+    return numTiers-1;
+}
+
+int CpuNeighborList::getNumBlockNeighbors(int blockIndex, int tier) const {
+    return blockTierEnd[blockIndex*tierCutoffs.size()+tier];
+}
+
 void CpuNeighborList::threadComputeNeighborList(ThreadPool& threads, int threadIndex) {
     // Compute the positions of atoms along the Hilbert curve.
 
@@ -534,9 +565,15 @@ void CpuNeighborList::threadComputeNeighborList(ThreadPool& threads, int threadI
     // Compute this thread's subset of neighbors.
 
     int numBlocks = blockNeighbors.size();
+    int numTiers = tierCutoffs.size();
+    vector<float> tierDistances2(numTiers);
+    for (int i = 0; i < numTiers; i++)
+        tierDistances2[i] = (tierCutoffs[i]+padding)*(tierCutoffs[i]+padding);
     vector<int> blockAtoms;
     vector<float> blockAtomX(blockSize), blockAtomY(blockSize), blockAtomZ(blockSize);
     vector<VoxelIndex> atomVoxelIndex;
+    vector<char> neighborTiers, unsortedExclusions;
+    vector<int> unsortedNeighbors, tierStart(numTiers);
     while (true) {
         int i = atomicCounter++;
         if (i >= numBlocks)
@@ -569,7 +606,32 @@ void CpuNeighborList::threadComputeNeighborList(ThreadPool& threads, int threadI
             blockAtomY[j] = 1e10;
             blockAtomZ[j] = 1e10;
         }
-        voxels->getNeighbors(blockNeighbors[i], i, (maxPos+minPos)*0.5f, (maxPos-minPos)*0.5f, sortedAtoms, blockExclusions[i], maxDistance, blockAtoms, blockAtomX, blockAtomY, blockAtomZ, sortedPositions, atomVoxelIndex);
+        voxels->getNeighbors(blockNeighbors[i], i, (maxPos+minPos)*0.5f, (maxPos-minPos)*0.5f, sortedAtoms, blockExclusions[i], maxDistance, blockAtoms, blockAtomX, blockAtomY, blockAtomZ, sortedPositions, atomVoxelIndex, tierDistances2, neighborTiers);
+        int numNeighbors = blockNeighbors[i].size();
+        if (numTiers > 1) {
+            // Sort the neighbors by tier.
+
+            for (int t = 0; t < numTiers; t++)
+                tierStart[t] = 0;
+            for (int k = 0; k < numNeighbors; k++)
+                tierStart[neighborTiers[k]]++;
+            int offset = 0;
+            for (int t = 0; t < numTiers; t++) {
+                int count = tierStart[t];
+                tierStart[t] = offset;
+                offset += count;
+                blockTierEnd[i*numTiers+t] = offset;
+            }
+            unsortedNeighbors = blockNeighbors[i];
+            unsortedExclusions = blockExclusions[i];
+            for (int k = 0; k < numNeighbors; k++) {
+                int index = tierStart[neighborTiers[k]]++;
+                blockNeighbors[i][index] = unsortedNeighbors[k];
+                blockExclusions[i][index] = unsortedExclusions[k];
+            }
+        }
+        else
+            blockTierEnd[i] = numNeighbors;
 
         // Record the exclusions for this block.
 
@@ -585,7 +647,6 @@ void CpuNeighborList::threadComputeNeighborList(ThreadPool& threads, int threadI
                     thisAtomFlags->second |= mask;
             }
         }
-        int numNeighbors = blockNeighbors[i].size();
         for (int k = 0; k < numNeighbors; k++) {
             int atomIndex = blockNeighbors[i][k];
             map<int, char>::iterator thisAtomFlags = atomFlags.find(atomIndex);
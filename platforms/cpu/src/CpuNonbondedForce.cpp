@@ -48,7 +48,7 @@ const int CpuNonbondedForce::NUM_TABLE_POINTS = 2048;
    --------------------------------------------------------------------------------------- */
 
 CpuNonbondedForce::CpuNonbondedForce() : cutoff(false), useSwitch(false), periodic(false), ewald(false), pme(false), ljpme(false), tableIsValid(false), expTableIsValid(false),
-    cutoffDistance(0.0f), alphaDispersionEwald(0.0f), alphaEwald(0.0f) {
+    cutoffDistance(0.0f), alphaDispersionEwald(0.0f), alphaEwald(0.0f), pmeOrder(5) {
 }
 
 CpuNonbondedForce::~CpuNonbondedForce() {
@@ -71,6 +71,7 @@ void CpuNonbondedForce::setUseCutoff(float distance, const CpuNeighborList& neig
     cutoffDistance = distance;
     inverseRcut6 = pow(cutoffDistance, -6);
     neighborList = &neighbors;
+    neighborTier = neighbors.getTierIndex(distance);
     krf = pow(cutoffDistance, -3.0f)*(solventDielectric-1.0)/(2.0*solventDielectric+1.0);
     crf = (1.0/cutoffDistance)*(3.0*solventDielectric)/(2.0*solventDielectric+1.0);
     if(alphaDispersionEwald != 0.0f){
@@ -202,6 +203,18 @@ void CpuNonbondedForce::setUseLJPME(float alpha, int meshSize[3]) {
     }
 }
 
+/**---------------------------------------------------------------------------------------
+
+     Set the order of the B-splines used for PME.
+
+     @param order  the interpolation order
+
+     --------------------------------------------------------------------------------------- */
+
+void CpuNonbondedForce::setPmeOrder(int order) {
+    pmeOrder = order;
+}
+
 
 void CpuNonbondedForce::tabulateEwaldScaleFactor() {
     if (tableIsValid)
@@ -240,21 +253,47 @@ void CpuNonbondedForce::tabulateExpTerms() {
     }
 }
 
+/**
+ * Loop over the k-vectors in the half space used by Ewald summation.  For each one, f is called with the
+ * components of the k-vector and the real and imaginary parts of q*exp(i*k*r) for each atom in a block.
+ */
+template <class F>
+static void forEachEwaldKVector(int numRx, int numRy, int numRz, const float* recipBoxSize, const vector<fvec4>& phases, const fvec4& charge, F f) {
+    const fvec4* px = &phases[0];
+    const fvec4* py = px+2*numRx;
+    const fvec4* pz = py+2*numRy;
+    for (int rx = 0; rx < numRx; rx++) {
+        float kx = rx*recipBoxSize[0];
+        fvec4 xr = charge*px[2*rx];
+        fvec4 xi = charge*px[2*rx+1];
+        for (int ry = (rx == 0 ? 0 : 1-numRy); ry < numRy; ry++) {
+            float ky = ry*recipBoxSize[1];
+            fvec4 yr = py[2*abs(ry)];
+            fvec4 yi = (ry >= 0 ? py[2*ry+1] : -py[-2*ry+1]);
+            fvec4 xyr = xr*yr - xi*yi;
+            fvec4 xyi = xr*yi + xi*yr;
+            for (int rz = (rx == 0 && ry == 0 ? 1 : 1-numRz); rz < numRz; rz++) {
+                float kz = rz*recipBoxSize[2];
+                fvec4 zr = pz[2*abs(rz)];
+                fvec4 zi = (rz >= 0 ? pz[2*rz+1] : -pz[-2*rz+1]);
+                f(kx, ky, kz, xyr*zr - xyi*zi, xyr*zi + xyi*zr);
+            }
+        }
+    }
+}
+
 void CpuNonbondedForce::calculateReciprocalIxn(int numberOfAtoms, float* posq, const vector<Vec3>& atomCoordinates,
                                                const vector<pair<float, float> >& atomParameters, const vector<float> &C6params, const vector<set<int> >& exclusions,
-                                               vector<Vec3>& forces, double* totalEnergy) const {
-    typedef std::complex<float> d_complex;
-
+                                               vector<Vec3>& forces, double* totalEnergy, ThreadPool& threads) {
     static const float epsilon     =  1.0;
 
-    int kmax                       = (ewald ? max(numRx, max(numRy,numRz)) : 0);
     float factorEwald              = -1 / (4*alphaEwald*alphaEwald);
     float TWO_PI                   = 2.0 * PI_M;
     float recipCoeff               = (float)(ONE_4PI_EPS0*4*PI_M/(periodicBoxVectors[0][0] * periodicBoxVectors[1][1] * periodicBoxVectors[2][2]) /epsilon);
 
     if (pme) {
         pme_t pmedata;
-        pme_init(&pmedata, alphaEwald, numberOfAtoms, meshDim, 5, 1);
+        pme_init(&pmedata, alphaEwald, numberOfAtoms, meshDim, pmeOrder, 1, true);
         vector<double> charges(numberOfAtoms);
         for (int i = 0; i < numberOfAtoms; i++)
             charges[i] = posq[4*i+3];
@@ -266,7 +305,7 @@ void CpuNonbondedForce::calculateReciprocalIxn(int numberOfAtoms, float* posq, c
 
         if (ljpme) {
             // Dispersion reciprocal space terms
-            pme_init(&pmedata,alphaDispersionEwald,numberOfAtoms,dispersionMeshDim,5,1);
+            pme_init(&pmedata,alphaDispersionEwald,numberOfAtoms,dispersionMeshDim,pmeOrder,1,true);
 
             std::vector<Vec3> dpmeforces;
             for (int i = 0; i < numberOfAtoms; i++){
@@ -291,90 +330,136 @@ void CpuNonbondedForce::calculateReciprocalIxn(int numberOfAtoms, float* posq, c
     // Ewald method
 
     else if (ewald) {
-
-        // setup reciprocal box
+        // The atoms are processed in blocks of four, one in each lane of an fvec4.  Each thread first
+        // accumulates the structure factor of every k-vector over its own blocks, then the partial sums are
+        // combined, and finally each thread computes the forces on its blocks.  exp(i*k*r) is computed for
+        // one block at a time, so the memory used scales with the number of k-vectors rather than with the
+        // number of k-vectors times the number of atoms.
 
         float recipBoxSize[3] = {(float) (TWO_PI/periodicBoxVectors[0][0]), (float) (TWO_PI/periodicBoxVectors[1][1]), (float) (TWO_PI/periodicBoxVectors[2][2])};
+        int numThreads = threads.getNumThreads();
+        int numBlocks = (numberOfAtoms+3)/4;
+        int numK = numRx*(2*numRy-1)*(2*numRz-1);
+        ewaldThreadSums.resize(2*numK*numThreads);
+        ewaldCoefficients.resize(2*numK);
+        threads.execute([&] (ThreadPool& threads, int threadIndex) {
+            vector<fvec4> phases(2*(numRx+numRy+numRz));
+            fvec4* sums = &ewaldThreadSums[2*numK*threadIndex];
+            for (int k = 0; k < 2*numK; k++)
+                sums[k] = fvec4(0.0f);
+            int firstBlock = threadIndex*numBlocks/numThreads;
+            int lastBlock = (threadIndex+1)*numBlocks/numThreads;
+            for (int block = firstBlock; block < lastBlock; block++) {
+                fvec4 charge;
+                computeEwaldPhases(block, posq, recipBoxSize, charge, phases);
+                int k = 0;
+                forEachEwaldKVector(numRx, numRy, numRz, recipBoxSize, phases, charge, [&] (float kx, float ky, float kz, const fvec4& re, const fvec4& im) {
+                    sums[k++] += re;
+                    sums[k++] += im;
+                });
+            }
+        });
+        threads.waitForThreads();
 
-
-        // setup K-vectors
-
-#define EIR(x, y, z) eir[(x)*numberOfAtoms*3+(y)*3+z]
-        vector<d_complex> eir(kmax*numberOfAtoms*3);
-        vector<d_complex> tab_xy(numberOfAtoms);
-        vector<d_complex> tab_qxyz(numberOfAtoms);
-
-        for (int i = 0; (i < numberOfAtoms); i++) {
-            float* pos = posq+4*i;
-            for (int m = 0; (m < 3); m++)
-                EIR(0, i, m) = d_complex(1,0);
-
-            for (int m=0; (m<3); m++)
-                EIR(1, i, m) = d_complex(cos(pos[m]*recipBoxSize[m]),
-                                         sin(pos[m]*recipBoxSize[m]));
-
-            for (int j=2; (j<kmax); j++)
-                for (int m=0; (m<3); m++)
-                    EIR(j, i, m) = EIR(j-1, i, m) * EIR(1, i, m);
-        }
-
-        // calculate reciprocal space energy and forces
-
-        int lowry = 0;
-        int lowrz = 1;
-
-        for (int rx = 0; rx < numRx; rx++) {
-            float kx = rx * recipBoxSize[0];
-            for (int ry = lowry; ry < numRy; ry++) {
-                float ky = ry * recipBoxSize[1];
-                if (ry >= 0) {
-                    for (int n = 0; n < numberOfAtoms; n++)
-                        tab_xy[n] = EIR(rx, n, 0) * EIR(ry, n, 1);
+        // Combine the structure factors from all threads and compute the energy.
+
+        double energy = 0.0;
+        int k = 0;
+        for (int rx = 0; rx < numRx; rx++)
+            for (int ry = (rx == 0 ? 0 : 1-numRy); ry < numRy; ry++)
+                for (int rz = (rx == 0 && ry == 0 ? 1 : 1-numRz); rz < numRz; rz++) {
+                    fvec4 re(0.0f), im(0.0f);
+                    for (int i = 0; i < numThreads; i++) {
+                        re += ewaldThreadSums[2*numK*i+2*k];
+                        im += ewaldThreadSums[2*numK*i+2*k+1];
+                    }
+                    float cs = dot4(re, fvec4(1.0f));
+                    float ss = dot4(im, fvec4(1.0f));
+                    float kx = rx*recipBoxSize[0];
+                    float ky = ry*recipBoxSize[1];
+                    float kz = rz*recipBoxSize[2];
+                    float k2 = kx*kx + ky*ky + kz*kz;
+                    float ak = exp(k2*factorEwald)/k2;
+                    energy += recipCoeff*ak*(cs*cs + ss*ss);
+                    ewaldCoefficients[2*k] = 2*recipCoeff*ak*cs;
+                    ewaldCoefficients[2*k+1] = 2*recipCoeff*ak*ss;
+                    k++;
                 }
-                else {
-                    for (int n = 0; n < numberOfAtoms; n++)
-                        tab_xy[n]= EIR(rx, n, 0) * conj (EIR(-ry, n, 1));
+        if (totalEnergy)
+            *totalEnergy += energy;
+
+        // Compute the forces.
+
+        threads.execute([&] (ThreadPool& threads, int threadIndex) {
+            vector<fvec4> phases(2*(numRx+numRy+numRz));
+            int firstBlock = threadIndex*numBlocks/numThreads;
+            int lastBlock = (threadIndex+1)*numBlocks/numThreads;
+            for (int block = firstBlock; block < lastBlock; block++) {
+                fvec4 charge;
+                computeEwaldPhases(block, posq, recipBoxSize, charge, phases);
+                fvec4 fx(0.0f), fy(0.0f), fz(0.0f);
+                int k = 0;
+                forEachEwaldKVector(numRx, numRy, numRz, recipBoxSize, phases, charge, [&] (float kx, float ky, float kz, const fvec4& re, const fvec4& im) {
+                    fvec4 f = ewaldCoefficients[2*k]*im - ewaldCoefficients[2*k+1]*re;
+                    fx += f*kx;
+                    fy += f*ky;
+                    fz += f*kz;
+                    k++;
+                });
+                float forceX[4], forceY[4], forceZ[4];
+                fx.store(forceX);
+                fy.store(forceY);
+                fz.store(forceZ);
+                for (int i = 0; i < 4 && 4*block+i < numberOfAtoms; i++) {
+                    forces[4*block+i][0] += forceX[i];
+                    forces[4*block+i][1] += forceY[i];
+                    forces[4*block+i][2] += forceZ[i];
                 }
-                for (int rz = lowrz; rz < numRz; rz++) {
-                    if (rz >= 0) {
-                        for (int n = 0; n < numberOfAtoms; n++)
-                            tab_qxyz[n] = posq[4*n+3] * (tab_xy[n] * EIR(rz, n, 2));
-                    }
-                    else {
-                        for (int n = 0; n < numberOfAtoms; n++)
-                            tab_qxyz[n] = posq[4*n+3] * (tab_xy[n] * conj(EIR(-rz, n, 2)));
-                    }
-                    float cs = 0.0f;
-                    float ss = 0.0f;
-
-                    for (int n = 0; n < numberOfAtoms; n++) {
-                        cs += tab_qxyz[n].real();
-                        ss += tab_qxyz[n].imag();
-                    }
-
-                    float kz = rz * recipBoxSize[2];
-                    float k2 = kx * kx + ky * ky + kz * kz;
-                    float ak = exp(k2*factorEwald) / k2;
-
-                    for (int n = 0; n < numberOfAtoms; n++) {
-                        float force = ak * (cs * tab_qxyz[n].imag() - ss * tab_qxyz[n].real());
-                        forces[n][0] += 2 * recipCoeff * force * kx;
-                        forces[n][1] += 2 * recipCoeff * force * ky;
-                        forces[n][2] += 2 * recipCoeff * force * kz;
-                    }
-
-                    if (totalEnergy)
-                        *totalEnergy += recipCoeff * ak * (cs * cs + ss * ss);
+            }
+        });
+        threads.waitForThreads();
+    }
+}
 
-                    lowrz = 1 - numRz;
-                }
-                lowry = 1 - numRy;
+void CpuNonbondedForce::computeEwaldPhases(int block, const float* posq, const float* recipBoxSize, fvec4& charge, vector<fvec4>& phases) const {
+    // Load the charges and positions of the atoms in the block.  Lanes past the end of the atom list get a
+    // charge of zero.
+
+    float q[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    float pos[3][4] = {{0.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}};
+    for (int i = 0; i < 4 && 4*block+i < numberOfAtoms; i++) {
+        const float* atomPosq = posq+4*(4*block+i);
+        for (int m = 0; m < 3; m++)
+            pos[m][i] = atomPosq[m];
+        q[i] = atomPosq[3];
+    }
+    charge = fvec4(q);
+
+    // phases holds exp(i*j*recipBoxSize*x) for j from 0 to numRx-1, then the same for y and z.  Real and
+    // imaginary parts alternate.
+
+    int numR[3] = {numRx, numRy, numRz};
+    fvec4* p = &phases[0];
+    for (int m = 0; m < 3; m++) {
+        p[0] = fvec4(1.0f);
+        p[1] = fvec4(0.0f);
+        if (numR[m] > 1) {
+            float c[4], s[4];
+            for (int i = 0; i < 4; i++) {
+                c[i] = cos(pos[m][i]*recipBoxSize[m]);
+                s[i] = sin(pos[m][i]*recipBoxSize[m]);
+            }
+            p[2] = fvec4(c);
+            p[3] = fvec4(s);
+            for (int j = 2; j < numR[m]; j++) {
+                p[2*j] = p[2*j-2]*p[2] - p[2*j-1]*p[3];
+                p[2*j+1] = p[2*j-2]*p[3] + p[2*j-1]*p[2];
             }
         }
+        p += 2*numR[m];
     }
 }
 
-
 void CpuNonbondedForce::calculateDirectIxn(int numberOfAtoms, float* posq, const vector<Vec3>& atomCoordinates, const vector<pair<float, float> >& atomParameters,
                                            const vector<float>& C6params, const vector<set<int> >& exclusions, vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads) {
     // Record the parameters for the threads.
@@ -122,7 +122,8 @@ void CpuNonbondedForceVec4::calculateBlockIxnImpl(int blockIndex, float* forces,
     
     const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
     const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
-    for (int i = 0; i < (int) neighbors.size(); i++) {
+    const int numNeighbors = neighborList->getNumBlockNeighbors(blockIndex, neighborTier);
+    for (int i = 0; i < numNeighbors; i++) {
         // Load the next neighbor.
         
         int atom = neighbors[i];
@@ -285,7 +286,8 @@ void CpuNonbondedForceVec4::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
     
     const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
     const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
-    for (int i = 0; i < (int) neighbors.size(); i++) {
+    const int numNeighbors = neighborList->getNumBlockNeighbors(blockIndex, neighborTier);
+    for (int i = 0; i < numNeighbors; i++) {
         // Load the next neighbor.
         
         int atom = neighbors[i];
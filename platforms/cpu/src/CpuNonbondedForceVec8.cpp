@@ -152,7 +152,8 @@ void CpuNonbondedForceVec8::calculateBlockIxnImpl(int blockIndex, float* forces,
     
     const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
     const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
-    for (int i = 0; i < (int) neighbors.size(); i++) {
+    const int numNeighbors = neighborList->getNumBlockNeighbors(blockIndex, neighborTier);
+    for (int i = 0; i < numNeighbors; i++) {
         // Load the next neighbor.
         
         int atom = neighbors[i];
@@ -316,7 +317,8 @@ void CpuNonbondedForceVec8::calculateBlockEwaldIxnImpl(int blockIndex, float* fo
     
     const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
     const vector<char>& exclusions = neighborList->getBlockExclusions(blockIndex);
-    for (int i = 0; i < (int) neighbors.size(); i++) {
+    const int numNeighbors = neighborList->getNumBlockNeighbors(blockIndex, neighborTier);
+    for (int i = 0; i < numNeighbors; i++) {
         // Load the next neighbor.
         
         int atom = neighbors[i];
@@ -77,6 +77,16 @@ CpuPlatform::CpuPlatform() {
     registerKernelFactory(IntegrateLangevinMiddleStepKernel::Name(), factory);
     platformProperties.push_back(CpuThreads());
     platformProperties.push_back(CpuDeterministicForces());
+    platformProperties.push_back(CpuNeighborListPadding());
+    platformProperties.push_back(CpuAdaptivePadding());
+    platformProperties.push_back(CpuPmeWisdomFile());
+    platformProperties.push_back(CpuPmeFFT());
+    platformProperties.push_back(CpuPmeGridAutotune());
+    platformProperties.push_back(CpuPmeThreads());
+    platformProperties.push_back(CpuPmeOrder());
+    platformProperties.push_back(CpuSpinWait());
+    platformProperties.push_back(CpuThreadAffinity());
+    platformProperties.push_back(CpuSinglePrecisionExpressions());
     int threads = getNumProcessors();
     char* threadsEnv = getenv("OPENMM_CPU_THREADS");
     if (threadsEnv != NULL)
@@ -85,6 +95,16 @@ CpuPlatform::CpuPlatform() {
     defaultThreads << threads;
     setPropertyDefaultValue(CpuThreads(), defaultThreads.str());
     setPropertyDefaultValue(CpuDeterministicForces(), "false");
+    setPropertyDefaultValue(CpuNeighborListPadding(), "");
+    setPropertyDefaultValue(CpuAdaptivePadding(), "false");
+    setPropertyDefaultValue(CpuPmeWisdomFile(), "");
+    setPropertyDefaultValue(CpuPmeFFT(), "");
+    setPropertyDefaultValue(CpuPmeGridAutotune(), "false");
+    setPropertyDefaultValue(CpuPmeThreads(), "0");
+    setPropertyDefaultValue(CpuPmeOrder(), "5");
+    setPropertyDefaultValue(CpuSpinWait(), "false");
+    setPropertyDefaultValue(CpuThreadAffinity(), "");
+    setPropertyDefaultValue(CpuSinglePrecisionExpressions(), "false");
 }
 
 const string& CpuPlatform::getPropertyValue(const Context& context, const string& property) const {
@@ -117,11 +137,73 @@ void CpuPlatform::contextCreated(ContextImpl& context, const map<string, string>
             getPropertyDefaultValue(CpuThreads()) : properties.find(CpuThreads())->second);
     string deterministicForcesValue = (properties.find(CpuDeterministicForces()) == properties.end() ?
             getPropertyDefaultValue(CpuDeterministicForces()) : properties.find(CpuDeterministicForces())->second);
+    const string& paddingPropValue = (properties.find(CpuNeighborListPadding()) == properties.end() ?
+            getPropertyDefaultValue(CpuNeighborListPadding()) : properties.find(CpuNeighborListPadding())->second);
+    string adaptivePaddingValue = (properties.find(CpuAdaptivePadding()) == properties.end() ?
+            getPropertyDefaultValue(CpuAdaptivePadding()) : properties.find(CpuAdaptivePadding())->second);
+    const string& wisdomFileValue = (properties.find(CpuPmeWisdomFile()) == properties.end() ?
+            getPropertyDefaultValue(CpuPmeWisdomFile()) : properties.find(CpuPmeWisdomFile())->second);
+    string fftValue = (properties.find(CpuPmeFFT()) == properties.end() ?
+            getPropertyDefaultValue(CpuPmeFFT()) : properties.find(CpuPmeFFT())->second);
+    string tunePmeValue = (properties.find(CpuPmeGridAutotune()) == properties.end() ?
+            getPropertyDefaultValue(CpuPmeGridAutotune()) : properties.find(CpuPmeGridAutotune())->second);
+    const string& pmeThreadsValue = (properties.find(CpuPmeThreads()) == properties.end() ?
+            getPropertyDefaultValue(CpuPmeThreads()) : properties.find(CpuPmeThreads())->second);
+    const string& pmeOrderValue = (properties.find(CpuPmeOrder()) == properties.end() ?
+            getPropertyDefaultValue(CpuPmeOrder()) : properties.find(CpuPmeOrder())->second);
+    string spinWaitValue = (properties.find(CpuSpinWait()) == properties.end() ?
+            getPropertyDefaultValue(CpuSpinWait()) : properties.find(CpuSpinWait())->second);
+    string affinityValue = (properties.find(CpuThreadAffinity()) == properties.end() ?
+            getPropertyDefaultValue(CpuThreadAffinity()) : properties.find(CpuThreadAffinity())->second);
+    string singlePrecisionValue = (properties.find(CpuSinglePrecisionExpressions()) == properties.end() ?
+            getPropertyDefaultValue(CpuSinglePrecisionExpressions()) : properties.find(CpuSinglePrecisionExpressions())->second);
     int numThreads;
     stringstream(threadsPropValue) >> numThreads;
     transform(deterministicForcesValue.begin(), deterministicForcesValue.end(), deterministicForcesValue.begin(), ::tolower);
     bool deterministicForces = (deterministicForcesValue == "true");
-    PlatformData* data = new PlatformData(context.getSystem().getNumParticles(), numThreads, deterministicForces);
+    double padding = -1.0;
+    if (paddingPropValue.size() > 0) {
+        stringstream(paddingPropValue) >> padding;
+        if (!(padding > 0.0))
+            throw OpenMMException("Illegal value for NeighborListPadding: "+paddingPropValue);
+    }
+    transform(adaptivePaddingValue.begin(), adaptivePaddingValue.end(), adaptivePaddingValue.begin(), ::tolower);
+    bool adaptivePadding = (adaptivePaddingValue == "true");
+    int pmeThreads = -1;
+    stringstream(pmeThreadsValue) >> pmeThreads;
+    if (pmeThreads < 0 || (pmeThreads > 0 && pmeThreads >= numThreads))
+        throw OpenMMException("Illegal value for PmeThreads: "+pmeThreadsValue);
+    int pmeOrder = -1;
+    stringstream(pmeOrderValue) >> pmeOrder;
+    if (pmeOrder < 4 || pmeOrder > 8)
+        throw OpenMMException("Illegal value for PmeOrder: "+pmeOrderValue);
+    transform(tunePmeValue.begin(), tunePmeValue.end(), tunePmeValue.begin(), ::tolower);
+    bool tunePme = (tunePmeValue == "true");
+    transform(spinWaitValue.begin(), spinWaitValue.end(), spinWaitValue.begin(), ::tolower);
+    bool spinWait = (spinWaitValue == "true");
+    transform(singlePrecisionValue.begin(), singlePrecisionValue.end(), singlePrecisionValue.begin(), ::tolower);
+    bool singlePrecisionExpressions = (singlePrecisionValue == "true");
+    transform(fftValue.begin(), fftValue.end(), fftValue.begin(), ::tolower);
+    if (fftValue == "fftw")
+        fftValue = "FFTW";
+    else if (fftValue == "builtin")
+        fftValue = "Builtin";
+    else if (fftValue != "")
+        throw OpenMMException("Illegal value for PmeFFT: "+fftValue);
+    string affinityPolicy = affinityValue;
+    transform(affinityPolicy.begin(), affinityPolicy.end(), affinityPolicy.begin(), ::tolower);
+    if (affinityPolicy == "compact" || affinityPolicy == "scatter")
+        affinityValue = affinityPolicy;
+    vector<int> cpuAffinity;
+    if (!ThreadPool::getCpuAffinity(affinityValue, cpuAffinity))
+        throw OpenMMException("Illegal value for ThreadAffinity: "+affinityValue);
+    PlatformData* data = new PlatformData(context.getSystem().getNumParticles(), numThreads-pmeThreads, deterministicForces, padding, adaptivePadding, tunePme,
+            pmeThreads, pmeOrder, spinWait, cpuAffinity);
+    data->singlePrecisionExpressions = singlePrecisionExpressions;
+    data->propertyValues[CpuThreadAffinity()] = affinityValue;
+    data->propertyValues[CpuSinglePrecisionExpressions()] = singlePrecisionExpressions ? "true" : "false";
+    data->propertyValues[CpuPmeWisdomFile()] = wisdomFileValue;
+    data->propertyValues[CpuPmeFFT()] = fftValue;
     contextData[&context] = data;
     ReferenceConstraints& constraints = *(ReferenceConstraints*) reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData())->constraints;
     if (constraints.settle != NULL) {
@@ -147,17 +229,43 @@ const CpuPlatform::PlatformData& CpuPlatform::getPlatformData(const ContextImpl&
     return *contextData[&context];
 }
 
-CpuPlatform::PlatformData::PlatformData(int numParticles, int numThreads, bool deterministicForces) : posq(4*numParticles), threads(numThreads),
-        deterministicForces(deterministicForces), neighborList(NULL), cutoff(0.0), paddedCutoff(0.0), anyExclusions(false), currentPosqIndex(-1), nextPosqIndex(0) {
+CpuPlatform::PlatformData::PlatformData(int numParticles, int numThreads, bool deterministicForces, double padding, bool adaptivePadding, bool tunePme, int pmeThreads, int pmeOrder, bool spinWait,
+            const vector<int>& cpuAffinity) : threads(numThreads, spinWait, cpuAffinity), deterministicForces(deterministicForces), neighborList(NULL), cutoff(0.0), paddedCutoff(0.0),
+        requestedPadding(padding), anyExclusions(false), adaptivePadding(adaptivePadding), tunePme(tunePme), singlePrecisionExpressions(false), currentPosqIndex(-1), nextPosqIndex(0),
+        pmeThreads(pmeThreads), pmeOrder(pmeOrder) {
     numThreads = threads.getNumThreads();
+
+    // Memory is usually placed on the NUMA node of the thread that first writes to it, so let the worker
+    // threads initialize the arrays they use.  Each one allocates and clears its own force buffer.
+
+    posq.resize(4*numParticles, threads);
     threadForce.resize(numThreads);
-    for (int i = 0; i < numThreads; i++)
-        threadForce[i].resize(4*numParticles);
+    threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        threadForce[threadIndex].resize(4*numParticles);
+        threadForce[threadIndex].zero(0, 4*numParticles);
+    });
+    threads.waitForThreads();
     isPeriodic = false;
     stringstream threadsProperty;
-    threadsProperty << numThreads;
+    threadsProperty << numThreads+pmeThreads;
     propertyValues[CpuThreads()] = threadsProperty.str();
+    stringstream pmeThreadsProperty;
+    pmeThreadsProperty << pmeThreads;
+    propertyValues[CpuPmeThreads()] = pmeThreadsProperty.str();
+    stringstream pmeOrderProperty;
+    pmeOrderProperty << pmeOrder;
+    propertyValues[CpuPmeOrder()] = pmeOrderProperty.str();
     propertyValues[CpuDeterministicForces()] = deterministicForces ? "true" : "false";
+    propertyValues[CpuAdaptivePadding()] = adaptivePadding ? "true" : "false";
+    propertyValues[CpuPmeGridAutotune()] = tunePme ? "true" : "false";
+    propertyValues[CpuSpinWait()] = spinWait ? "true" : "false";
+    if (padding > 0.0) {
+        stringstream paddingProperty;
+        paddingProperty << padding;
+        propertyValues[CpuNeighborListPadding()] = paddingProperty.str();
+    }
+    else
+        propertyValues[CpuNeighborListPadding()] = "";
 }
 
 CpuPlatform::PlatformData::~PlatformData() {
@@ -170,10 +278,19 @@ bool isVec8Supported();
 void CpuPlatform::PlatformData::requestNeighborList(double cutoffDistance, double padding, bool useExclusions, const vector<set<int> >& exclusionList) {
     if (neighborList == NULL)
         neighborList = new CpuNeighborList(isVec8Supported() ? 8 : 4);
+    if (requestedPadding > 0.0)
+        padding = requestedPadding;
     if (cutoffDistance > cutoff)
         cutoff = cutoffDistance;
+    if (find(tierCutoffs.begin(), tierCutoffs.end(), (float) cutoffDistance) == tierCutoffs.end()) {
+        // Each distinct cutoff gets its own tier in the neighbor list.
+
+        tierCutoffs.push_back((float) cutoffDistance);
+        sort(tierCutoffs.begin(), tierCutoffs.end());
+    }
     if (cutoffDistance+padding > paddedCutoff)
         paddedCutoff = cutoffDistance+padding;
+    setNeighborListPadding(paddedCutoff-cutoff);
     if (useExclusions) {
         if (anyExclusions && exclusions != exclusionList)
             throw OpenMMException("All Forces must have identical exclusions");
@@ -186,6 +303,13 @@ void CpuPlatform::PlatformData::requestNeighborList(double cutoffDistance, doubl
         exclusions = exclusionList;
 }
 
+void CpuPlatform::PlatformData::setNeighborListPadding(double padding) {
+    paddedCutoff = cutoff+padding;
+    stringstream paddingProperty;
+    paddingProperty << padding;
+    propertyValues[CpuNeighborListPadding()] = paddingProperty.str();
+}
+
 int CpuPlatform::PlatformData::requestPosqIndex() {
     return nextPosqIndex++;
 }
\ No newline at end of file
@@ -31,6 +31,55 @@
 
 #include "CpuTests.h"
 #include "TestCustomGBForce.h"
+#include "ReferencePlatform.h"
+
+void testNeighborListReuse() {
+    // Move the particles by a series of small displacements, so the padded neighbor list is sometimes
+    // reused and sometimes rebuilt, and make sure the results always agree with the Reference platform.
+
+    const int numParticles = 200;
+    const double boxSize = 5.0;
+    const double cutoff = 1.2;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    CustomGBForce* custom = new CustomGBForce();
+    custom->setNonbondedMethod(CustomGBForce::CutoffPeriodic);
+    custom->setCutoffDistance(cutoff);
+    custom->addPerParticleParameter("q");
+    custom->addComputedValue("I", "exp(-2*r^2)", CustomGBForce::ParticlePairNoExclusions);
+    custom->addEnergyTerm("0.5*I^2", CustomGBForce::SingleParticle);
+    custom->addEnergyTerm("q1*q2*(1/r-1/1.2)*(1+I1+I2)", CustomGBForce::ParticlePair);
+    system.addForce(custom);
+    vector<Vec3> positions(numParticles);
+    vector<double> params(1);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        params[0] = (i%2 == 0 ? 0.5 : -0.5);
+        custom->addParticle(params);
+        if (i%2 == 1)
+            custom->addExclusion(i-1, i);
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    }
+    ReferencePlatform reference;
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    Context context(system, integrator1, platform);
+    Context referenceContext(system, integrator2, reference);
+    for (int step = 0; step < 10; step++) {
+        context.setPositions(positions);
+        referenceContext.setPositions(positions);
+        State state = context.getState(State::Forces | State::Energy);
+        State referenceState = referenceContext.getState(State::Forces | State::Energy);
+        ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-4);
+        for (int i = 0; i < numParticles; i++)
+            ASSERT_EQUAL_VEC(referenceState.getForces()[i], state.getForces()[i], 1e-4);
+        for (int i = 0; i < numParticles; i++)
+            positions[i] += Vec3(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5)*0.1;
+    }
+}
 
 void runPlatformTests() {
+    testNeighborListReuse();
 }
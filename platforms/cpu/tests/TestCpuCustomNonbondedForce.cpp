@@ -31,6 +31,164 @@
 
 #include "CpuTests.h"
 #include "TestCustomNonbondedForce.h"
+#include "ReferencePlatform.h"
+
+void testDifferentCutoffs() {
+    // A CustomNonbondedForce and a NonbondedForce with different cutoffs share a tiered neighbor list.
+    // Make sure each one gets all the interactions inside its own cutoff.
+
+    const int numParticles = 400;
+    const double boxSize = 4.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    CustomNonbondedForce* custom = new CustomNonbondedForce("a1*a2*(r-0.9)^2");
+    custom->addPerParticleParameter("a");
+    custom->setNonbondedMethod(CustomNonbondedForce::CutoffPeriodic);
+    custom->setCutoffDistance(0.9);
+    system.addForce(custom);
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.2);
+    system.addForce(nonbonded);
+    vector<Vec3> positions(numParticles);
+    vector<double> params(1);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        params[0] = 0.5+genrand_real2(sfmt);
+        custom->addParticle(params);
+        nonbonded->addParticle(i%2 == 0 ? 0.2 : -0.2, 0.2, 0.1);
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    }
+    for (int i = 1; i < numParticles; i += 2) {
+        custom->addExclusion(i-1, i);
+        nonbonded->addException(i-1, i, 0.0, 1.0, 0.0);
+    }
+    ReferencePlatform reference;
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    Context context(system, integrator1, platform);
+    Context referenceContext(system, integrator2, reference);
+    context.setPositions(positions);
+    referenceContext.setPositions(positions);
+    State state = context.getState(State::Forces | State::Energy);
+    State referenceState = referenceContext.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-4);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(referenceState.getForces()[i], state.getForces()[i], 1e-4);
+}
+
+void testInteractionGroupNeighborList(CustomNonbondedForce::NonbondedMethod method, bool triclinic) {
+    // Interaction groups with a cutoff use a cell list that is only rebuilt when atoms move far enough.
+    // Move the atoms repeatedly and make sure the results stay correct.
+
+    const int numParticles = 600;
+    const double boxSize = 4.0;
+    System system;
+    if (triclinic)
+        system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0.3*boxSize, boxSize, 0), Vec3(-0.2*boxSize, 0.4*boxSize, boxSize));
+    else
+        system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    CustomNonbondedForce* custom = new CustomNonbondedForce("a1*a2*(r-1.1)^2");
+    custom->addPerParticleParameter("a");
+    custom->setNonbondedMethod(method);
+    custom->setCutoffDistance(1.1);
+    system.addForce(custom);
+    vector<Vec3> positions(numParticles);
+    vector<double> params(1);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        params[0] = 0.5+genrand_real2(sfmt);
+        custom->addParticle(params);
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    }
+    for (int i = 1; i < numParticles; i += 2)
+        custom->addExclusion(i-1, i);
+    set<int> set1, set2, set3;
+    for (int i = 0; i < 20; i++)
+        set1.insert(i);
+    for (int i = 0; i < numParticles; i++)
+        set2.insert(i);
+    for (int i = 20; i < 60; i++)
+        set3.insert(i);
+    custom->addInteractionGroup(set1, set2);
+    custom->addInteractionGroup(set3, set3);
+    ReferencePlatform reference;
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    Context context(system, integrator1, platform);
+    Context referenceContext(system, integrator2, reference);
+    for (int iteration = 0; iteration < 10; iteration++) {
+        context.setPositions(positions);
+        referenceContext.setPositions(positions);
+        State state = context.getState(State::Forces | State::Energy);
+        State referenceState = referenceContext.getState(State::Forces | State::Energy);
+        ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-4);
+        for (int i = 0; i < numParticles; i++)
+            ASSERT_EQUAL_VEC(referenceState.getForces()[i], state.getForces()[i], 1e-4);
+        double step = (iteration%3 == 2 ? 0.3 : 0.03);
+        for (int i = 0; i < numParticles; i++)
+            positions[i] += Vec3(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5)*step;
+    }
+}
+
+void testSinglePrecisionExpressions() {
+    // When requested, pairs from interaction groups are evaluated with single precision expressions.  Compare
+    // them to the double precision expressions used by default, with a cutoff large enough to include every pair.
+
+    const int numParticles = 200;
+    const double boxSize = 3.0;
+    System system;
+    CustomNonbondedForce* custom = new CustomNonbondedForce("4*eps*((sigma/reff)^12-(sigma/reff)^6); reff=(lambda*0.5*sigma^6+r^6)^(1/6); sigma=0.5*(sigma1+sigma2); eps=sqrt(eps1*eps2)");
+    custom->addPerParticleParameter("sigma");
+    custom->addPerParticleParameter("eps");
+    custom->addGlobalParameter("lambda", 0.3);
+    custom->addEnergyParameterDerivative("lambda");
+    custom->setNonbondedMethod(CustomNonbondedForce::CutoffNonPeriodic);
+    custom->setCutoffDistance(100.0);
+    system.addForce(custom);
+    vector<Vec3> positions(numParticles);
+    vector<double> params(2);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        params[0] = 0.2+0.1*genrand_real2(sfmt);
+        params[1] = 0.5+genrand_real2(sfmt);
+        custom->addParticle(params);
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    }
+    set<int> set1, set2;
+    for (int i = 0; i < 50; i++)
+        set1.insert(i);
+    for (int i = 0; i < numParticles; i++)
+        set2.insert(i);
+    custom->addInteractionGroup(set1, set2);
+    VerletIntegrator integrator1(0.001);
+    Context context1(system, integrator1, platform);
+    ASSERT_EQUAL("false", platform.getPropertyValue(context1, CpuPlatform::CpuSinglePrecisionExpressions()));
+    context1.setPositions(positions);
+    State state1 = context1.getState(State::Forces | State::Energy | State::ParameterDerivatives);
+    map<string, string> properties;
+    properties[CpuPlatform::CpuSinglePrecisionExpressions()] = "true";
+    VerletIntegrator integrator2(0.001);
+    Context context2(system, integrator2, platform, properties);
+    ASSERT_EQUAL("true", platform.getPropertyValue(context2, CpuPlatform::CpuSinglePrecisionExpressions()));
+    context2.setPositions(positions);
+    State state2 = context2.getState(State::Forces | State::Energy | State::ParameterDerivatives);
+    ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-5);
+    ASSERT_EQUAL_TOL(state1.getEnergyParameterDerivatives().at("lambda"), state2.getEnergyParameterDerivatives().at("lambda"), 1e-5);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], 1e-4);
+}
 
 void runPlatformTests() {
+    testDifferentCutoffs();
+    testInteractionGroupNeighborList(CustomNonbondedForce::CutoffNonPeriodic, false);
+    testInteractionGroupNeighborList(CustomNonbondedForce::CutoffPeriodic, false);
+    testInteractionGroupNeighborList(CustomNonbondedForce::CutoffPeriodic, true);
+    testSinglePrecisionExpressions();
 }
@@ -32,5 +32,45 @@
 #include "CpuTests.h"
 #include "TestEwald.h"
 
+void testEwaldThreads() {
+    // Compute Ewald forces with different numbers of threads, including a number of atoms that is not a
+    // multiple of the vector width, and compare them to the Reference platform.
+
+    const int numParticles = 103;
+    const double boxSize = 2.5;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::Ewald);
+    nonbonded->setCutoffDistance(1.0);
+    nonbonded->setEwaldErrorTolerance(1e-5);
+    system.addForce(nonbonded);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 1.0 : -1.0, 0.3, 0.0);
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    }
+    ReferencePlatform reference;
+    VerletIntegrator referenceIntegrator(0.001);
+    Context referenceContext(system, referenceIntegrator, reference);
+    referenceContext.setPositions(positions);
+    State referenceState = referenceContext.getState(State::Forces | State::Energy);
+    for (string threads : {"1", "3", "4"}) {
+        map<string, string> properties;
+        properties[CpuPlatform::CpuThreads()] = threads;
+        VerletIntegrator integrator(0.001);
+        Context context(system, integrator, platform, properties);
+        context.setPositions(positions);
+        State state = context.getState(State::Forces | State::Energy);
+        ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-4);
+        for (int i = 0; i < numParticles; i++)
+            ASSERT_EQUAL_VEC(referenceState.getForces()[i], state.getForces()[i], 1e-4);
+    }
+}
+
 void runPlatformTests() {
+    testEwaldThreads();
 }
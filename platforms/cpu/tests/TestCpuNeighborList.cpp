@@ -119,6 +119,92 @@ void testNeighborList(bool periodic, bool triclinic) {
         }
 }
 
+void testTieredNeighborList(bool periodic, bool triclinic) {
+    const int numParticles = 500;
+    const float padding = 0.1f;
+    vector<float> cutoffs;
+    cutoffs.push_back(1.0f);
+    cutoffs.push_back(1.5f);
+    cutoffs.push_back(2.0f);
+    Vec3 boxVectors[3];
+    if (triclinic) {
+        boxVectors[0] = Vec3(10, 0, 0);
+        boxVectors[1] = Vec3(4, 9, 0);
+        boxVectors[2] = Vec3(-3, -3.5, 11);
+    }
+    else {
+        boxVectors[0] = Vec3(10, 0, 0);
+        boxVectors[1] = Vec3(0, 9, 0);
+        boxVectors[2] = Vec3(0, 0, 11);
+    }
+    const float boxSize[3] = {(float) boxVectors[0][0], (float) boxVectors[1][1], (float) boxVectors[2][2]};
+    const int blockSize = 8;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    AlignedArray<float> positions(4*numParticles);
+    for (int i = 0; i < 4*numParticles; i++)
+        if (i%4 < 3)
+            positions[i] = boxSize[i%4]*genrand_real2(sfmt);
+    vector<set<int> > exclusions(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        int num = min(i+1, 10);
+        for (int j = 0; j < num; j++) {
+            exclusions[i].insert(i-j);
+            exclusions[i-j].insert(i);
+        }
+    }
+    ThreadPool threads;
+    CpuNeighborList neighborList(blockSize);
+    neighborList.computeNeighborList(numParticles, positions, exclusions, boxVectors, periodic, cutoffs, padding, threads);
+    ASSERT_EQUAL(0, neighborList.getTierIndex(0.5f));
+    ASSERT_EQUAL(1, neighborList.getTierIndex(1.5f));
+    ASSERT_EQUAL(2, neighborList.getTierIndex(3.0f));
+    int innerCount = 0, outerCount = 0;
+    for (int i = 0; i < neighborList.getNumBlocks(); i++) {
+        innerCount += neighborList.getNumBlockNeighbors(i, 0);
+        outerCount += neighborList.getNumBlockNeighbors(i, 2);
+        ASSERT_EQUAL((int) neighborList.getBlockNeighbors(i).size(), neighborList.getNumBlockNeighbors(i, 2));
+    }
+    ASSERT(innerCount < outerCount);
+    for (int tier = 0; tier < (int) cutoffs.size(); tier++) {
+        // Collect the pairs in this tier.
+
+        set<pair<int, int> > neighbors;
+        for (int i = 0; i < (int) neighborList.getSortedAtoms().size(); i++) {
+            int blockIndex = i/blockSize;
+            int indexInBlock = i-blockIndex*blockSize;
+            char mask = 1<<indexInBlock;
+            int numNeighbors = neighborList.getNumBlockNeighbors(blockIndex, tier);
+            ASSERT(numNeighbors <= (int) neighborList.getBlockNeighbors(blockIndex).size());
+            if (tier > 0)
+                ASSERT(numNeighbors >= neighborList.getNumBlockNeighbors(blockIndex, tier-1));
+            for (int j = 0; j < numNeighbors; j++) {
+                if ((neighborList.getBlockExclusions(blockIndex)[j] & mask) == 0) {
+                    int atom1 = neighborList.getSortedAtoms()[i];
+                    int atom2 = neighborList.getBlockNeighbors(blockIndex)[j];
+                    neighbors.insert(make_pair(min(atom1, atom2), max(atom1, atom2)));
+                }
+            }
+        }
+
+        // Every pair within the tier's cutoff must be included.
+
+        for (int i = 0; i < numParticles; i++)
+            for (int j = 0; j < i; j++) {
+                if (exclusions[i].find(j) != exclusions[i].end())
+                    continue;
+                Vec3 diff(positions[4*i]-positions[4*j], positions[4*i+1]-positions[4*j+1], positions[4*i+2]-positions[4*j+2]);
+                if (periodic) {
+                    diff -= boxVectors[2]*floor(diff[2]/boxSize[2]+0.5);
+                    diff -= boxVectors[1]*floor(diff[1]/boxSize[1]+0.5);
+                    diff -= boxVectors[0]*floor(diff[0]/boxSize[0]+0.5);
+                }
+                if (diff.dot(diff) < cutoffs[tier]*cutoffs[tier])
+                    ASSERT(neighbors.find(make_pair(j, i)) != neighbors.end());
+            }
+    }
+}
+
 int main() {
     try {
         if (!CpuPlatform::isProcessorSupported()) {
@@ -128,6 +214,9 @@ int main() {
         testNeighborList(false, false);
         testNeighborList(true, false);
         testNeighborList(true, true);
+        testTieredNeighborList(false, false);
+        testTieredNeighborList(true, false);
+        testTieredNeighborList(true, true);
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
@@ -31,6 +31,321 @@
 
 #include "CpuTests.h"
 #include "TestNonbondedForce.h"
+#include "openmm/internal/NonbondedForceImpl.h"
+#include <memory>
+
+void testNeighborListPadding() {
+    const int numParticles = 500;
+    const double cutoff = 1.0;
+    const double boxSize = 5.0;
+    ReferencePlatform reference;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(cutoff);
+    system.addForce(nonbonded);
+    vector<Vec3> positions(numParticles);
+    vector<Vec3> velocities(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(10.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.2 : -0.2, 0.3, 0.5);
+        positions[i] = Vec3(0.625*(i%8)+0.1*genrand_real2(sfmt), 0.625*((i/8)%8)+0.1*genrand_real2(sfmt), 0.625*(i/64)+0.1*genrand_real2(sfmt));
+        velocities[i] = Vec3(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5);
+    }
+    
+    // The default padding is chosen from the cutoff, and can be overridden.
+    
+    VerletIntegrator integrator1(0.001);
+    Context context1(system, integrator1, platform);
+    ASSERT_EQUAL_TOL(0.25*cutoff, stod(platform.getPropertyValue(context1, CpuPlatform::CpuNeighborListPadding())), 1e-6);
+    map<string, string> properties;
+    properties[CpuPlatform::CpuNeighborListPadding()] = "0.1";
+    VerletIntegrator integrator2(0.001);
+    Context context2(system, integrator2, platform, properties);
+    ASSERT_EQUAL_TOL(0.1, stod(platform.getPropertyValue(context2, CpuPlatform::CpuNeighborListPadding())), 1e-6);
+    
+    // Simulate with adaptive padding.  The padding should stay in the allowed range, the tuner should
+    // try values other than the initial one, and the forces should still match the Reference platform
+    // to within single precision accuracy.  A missed neighbor would produce errors many times larger.
+    
+    properties.clear();
+    properties[CpuPlatform::CpuAdaptivePadding()] = "true";
+    VerletIntegrator integrator3(0.002);
+    Context context3(system, integrator3, platform, properties);
+    ASSERT_EQUAL("true", platform.getPropertyValue(context3, CpuPlatform::CpuAdaptivePadding()));
+    context3.setPositions(positions);
+    context3.setVelocities(velocities);
+    VerletIntegrator integrator4(0.002);
+    Context referenceContext(system, integrator4, reference);
+    double initialPadding = stod(platform.getPropertyValue(context3, CpuPlatform::CpuNeighborListPadding()));
+    bool paddingChanged = false;
+    for (int i = 0; i < 20; i++) {
+        integrator3.step(50);
+        State state = context3.getState(State::Positions | State::Forces | State::Energy);
+        double padding = stod(platform.getPropertyValue(context3, CpuPlatform::CpuNeighborListPadding()));
+        ASSERT(padding >= 0.05*cutoff-1e-6 && padding <= 0.5*cutoff+1e-6);
+        if (fabs(padding-initialPadding) > 1e-6)
+            paddingChanged = true;
+        referenceContext.setPositions(state.getPositions());
+        State referenceState = referenceContext.getState(State::Forces | State::Energy);
+        for (int j = 0; j < numParticles; j++)
+            ASSERT_EQUAL_VEC(referenceState.getForces()[j], state.getForces()[j], 1e-3);
+        ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-3);
+    }
+    ASSERT(paddingChanged);
+}
+
+void testPmeGridAutotune() {
+    const int numParticles = 500;
+    const double boxSize = 3.5;
+    ReferencePlatform reference;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::PME);
+    nonbonded->setCutoffDistance(1.0);
+    system.addForce(nonbonded);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(10.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.2 : -0.2, 0.3, 0.5);
+        positions[i] = Vec3(0.4375*(i%8)+0.1*genrand_real2(sfmt), 0.4375*((i/8)%8)+0.1*genrand_real2(sfmt), 0.4375*(i/64)+0.1*genrand_real2(sfmt));
+    }
+    map<string, string> properties;
+    properties[CpuPlatform::CpuPmeGridAutotune()] = "true";
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform, properties);
+    ASSERT_EQUAL("true", platform.getPropertyValue(context, CpuPlatform::CpuPmeGridAutotune()));
+    context.setPositions(positions);
+    double alpha, defaultAlpha;
+    int nx, ny, nz, defaultNx, defaultNy, defaultNz;
+    NonbondedForceImpl::calcPMEParameters(system, *nonbonded, defaultAlpha, defaultNx, defaultNy, defaultNz, false);
+
+    // Each grid that is tried should give the same forces as the Reference platform using that grid, and
+    // the alpha should never change.
+
+    unique_ptr<VerletIntegrator> referenceIntegrator;
+    unique_ptr<Context> referenceContext;
+    int referenceGrid[3] = {0, 0, 0};
+    int numGrids = 0;
+    for (int i = 0; i < 100; i++) {
+        State state = context.getState(State::Positions | State::Forces | State::Energy);
+        nonbonded->getPMEParametersInContext(context, alpha, nx, ny, nz);
+        ASSERT_EQUAL_TOL(defaultAlpha, alpha, 1e-6);
+        ASSERT(nx >= defaultNx && ny >= defaultNy && nz >= defaultNz);
+        if (nx != referenceGrid[0] || ny != referenceGrid[1] || nz != referenceGrid[2]) {
+            nonbonded->setPMEParameters(alpha, nx, ny, nz);
+            referenceContext.reset();
+            referenceIntegrator.reset(new VerletIntegrator(0.001));
+            referenceContext.reset(new Context(system, *referenceIntegrator, reference));
+            referenceGrid[0] = nx;
+            referenceGrid[1] = ny;
+            referenceGrid[2] = nz;
+            numGrids++;
+        }
+        referenceContext->setPositions(state.getPositions());
+        State referenceState = referenceContext->getState(State::Forces | State::Energy);
+        for (int j = 0; j < numParticles; j++)
+            ASSERT_EQUAL_VEC(referenceState.getForces()[j], state.getForces()[j], 5e-3);
+        ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), state.getPotentialEnergy(), 5e-3);
+        integrator.step(1);
+    }
+    ASSERT(numGrids > 1);
+}
+
+void testPmeThreads() {
+    const int numParticles = 200;
+    const double boxSize = 3.0;
+    ReferencePlatform reference;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::PME);
+    nonbonded->setCutoffDistance(1.0);
+    system.addForce(nonbonded);
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    system.addForce(bonds);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.5 : -0.5, 0.3, 0.5);
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+        if (i%2 == 1) {
+            bonds->addBond(i-1, i, 0.1, 1000.0);
+            nonbonded->addException(i-1, i, 0.0, 1.0, 0.0);
+        }
+    }
+
+    // The number of dedicated threads must be less than the total.
+
+    map<string, string> properties;
+    properties[CpuPlatform::CpuThreads()] = "2";
+    properties[CpuPlatform::CpuPmeThreads()] = "2";
+    VerletIntegrator integrator1(0.001);
+    bool threwException = false;
+    try {
+        Context(system, integrator1, platform, properties);
+    }
+    catch (const exception& e) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+
+    // Splitting the threads should not change the results.
+
+    properties[CpuPlatform::CpuThreads()] = "3";
+    properties[CpuPlatform::CpuPmeThreads()] = "1";
+    VerletIntegrator integrator2(0.001);
+    Context context(system, integrator2, platform, properties);
+    ASSERT_EQUAL("3", platform.getPropertyValue(context, CpuPlatform::CpuThreads()));
+    ASSERT_EQUAL("1", platform.getPropertyValue(context, CpuPlatform::CpuPmeThreads()));
+    context.setPositions(positions);
+    VerletIntegrator integrator3(0.001);
+    Context referenceContext(system, integrator3, reference);
+    referenceContext.setPositions(positions);
+    State state = context.getState(State::Forces | State::Energy);
+    State referenceState = referenceContext.getState(State::Forces | State::Energy);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(referenceState.getForces()[i], state.getForces()[i], 5e-3);
+    ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), state.getPotentialEnergy(), 5e-3);
+}
+
+void testPmeOrder() {
+    const int numParticles = 200;
+    const double boxSize = 3.0;
+    ReferencePlatform reference;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::LJPME);
+    nonbonded->setCutoffDistance(1.0);
+    nonbonded->setEwaldErrorTolerance(1e-5);
+    system.addForce(nonbonded);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.5 : -0.5, 0.1, 0.5);
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    }
+    VerletIntegrator integrator(0.001);
+    Context referenceContext(system, integrator, reference);
+    referenceContext.setPositions(positions);
+    State referenceState = referenceContext.getState(State::Forces | State::Energy);
+    double alpha;
+    int referenceGrid[3];
+    nonbonded->getPMEParametersInContext(referenceContext, alpha, referenceGrid[0], referenceGrid[1], referenceGrid[2]);
+
+    // Orders outside the supported range should be rejected.
+
+    map<string, string> properties;
+    properties[CpuPlatform::CpuPmeOrder()] = "3";
+    VerletIntegrator integrator1(0.001);
+    bool threwException = false;
+    try {
+        Context(system, integrator1, platform, properties);
+    }
+    catch (const exception& e) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+
+    // Every supported order should give the same result to within the error tolerance.  Higher orders
+    // should use coarser grids, and lower orders finer ones.
+
+    for (int order = 4; order <= 8; order++) {
+        properties[CpuPlatform::CpuPmeOrder()] = to_string(order);
+        VerletIntegrator integrator2(0.001);
+        Context context(system, integrator2, platform, properties);
+        ASSERT_EQUAL(to_string(order), platform.getPropertyValue(context, CpuPlatform::CpuPmeOrder()));
+        context.setPositions(positions);
+        State state = context.getState(State::Forces | State::Energy);
+        for (int i = 0; i < numParticles; i++)
+            ASSERT_EQUAL_VEC(referenceState.getForces()[i], state.getForces()[i], 5e-3);
+        ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), state.getPotentialEnergy(), 5e-3);
+        int grid[3];
+        nonbonded->getPMEParametersInContext(context, alpha, grid[0], grid[1], grid[2]);
+        for (int i = 0; i < 3; i++) {
+            if (order < 5)
+                ASSERT(grid[i] > referenceGrid[i]);
+            if (order > 5)
+                ASSERT(grid[i] < referenceGrid[i]);
+        }
+    }
+}
+
+void testThreadAffinity() {
+    const int numParticles = 100;
+    const double boxSize = 2.5;
+    ReferencePlatform reference;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::PME);
+    nonbonded->setCutoffDistance(1.0);
+    system.addForce(nonbonded);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.5 : -0.5, 0.3, 0.5);
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    }
+    VerletIntegrator referenceIntegrator(0.001);
+    Context referenceContext(system, referenceIntegrator, reference);
+    referenceContext.setPositions(positions);
+    State referenceState = referenceContext.getState(State::Forces | State::Energy);
+
+    // Invalid processor lists should be rejected.
+
+    for (string value : {"abc", "2-1", "0,,1", "-1", "0-"}) {
+        map<string, string> properties;
+        properties[CpuPlatform::CpuThreadAffinity()] = value;
+        VerletIntegrator integrator(0.001);
+        bool threwException = false;
+        try {
+            Context(system, integrator, platform, properties);
+        }
+        catch (const exception& e) {
+            threwException = true;
+        }
+        ASSERT(threwException);
+    }
+
+    // Pinning the threads should not change the results, whether or not reciprocal space has its own
+    // threads.  Those threads are pinned and spin wait as well.
+
+    for (string value : {"", "Compact", "scatter", "0"})
+        for (string pmeThreads : {"0", "1"}) {
+            map<string, string> properties;
+            properties[CpuPlatform::CpuThreads()] = "3";
+            properties[CpuPlatform::CpuThreadAffinity()] = value;
+            properties[CpuPlatform::CpuPmeThreads()] = pmeThreads;
+            properties[CpuPlatform::CpuSpinWait()] = (pmeThreads == "1" ? "true" : "false");
+            VerletIntegrator integrator(0.001);
+            Context context(system, integrator, platform, properties);
+            ASSERT_EQUAL(value == "Compact" ? "compact" : value, platform.getPropertyValue(context, CpuPlatform::CpuThreadAffinity()));
+            context.setPositions(positions);
+            State state = context.getState(State::Forces | State::Energy);
+            for (int i = 0; i < numParticles; i++)
+                ASSERT_EQUAL_VEC(referenceState.getForces()[i], state.getForces()[i], 5e-3);
+            ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), state.getPotentialEnergy(), 5e-3);
+        }
+}
 
 void runPlatformTests() {
+    testNeighborListPadding();
+    testPmeGridAutotune();
+    testPmeThreads();
+    testPmeOrder();
+    testThreadAffinity();
 }
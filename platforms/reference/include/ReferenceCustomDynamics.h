@@ -30,7 +30,7 @@
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/internal/CustomIntegratorUtilities.h"
 #include "openmm/internal/CompiledExpressionSet.h"
-#include "openmm/internal/VectorExpression.h"
+#include "openmm/internal/CompiledVec3Expression.h"
 #include "lepton/CompiledExpression.h"
 
 #include <map>
@@ -45,11 +45,11 @@ private:
     class DerivFunction;
     const OpenMM::CustomIntegrator& integrator;
     std::vector<double> inverseMasses;
-    std::vector<OpenMM::Vec3> sumBuffer, oldPos;
+    std::vector<OpenMM::Vec3> sumBuffer, oldPos, uniformValues, gaussianValues;
     std::vector<OpenMM::CustomIntegrator::ComputationType> stepType;
     std::vector<std::string> stepVariable;
     std::vector<std::vector<Lepton::CompiledExpression> > stepExpressions;
-    std::vector<std::vector<VectorExpression> > stepVectorExpressions;
+    std::vector<std::vector<CompiledVec3Expression> > stepVectorExpressions;
     std::vector<CustomIntegratorUtilities::Comparison> comparisons;
     std::vector<bool> invalidatesForces, needsForces, needsEnergy, computeBothForceAndEnergy;
     std::vector<int> forceGroupFlags, blockEnd;
@@ -72,7 +72,7 @@ private:
     
     void computePerParticle(int numberOfAtoms, std::vector<OpenMM::Vec3>& results, const std::vector<OpenMM::Vec3>& atomCoordinates,
                   const std::vector<OpenMM::Vec3>& velocities, const std::vector<OpenMM::Vec3>& forces, const std::vector<double>& masses,
-                  const std::vector<std::vector<OpenMM::Vec3> >& perDof, const std::map<std::string, double>& globals, const VectorExpression& expression);
+                  const std::vector<std::vector<OpenMM::Vec3> >& perDof, const std::map<std::string, double>& globals, CompiledVec3Expression& expression);
     
     void recordChangedParameters(OpenMM::ContextImpl& context, std::map<std::string, double>& globals);
 
@@ -57,6 +57,9 @@ pme_t;
  * ngrid       Size of the full pme grid
  * pme_order   Interpolation order, almost always 4
  * epsilon_r   Dielectric coefficient, typically 1.0.
+ * use_simd_fft  If true, fourier transforms are done with SimdFFT3D instead of
+ *             fftpack.  This is faster, and agrees with fftpack to within
+ *             double precision roundoff.
  */
 int OPENMM_EXPORT
 pme_init(pme_t* ppme,
@@ -64,7 +67,8 @@ pme_init(pme_t* ppme,
          int natoms,
          const int ngrid[3],
          int pme_order,
-         double epsilon_r);
+         double epsilon_r,
+         bool use_simd_fft=false);
 
 /*
  * Evaluate reciprocal space PME energy and forces.
@@ -55,6 +55,7 @@ public:
     double evaluate(const double* arguments) const;
     double evaluateDerivative(const double* arguments, const int* derivOrder) const;
     CustomFunction* clone() const;
+    bool getUniformPolynomials(const int* derivOrder, double& min, double& max, std::vector<double>& coefficients) const;
 private:
     ReferenceContinuous1DFunction(const ReferenceContinuous1DFunction& other);
     const Continuous1DFunction& function;
@@ -159,6 +160,7 @@ public:
     double evaluate(const double* arguments) const;
     double evaluateDerivative(const double* arguments, const int* derivOrder) const;
     CustomFunction* clone() const;
+    bool getUniformPolynomials(const int* derivOrder, double& min, double& max, std::vector<double>& coefficients) const;
 private:
     std::shared_ptr<const CustomFunction> pointer;
 };
@@ -0,0 +1,130 @@
+#ifndef OPENMM_SIMDFFT3D_H_
+#define OPENMM_SIMDFFT3D_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: agent                                                             *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/internal/windowsExport.h"
+#include <complex>
+#include <functional>
+#include <vector>
+
+namespace OpenMM {
+
+class ThreadPool;
+
+/**
+ * This class performs three dimensional FFTs without depending on any external library.  It uses a
+ * mixed radix Stockham algorithm with specialized butterflies for factors of 2, 3, and 4.  Any size is
+ * supported, but sizes whose prime factors are all 2, 3, 5, or 7 are much faster than others.
+ *
+ * Single precision transforms are vectorized by transforming four lines of the grid at once, one in
+ * each lane of an fvec4.  If a ThreadPool is passed to a transform, the lines are divided between its
+ * threads.  SimdFFT3D does not create any threads of its own, so transforms run on whatever pool the
+ * caller already uses, with that pool's thread affinity and waiting behavior.  Double precision
+ * transforms are scalar and single threaded.
+ *
+ * Like FFTW, transforms are not normalized: a forward transform followed by a backward transform
+ * multiplies every element by the total number of grid points.
+ */
+class OPENMM_EXPORT SimdFFT3D {
+public:
+    /**
+     * Create a SimdFFT3D for transforming grids of a particular size.
+     *
+     * @param xsize       the size of the grid along the x axis
+     * @param ysize       the size of the grid along the y axis
+     * @param zsize       the size of the grid along the z axis.  This is the axis that varies fastest.
+     */
+    SimdFFT3D(int xsize, int ysize, int zsize);
+    ~SimdFFT3D();
+    /**
+     * Perform a forward real-to-complex transform.  The output has the same layout as the corresponding
+     * transform in FFTW: xsize*ysize*(zsize/2+1) complex values, of which only the non-negative z
+     * frequencies are stored.
+     *
+     * @param in    the real grid to transform
+     * @param out   on exit, this contains the transformed grid
+     */
+    void transformRealToComplex(const float* in, std::complex<float>* out);
+    /**
+     * Perform a forward real-to-complex transform, dividing the work between the threads of a ThreadPool.
+     * This must be called from outside the pool, while it is not executing any other task.
+     *
+     * @param in       the real grid to transform
+     * @param out      on exit, this contains the transformed grid
+     * @param threads  the ThreadPool whose threads should perform the transform
+     */
+    void transformRealToComplex(const float* in, std::complex<float>* out, ThreadPool& threads);
+    /**
+     * Perform a backward complex-to-real transform.  This is the inverse of transformRealToComplex(),
+     * apart from the normalization.
+     *
+     * @param in    the complex grid to transform, in the layout produced by transformRealToComplex()
+     * @param out   on exit, this contains the transformed real grid
+     */
+    void transformComplexToReal(const std::complex<float>* in, float* out);
+    /**
+     * Perform a backward complex-to-real transform, dividing the work between the threads of a ThreadPool.
+     * This must be called from outside the pool, while it is not executing any other task.
+     *
+     * @param in       the complex grid to transform, in the layout produced by transformRealToComplex()
+     * @param out      on exit, this contains the transformed real grid
+     * @param threads  the ThreadPool whose threads should perform the transform
+     */
+    void transformComplexToReal(const std::complex<float>* in, float* out, ThreadPool& threads);
+    /**
+     * Perform an in place complex-to-complex transform in double precision.
+     *
+     * @param data      the grid to transform, with xsize*ysize*zsize elements
+     * @param forward   true to perform a forward transform, false to perform a backward transform
+     */
+    void transformComplex(std::complex<double>* data, bool forward);
+    /**
+     * Get the smallest size greater than or equal to a minimum value whose prime factors are all
+     * 2, 3, 5, or 7.
+     */
+    static int findLegalDimension(int minimum);
+    class Plan1D;
+private:
+    void transformRealToComplex(const float* in, std::complex<float>* out, ThreadPool* threads);
+    void transformComplexToReal(const std::complex<float>* in, float* out, ThreadPool* threads);
+    void executeInParallel(ThreadPool* threads, int numTasks, const std::function<void (int, int)>& task);
+    int xsize, ysize, zsize, workspaceSize;
+    Plan1D* plan[3];
+    std::vector<std::vector<float> > threadWorkspace;
+    std::vector<std::complex<float> > complexWorkspace;
+    std::vector<double> doubleWorkspace;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_SIMDFFT3D_H_*/
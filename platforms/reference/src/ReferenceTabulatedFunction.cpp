@@ -112,6 +112,41 @@ CustomFunction* ReferenceContinuous1DFunction::clone() const {
     return new ReferenceContinuous1DFunction(*this);
 }
 
+bool ReferenceContinuous1DFunction::getUniformPolynomials(const int* derivOrder, double& minX, double& maxX, vector<double>& coefficients) const {
+    // evaluateDerivative() always returns the first derivative, so higher derivatives are left to it.
+
+    if (derivOrder[0] > 1)
+        return false;
+    minX = min;
+    maxX = max;
+    int numIntervals = values.size()-1;
+    double dx = (max-min)/numIntervals;
+    coefficients.resize(4*numIntervals);
+    for (int i = 0; i < numIntervals; i++) {
+        // Expand the spline computed by SplineFitter::evaluateSpline() in powers of the position within the interval.
+
+        double d0 = derivs[i]*dx*dx/6.0;
+        double d1 = derivs[i+1]*dx*dx/6.0;
+        double c0 = values[i];
+        double c1 = values[i+1]-values[i]-2.0*d0-d1;
+        double c2 = 3.0*d0;
+        double c3 = d1-d0;
+        if (derivOrder[0] == 0) {
+            coefficients[4*i] = c0;
+            coefficients[4*i+1] = c1;
+            coefficients[4*i+2] = c2;
+            coefficients[4*i+3] = c3;
+        }
+        else {
+            coefficients[4*i] = c1/dx;
+            coefficients[4*i+1] = 2.0*c2/dx;
+            coefficients[4*i+2] = 3.0*c3/dx;
+            coefficients[4*i+3] = 0.0;
+        }
+    }
+    return true;
+}
+
 ReferenceContinuous2DFunction::ReferenceContinuous2DFunction(const Continuous2DFunction& function) : function(function) {
     function.getFunctionParameters(xsize, ysize, values, xmin, xmax, ymin, ymax);
     x.resize(xsize);
@@ -320,3 +355,7 @@ double SharedFunctionWrapper::evaluateDerivative(const double* arguments, const
 CustomFunction* SharedFunctionWrapper::clone() const {
     return new SharedFunctionWrapper(pointer);
 }
+
+bool SharedFunctionWrapper::getUniformPolynomials(const int* derivOrder, double& min, double& max, vector<double>& coefficients) const {
+    return pointer->getUniformPolynomials(derivOrder, min, max, coefficients);
+}
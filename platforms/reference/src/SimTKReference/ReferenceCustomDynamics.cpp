@@ -87,6 +87,8 @@ ReferenceCustomDynamics::ReferenceCustomDynamics(int numberOfAtoms, const Custom
            ReferenceDynamics(numberOfAtoms, integrator.getStepSize(), 0.0), integrator(integrator) {
     sumBuffer.resize(numberOfAtoms);
     oldPos.resize(numberOfAtoms);
+    uniformValues.resize(numberOfAtoms);
+    gaussianValues.resize(numberOfAtoms);
     stepType.resize(integrator.getNumComputations());
     stepVariable.resize(integrator.getNumComputations());
     for (int i = 0; i < integrator.getNumComputations(); i++) {
@@ -147,7 +149,7 @@ void ReferenceCustomDynamics::initialize(ContextImpl& context, vector<double>& m
         for (int j = 0; j < (int) expressions[i].size(); j++) {
             ParsedExpression parsed(replaceDerivFunctions(expressions[i][j].getRootNode(), context));
             if (isVectorExpression(parsed.getRootNode()))
-                stepVectorExpressions[i].push_back(VectorExpression(parsed));
+                stepVectorExpressions[i].push_back(CompiledVec3Expression(parsed));
             else {
                 stepExpressions[i][j] = parsed.createCompiledExpression();
                 stepExpressions[i][j].setVariableLocations(variableLocations);
@@ -382,26 +384,44 @@ void ReferenceCustomDynamics::computePerDof(int numberOfAtoms, vector<Vec3>& res
 
 void ReferenceCustomDynamics::computePerParticle(int numberOfAtoms, vector<Vec3>& results, const vector<Vec3>& atomCoordinates,
               const vector<Vec3>& velocities, const vector<Vec3>& forces, const vector<double>& masses,
-              const vector<vector<Vec3> >& perDof, const map<string, double>& globals, const VectorExpression& expression) {
-    // Loop over all degrees of freedom.
+              const vector<vector<Vec3> >& perDof, const map<string, double>& globals, CompiledVec3Expression& expression) {
+    // Generate random numbers for all particles that have mass.
 
-    map<string, Vec3> variables;
-    for (auto& entry : globals)
-        variables[entry.first] = Vec3(entry.second, entry.second, entry.second);
     for (int i = 0; i < numberOfAtoms; i++) {
         if (masses[i] != 0.0) {
-            variables["m"] = Vec3(masses[i], masses[i], masses[i]);
-            variables["x"] = atomCoordinates[i];
-            variables["v"] = velocities[i];
-            variables["f"] = forces[i];
-            variables["uniform"] = Vec3(SimTKOpenMMUtilities::getUniformlyDistributedRandomNumber(),
-                    SimTKOpenMMUtilities::getUniformlyDistributedRandomNumber(), SimTKOpenMMUtilities::getUniformlyDistributedRandomNumber());
-            variables["gaussian"] = Vec3(SimTKOpenMMUtilities::getNormallyDistributedRandomNumber(),
-                    SimTKOpenMMUtilities::getNormallyDistributedRandomNumber(), SimTKOpenMMUtilities::getNormallyDistributedRandomNumber());
-            for (int j = 0; j < perDof.size(); j++)
-                variables[integrator.getPerDofVariableName(j)] = perDof[j][i];
-            results[i] = expression.evaluate(variables);
+            for (int j = 0; j < 3; j++)
+                uniformValues[i][j] = SimTKOpenMMUtilities::getUniformlyDistributedRandomNumber();
+            for (int j = 0; j < 3; j++)
+                gaussianValues[i][j] = SimTKOpenMMUtilities::getNormallyDistributedRandomNumber();
+        }
+    }
+
+    // Tell the expression where to find the variables.
+
+    for (auto& entry : globals)
+        expression.setGlobalVariable(entry.first, &entry.second);
+    expression.setPerParticleVariable("m", &masses[0]);
+    expression.setPerParticleVariable("x", &atomCoordinates[0]);
+    expression.setPerParticleVariable("v", &velocities[0]);
+    expression.setPerParticleVariable("f", &forces[0]);
+    expression.setPerParticleVariable("uniform", &uniformValues[0]);
+    expression.setPerParticleVariable("gaussian", &gaussianValues[0]);
+    for (int j = 0; j < perDof.size(); j++)
+        expression.setPerParticleVariable(integrator.getPerDofVariableName(j), &perDof[j][0]);
+
+    // Evaluate it for each block of consecutive particles that have mass.
+
+    int start = 0;
+    while (start < numberOfAtoms) {
+        if (masses[start] == 0.0) {
+            start++;
+            continue;
         }
+        int end = start+1;
+        while (end < numberOfAtoms && masses[end] != 0.0)
+            end++;
+        expression.evaluate(start, end, &results[0]);
+        start = end;
     }
 }
 
@@ -35,6 +35,7 @@
 
 #include "ReferencePME.h"
 #include "fftpack.h"
+#include "SimdFFT3D.h"
 #include "SimTKOpenMMRealType.h"
 
 using std::vector;
@@ -54,6 +55,7 @@ struct pme
                                         */
     int          ngrid[3];             /* Total grid dimensions (all data is complex!) */
     fftpack_t    fftplan;              /* Handle to fourier transform setup  */
+    SimdFFT3D*   simdfft;              /* If not NULL, used for fourier transforms in place of fftplan */
 
     int          order;                /* PME interpolation order. Almost always 4 */
 
@@ -714,6 +716,17 @@ pme_grid_interpolate_force(pme_t pme,
 
 
 
+/* Perform an in place 3D fourier transform of the charge grid */
+static void
+pme_fft_3d(pme_t pme, enum fftpack_direction dir)
+{
+    if (pme->simdfft != NULL)
+        pme->simdfft->transformComplex(reinterpret_cast<std::complex<double>*>(pme->grid), dir == FFTPACK_FORWARD);
+    else
+        fftpack_exec_3d(pme->fftplan,dir,pme->grid,pme->grid);
+}
+
+
 /* EXPORTED ROUTINES */
 
 int
@@ -722,7 +735,8 @@ pme_init(pme_t *       ppme,
          int           natoms,
          const int     ngrid[3],
          int           pme_order,
-         double        epsilon_r)
+         double        epsilon_r,
+         bool          use_simd_fft)
 {
     pme_t pme;
     int   d;
@@ -747,7 +761,16 @@ pme_init(pme_t *       ppme,
     /* Allocate charge grid storage */
     pme->grid        = (t_complex *)malloc(sizeof(t_complex)*ngrid[0]*ngrid[1]*ngrid[2]);
 
-    fftpack_init_3d(&pme->fftplan,ngrid[0],ngrid[1],ngrid[2]);
+    if (use_simd_fft)
+    {
+        pme->fftplan = NULL;
+        pme->simdfft = new SimdFFT3D(ngrid[0],ngrid[1],ngrid[2]);
+    }
+    else
+    {
+        fftpack_init_3d(&pme->fftplan,ngrid[0],ngrid[1],ngrid[2]);
+        pme->simdfft = NULL;
+    }
 
     /* Setup bspline moduli (see Essman paper) */
     pme_calculate_bsplines_moduli(pme);
@@ -790,13 +813,13 @@ int pme_exec(pme_t       pme,
     pme_grid_spread_charge(pme, charges);
 
     /* do 3d-fft */
-    fftpack_exec_3d(pme->fftplan,FFTPACK_FORWARD,pme->grid,pme->grid);
+    pme_fft_3d(pme,FFTPACK_FORWARD);
 
     /* solve in k-space */
     pme_reciprocal_convolution(pme,periodicBoxVectors,recipBoxVectors,energy);
 
     /* do 3d-invfft */
-    fftpack_exec_3d(pme->fftplan,FFTPACK_BACKWARD,pme->grid,pme->grid);
+    pme_fft_3d(pme,FFTPACK_BACKWARD);
 
     /* Get the particle forces from the grid and bsplines in the pme structure */
     pme_grid_interpolate_force(pme,recipBoxVectors,charges,forces);
@@ -834,13 +857,13 @@ int pme_exec_dpme(pme_t       pme,
     pme_grid_spread_charge(pme, c6s);
 
     /* do 3d-fft */
-    fftpack_exec_3d(pme->fftplan,FFTPACK_FORWARD,pme->grid,pme->grid);
+    pme_fft_3d(pme,FFTPACK_FORWARD);
 
     /* solve in k-space */
     dpme_reciprocal_convolution(pme,periodicBoxVectors,recipBoxVectors,energy);
 
     /* do 3d-invfft */
-    fftpack_exec_3d(pme->fftplan,FFTPACK_BACKWARD,pme->grid,pme->grid);
+    pme_fft_3d(pme,FFTPACK_BACKWARD);
 
     /* Get the particle forces from the grid and bsplines in the pme structure */
     pme_grid_interpolate_force(pme,recipBoxVectors,c6s,forces);
@@ -866,7 +889,10 @@ pme_destroy(pme_t    pme)
     free(pme->particlefraction);
     free(pme->particleindex);
 
-    fftpack_destroy(pme->fftplan);
+    if (pme->simdfft != NULL)
+        delete pme->simdfft;
+    else
+        fftpack_destroy(pme->fftplan);
 
     /* destroy structure itself */
     free(pme);
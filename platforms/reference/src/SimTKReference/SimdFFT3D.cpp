@@ -0,0 +1,484 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: agent                                                             *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "SimdFFT3D.h"
+#include "SimTKOpenMMRealType.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/internal/ThreadPool.h"
+#include "openmm/internal/vectorize.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+using namespace OpenMM;
+using namespace std;
+
+/**
+ * This holds the precomputed data for transforming lines of one length.  The transform is
+ * performed as a series of stages, one for each factor of the length.
+ */
+class SimdFFT3D::Plan1D {
+public:
+    Plan1D(int size) : size(size) {
+        // Factor the size, putting the radices we have specialized butterflies for first.
+
+        int remaining = size;
+        while (remaining%4 == 0) {
+            factors.push_back(4);
+            remaining /= 4;
+        }
+        for (int factor = 2; remaining > 1; factor++)
+            while (remaining%factor == 0) {
+                factors.push_back(factor);
+                remaining /= factor;
+            }
+        maxFactor = 1;
+        for (int factor : factors)
+            maxFactor = max(maxFactor, factor);
+
+        // Compute the twiddle factors for each stage, and the roots of unity for its butterflies.
+
+        int n = size;
+        for (int factor : factors) {
+            int m = n/factor;
+            twiddleOffset.push_back(twiddleReal.size());
+            for (int j = 0; j < m; j++)
+                for (int k = 0; k < factor; k++) {
+                    double angle = 2*M_PI*j*k/n;
+                    twiddleReal.push_back(cos(angle));
+                    twiddleImag.push_back(-sin(angle));
+                }
+            rootOffset.push_back(rootReal.size());
+            for (int k = 0; k < factor; k++) {
+                double angle = 2*M_PI*k/factor;
+                rootReal.push_back(cos(angle));
+                rootImag.push_back(-sin(angle));
+            }
+            n = m;
+        }
+        twiddleRealFloat.assign(twiddleReal.begin(), twiddleReal.end());
+        twiddleImagFloat.assign(twiddleImag.begin(), twiddleImag.end());
+        rootRealFloat.assign(rootReal.begin(), rootReal.end());
+        rootImagFloat.assign(rootImag.begin(), rootImag.end());
+    }
+    const double* getTwiddleReal(double) const {
+        return twiddleReal.data();
+    }
+    const float* getTwiddleReal(float) const {
+        return twiddleRealFloat.data();
+    }
+    const double* getTwiddleImag(double) const {
+        return twiddleImag.data();
+    }
+    const float* getTwiddleImag(float) const {
+        return twiddleImagFloat.data();
+    }
+    const double* getRootReal(double) const {
+        return rootReal.data();
+    }
+    const float* getRootReal(float) const {
+        return rootRealFloat.data();
+    }
+    const double* getRootImag(double) const {
+        return rootImag.data();
+    }
+    const float* getRootImag(float) const {
+        return rootImagFloat.data();
+    }
+    int size, maxFactor;
+    vector<int> factors, twiddleOffset, rootOffset;
+    vector<double> twiddleReal, twiddleImag, rootReal, rootImag;
+    vector<float> twiddleRealFloat, twiddleImagFloat, rootRealFloat, rootImagFloat;
+};
+
+static inline double load(const double* data) {
+    return *data;
+}
+
+static inline fvec4 load(const float* data) {
+    return fvec4(data);
+}
+
+static inline void store(double* data, double value) {
+    *data = value;
+}
+
+static inline void store(float* data, const fvec4& value) {
+    value.store(data);
+}
+
+/**
+ * Perform one stage of a Stockham transform, combining groups of p elements from x and writing
+ * them to y.  Elements are stored as L consecutive values of type R, which are processed together
+ * as a single value of type T.  The scratch array must hold 4*p*L values.
+ */
+template <class T, class R, int L>
+static void performStage(int n, int s, int p, const R* xr, const R* xi, R* yr, R* yi, const R* wr, const R* wi,
+        const R* rootr, const R* rooti, R sign, R* scratch) {
+    const int m = n/p;
+    for (int j = 0; j < m; j++) {
+        for (int q = 0; q < s; q++) {
+            if (p == 2) {
+                int i0 = L*(q+s*j);
+                int i1 = L*(q+s*(j+m));
+                T a0r = load(&xr[i0]), a0i = load(&xi[i0]);
+                T a1r = load(&xr[i1]), a1i = load(&xi[i1]);
+                store(&scratch[0], a0r+a1r);
+                store(&scratch[L], a0r-a1r);
+                store(&scratch[2*L], a0i+a1i);
+                store(&scratch[3*L], a0i-a1i);
+            }
+            else if (p == 3) {
+                const R c = (R) (0.5*sqrt(3.0))*sign;
+                T a0r = load(&xr[L*(q+s*j)]), a0i = load(&xi[L*(q+s*j)]);
+                T a1r = load(&xr[L*(q+s*(j+m))]), a1i = load(&xi[L*(q+s*(j+m))]);
+                T a2r = load(&xr[L*(q+s*(j+2*m))]), a2i = load(&xi[L*(q+s*(j+2*m))]);
+                T t1r = a1r+a2r, t1i = a1i+a2i;
+                T t2r = a1r-a2r, t2i = a1i-a2i;
+                T mr = a0r-t1r*(R) 0.5, mi = a0i-t1i*(R) 0.5;
+                T ur = t2i*c, ui = t2r*(-c);
+                store(&scratch[0], a0r+t1r);
+                store(&scratch[L], mr+ur);
+                store(&scratch[2*L], mr-ur);
+                store(&scratch[3*L], a0i+t1i);
+                store(&scratch[4*L], mi+ui);
+                store(&scratch[5*L], mi-ui);
+            }
+            else if (p == 4) {
+                T a0r = load(&xr[L*(q+s*j)]), a0i = load(&xi[L*(q+s*j)]);
+                T a1r = load(&xr[L*(q+s*(j+m))]), a1i = load(&xi[L*(q+s*(j+m))]);
+                T a2r = load(&xr[L*(q+s*(j+2*m))]), a2i = load(&xi[L*(q+s*(j+2*m))]);
+                T a3r = load(&xr[L*(q+s*(j+3*m))]), a3i = load(&xi[L*(q+s*(j+3*m))]);
+                T t0r = a0r+a2r, t0i = a0i+a2i;
+                T t1r = a0r-a2r, t1i = a0i-a2i;
+                T t2r = a1r+a3r, t2i = a1i+a3i;
+                T t3r = (a1r-a3r)*sign, t3i = (a1i-a3i)*sign;
+                store(&scratch[0], t0r+t2r);
+                store(&scratch[L], t1r+t3i);
+                store(&scratch[2*L], t0r-t2r);
+                store(&scratch[3*L], t1r-t3i);
+                store(&scratch[4*L], t0i+t2i);
+                store(&scratch[5*L], t1i-t3r);
+                store(&scratch[6*L], t0i-t2i);
+                store(&scratch[7*L], t1i+t3r);
+            }
+            else {
+                // A general butterfly for any radix.
+
+                R* ar = &scratch[2*p*L];
+                R* ai = &scratch[3*p*L];
+                for (int r = 0; r < p; r++) {
+                    store(&ar[r*L], load(&xr[L*(q+s*(j+r*m))]));
+                    store(&ai[r*L], load(&xi[L*(q+s*(j+r*m))]));
+                }
+                for (int k = 0; k < p; k++) {
+                    T br = load(&ar[0]), bi = load(&ai[0]);
+                    for (int r = 1; r < p; r++) {
+                        int root = (r*k)%p;
+                        R c = rootr[root], sn = rooti[root]*sign;
+                        T vr = load(&ar[r*L]), vi = load(&ai[r*L]);
+                        br = br + vr*c - vi*sn;
+                        bi = bi + vr*sn + vi*c;
+                    }
+                    store(&scratch[k*L], br);
+                    store(&scratch[(p+k)*L], bi);
+                }
+            }
+
+            // Apply the twiddle factors and store the results.
+
+            for (int k = 0; k < p; k++) {
+                T br = load(&scratch[k*L]), bi = load(&scratch[(p+k)*L]);
+                if (j > 0 && k > 0) {
+                    R c = wr[j*p+k], sn = wi[j*p+k]*sign;
+                    T tr = br*c - bi*sn;
+                    bi = br*sn + bi*c;
+                    br = tr;
+                }
+                int index = L*(q+s*(p*j+k));
+                store(&yr[index], br);
+                store(&yi[index], bi);
+            }
+        }
+    }
+}
+
+/**
+ * Transform L lines at once.  The values of element i are stored in re[i*L] through re[i*L+L-1] and im[i*L]
+ * through im[i*L+L-1].  The workspace must hold (4*size+4*maxFactor)*L values.
+ */
+template <class T, class R, int L>
+static void transformLines(const SimdFFT3D::Plan1D& plan, R* re, R* im, R* workspace, bool forward) {
+    R* xr = re;
+    R* xi = im;
+    R* yr = workspace;
+    R* yi = workspace+plan.size*L;
+    R* scratch = workspace+2*plan.size*L;
+    const R* twiddleReal = plan.getTwiddleReal((R) 0);
+    const R* twiddleImag = plan.getTwiddleImag((R) 0);
+    const R* rootReal = plan.getRootReal((R) 0);
+    const R* rootImag = plan.getRootImag((R) 0);
+    R sign = (forward ? 1 : -1);
+    int n = plan.size, s = 1;
+    for (int stage = 0; stage < (int) plan.factors.size(); stage++) {
+        int p = plan.factors[stage];
+        performStage<T, R, L>(n, s, p, xr, xi, yr, yi, &twiddleReal[plan.twiddleOffset[stage]], &twiddleImag[plan.twiddleOffset[stage]],
+                &rootReal[plan.rootOffset[stage]], &rootImag[plan.rootOffset[stage]], sign, scratch);
+        swap(xr, yr);
+        swap(xi, yi);
+        n /= p;
+        s *= p;
+    }
+    if (xr != re) {
+        copy(xr, xr+plan.size*L, re);
+        copy(xi, xi+plan.size*L, im);
+    }
+}
+
+/**
+ * Transform a set of lines through a complex grid.  Lines are identified by an outer and inner index.
+ * The first element of each line is at outer*outerStride+inner, and successive elements are separated
+ * by stride.  Lines with consecutive inner indices are transformed together.
+ */
+template <class T, class R, int L>
+static void transformComplexLines(const SimdFFT3D::Plan1D& plan, complex<R>* data, int task, int stride, int outerStride, int innerCount,
+        R* workspace, bool forward) {
+    int innerBatches = (innerCount+L-1)/L;
+    int outer = task/innerBatches;
+    int inner = (task%innerBatches)*L;
+    int lanes = min(L, innerCount-inner);
+    int base = outer*outerStride+inner;
+    R* re = workspace;
+    R* im = workspace+plan.size*L;
+    for (int i = 0; i < plan.size; i++)
+        for (int lane = 0; lane < L; lane++) {
+            if (lane < lanes) {
+                complex<R> value = data[base+lane+i*stride];
+                re[i*L+lane] = value.real();
+                im[i*L+lane] = value.imag();
+            }
+            else {
+                re[i*L+lane] = 0;
+                im[i*L+lane] = 0;
+            }
+        }
+    transformLines<T, R, L>(plan, re, im, workspace+2*plan.size*L, forward);
+    for (int i = 0; i < plan.size; i++)
+        for (int lane = 0; lane < lanes; lane++)
+            data[base+lane+i*stride] = complex<R>(re[i*L+lane], im[i*L+lane]);
+}
+
+SimdFFT3D::SimdFFT3D(int xsize, int ysize, int zsize) : xsize(xsize), ysize(ysize), zsize(zsize) {
+    if (xsize < 1 || ysize < 1 || zsize < 1)
+        throw OpenMMException("SimdFFT3D: Illegal grid size");
+    plan[0] = new Plan1D(xsize);
+    plan[1] = new Plan1D(ysize);
+    plan[2] = new Plan1D(zsize);
+    int maxSize = max(max(xsize, ysize), zsize);
+    int maxFactor = max(max(plan[0]->maxFactor, plan[1]->maxFactor), plan[2]->maxFactor);
+    workspaceSize = 4*(4*maxSize+4*maxFactor);
+    threadWorkspace.resize(1, vector<float>(workspaceSize));
+}
+
+SimdFFT3D::~SimdFFT3D() {
+    for (int i = 0; i < 3; i++)
+        delete plan[i];
+}
+
+void SimdFFT3D::executeInParallel(ThreadPool* threads, int numTasks, const function<void (int, int)>& task) {
+    if (threads == NULL || threads->getNumThreads() == 1) {
+        for (int i = 0; i < numTasks; i++)
+            task(i, 0);
+        return;
+    }
+    if ((int) threadWorkspace.size() < threads->getNumThreads())
+        threadWorkspace.resize(threads->getNumThreads(), vector<float>(workspaceSize));
+    atomic<int> counter(0);
+    threads->execute([&] (ThreadPool& pool, int threadIndex) {
+        while (true) {
+            int i = counter++;
+            if (i >= numTasks)
+                break;
+            task(i, threadIndex);
+        }
+    });
+    threads->waitForThreads();
+}
+
+void SimdFFT3D::transformRealToComplex(const float* in, complex<float>* out) {
+    transformRealToComplex(in, out, (ThreadPool*) NULL);
+}
+
+void SimdFFT3D::transformRealToComplex(const float* in, complex<float>* out, ThreadPool& threads) {
+    transformRealToComplex(in, out, &threads);
+}
+
+void SimdFFT3D::transformComplexToReal(const complex<float>* in, float* out) {
+    transformComplexToReal(in, out, (ThreadPool*) NULL);
+}
+
+void SimdFFT3D::transformComplexToReal(const complex<float>* in, float* out, ThreadPool& threads) {
+    transformComplexToReal(in, out, &threads);
+}
+
+void SimdFFT3D::transformRealToComplex(const float* in, complex<float>* out, ThreadPool* threads) {
+    // Transform along z.  Each lane transforms two real lines at once, one in the real part and one in
+    // the imaginary part, which are then separated using the symmetry of their transforms.
+
+    const int L = 4;
+    const int zsizeHalf = zsize/2+1;
+    const int numLines = xsize*ysize;
+    executeInParallel(threads, (numLines+2*L-1)/(2*L), [&] (int task, int threadIndex) {
+        float* re = threadWorkspace[threadIndex].data();
+        float* im = re+zsize*L;
+        for (int lane = 0; lane < L; lane++) {
+            int line1 = 2*(task*L+lane);
+            int line2 = line1+1;
+            for (int i = 0; i < zsize; i++) {
+                re[i*L+lane] = (line1 < numLines ? in[line1*zsize+i] : 0.0f);
+                im[i*L+lane] = (line2 < numLines ? in[line2*zsize+i] : 0.0f);
+            }
+        }
+        transformLines<fvec4, float, L>(*plan[2], re, im, im+zsize*L, true);
+        for (int lane = 0; lane < L; lane++) {
+            int line1 = 2*(task*L+lane);
+            int line2 = line1+1;
+            for (int k = 0; k < zsizeHalf; k++) {
+                int k2 = (zsize-k)%zsize;
+                float zr = re[k*L+lane], zi = im[k*L+lane];
+                float zr2 = re[k2*L+lane], zi2 = im[k2*L+lane];
+                if (line1 < numLines)
+                    out[line1*zsizeHalf+k] = complex<float>(0.5f*(zr+zr2), 0.5f*(zi-zi2));
+                if (line2 < numLines)
+                    out[line2*zsizeHalf+k] = complex<float>(0.5f*(zi+zi2), -0.5f*(zr-zr2));
+            }
+        }
+    });
+
+    // Transform along y and x.
+
+    int zBatches = (zsizeHalf+L-1)/L;
+    executeInParallel(threads, xsize*zBatches, [&] (int task, int threadIndex) {
+        transformComplexLines<fvec4, float, L>(*plan[1], out, task, zsizeHalf, ysize*zsizeHalf, zsizeHalf, threadWorkspace[threadIndex].data(), true);
+    });
+    int yzBatches = (ysize*zsizeHalf+L-1)/L;
+    executeInParallel(threads, yzBatches, [&] (int task, int threadIndex) {
+        transformComplexLines<fvec4, float, L>(*plan[0], out, task, ysize*zsizeHalf, 0, ysize*zsizeHalf, threadWorkspace[threadIndex].data(), true);
+    });
+}
+
+void SimdFFT3D::transformComplexToReal(const complex<float>* in, float* out, ThreadPool* threads) {
+    // Transform along x and y, working in a copy of the input so it is not modified.
+
+    const int L = 4;
+    const int zsizeHalf = zsize/2+1;
+    complexWorkspace.assign(in, in+xsize*ysize*zsizeHalf);
+    complex<float>* grid = complexWorkspace.data();
+    int yzBatches = (ysize*zsizeHalf+L-1)/L;
+    executeInParallel(threads, yzBatches, [&] (int task, int threadIndex) {
+        transformComplexLines<fvec4, float, L>(*plan[0], grid, task, ysize*zsizeHalf, 0, ysize*zsizeHalf, threadWorkspace[threadIndex].data(), false);
+    });
+    int zBatches = (zsizeHalf+L-1)/L;
+    executeInParallel(threads, xsize*zBatches, [&] (int task, int threadIndex) {
+        transformComplexLines<fvec4, float, L>(*plan[1], grid, task, zsizeHalf, ysize*zsizeHalf, zsizeHalf, threadWorkspace[threadIndex].data(), false);
+    });
+
+    // Transform along z.  The full spectrum of each line is reconstructed from its symmetry, and two
+    // lines whose transforms are real are computed at once in the real and imaginary parts of each lane.
+
+    const int numLines = xsize*ysize;
+    executeInParallel(threads, (numLines+2*L-1)/(2*L), [&] (int task, int threadIndex) {
+        float* re = threadWorkspace[threadIndex].data();
+        float* im = re+zsize*L;
+        for (int lane = 0; lane < L; lane++) {
+            int line1 = 2*(task*L+lane);
+            int line2 = line1+1;
+            for (int k = 0; k < zsize; k++) {
+                complex<float> a, b;
+                if (k < zsizeHalf) {
+                    if (line1 < numLines)
+                        a = grid[line1*zsizeHalf+k];
+                    if (line2 < numLines)
+                        b = grid[line2*zsizeHalf+k];
+                }
+                else {
+                    if (line1 < numLines)
+                        a = conj(grid[line1*zsizeHalf+zsize-k]);
+                    if (line2 < numLines)
+                        b = conj(grid[line2*zsizeHalf+zsize-k]);
+                }
+                re[k*L+lane] = a.real()-b.imag();
+                im[k*L+lane] = a.imag()+b.real();
+            }
+        }
+        transformLines<fvec4, float, L>(*plan[2], re, im, im+zsize*L, false);
+        for (int lane = 0; lane < L; lane++) {
+            int line1 = 2*(task*L+lane);
+            int line2 = line1+1;
+            for (int i = 0; i < zsize; i++) {
+                if (line1 < numLines)
+                    out[line1*zsize+i] = re[i*L+lane];
+                if (line2 < numLines)
+                    out[line2*zsize+i] = im[i*L+lane];
+            }
+        }
+    });
+}
+
+void SimdFFT3D::transformComplex(complex<double>* data, bool forward) {
+    int maxSize = max(max(xsize, ysize), zsize);
+    int maxFactor = max(max(plan[0]->maxFactor, plan[1]->maxFactor), plan[2]->maxFactor);
+    doubleWorkspace.resize(4*maxSize+4*maxFactor);
+    double* workspace = doubleWorkspace.data();
+    for (int task = 0; task < xsize*ysize; task++)
+        transformComplexLines<double, double, 1>(*plan[2], data, task, 1, zsize, 1, workspace, forward);
+    for (int task = 0; task < xsize*zsize; task++)
+        transformComplexLines<double, double, 1>(*plan[1], data, task, zsize, ysize*zsize, zsize, workspace, forward);
+    for (int task = 0; task < ysize*zsize; task++)
+        transformComplexLines<double, double, 1>(*plan[0], data, task, ysize*zsize, 0, ysize*zsize, workspace, forward);
+}
+
+int SimdFFT3D::findLegalDimension(int minimum) {
+    if (minimum < 1)
+        return 1;
+    while (true) {
+        // Attempt to factor the current value.
+
+        int unfactored = minimum;
+        for (int factor = 2; factor < 8; factor++) {
+            while (unfactored > 1 && unfactored%factor == 0)
+                unfactored /= factor;
+        }
+        if (unfactored == 1)
+            return minimum;
+        minimum++;
+    }
+}
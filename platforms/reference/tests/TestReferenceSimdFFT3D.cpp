@@ -0,0 +1,189 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: agent                                                             *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+/**
+ * This tests the built in FFT implementation.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/internal/ThreadPool.h"
+#include "ReferencePME.h"
+#include "SimdFFT3D.h"
+#include "SimTKOpenMMRealType.h"
+#include "sfmt/SFMT.h"
+#include <complex>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+using namespace OpenMM;
+
+/**
+ * Compute a 3D DFT directly from the definition.
+ */
+vector<complex<double> > computeDFT(const vector<complex<double> >& data, int xsize, int ysize, int zsize, bool forward) {
+    double sign = (forward ? -1.0 : 1.0);
+    vector<complex<double> > result(data.size());
+    for (int kx = 0; kx < xsize; kx++)
+        for (int ky = 0; ky < ysize; ky++)
+            for (int kz = 0; kz < zsize; kz++) {
+                complex<double> sum = 0;
+                for (int x = 0; x < xsize; x++)
+                    for (int y = 0; y < ysize; y++)
+                        for (int z = 0; z < zsize; z++) {
+                            double phase = 2*M_PI*((double) kx*x/xsize + (double) ky*y/ysize + (double) kz*z/zsize);
+                            sum += data[(x*ysize+y)*zsize+z]*polar(1.0, sign*phase);
+                        }
+                result[(kx*ysize+ky)*zsize+kz] = sum;
+            }
+    return result;
+}
+
+void testRealTransform(int xsize, int ysize, int zsize, int numThreads) {
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    int zsizeHalf = zsize/2+1;
+    vector<float> real(xsize*ysize*zsize);
+    vector<complex<double> > expected(real.size());
+    for (int i = 0; i < real.size(); i++) {
+        real[i] = (float) (genrand_real2(sfmt)-0.5);
+        expected[i] = real[i];
+    }
+    expected = computeDFT(expected, xsize, ysize, zsize, true);
+    SimdFFT3D fft(xsize, ysize, zsize);
+    ThreadPool threads(numThreads);
+    vector<complex<float> > transformed(xsize*ysize*zsizeHalf);
+    if (numThreads == 1)
+        fft.transformRealToComplex(real.data(), transformed.data());
+    else
+        fft.transformRealToComplex(real.data(), transformed.data(), threads);
+    for (int x = 0; x < xsize; x++)
+        for (int y = 0; y < ysize; y++)
+            for (int z = 0; z < zsizeHalf; z++) {
+                complex<double> value = expected[(x*ysize+y)*zsize+z];
+                complex<float> computed = transformed[(x*ysize+y)*zsizeHalf+z];
+                ASSERT_EQUAL_TOL(value.real(), computed.real(), 1e-4);
+                ASSERT_EQUAL_TOL(value.imag(), computed.imag(), 1e-4);
+            }
+
+    // Transforming back should give the original values scaled by the grid size.
+
+    vector<float> inverse(real.size());
+    if (numThreads == 1)
+        fft.transformComplexToReal(transformed.data(), inverse.data());
+    else
+        fft.transformComplexToReal(transformed.data(), inverse.data(), threads);
+    for (int i = 0; i < real.size(); i++)
+        ASSERT_EQUAL_TOL(real[i]*real.size(), inverse[i], 1e-4);
+}
+
+void testComplexTransform(int xsize, int ysize, int zsize) {
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<complex<double> > data(xsize*ysize*zsize);
+    for (auto& value : data)
+        value = complex<double>(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5);
+    SimdFFT3D fft(xsize, ysize, zsize);
+    for (bool forward : {true, false}) {
+        vector<complex<double> > expected = computeDFT(data, xsize, ysize, zsize, forward);
+        vector<complex<double> > transformed = data;
+        fft.transformComplex(transformed.data(), forward);
+        for (int i = 0; i < data.size(); i++) {
+            ASSERT_EQUAL_TOL(expected[i].real(), transformed[i].real(), 1e-10);
+            ASSERT_EQUAL_TOL(expected[i].imag(), transformed[i].imag(), 1e-10);
+        }
+    }
+}
+
+void testReferencePME() {
+    // Compute reciprocal space PME with both fftpack and SimdFFT3D, and make sure they agree.
+
+    const int numParticles = 100;
+    const double boxWidth = 3.0;
+    const double alpha = 3.0;
+    const int grid[3] = {24, 21, 25};
+    Vec3 boxVectors[3] = {Vec3(boxWidth, 0, 0), Vec3(0.3, boxWidth, 0), Vec3(-0.2, 0.4, boxWidth)};
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<Vec3> positions(numParticles);
+    vector<double> charges(numParticles), c6s(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        positions[i] = Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*boxWidth;
+        charges[i] = (i%2 == 0 ? 1.0 : -1.0)*genrand_real2(sfmt);
+        c6s[i] = genrand_real2(sfmt);
+    }
+    for (bool dispersion : {false, true}) {
+        vector<Vec3> forces[2];
+        double energy[2];
+        for (int i = 0; i < 2; i++) {
+            pme_t pme;
+            pme_init(&pme, alpha, numParticles, grid, 5, 1.0, i == 1);
+            forces[i].resize(numParticles);
+            energy[i] = 0.0;
+            if (dispersion)
+                pme_exec_dpme(pme, positions, forces[i], c6s, boxVectors, &energy[i]);
+            else
+                pme_exec(pme, positions, forces[i], charges, boxVectors, &energy[i]);
+            pme_destroy(pme);
+        }
+        ASSERT_EQUAL_TOL(energy[0], energy[1], 1e-10);
+        for (int i = 0; i < numParticles; i++)
+            ASSERT_EQUAL_VEC(forces[0][i], forces[1][i], 1e-10);
+    }
+}
+
+void testLegalDimension() {
+    ASSERT_EQUAL(1, SimdFFT3D::findLegalDimension(0));
+    ASSERT_EQUAL(10, SimdFFT3D::findLegalDimension(10));
+    ASSERT_EQUAL(12, SimdFFT3D::findLegalDimension(11));
+    ASSERT_EQUAL(14, SimdFFT3D::findLegalDimension(13));
+    ASSERT_EQUAL(35, SimdFFT3D::findLegalDimension(34));
+}
+
+int main() {
+    try {
+        testRealTransform(8, 6, 10, 1);
+        testRealTransform(7, 9, 12, 3);
+        testRealTransform(5, 11, 15, 2);
+        testRealTransform(3, 4, 1, 1);
+        testComplexTransform(8, 6, 10);
+        testComplexTransform(7, 9, 13);
+        testLegalDimension();
+        testReferencePME();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
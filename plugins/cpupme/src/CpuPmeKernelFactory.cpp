@@ -28,7 +28,10 @@
 #include "CpuPmeKernels.h"
 #include "internal/windowsExportPme.h"
 #include "openmm/internal/ContextImpl.h"
+#include "openmm/internal/ThreadPool.h"
 #include "openmm/OpenMMException.h"
+#include <algorithm>
+#include <cstdlib>
 
 using namespace OpenMM;
 
@@ -55,9 +58,44 @@ extern "C" OPENMM_EXPORT_PME void registerPlatforms() {
 #endif
 
 KernelImpl* CpuPmeKernelFactory::createKernelImpl(std::string name, const Platform& platform, ContextImpl& context) const {
+    // Platforms that support it let the user specify a file for storing FFTW wisdom, which FFT
+    // implementation to use, how many threads to use, the interpolation order, and how the threads
+    // should wait and be placed on processors.
+
+    std::string wisdomFile, fft, affinity;
+    int numThreads = 0, order = 5;
+    bool spinWait = false;
+    const std::vector<std::string>& properties = platform.getPropertyNames();
+    if (std::find(properties.begin(), properties.end(), "PmeWisdomFile") != properties.end())
+        wisdomFile = platform.getPropertyValue(context.getOwner(), "PmeWisdomFile");
+    if (std::find(properties.begin(), properties.end(), "PmeFFT") != properties.end())
+        fft = platform.getPropertyValue(context.getOwner(), "PmeFFT");
+    if (std::find(properties.begin(), properties.end(), "PmeThreads") != properties.end())
+        numThreads = std::atoi(platform.getPropertyValue(context.getOwner(), "PmeThreads").c_str());
+    if (std::find(properties.begin(), properties.end(), "PmeOrder") != properties.end())
+        order = std::atoi(platform.getPropertyValue(context.getOwner(), "PmeOrder").c_str());
+    if (std::find(properties.begin(), properties.end(), "SpinWait") != properties.end())
+        spinWait = (platform.getPropertyValue(context.getOwner(), "SpinWait") == "true");
+    if (std::find(properties.begin(), properties.end(), "ThreadAffinity") != properties.end())
+        affinity = platform.getPropertyValue(context.getOwner(), "ThreadAffinity");
+    std::vector<int> cpuAffinity;
+    if (!ThreadPool::getCpuAffinity(affinity, cpuAffinity))
+        throw OpenMMException("Illegal value for ThreadAffinity: "+affinity);
+    if (numThreads > 0 && cpuAffinity.size() > 0 && std::find(properties.begin(), properties.end(), "Threads") != properties.end()) {
+        // The PME threads run at the same time as the other ones, so place them on the processors that
+        // follow the ones used by the main thread pool.
+
+        int mainThreads = std::atoi(platform.getPropertyValue(context.getOwner(), "Threads").c_str())-numThreads;
+        std::rotate(cpuAffinity.begin(), cpuAffinity.begin()+(mainThreads%cpuAffinity.size()), cpuAffinity.end());
+    }
+#ifndef OPENMM_PME_USE_FFTW
+    if (fft == "FFTW")
+        throw OpenMMException("PmeFFT was set to FFTW, but OpenMM was compiled without FFTW");
+#endif
+    bool useBuiltinFFT = (fft == "Builtin");
     if (name == CalcPmeReciprocalForceKernel::Name())
-        return new CpuCalcPmeReciprocalForceKernel(name, platform);
+        return new CpuCalcPmeReciprocalForceKernel(name, platform, wisdomFile, useBuiltinFFT, numThreads, order, spinWait, cpuAffinity);
     if (name == CalcDispersionPmeReciprocalForceKernel::Name())
-        return new CpuCalcDispersionPmeReciprocalForceKernel(name, platform);
+        return new CpuCalcDispersionPmeReciprocalForceKernel(name, platform, wisdomFile, useBuiltinFFT, numThreads, order, spinWait, cpuAffinity);
     throw OpenMMException((std::string("Tried to create kernel with illegal kernel name '")+name+"'").c_str());
 }
@@ -39,123 +39,361 @@
 #include "openmm/OpenMMException.h"
 #include <cmath>
 #include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <cstdlib>
+#include <tuple>
 
 using namespace OpenMM;
 using namespace std;
 
-static const int PME_ORDER = 5;
-
 bool CpuCalcDispersionPmeReciprocalForceKernel::hasInitializedThreads = false;
-int CpuCalcDispersionPmeReciprocalForceKernel::numThreads = 0;
+int CpuCalcDispersionPmeReciprocalForceKernel::defaultNumThreads = 0;
 
-static void spreadCharge(float* posq, float* grid, int gridx, int gridy, int gridz, int numParticles, Vec3* periodicBoxVectors, Vec3* recipBoxVectors,
-        atomic<int>& atomicCounter, const float epsilonFactor, int threadIndex, int numThreads, bool deterministic) {
-    float temp[4];
+#ifdef OPENMM_PME_USE_FFTW
+/**
+ * FFTW plans are shared between all kernels that use the same grid size and number of threads, so
+ * creating many Contexts for the same system only pays for planning once.  The FFTW planner is not
+ * thread safe, so every call to it is guarded by planLock.
+ */
+struct SharedFFTPlans {
+    fftwf_plan forwardFFT, backwardFFT;
+    int refCount;
+};
+static mutex planLock;
+static map<tuple<int, int, int, int>, SharedFFTPlans> sharedPlans;
+static set<string> loadedWisdomFiles;
+
+/**
+ * Write all accumulated FFTW wisdom to a file.  It is first written to a temporary file which is then
+ * renamed, so other processes sharing the file never see it partially written.
+ */
+static void saveWisdom(const string& wisdomFile) {
+    stringstream tempFile;
+    tempFile << wisdomFile << ".tmp" << chrono::steady_clock::now().time_since_epoch().count();
+    if (!fftwf_export_wisdom_to_filename(tempFile.str().c_str()))
+        return;
+    if (rename(tempFile.str().c_str(), wisdomFile.c_str()) != 0) {
+        remove(wisdomFile.c_str());
+        if (rename(tempFile.str().c_str(), wisdomFile.c_str()) != 0)
+            remove(tempFile.str().c_str());
+    }
+}
+
+/**
+ * Get the forward and backward FFT plans for a grid, creating them if no other kernel is already using them.
+ * If wisdomFile is not empty, wisdom is loaded from it before planning, and any new wisdom is saved to it.
+ */
+static void acquireFFTPlans(int gridx, int gridy, int gridz, int numThreads, float* realGrid, fftwf_complex* complexGrid,
+        const string& wisdomFile, fftwf_plan& forwardFFT, fftwf_plan& backwardFFT) {
+    lock_guard<mutex> guard(planLock);
+    tuple<int, int, int, int> key = make_tuple(gridx, gridy, gridz, numThreads);
+    auto plans = sharedPlans.find(key);
+    if (plans != sharedPlans.end()) {
+        plans->second.refCount++;
+        forwardFFT = plans->second.forwardFFT;
+        backwardFFT = plans->second.backwardFFT;
+        return;
+    }
+    if (wisdomFile.size() > 0 && loadedWisdomFiles.find(wisdomFile) == loadedWisdomFiles.end()) {
+        fftwf_import_wisdom_from_filename(wisdomFile.c_str()); // If the file does not exist yet, it will be created below.
+        loadedWisdomFiles.insert(wisdomFile);
+    }
+    fftwf_plan_with_nthreads(numThreads);
+    forwardFFT = fftwf_plan_dft_r2c_3d(gridx, gridy, gridz, realGrid, complexGrid, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+    backwardFFT = fftwf_plan_dft_c2r_3d(gridx, gridy, gridz, complexGrid, realGrid, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+    bool hasNewWisdom = false;
+    if (forwardFFT == NULL) {
+        forwardFFT = fftwf_plan_dft_r2c_3d(gridx, gridy, gridz, realGrid, complexGrid, FFTW_MEASURE);
+        hasNewWisdom = true;
+    }
+    if (backwardFFT == NULL) {
+        backwardFFT = fftwf_plan_dft_c2r_3d(gridx, gridy, gridz, complexGrid, realGrid, FFTW_MEASURE);
+        hasNewWisdom = true;
+    }
+    SharedFFTPlans& newPlans = sharedPlans[key];
+    newPlans.forwardFFT = forwardFFT;
+    newPlans.backwardFFT = backwardFFT;
+    newPlans.refCount = 1;
+    if (hasNewWisdom && wisdomFile.size() > 0)
+        saveWisdom(wisdomFile);
+}
+
+/**
+ * Release the FFT plans for a grid, destroying them once no kernel is using them.  FFTW keeps the wisdom
+ * from them in memory, so planning the same grid again later in the process is still fast.
+ */
+static void releaseFFTPlans(int gridx, int gridy, int gridz, int numThreads) {
+    lock_guard<mutex> guard(planLock);
+    auto plans = sharedPlans.find(make_tuple(gridx, gridy, gridz, numThreads));
+    if (--plans->second.refCount == 0) {
+        fftwf_destroy_plan(plans->second.forwardFFT);
+        fftwf_destroy_plan(plans->second.backwardFFT);
+        sharedPlans.erase(plans);
+    }
+}
+
+#endif
+
+static void* allocateGrid(size_t size) {
+#ifdef OPENMM_PME_USE_FFTW
+    return fftwf_malloc(size);
+#else
+    return malloc(size);
+#endif
+}
+
+static void freeGrid(void* grid) {
+#ifdef OPENMM_PME_USE_FFTW
+    fftwf_free(grid);
+#else
+    free(grid);
+#endif
+}
+
+/**
+ * Allocate the charge grids.  This is called from the main thread of a kernel once its thread pool exists.
+ * Each worker allocates and clears its own slab, and clears the planes of the real and complex grids it
+ * later sums into and convolves, so on NUMA systems first touch places that memory near the thread
+ * that uses it.
+ */
+static void allocateGrids(ThreadPool& threads, int gridx, int gridy, int gridz, int order, vector<vector<float> >& slabGrid,
+        float*& realGrid, complex<float>*& complexGrid) {
+    int numThreads = threads.getNumThreads();
+    int realSize = gridx*gridy*gridz+3;
+    int complexSize = gridx*gridy*(gridz/2+1);
+    realGrid = (float*) allocateGrid(sizeof(float)*realSize);
+    complexGrid = (complex<float>*) allocateGrid(sizeof(complex<float>)*complexSize);
+    threads.execute([&] (ThreadPool& threads, int index) {
+        int slabStart = (index*gridx)/numThreads;
+        int slabEnd = ((index+1)*gridx)/numThreads;
+        if (slabEnd > slabStart)
+            slabGrid[index].resize((slabEnd-slabStart+order-1)*gridy*gridz);
+        int realStart = slabStart*gridy*gridz;
+        int realEnd = (index == numThreads-1 ? realSize : slabEnd*gridy*gridz);
+        memset(&realGrid[realStart], 0, sizeof(float)*(realEnd-realStart));
+        int complexStart = (index*complexSize)/numThreads;
+        int complexEnd = ((index+1)*complexSize)/numThreads;
+        memset(&complexGrid[complexStart], 0, sizeof(complex<float>)*(complexEnd-complexStart));
+    });
+    threads.waitForThreads();
+}
+
+/**
+ * Find the index of the first grid point an atom's charge is spread to along each axis, and the
+ * fractional offset of the atom from it.
+ */
+static inline ivec4 findGridIndex(const float* atomPos, const fvec4& boxSize, const fvec4& invBoxSize, const fvec4* recipBoxVec,
+        const fvec4& gridSize, const ivec4& gridSizeInt, fvec4& dr) {
+    fvec4 pos(atomPos);
+    float posInBox[4];
+    (pos-boxSize*floor(pos*invBoxSize)).store(posInBox);
+    fvec4 t = posInBox[0]*recipBoxVec[0] + posInBox[1]*recipBoxVec[1] + posInBox[2]*recipBoxVec[2];
+    t = (t-floor(t))*gridSize;
+    ivec4 ti = t;
+    dr = t-ti;
+    return ti-(gridSizeInt&ti==gridSizeInt);
+}
+
+/**
+ * Sort a range of atoms into lists based on which slab of the grid they start spreading charge to.
+ * Each slab is a range of planes along the x axis.
+ */
+static void findSlabAtoms(float* posq, int start, int end, int gridx, int gridy, int gridz, Vec3* periodicBoxVectors, Vec3* recipBoxVectors,
+        const vector<int>& planeSlab, vector<vector<int> >& slabAtoms) {
     fvec4 boxSize((float) periodicBoxVectors[0][0], (float) periodicBoxVectors[1][1], (float) periodicBoxVectors[2][2], 0);
     fvec4 invBoxSize((float) recipBoxVectors[0][0], (float) recipBoxVectors[1][1], (float) recipBoxVectors[2][2], 0);
-    fvec4 recipBoxVec0((float) recipBoxVectors[0][0], (float) recipBoxVectors[0][1], (float) recipBoxVectors[0][2], 0);
-    fvec4 recipBoxVec1((float) recipBoxVectors[1][0], (float) recipBoxVectors[1][1], (float) recipBoxVectors[1][2], 0);
-    fvec4 recipBoxVec2((float) recipBoxVectors[2][0], (float) recipBoxVectors[2][1], (float) recipBoxVectors[2][2], 0);
+    fvec4 recipBoxVec[3];
+    for (int i = 0; i < 3; i++)
+        recipBoxVec[i] = fvec4((float) recipBoxVectors[i][0], (float) recipBoxVectors[i][1], (float) recipBoxVectors[i][2], 0);
     fvec4 gridSize(gridx, gridy, gridz, 0);
     ivec4 gridSizeInt(gridx, gridy, gridz, 0);
-    fvec4 one(1);
-    fvec4 scale(1.0f/(PME_ORDER-1));
-    float posInBox[4] = {0,0,0,0};
-    memset(grid, 0, sizeof(float)*gridx*gridy*gridz);
+    for (auto& atoms : slabAtoms)
+        atoms.clear();
+    for (int i = start; i < end; i++) {
+        fvec4 dr;
+        int gridIndexX = findGridIndex(&posq[4*i], boxSize, invBoxSize, recipBoxVec, gridSize, gridSizeInt, dr)[0];
+        if (gridIndexX < 0 || gridIndexX >= gridx)
+            continue; // This happens when a simulation blows up and coordinates become NaN.
+        slabAtoms[planeSlab[gridIndexX]].push_back(i);
+    }
+}
 
-    int i = threadIndex;
-    while (true) {
-        if (!deterministic)
-            i = atomicCounter++;
-        if (i >= numParticles)
-            break;
+/**
+ * Compute the B-spline coefficients for an atom along all three axes at once, given its fractional offset
+ * from the first grid point.  If ddata is not NULL, the derivatives of the coefficients are stored in it.
+ */
+template <int ORDER>
+static inline void computeBSplines(const fvec4& dr, fvec4* data, fvec4* ddata) {
+    fvec4 one(1);
+    fvec4 scale(1.0f/(ORDER-1));
+    data[ORDER-1] = 0.0f;
+    data[1] = dr;
+    data[0] = one-dr;
+    for (int j = 3; j < ORDER; j++) {
+        fvec4 div(1.0f/(j-1));
+        data[j-1] = div*dr*data[j-2];
+        for (int k = 1; k < j-1; k++)
+            data[j-k-1] = div*((dr+k)*data[j-k-2]+(fvec4(j-k)-dr)*data[j-k-1]);
+        data[0] = div*(one-dr)*data[0];
+    }
+    if (ddata != NULL) {
+        ddata[0] = -data[0];
+        for (int j = 1; j < ORDER; j++)
+            ddata[j] = data[j-1]-data[j];
+    }
+    data[ORDER-1] = scale*dr*data[ORDER-2];
+    for (int j = 1; j < (ORDER-1); j++)
+        data[ORDER-j-1] = scale*((dr+j)*data[ORDER-j-2]+(fvec4(ORDER-j)-dr)*data[ORDER-j-1]);
+    data[0] = scale*(one-dr)*data[0];
+}
 
-        // Find the position relative to the nearest grid point.
+/**
+ * Spread the charges of atoms into one slab of the grid.  The slab grid holds the planes starting at
+ * firstPlane, including the extra planes at the end that atoms near the edge of the slab spill into.
+ * The atoms to spread are taken from every thread's list for this slab.
+ *
+ * The interpolation order is a template parameter so the loops over grid points can be fully unrolled.
+ * Along the z axis, the points are added in blocks of four with SIMD operations, followed by the
+ * ORDER%4 that remain.
+ */
+template <int ORDER>
+static void spreadCharge(float* posq, float* grid, int gridx, int gridy, int gridz, int firstPlane, int numPlanes,
+        const vector<vector<vector<int> > >& slabAtoms, int slab, Vec3* periodicBoxVectors, Vec3* recipBoxVectors, const float epsilonFactor) {
+    const int numZBlocks = ORDER/4;
+    const int numZRemaining = ORDER%4;
+    float temp[4];
+    fvec4 boxSize((float) periodicBoxVectors[0][0], (float) periodicBoxVectors[1][1], (float) periodicBoxVectors[2][2], 0);
+    fvec4 invBoxSize((float) recipBoxVectors[0][0], (float) recipBoxVectors[1][1], (float) recipBoxVectors[2][2], 0);
+    fvec4 recipBoxVec[3];
+    for (int i = 0; i < 3; i++)
+        recipBoxVec[i] = fvec4((float) recipBoxVectors[i][0], (float) recipBoxVectors[i][1], (float) recipBoxVectors[i][2], 0);
+    fvec4 gridSize(gridx, gridy, gridz, 0);
+    ivec4 gridSizeInt(gridx, gridy, gridz, 0);
+    memset(grid, 0, sizeof(float)*numPlanes*gridy*gridz);
+    for (auto& threadAtoms : slabAtoms) {
+        for (int i : threadAtoms[slab]) {
+            // Find the position relative to the nearest grid point.
 
-        fvec4 pos(&posq[4*i]);
-        (pos-boxSize*floor(pos*invBoxSize)).store(posInBox);
-        fvec4 t = posInBox[0]*recipBoxVec0 + posInBox[1]*recipBoxVec1 + posInBox[2]*recipBoxVec2;
-        t = (t-floor(t))*gridSize;
-        ivec4 ti = t;
-        fvec4 dr = t-ti;
-        ivec4 gridIndex = ti-(gridSizeInt&ti==gridSizeInt);
+            fvec4 dr;
+            ivec4 gridIndex = findGridIndex(&posq[4*i], boxSize, invBoxSize, recipBoxVec, gridSize, gridSizeInt, dr);
         
-        // Compute the B-spline coefficients.
+            // Compute the B-spline coefficients.
 
-        fvec4 data[PME_ORDER];
-        data[PME_ORDER-1] = 0.0f;
-        data[1] = dr;
-        data[0] = one-dr;
-        for (int j = 3; j < PME_ORDER; j++) {
-            fvec4 div(1.0f/(j-1));
-            data[j-1] = div*dr*data[j-2];
-            for (int k = 1; k < j-1; k++)
-                data[j-k-1] = div*((dr+k)*data[j-k-2]+(fvec4(j-k)-dr)*data[j-k-1]);
-            data[0] = div*(one-dr)*data[0];
-        }
-        data[PME_ORDER-1] = scale*dr*data[PME_ORDER-2];
-        for (int j = 1; j < (PME_ORDER-1); j++)
-            data[PME_ORDER-j-1] = scale*((dr+j)*data[PME_ORDER-j-2]+(fvec4(PME_ORDER-j)-dr)*data[PME_ORDER-j-1]);
-        data[0] = scale*(one-dr)*data[0];
+            fvec4 data[ORDER];
+            computeBSplines<ORDER>(dr, data, NULL);
         
-        // Spread the charges.
+            // Spread the charges.
         
-        int gridIndexX = gridIndex[0];
-        int gridIndexY = gridIndex[1];
-        int gridIndexZ = gridIndex[2];
-        if (gridIndexX < 0)
-            return; // This happens when a simulation blows up and coordinates become NaN.
-        int zindex[PME_ORDER];
-        for (int j = 0; j < PME_ORDER; j++) {
-            zindex[j] = gridIndexZ+j;
-            zindex[j] -= (zindex[j] >= gridz ? gridz : 0);
-        }
-        float charge = epsilonFactor*posq[4*i+3];
-        fvec4 zdata0to3(data[0][2], data[1][2], data[2][2], data[3][2]);
-        float zdata4 = data[4][2];
-        if (gridIndexZ+4 < gridz) {
-            for (int ix = 0; ix < PME_ORDER; ix++) {
-                int xbase = gridIndexX+ix;
-                xbase -= (xbase >= gridx ? gridx : 0);
-                xbase = xbase*gridy*gridz;
-                float xdata = charge*data[ix][0];
-                for (int iy = 0; iy < PME_ORDER; iy++) {
-                    int ybase = gridIndexY+iy;
-                    ybase -= (ybase >= gridy ? gridy : 0);
-                    ybase = xbase + ybase*gridz;
-                    float multiplier = xdata*data[iy][1];
-                    fvec4 add0to3 = zdata0to3*multiplier;
-                    (fvec4(&grid[ybase+gridIndexZ])+add0to3).store(&grid[ybase+gridIndexZ]);
-                    grid[ybase+zindex[4]] += multiplier*zdata4;
+            int gridIndexX = gridIndex[0]-firstPlane;
+            int gridIndexY = gridIndex[1];
+            int gridIndexZ = gridIndex[2];
+            int zindex[ORDER];
+            for (int j = 0; j < ORDER; j++) {
+                zindex[j] = gridIndexZ+j;
+                zindex[j] -= (zindex[j] >= gridz ? gridz : 0);
+            }
+            float charge = epsilonFactor*posq[4*i+3];
+            fvec4 zdataBlock[numZBlocks];
+            float zdataRemaining[numZRemaining > 0 ? numZRemaining : 1];
+            for (int j = 0; j < numZBlocks; j++)
+                zdataBlock[j] = fvec4(data[4*j][2], data[4*j+1][2], data[4*j+2][2], data[4*j+3][2]);
+            for (int j = 0; j < numZRemaining; j++)
+                zdataRemaining[j] = data[4*numZBlocks+j][2];
+            if (gridIndexZ+ORDER-1 < gridz) {
+                for (int ix = 0; ix < ORDER; ix++) {
+                    int xbase = (gridIndexX+ix)*gridy*gridz;
+                    float xdata = charge*data[ix][0];
+                    for (int iy = 0; iy < ORDER; iy++) {
+                        int ybase = gridIndexY+iy;
+                        ybase -= (ybase >= gridy ? gridy : 0);
+                        ybase = xbase + ybase*gridz + gridIndexZ;
+                        float multiplier = xdata*data[iy][1];
+                        for (int j = 0; j < numZBlocks; j++)
+                            (fvec4(&grid[ybase+4*j])+zdataBlock[j]*multiplier).store(&grid[ybase+4*j]);
+                        for (int j = 0; j < numZRemaining; j++)
+                            grid[ybase+4*numZBlocks+j] += multiplier*zdataRemaining[j];
+                    }
                 }
             }
-        }
-        else {
-            for (int ix = 0; ix < PME_ORDER; ix++) {
-                int xbase = gridIndexX+ix;
-                xbase -= (xbase >= gridx ? gridx : 0);
-                xbase = xbase*gridy*gridz;
-                float xdata = charge*data[ix][0];
-                for (int iy = 0; iy < PME_ORDER; iy++) {
-                    int ybase = gridIndexY+iy;
-                    ybase -= (ybase >= gridy ? gridy : 0);
-                    ybase = xbase + ybase*gridz;
-                    float multiplier = xdata*data[iy][1];
-                    fvec4 add0to3 = zdata0to3*multiplier;
-                    add0to3.store(temp);
-                    grid[ybase+zindex[0]] += temp[0];
-                    grid[ybase+zindex[1]] += temp[1];
-                    grid[ybase+zindex[2]] += temp[2];
-                    grid[ybase+zindex[3]] += temp[3];
-                    grid[ybase+zindex[4]] += multiplier*zdata4;
+            else {
+                for (int ix = 0; ix < ORDER; ix++) {
+                    int xbase = (gridIndexX+ix)*gridy*gridz;
+                    float xdata = charge*data[ix][0];
+                    for (int iy = 0; iy < ORDER; iy++) {
+                        int ybase = gridIndexY+iy;
+                        ybase -= (ybase >= gridy ? gridy : 0);
+                        ybase = xbase + ybase*gridz;
+                        float multiplier = xdata*data[iy][1];
+                        for (int j = 0; j < numZBlocks; j++) {
+                            (zdataBlock[j]*multiplier).store(temp);
+                            grid[ybase+zindex[4*j]] += temp[0];
+                            grid[ybase+zindex[4*j+1]] += temp[1];
+                            grid[ybase+zindex[4*j+2]] += temp[2];
+                            grid[ybase+zindex[4*j+3]] += temp[3];
+                        }
+                        for (int j = 0; j < numZRemaining; j++)
+                            grid[ybase+zindex[4*numZBlocks+j]] += multiplier*zdataRemaining[j];
+                    }
                 }
             }
         }
-        if (deterministic)
-            i += numThreads;
+    }
+}
+
+/**
+ * Select the version of spreadCharge() for an interpolation order.
+ */
+static void spreadCharge(int order, float* posq, float* grid, int gridx, int gridy, int gridz, int firstPlane, int numPlanes,
+        const vector<vector<vector<int> > >& slabAtoms, int slab, Vec3* periodicBoxVectors, Vec3* recipBoxVectors, const float epsilonFactor) {
+    switch (order) {
+        case 4:
+            spreadCharge<4>(posq, grid, gridx, gridy, gridz, firstPlane, numPlanes, slabAtoms, slab, periodicBoxVectors, recipBoxVectors, epsilonFactor);
+            break;
+        case 5:
+            spreadCharge<5>(posq, grid, gridx, gridy, gridz, firstPlane, numPlanes, slabAtoms, slab, periodicBoxVectors, recipBoxVectors, epsilonFactor);
+            break;
+        case 6:
+            spreadCharge<6>(posq, grid, gridx, gridy, gridz, firstPlane, numPlanes, slabAtoms, slab, periodicBoxVectors, recipBoxVectors, epsilonFactor);
+            break;
+        case 7:
+            spreadCharge<7>(posq, grid, gridx, gridy, gridz, firstPlane, numPlanes, slabAtoms, slab, periodicBoxVectors, recipBoxVectors, epsilonFactor);
+            break;
+        case 8:
+            spreadCharge<8>(posq, grid, gridx, gridy, gridz, firstPlane, numPlanes, slabAtoms, slab, periodicBoxVectors, recipBoxVectors, epsilonFactor);
+            break;
+    }
+}
+
+/**
+ * Build a range of planes of the full grid by adding together the contributions from every slab
+ * that overlaps them.
+ */
+static void sumSlabGrids(float* realGrid, const vector<vector<float> >& slabGrid, const vector<int>& slabStart, int start, int end, int gridx, int gridy, int gridz) {
+    const int planeSize = gridy*gridz;
+    const int numSlabs = slabGrid.size();
+    for (int x = start; x < end; x++) {
+        float* plane = &realGrid[x*planeSize];
+        memset(plane, 0, sizeof(float)*planeSize);
+        for (int slab = 0; slab < numSlabs; slab++) {
+            int numPlanes = slabGrid[slab].size()/planeSize;
+            int localPlane = x-slabStart[slab];
+            if (localPlane < 0)
+                localPlane += gridx;
+            for (; localPlane < numPlanes; localPlane += gridx) {
+                const float* source = &slabGrid[slab][localPlane*planeSize];
+                int i;
+                for (i = 0; i+3 < planeSize; i += 4)
+                    (fvec4(&plane[i])+fvec4(&source[i])).store(&plane[i]);
+                for (; i < planeSize; i++)
+                    plane[i] += source[i];
+            }
+        }
     }
 }
 
@@ -238,7 +476,7 @@ static void computeReciprocalEterm(int start, int end, int gridx, int gridy, int
     }
 }
 
-static double reciprocalEnergy(int start, int end, fftwf_complex* grid, vector<float>& recipEterm, int gridx, int gridy, int gridz, double alpha, vector<float>* bsplineModuli, Vec3* periodicBoxVectors, Vec3* recipBoxVectors) {
+static double reciprocalEnergy(int start, int end, complex<float>* grid, vector<float>& recipEterm, int gridx, int gridy, int gridz, double alpha, vector<float>* bsplineModuli, Vec3* periodicBoxVectors, Vec3* recipBoxVectors) {
     const unsigned int zsizeHalf = gridz/2+1;
     const unsigned int yzsizeHalf = gridy*zsizeHalf;
 
@@ -260,8 +498,8 @@ static double reciprocalEnergy(int start, int end, fftwf_complex* grid, vector<f
                     kz1 = kz;
                 }
                 int index = kx1*yzsizeHalf + ky1*zsizeHalf + kz1;
-                float gridReal = grid[index][0];
-                float gridImag = grid[index][1];
+                float gridReal = grid[index].real();
+                float gridImag = grid[index].imag();
                 energy += recipEterm[index]*(gridReal*gridReal+gridImag*gridImag);
             }
             firstz = 0;
@@ -271,7 +509,7 @@ static double reciprocalEnergy(int start, int end, fftwf_complex* grid, vector<f
 }
 
 
-static double reciprocalDispersionEnergy(int start, int end, fftwf_complex* grid, const vector<float>& recipEterm, int gridx, int gridy, int gridz, double alpha, vector<float>* bsplineModuli, Vec3* periodicBoxVectors, Vec3* recipBoxVectors) {
+static double reciprocalDispersionEnergy(int start, int end, complex<float>* grid, const vector<float>& recipEterm, int gridx, int gridy, int gridz, double alpha, vector<float>* bsplineModuli, Vec3* periodicBoxVectors, Vec3* recipBoxVectors) {
     const unsigned int zsizeHalf = gridz/2+1;
     const unsigned int yzsizeHalf = gridy*zsizeHalf;
 
@@ -292,8 +530,8 @@ static double reciprocalDispersionEnergy(int start, int end, fftwf_complex* grid
                     kz1 = kz;
                 }
                 int index = kx1*yzsizeHalf + ky1*zsizeHalf + kz1;
-                float gridReal = grid[index][0];
-                float gridImag = grid[index][1];
+                float gridReal = grid[index].real();
+                float gridImag = grid[index].imag();
                 energy += recipEterm[index]*(gridReal*gridReal+gridImag*gridImag);
             }
         }
@@ -302,14 +540,14 @@ static double reciprocalDispersionEnergy(int start, int end, fftwf_complex* grid
 }
 
 
-static void reciprocalConvolution(int start, int end, fftwf_complex* grid, vector<float>& recipEterm) {
+static void reciprocalConvolution(int start, int end, complex<float>* grid, vector<float>& recipEterm) {
     for (int index = start; index < end; index++) {
         float eterm = recipEterm[index];
-        grid[index][0] *= eterm;
-        grid[index][1] *= eterm;
+        grid[index] *= eterm;
     }
 }
 
+template <int ORDER>
 static void interpolateForces(float* posq, float* force, float* grid, int gridx, int gridy, int gridz, int numParticles, Vec3* periodicBoxVectors, Vec3* recipBoxVectors, atomic<int>& atomicCounter, const float epsilonFactor) {
     fvec4 boxSize((float) periodicBoxVectors[0][0], (float) periodicBoxVectors[1][1], (float) periodicBoxVectors[2][2], 0);
     fvec4 invBoxSize((float) recipBoxVectors[0][0], (float) recipBoxVectors[1][1], (float) recipBoxVectors[2][2], 0);
@@ -318,8 +556,6 @@ static void interpolateForces(float* posq, float* force, float* grid, int gridx,
     fvec4 recipBoxVec2((float) recipBoxVectors[2][0], (float) recipBoxVectors[2][1], (float) recipBoxVectors[2][2], 0);
     fvec4 gridSize(gridx, gridy, gridz, 0);
     ivec4 gridSizeInt(gridx, gridy, gridz, 0);
-    fvec4 one(1);
-    fvec4 scale(1.0f/(PME_ORDER-1));
     while (true) {
         int i = atomicCounter++;
         if (i >= numParticles)
@@ -338,25 +574,9 @@ static void interpolateForces(float* posq, float* force, float* grid, int gridx,
         
         // Compute the B-spline coefficients.
         
-        fvec4 data[PME_ORDER];
-        fvec4 ddata[PME_ORDER];
-        data[PME_ORDER-1] = 0.0f;
-        data[1] = dr;
-        data[0] = one-dr;
-        for (int j = 3; j < PME_ORDER; j++) {
-            fvec4 div(1.0f/(j-1));
-            data[j-1] = div*dr*data[j-2];
-            for (int k = 1; k < j-1; k++)
-                data[j-k-1] = div*((dr+k)*data[j-k-2]+(fvec4(j-k)-dr)*data[j-k-1]);
-            data[0] = div*(one-dr)*data[0];
-        }
-        ddata[0] = -data[0];
-        for (int j = 1; j < PME_ORDER; j++)
-            ddata[j] = data[j-1]-data[j];
-        data[PME_ORDER-1] = scale*dr*data[PME_ORDER-2];
-        for (int j = 1; j < (PME_ORDER-1); j++)
-            data[PME_ORDER-j-1] = scale*((dr+j)*data[PME_ORDER-j-2]+(fvec4(PME_ORDER-j)-dr)*data[PME_ORDER-j-1]);
-        data[0] = scale*(one-dr)*data[0];
+        fvec4 data[ORDER];
+        fvec4 ddata[ORDER];
+        computeBSplines<ORDER>(dr, data, ddata);
                 
         // Compute the force on this atom.
         
@@ -365,16 +585,16 @@ static void interpolateForces(float* posq, float* force, float* grid, int gridx,
         int gridIndexZ = gridIndex[2];
         if (gridIndexX < 0)
             return; // This happens when a simulation blows up and coordinates become NaN.
-        int zindex[PME_ORDER];
-        for (int j = 0; j < PME_ORDER; j++) {
+        int zindex[ORDER];
+        for (int j = 0; j < ORDER; j++) {
             zindex[j] = gridIndexZ+j;
             zindex[j] -= (zindex[j] >= gridz ? gridz : 0);
         }
-        fvec4 zdata[PME_ORDER];
-        for (int j = 0; j < PME_ORDER; j++)
+        fvec4 zdata[ORDER];
+        for (int j = 0; j < ORDER; j++)
             zdata[j] = fvec4(data[j][2], data[j][2], ddata[j][2], 0);
         fvec4 f = 0.0f;
-        for (int ix = 0; ix < PME_ORDER; ix++) {
+        for (int ix = 0; ix < ORDER; ix++) {
             int xbase = gridIndexX+ix;
             xbase -= (xbase >= gridx ? gridx : 0);
             xbase = xbase*gridy*gridz;
@@ -382,7 +602,7 @@ static void interpolateForces(float* posq, float* force, float* grid, int gridx,
             float ddx = ddata[ix][0];
             fvec4 xdata(ddx, dx, dx, 0);
 
-            for (int iy = 0; iy < PME_ORDER; iy++) {
+            for (int iy = 0; iy < ORDER; iy++) {
                 int ybase = gridIndexY+iy;
                 ybase -= (ybase >= gridy ? gridy : 0);
                 ybase = xbase + ybase*gridz;
@@ -390,7 +610,7 @@ static void interpolateForces(float* posq, float* force, float* grid, int gridx,
                 float ddy = ddata[iy][1];
                 fvec4 xydata = xdata*fvec4(dy, ddy, dy, 0);
 
-                for (int iz = 0; iz < PME_ORDER; iz++) {
+                for (int iz = 0; iz < ORDER; iz++) {
                     fvec4 gridValue(grid[ybase+zindex[iz]]);
                     f = f+xydata*zdata[iz]*gridValue;
                 }
@@ -405,6 +625,29 @@ static void interpolateForces(float* posq, float* force, float* grid, int gridx,
     }
 }
 
+/**
+ * Select the version of interpolateForces() for an interpolation order.
+ */
+static void interpolateForces(int order, float* posq, float* force, float* grid, int gridx, int gridy, int gridz, int numParticles, Vec3* periodicBoxVectors, Vec3* recipBoxVectors, atomic<int>& atomicCounter, const float epsilonFactor) {
+    switch (order) {
+        case 4:
+            interpolateForces<4>(posq, force, grid, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors, atomicCounter, epsilonFactor);
+            break;
+        case 5:
+            interpolateForces<5>(posq, force, grid, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors, atomicCounter, epsilonFactor);
+            break;
+        case 6:
+            interpolateForces<6>(posq, force, grid, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors, atomicCounter, epsilonFactor);
+            break;
+        case 7:
+            interpolateForces<7>(posq, force, grid, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors, atomicCounter, epsilonFactor);
+            break;
+        case 8:
+            interpolateForces<8>(posq, force, grid, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors, atomicCounter, epsilonFactor);
+            break;
+    }
+}
+
 static void* threadBody(void* args) {
     CpuCalcPmeReciprocalForceKernel& owner = *reinterpret_cast<CpuCalcPmeReciprocalForceKernel*>(args);
     owner.runMainThread();
@@ -413,24 +656,48 @@ static void* threadBody(void* args) {
 
 void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize, int numParticles, double alpha, bool deterministic) {
     if (!hasInitializedThreads) {
-        numThreads = getNumProcessors();
+        defaultNumThreads = getNumProcessors();
         char* threadsEnv = getenv("OPENMM_CPU_THREADS");
         if (threadsEnv != NULL)
-            stringstream(threadsEnv) >> numThreads;
+            stringstream(threadsEnv) >> defaultNumThreads;
+#ifdef OPENMM_PME_USE_FFTW
         fftwf_init_threads();
+#endif
         hasInitializedThreads = true;
     }
+    if (numThreads <= 0)
+        numThreads = defaultNumThreads;
+    if (order < 4 || order > 8)
+        throw OpenMMException("Unsupported PME interpolation order: "+to_string(order));
     threadEnergy.resize(numThreads);
-    gridx = findFFTDimension(xsize, false);
-    gridy = findFFTDimension(ysize, false);
-    gridz = findFFTDimension(zsize, true);
+
+    // Every dimension of the grid must be at least as large as the order, since each atom is spread
+    // to that many points along each axis.
+
+    gridx = findFFTDimension(std::max(xsize, order), false);
+    gridy = findFFTDimension(std::max(ysize, order), false);
+    gridz = findFFTDimension(std::max(zsize, order), true);
     this->numParticles = numParticles;
     this->alpha = alpha;
-    this->deterministic = deterministic;
     force.resize(4*numParticles);
     recipEterm.resize(gridx*gridy*gridz);
     
-    // Initialize threads.
+    // Divide the grid into slabs along the x axis, one for each thread.  Each slab has extra planes
+    // at the end to hold charge that is spread past its last plane.  The slabs themselves are allocated
+    // by the worker threads.
+
+    slabGrid.resize(numThreads);
+    slabStart.resize(numThreads);
+    planeSlab.resize(gridx);
+    for (int i = 0; i < numThreads; i++) {
+        slabStart[i] = (i*gridx)/numThreads;
+        int slabEnd = ((i+1)*gridx)/numThreads;
+        for (int j = slabStart[i]; j < slabEnd; j++)
+            planeSlab[j] = i;
+    }
+    slabAtoms.resize(numThreads, vector<vector<int> >(numThreads));
+    
+    // Initialize threads.  The main thread allocates the grids before it reports that it is running.
     
     isFinished = false;
     pthread_cond_init(&startCondition, NULL);
@@ -445,27 +712,27 @@ void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize
         pthread_cond_wait(&endCondition, &lock);
     pthread_mutex_unlock(&lock);
     
-    // Initialize FFTW.
+    // Initialize the FFT.  Planning overwrites the grids, but they have already been placed in memory.
     
-    for (int i = 0; i < numThreads; i++)
-        tempGrid.push_back((float*) fftwf_malloc(sizeof(float)*(gridx*gridy*gridz+3)));
-    realGrid = tempGrid[0];
-    complexGrid = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex)*gridx*gridy*(gridz/2+1));
-    fftwf_plan_with_nthreads(numThreads);
-    forwardFFT = fftwf_plan_dft_r2c_3d(gridx, gridy, gridz, realGrid, complexGrid, FFTW_MEASURE);
-    backwardFFT = fftwf_plan_dft_c2r_3d(gridx, gridy, gridz, complexGrid, realGrid, FFTW_MEASURE);
-    hasCreatedPlan = true;
+#ifdef OPENMM_PME_USE_FFTW
+    if (!useBuiltinFFT) {
+        acquireFFTPlans(gridx, gridy, gridz, numThreads, realGrid, (fftwf_complex*) complexGrid, wisdomFile, forwardFFT, backwardFFT);
+        hasCreatedPlan = true;
+    }
+    else
+#endif
+        builtinFFT = new SimdFFT3D(gridx, gridy, gridz);
     
     // Initialize the b-spline moduli.
 
     int maxSize = std::max(std::max(gridx, gridy), gridz);
-    vector<double> data(PME_ORDER);
-    vector<double> ddata(PME_ORDER);
-    vector<double> bsplinesData(maxSize);
-    data[PME_ORDER-1] = 0.0;
+    vector<double> data(order);
+    vector<double> ddata(order);
+    vector<double> bsplinesData(std::max(maxSize, order+1));
+    data[order-1] = 0.0;
     data[1] = 0.0;
     data[0] = 1.0;
-    for (int i = 3; i < PME_ORDER; i++) {
+    for (int i = 3; i < order; i++) {
         double div = 1.0/(i-1.0);
         data[i-1] = 0.0;
         for (int j = 1; j < (i-1); j++)
@@ -476,16 +743,16 @@ void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize
     // Differentiate.
 
     ddata[0] = -data[0];
-    for (int i = 1; i < PME_ORDER; i++)
+    for (int i = 1; i < order; i++)
         ddata[i] = data[i-1]-data[i];
-    double div = 1.0/(PME_ORDER-1);
-    data[PME_ORDER-1] = 0.0;
-    for (int i = 1; i < (PME_ORDER-1); i++)
-        data[PME_ORDER-i-1] = div*(i*data[PME_ORDER-i-2]+(PME_ORDER-i)*data[PME_ORDER-i-1]);
+    double div = 1.0/(order-1);
+    data[order-1] = 0.0;
+    for (int i = 1; i < (order-1); i++)
+        data[order-i-1] = div*(i*data[order-i-2]+(order-i)*data[order-i-1]);
     data[0] = div*data[0];
-    for (int i = 0; i < maxSize; i++)
+    for (int i = 0; i < bsplinesData.size(); i++)
         bsplinesData[i] = 0.0;
-    for (int i = 1; i <= PME_ORDER; i++)
+    for (int i = 1; i <= order; i++)
         bsplinesData[i] = data[i-1];
 
     // Evaluate the actual bspline moduli for X/Y/Z.
@@ -521,23 +788,26 @@ CpuCalcPmeReciprocalForceKernel::~CpuCalcPmeReciprocalForceKernel() {
     pthread_mutex_destroy(&lock);
     pthread_cond_destroy(&startCondition);
     pthread_cond_destroy(&endCondition);
-    for (auto grid : tempGrid)
-        fftwf_free(grid);
+    if (realGrid != NULL)
+        freeGrid(realGrid);
     if (complexGrid != NULL)
-        fftwf_free(complexGrid);
-    if (hasCreatedPlan) {
-        fftwf_destroy_plan(forwardFFT);
-        fftwf_destroy_plan(backwardFFT);
-    }
+        freeGrid(complexGrid);
+#ifdef OPENMM_PME_USE_FFTW
+    if (hasCreatedPlan)
+        releaseFFTPlans(gridx, gridy, gridz, numThreads);
+#endif
+    if (builtinFFT != NULL)
+        delete builtinFFT;
 }
 
 void CpuCalcPmeReciprocalForceKernel::runMainThread() {
     // This is the main thread that coordinates all the other ones.
 
     pthread_mutex_lock(&lock);
+    ThreadPool threads(numThreads, spinWait, cpuAffinity);
+    allocateGrids(threads, gridx, gridy, gridz, order, slabGrid, realGrid, complexGrid);
     isFinished = true;
     pthread_cond_signal(&endCondition);
-    ThreadPool threads(numThreads);
     while (true) {
         // Wait for the signal to start.
 
@@ -545,27 +815,39 @@ void CpuCalcPmeReciprocalForceKernel::runMainThread() {
         if (isDeleted)
             break;
         posq = io->getPosq();
-        atomicCounter = 0;
-        threads.execute([&] (ThreadPool& threads, int threadIndex) { runWorkerThread(threads, threadIndex); }); // Signal threads to perform charge spreading.
+        threads.execute([&] (ThreadPool& threads, int threadIndex) { runSpreadingStage(threads, threadIndex); }); // Signal threads to sort atoms into slabs.
+        threads.waitForThreads();
+        threads.resumeThreads(); // Signal threads to perform charge spreading.
         threads.waitForThreads();
         threads.resumeThreads(); // Signal threads to sum the charge grids.
         threads.waitForThreads();
-        fftwf_execute_dft_r2c(forwardFFT, realGrid, complexGrid);
-        if (lastBoxVectors[0] != periodicBoxVectors[0] || lastBoxVectors[1] != periodicBoxVectors[1] || lastBoxVectors[2] != periodicBoxVectors[2]) {
-            threads.resumeThreads(); // Signal threads to compute the reciprocal scale factors.
-            threads.waitForThreads();
+#ifdef OPENMM_PME_USE_FFTW
+        if (!useBuiltinFFT)
+            fftwf_execute_dft_r2c(forwardFFT, realGrid, (fftwf_complex*) complexGrid);
+        else
+#endif
+            builtinFFT->transformRealToComplex(realGrid, complexGrid, threads);
+        bool boxChanged = (lastBoxVectors[0] != periodicBoxVectors[0] || lastBoxVectors[1] != periodicBoxVectors[1] || lastBoxVectors[2] != periodicBoxVectors[2]);
+        threads.execute([&] (ThreadPool& threads, int threadIndex) { runConvolutionStage(threads, threadIndex, boxChanged); });
+        if (boxChanged) {
+            threads.waitForThreads(); // Wait for threads to compute the reciprocal scale factors.
+            threads.resumeThreads();
         }
         if (includeEnergy) {
-            threads.resumeThreads(); // Signal threads to compute energy.
-            threads.waitForThreads();
+            threads.waitForThreads(); // Wait for threads to compute energy.
             for (auto e : threadEnergy)
                 energy += e;
+            threads.resumeThreads();
         }
-        threads.resumeThreads(); // Signal threads to perform reciprocal convolution.
-        threads.waitForThreads();
-        fftwf_execute_dft_c2r(backwardFFT, complexGrid, realGrid);
+        threads.waitForThreads(); // Wait for threads to perform reciprocal convolution.
+#ifdef OPENMM_PME_USE_FFTW
+        if (!useBuiltinFFT)
+            fftwf_execute_dft_c2r(backwardFFT, (fftwf_complex*) complexGrid, realGrid);
+        else
+#endif
+            builtinFFT->transformComplexToReal(complexGrid, realGrid, threads);
         atomicCounter = 0;
-        threads.resumeThreads(); // Signal threads to interpolate forces.
+        threads.execute([&] (ThreadPool& threads, int threadIndex) { runInterpolationStage(threads, threadIndex); }); // Signal threads to interpolate forces.
         threads.waitForThreads();
         isFinished = true;
         lastBoxVectors[0] = periodicBoxVectors[0];
@@ -576,27 +858,25 @@ void CpuCalcPmeReciprocalForceKernel::runMainThread() {
     pthread_mutex_unlock(&lock);
 }
 
-void CpuCalcPmeReciprocalForceKernel::runWorkerThread(ThreadPool& threads, int index) {
+void CpuCalcPmeReciprocalForceKernel::runSpreadingStage(ThreadPool& threads, int index) {
     int gridxStart = (index*gridx)/numThreads;
     int gridxEnd = ((index+1)*gridx)/numThreads;
-    int gridSize = (gridx*gridy*gridz+3)/4;
-    int gridStart = 4*((index*gridSize)/numThreads);
-    int gridEnd = 4*(((index+1)*gridSize)/numThreads);
-    int complexSize = gridx*gridy*(gridz/2+1);
-    int complexStart = std::max(1, ((index*complexSize)/numThreads));
-    int complexEnd = (((index+1)*complexSize)/numThreads);
     const float epsilonFactor = sqrt(ONE_4PI_EPS0);
-    spreadCharge(posq, tempGrid[index], gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors, atomicCounter, epsilonFactor, index, numThreads, deterministic);
+    findSlabAtoms(posq, (index*numParticles)/numThreads, ((index+1)*numParticles)/numThreads, gridx, gridy, gridz, periodicBoxVectors, recipBoxVectors, planeSlab, slabAtoms[index]);
     threads.syncThreads();
-    int numGrids = tempGrid.size();
-    for (int i = gridStart; i < gridEnd; i += 4) {
-        fvec4 sum(&realGrid[i]);
-        for (int j = 1; j < numGrids; j++)
-            sum += fvec4(&tempGrid[j][i]);
-        sum.store(&realGrid[i]);
-    }
+    int numSlabPlanes = slabGrid[index].size()/(gridy*gridz);
+    spreadCharge(order, posq, slabGrid[index].data(), gridx, gridy, gridz, gridxStart, numSlabPlanes, slabAtoms, index, periodicBoxVectors, recipBoxVectors, epsilonFactor);
     threads.syncThreads();
-    if (lastBoxVectors[0] != periodicBoxVectors[0] || lastBoxVectors[1] != periodicBoxVectors[1] || lastBoxVectors[2] != periodicBoxVectors[2]) {
+    sumSlabGrids(realGrid, slabGrid, slabStart, gridxStart, gridxEnd, gridx, gridy, gridz);
+}
+
+void CpuCalcPmeReciprocalForceKernel::runConvolutionStage(ThreadPool& threads, int index, bool boxChanged) {
+    int gridxStart = (index*gridx)/numThreads;
+    int gridxEnd = ((index+1)*gridx)/numThreads;
+    int complexSize = gridx*gridy*(gridz/2+1);
+    int complexStart = std::max(1, ((index*complexSize)/numThreads));
+    int complexEnd = (((index+1)*complexSize)/numThreads);
+    if (boxChanged) {
         computeReciprocalEterm(gridxStart, gridxEnd, gridx, gridy, gridz, recipEterm, alpha, bsplineModuli, periodicBoxVectors, recipBoxVectors);
         threads.syncThreads();
     }
@@ -605,11 +885,27 @@ void CpuCalcPmeReciprocalForceKernel::runWorkerThread(ThreadPool& threads, int i
         threads.syncThreads();
     }
     reciprocalConvolution(complexStart, complexEnd, complexGrid, recipEterm);
-    threads.syncThreads();
-    interpolateForces(posq, &force[0], realGrid, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors, atomicCounter, epsilonFactor);
+}
+
+void CpuCalcPmeReciprocalForceKernel::runInterpolationStage(ThreadPool& threads, int index) {
+    const float epsilonFactor = sqrt(ONE_4PI_EPS0);
+    interpolateForces(order, posq, &force[0], realGrid, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors, atomicCounter, epsilonFactor);
 }
 
 void CpuCalcPmeReciprocalForceKernel::beginComputation(IO& io, const Vec3* periodicBoxVectors, bool includeEnergy) {
+    // If nothing has changed since the last calculation, its results are still valid.  The energy can
+    // only be reused if it was computed.
+
+    float* newPosq = io.getPosq();
+    useCachedResult = (hasCachedResult && (cachedResultHasEnergy || !includeEnergy) && lastBoxVectors[0] == periodicBoxVectors[0] &&
+            lastBoxVectors[1] == periodicBoxVectors[1] && lastBoxVectors[2] == periodicBoxVectors[2] &&
+            memcmp(newPosq, cachedPosq.data(), 4*numParticles*sizeof(float)) == 0);
+    if (useCachedResult) {
+        this->includeEnergy = includeEnergy;
+        return;
+    }
+    cachedPosq.assign(newPosq, newPosq+4*numParticles);
+    hasCachedResult = false;
     this->io = &io;
     this->periodicBoxVectors[0] = periodicBoxVectors[0];
     this->periodicBoxVectors[1] = periodicBoxVectors[1];
@@ -634,11 +930,17 @@ void CpuCalcPmeReciprocalForceKernel::beginComputation(IO& io, const Vec3* perio
 }
 
 double CpuCalcPmeReciprocalForceKernel::finishComputation(IO& io) {
+    if (useCachedResult) {
+        io.setForce(&force[0]);
+        return (includeEnergy ? energy : 0.0);
+    }
     pthread_mutex_lock(&lock);
     while (!isFinished) {
         pthread_cond_wait(&endCondition, &lock);
     }
     pthread_mutex_unlock(&lock);
+    hasCachedResult = true;
+    cachedResultHasEnergy = includeEnergy;
     io.setForce(&force[0]);
     return energy;
 }
@@ -683,19 +985,9 @@ int CpuCalcPmeReciprocalForceKernel::findFFTDimension(int minimum, bool isZ) {
  */
 
 bool CpuCalcPmeReciprocalForceKernel::hasInitializedThreads = false;
-int CpuCalcPmeReciprocalForceKernel::numThreads = 0;
+int CpuCalcPmeReciprocalForceKernel::defaultNumThreads = 0;
 
 
-class CpuCalcDispersionPmeReciprocalForceKernel::ComputeTask : public ThreadPool::Task {
-public:
-    ComputeTask(CpuCalcDispersionPmeReciprocalForceKernel& owner) : owner(owner) {
-    }
-    void execute(ThreadPool& threads, int threadIndex) {
-        owner.runWorkerThread(threads, threadIndex);
-    }
-    CpuCalcDispersionPmeReciprocalForceKernel& owner;
-};
-
 static void* dispersionThreadBody(void* args) {
     CpuCalcDispersionPmeReciprocalForceKernel& owner = *reinterpret_cast<CpuCalcDispersionPmeReciprocalForceKernel*>(args);
     owner.runMainThread();
@@ -704,24 +996,48 @@ static void* dispersionThreadBody(void* args) {
 
 void CpuCalcDispersionPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize, int numParticles, double alpha, bool deterministic) {
     if (!hasInitializedThreads) {
-        numThreads = getNumProcessors();
+        defaultNumThreads = getNumProcessors();
         char* threadsEnv = getenv("OPENMM_CPU_THREADS");
         if (threadsEnv != NULL)
-            stringstream(threadsEnv) >> numThreads;
+            stringstream(threadsEnv) >> defaultNumThreads;
+#ifdef OPENMM_PME_USE_FFTW
         fftwf_init_threads();
+#endif
         hasInitializedThreads = true;
     }
+    if (numThreads <= 0)
+        numThreads = defaultNumThreads;
+    if (order < 4 || order > 8)
+        throw OpenMMException("Unsupported PME interpolation order: "+to_string(order));
     threadEnergy.resize(numThreads);
-    gridx = findFFTDimension(xsize, false);
-    gridy = findFFTDimension(ysize, false);
-    gridz = findFFTDimension(zsize, true);
+
+    // Every dimension of the grid must be at least as large as the order, since each atom is spread
+    // to that many points along each axis.
+
+    gridx = findFFTDimension(std::max(xsize, order), false);
+    gridy = findFFTDimension(std::max(ysize, order), false);
+    gridz = findFFTDimension(std::max(zsize, order), true);
     this->numParticles = numParticles;
     this->alpha = alpha;
-    this->deterministic = deterministic;
     force.resize(4*numParticles);
     recipEterm.resize(gridx*gridy*gridz);
     
-    // Initialize threads.
+    // Divide the grid into slabs along the x axis, one for each thread.  Each slab has extra planes
+    // at the end to hold charge that is spread past its last plane.  The slabs themselves are allocated
+    // by the worker threads.
+
+    slabGrid.resize(numThreads);
+    slabStart.resize(numThreads);
+    planeSlab.resize(gridx);
+    for (int i = 0; i < numThreads; i++) {
+        slabStart[i] = (i*gridx)/numThreads;
+        int slabEnd = ((i+1)*gridx)/numThreads;
+        for (int j = slabStart[i]; j < slabEnd; j++)
+            planeSlab[j] = i;
+    }
+    slabAtoms.resize(numThreads, vector<vector<int> >(numThreads));
+    
+    // Initialize threads.  The main thread allocates the grids before it reports that it is running.
     
     isFinished = false;
     pthread_cond_init(&startCondition, NULL);
@@ -736,27 +1052,27 @@ void CpuCalcDispersionPmeReciprocalForceKernel::initialize(int xsize, int ysize,
         pthread_cond_wait(&endCondition, &lock);
     pthread_mutex_unlock(&lock);
     
-    // Initialize FFTW.
+    // Initialize the FFT.  Planning overwrites the grids, but they have already been placed in memory.
     
-    for (int i = 0; i < numThreads; i++)
-        tempGrid.push_back((float*) fftwf_malloc(sizeof(float)*(gridx*gridy*gridz+3)));
-    realGrid = tempGrid[0];
-    complexGrid = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex)*gridx*gridy*(gridz/2+1));
-    fftwf_plan_with_nthreads(numThreads);
-    forwardFFT = fftwf_plan_dft_r2c_3d(gridx, gridy, gridz, realGrid, complexGrid, FFTW_MEASURE);
-    backwardFFT = fftwf_plan_dft_c2r_3d(gridx, gridy, gridz, complexGrid, realGrid, FFTW_MEASURE);
-    hasCreatedPlan = true;
+#ifdef OPENMM_PME_USE_FFTW
+    if (!useBuiltinFFT) {
+        acquireFFTPlans(gridx, gridy, gridz, numThreads, realGrid, (fftwf_complex*) complexGrid, wisdomFile, forwardFFT, backwardFFT);
+        hasCreatedPlan = true;
+    }
+    else
+#endif
+        builtinFFT = new SimdFFT3D(gridx, gridy, gridz);
     
     // Initialize the b-spline moduli.
 
     int maxSize = std::max(std::max(gridx, gridy), gridz);
-    vector<double> data(PME_ORDER);
-    vector<double> ddata(PME_ORDER);
-    vector<double> bsplinesData(maxSize);
-    data[PME_ORDER-1] = 0.0;
+    vector<double> data(order);
+    vector<double> ddata(order);
+    vector<double> bsplinesData(std::max(maxSize, order+1));
+    data[order-1] = 0.0;
     data[1] = 0.0;
     data[0] = 1.0;
-    for (int i = 3; i < PME_ORDER; i++) {
+    for (int i = 3; i < order; i++) {
         double div = 1.0/(i-1.0);
         data[i-1] = 0.0;
         for (int j = 1; j < (i-1); j++)
@@ -767,16 +1083,16 @@ void CpuCalcDispersionPmeReciprocalForceKernel::initialize(int xsize, int ysize,
     // Differentiate.
 
     ddata[0] = -data[0];
-    for (int i = 1; i < PME_ORDER; i++)
+    for (int i = 1; i < order; i++)
         ddata[i] = data[i-1]-data[i];
-    double div = 1.0/(PME_ORDER-1);
-    data[PME_ORDER-1] = 0.0;
-    for (int i = 1; i < (PME_ORDER-1); i++)
-        data[PME_ORDER-i-1] = div*(i*data[PME_ORDER-i-2]+(PME_ORDER-i)*data[PME_ORDER-i-1]);
+    double div = 1.0/(order-1);
+    data[order-1] = 0.0;
+    for (int i = 1; i < (order-1); i++)
+        data[order-i-1] = div*(i*data[order-i-2]+(order-i)*data[order-i-1]);
     data[0] = div*data[0];
-    for (int i = 0; i < maxSize; i++)
+    for (int i = 0; i < bsplinesData.size(); i++)
         bsplinesData[i] = 0.0;
-    for (int i = 1; i <= PME_ORDER; i++)
+    for (int i = 1; i <= order; i++)
         bsplinesData[i] = data[i-1];
 
     // Evaluate the actual bspline moduli for X/Y/Z.
@@ -812,23 +1128,26 @@ CpuCalcDispersionPmeReciprocalForceKernel::~CpuCalcDispersionPmeReciprocalForceK
     pthread_mutex_destroy(&lock);
     pthread_cond_destroy(&startCondition);
     pthread_cond_destroy(&endCondition);
-    for (auto grid : tempGrid)
-        fftwf_free(grid);
+    if (realGrid != NULL)
+        freeGrid(realGrid);
     if (complexGrid != NULL)
-        fftwf_free(complexGrid);
-    if (hasCreatedPlan) {
-        fftwf_destroy_plan(forwardFFT);
-        fftwf_destroy_plan(backwardFFT);
-    }
+        freeGrid(complexGrid);
+#ifdef OPENMM_PME_USE_FFTW
+    if (hasCreatedPlan)
+        releaseFFTPlans(gridx, gridy, gridz, numThreads);
+#endif
+    if (builtinFFT != NULL)
+        delete builtinFFT;
 }
 
 void CpuCalcDispersionPmeReciprocalForceKernel::runMainThread() {
     // This is the main thread that coordinates all the other ones.
 
     pthread_mutex_lock(&lock);
+    ThreadPool threads(numThreads, spinWait, cpuAffinity);
+    allocateGrids(threads, gridx, gridy, gridz, order, slabGrid, realGrid, complexGrid);
     isFinished = true;
     pthread_cond_signal(&endCondition);
-    ThreadPool threads(numThreads);
     while (true) {
         // Wait for the signal to start.
 
@@ -836,28 +1155,39 @@ void CpuCalcDispersionPmeReciprocalForceKernel::runMainThread() {
         if (isDeleted)
             break;
         posq = io->getPosq();
-        ComputeTask task(*this);
-        atomicCounter = 0;
-        threads.execute(task); // Signal threads to perform charge spreading.
+        threads.execute([&] (ThreadPool& threads, int threadIndex) { runSpreadingStage(threads, threadIndex); }); // Signal threads to sort atoms into slabs.
+        threads.waitForThreads();
+        threads.resumeThreads(); // Signal threads to perform charge spreading.
         threads.waitForThreads();
         threads.resumeThreads(); // Signal threads to sum the charge grids.
         threads.waitForThreads();
-        fftwf_execute_dft_r2c(forwardFFT, realGrid, complexGrid);
-        if (lastBoxVectors[0] != periodicBoxVectors[0] || lastBoxVectors[1] != periodicBoxVectors[1] || lastBoxVectors[2] != periodicBoxVectors[2]) {
-            threads.resumeThreads(); // Signal threads to compute the reciprocal scale factors.
-            threads.waitForThreads();
+#ifdef OPENMM_PME_USE_FFTW
+        if (!useBuiltinFFT)
+            fftwf_execute_dft_r2c(forwardFFT, realGrid, (fftwf_complex*) complexGrid);
+        else
+#endif
+            builtinFFT->transformRealToComplex(realGrid, complexGrid, threads);
+        bool boxChanged = (lastBoxVectors[0] != periodicBoxVectors[0] || lastBoxVectors[1] != periodicBoxVectors[1] || lastBoxVectors[2] != periodicBoxVectors[2]);
+        threads.execute([&] (ThreadPool& threads, int threadIndex) { runConvolutionStage(threads, threadIndex, boxChanged); });
+        if (boxChanged) {
+            threads.waitForThreads(); // Wait for threads to compute the reciprocal scale factors.
+            threads.resumeThreads();
         }
         if (includeEnergy) {
-            threads.resumeThreads(); // Signal threads to compute energy.
-            threads.waitForThreads();
+            threads.waitForThreads(); // Wait for threads to compute energy.
             for (auto e : threadEnergy)
                 energy += e;
+            threads.resumeThreads();
         }
-        threads.resumeThreads(); // Signal threads to perform reciprocal convolution.
-        threads.waitForThreads();
-        fftwf_execute_dft_c2r(backwardFFT, complexGrid, realGrid);
+        threads.waitForThreads(); // Wait for threads to perform reciprocal convolution.
+#ifdef OPENMM_PME_USE_FFTW
+        if (!useBuiltinFFT)
+            fftwf_execute_dft_c2r(backwardFFT, (fftwf_complex*) complexGrid, realGrid);
+        else
+#endif
+            builtinFFT->transformComplexToReal(complexGrid, realGrid, threads);
         atomicCounter = 0;
-        threads.resumeThreads(); // Signal threads to interpolate forces.
+        threads.execute([&] (ThreadPool& threads, int threadIndex) { runInterpolationStage(threads, threadIndex); }); // Signal threads to interpolate forces.
         threads.waitForThreads();
         isFinished = true;
         lastBoxVectors[0] = periodicBoxVectors[0];
@@ -868,27 +1198,26 @@ void CpuCalcDispersionPmeReciprocalForceKernel::runMainThread() {
     pthread_mutex_unlock(&lock);
 }
 
-void CpuCalcDispersionPmeReciprocalForceKernel::runWorkerThread(ThreadPool& threads, int index) {
+void CpuCalcDispersionPmeReciprocalForceKernel::runSpreadingStage(ThreadPool& threads, int index) {
     int gridxStart = (index*gridx)/numThreads;
     int gridxEnd = ((index+1)*gridx)/numThreads;
-    int gridSize = (gridx*gridy*gridz+3)/4;
-    int gridStart = 4*((index*gridSize)/numThreads);
-    int gridEnd = 4*(((index+1)*gridSize)/numThreads);
-    int complexSize = gridx*gridy*(gridz/2+1);
-    int complexStart = std::max(1, ((index*complexSize)/numThreads));
-    int complexEnd = (((index+1)*complexSize)/numThreads);
     const float epsilonFactor = 1.0f;
-    spreadCharge(posq, tempGrid[index], gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors, atomicCounter, epsilonFactor, index, numThreads, deterministic);
+    findSlabAtoms(posq, (index*numParticles)/numThreads, ((index+1)*numParticles)/numThreads, gridx, gridy, gridz, periodicBoxVectors, recipBoxVectors, planeSlab, slabAtoms[index]);
     threads.syncThreads();
-    int numGrids = tempGrid.size();
-    for (int i = gridStart; i < gridEnd; i += 4) {
-        fvec4 sum(&realGrid[i]);
-        for (int j = 1; j < numGrids; j++)
-            sum += fvec4(&tempGrid[j][i]);
-        sum.store(&realGrid[i]);
-    }
+    int numSlabPlanes = slabGrid[index].size()/(gridy*gridz);
+    spreadCharge(order, posq, slabGrid[index].data(), gridx, gridy, gridz, gridxStart, numSlabPlanes, slabAtoms, index, periodicBoxVectors, recipBoxVectors, epsilonFactor);
     threads.syncThreads();
-    if (lastBoxVectors[0] != periodicBoxVectors[0] || lastBoxVectors[1] != periodicBoxVectors[1] || lastBoxVectors[2] != periodicBoxVectors[2]) {
+    sumSlabGrids(realGrid, slabGrid, slabStart, gridxStart, gridxEnd, gridx, gridy, gridz);
+}
+
+void CpuCalcDispersionPmeReciprocalForceKernel::runConvolutionStage(ThreadPool& threads, int index, bool boxChanged) {
+    int gridxStart = (index*gridx)/numThreads;
+    int gridxEnd = ((index+1)*gridx)/numThreads;
+    int complexSize = gridx*gridy*(gridz/2+1);
+    // For dispersion, we include the {0,0,0} term.
+    int complexStart = (index*complexSize)/numThreads;
+    int complexEnd = (((index+1)*complexSize)/numThreads);
+    if (boxChanged) {
         computeReciprocalDispersionEterm(gridxStart, gridxEnd, gridx, gridy, gridz, recipEterm, alpha, bsplineModuli, periodicBoxVectors, recipBoxVectors);
         threads.syncThreads();
     }
@@ -896,14 +1225,28 @@ void CpuCalcDispersionPmeReciprocalForceKernel::runWorkerThread(ThreadPool& thre
         threadEnergy[index] = reciprocalDispersionEnergy(gridxStart, gridxEnd, complexGrid, recipEterm, gridx, gridy, gridz, alpha, bsplineModuli, periodicBoxVectors, recipBoxVectors);
         threads.syncThreads();
     }
-    // For dispersion, we include the {0,0,0} term, so the start point needs to be redefined
-    complexStart = (index*complexSize)/numThreads;
     reciprocalConvolution(complexStart, complexEnd, complexGrid, recipEterm);
-    threads.syncThreads();
-    interpolateForces(posq, &force[0], realGrid, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors, atomicCounter, epsilonFactor);
+}
+
+void CpuCalcDispersionPmeReciprocalForceKernel::runInterpolationStage(ThreadPool& threads, int index) {
+    const float epsilonFactor = 1.0f;
+    interpolateForces(order, posq, &force[0], realGrid, gridx, gridy, gridz, numParticles, periodicBoxVectors, recipBoxVectors, atomicCounter, epsilonFactor);
 }
 
 void CpuCalcDispersionPmeReciprocalForceKernel::beginComputation(CalcPmeReciprocalForceKernel::IO& io, const Vec3* periodicBoxVectors, bool includeEnergy) {
+    // If nothing has changed since the last calculation, its results are still valid.  The energy can
+    // only be reused if it was computed.
+
+    float* newPosq = io.getPosq();
+    useCachedResult = (hasCachedResult && (cachedResultHasEnergy || !includeEnergy) && lastBoxVectors[0] == periodicBoxVectors[0] &&
+            lastBoxVectors[1] == periodicBoxVectors[1] && lastBoxVectors[2] == periodicBoxVectors[2] &&
+            memcmp(newPosq, cachedPosq.data(), 4*numParticles*sizeof(float)) == 0);
+    if (useCachedResult) {
+        this->includeEnergy = includeEnergy;
+        return;
+    }
+    cachedPosq.assign(newPosq, newPosq+4*numParticles);
+    hasCachedResult = false;
     this->io = &io;
     this->periodicBoxVectors[0] = periodicBoxVectors[0];
     this->periodicBoxVectors[1] = periodicBoxVectors[1];
@@ -928,11 +1271,17 @@ void CpuCalcDispersionPmeReciprocalForceKernel::beginComputation(CalcPmeReciproc
 }
 
 double CpuCalcDispersionPmeReciprocalForceKernel::finishComputation(CalcPmeReciprocalForceKernel::IO& io) {
+    if (useCachedResult) {
+        io.setForce(&force[0]);
+        return (includeEnergy ? energy : 0.0);
+    }
     pthread_mutex_lock(&lock);
     while (!isFinished) {
         pthread_cond_wait(&endCondition, &lock);
     }
     pthread_mutex_unlock(&lock);
+    hasCachedResult = true;
+    cachedResultHasEnergy = includeEnergy;
     io.setForce(&force[0]);
     return energy;
 }
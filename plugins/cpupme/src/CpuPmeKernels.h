@@ -37,22 +37,52 @@
 #include "openmm/kernels.h"
 #include "openmm/Vec3.h"
 #include "openmm/internal/ThreadPool.h"
+#include "SimdFFT3D.h"
 #include <atomic>
+#include <complex>
+#ifdef OPENMM_PME_USE_FFTW
 #include <fftw3.h>
+#endif
 #include <pthread.h>
+#include <string>
 #include <vector>
 
 namespace OpenMM {
 
 /**
  * This is an optimized CPU implementation of CalcPmeReciprocalForceKernel.  It is both
- * vectorized (requiring SSE 4.1) and multithreaded.  It uses FFTW to perform the FFTs.
+ * vectorized (requiring SSE 4.1) and multithreaded.  It uses FFTW to perform the FFTs if the plugin was
+ * built with it, and otherwise uses SimdFFT3D.
  */
 
 class OPENMM_EXPORT_PME CpuCalcPmeReciprocalForceKernel : public CalcPmeReciprocalForceKernel {
 public:
-    CpuCalcPmeReciprocalForceKernel(const std::string& name, const Platform& platform) : CalcPmeReciprocalForceKernel(name, platform),
-            hasCreatedPlan(false), isDeleted(false), realGrid(NULL), complexGrid(NULL) {
+    /**
+     * Create the kernel.
+     *
+     * @param name         the name of the kernel
+     * @param platform     the Platform that created it
+     * @param wisdomFile     the file in which to store FFTW wisdom between processes.  If this is empty,
+     *                       wisdom is not saved.
+     * @param useBuiltinFFT  if true, SimdFFT3D is used to perform FFTs even if FFTW is available
+     * @param numThreads     the number of threads to use.  If this is 0, the number of threads is given by
+     *                       the OPENMM_CPU_THREADS environment variable, or the number of processors if that
+     *                       is not set.
+     * @param order          the order of the B-splines used to spread charges onto the grid and interpolate
+     *                       forces from it.  Values from 4 to 8 are supported.
+     * @param spinWait       if true, the worker threads spin for a limited time before sleeping when they wait
+     * @param cpuAffinity    the logical processors to pin the worker threads to, as described for ThreadPool.
+     *                       If this is empty, threads are not pinned.
+     */
+    CpuCalcPmeReciprocalForceKernel(const std::string& name, const Platform& platform, const std::string& wisdomFile="", bool useBuiltinFFT=false, int numThreads=0, int order=5,
+            bool spinWait=false, const std::vector<int>& cpuAffinity=std::vector<int>()) :
+            CalcPmeReciprocalForceKernel(name, platform), numThreads(numThreads), order(order), wisdomFile(wisdomFile), spinWait(spinWait), cpuAffinity(cpuAffinity), hasCreatedPlan(false),
+            isDeleted(false), hasCachedResult(false), realGrid(NULL), complexGrid(NULL), builtinFFT(NULL) {
+#ifdef OPENMM_PME_USE_FFTW
+        this->useBuiltinFFT = useBuiltinFFT;
+#else
+        this->useBuiltinFFT = true;
+#endif
     }
     /**
      * Initialize the kernel.
@@ -62,12 +92,18 @@ public:
      * @param gridz        the z size of the PME grid
      * @param numParticles the number of particles in the system
      * @param alpha        the Ewald blending parameter
-     * @param deterministic whether it should attempt to make the resulting forces deterministic
+     * @param deterministic whether it should attempt to make the resulting forces deterministic.  This is
+     *                      ignored, since charges are always spread and summed in a fixed order for a given
+     *                      number of threads.
      */
     void initialize(int xsize, int ysize, int zsize, int numParticles, double alpha, bool deterministic);
     ~CpuCalcPmeReciprocalForceKernel();
     /**
-     * Begin computing the force and energy.
+     * Begin computing the force and energy.  If the positions, charges, and periodic box are identical to
+     * the previous call, the forces and energy it computed are reused instead of being recomputed.  This
+     * makes it cheap to evaluate a force group containing only reciprocal space more than once at the
+     * same positions, for example when a multiple time step integrator or a Monte Carlo move requests the
+     * energy again.
      * 
      * @param io                  an object that coordinates data transfer
      * @param periodicBoxVectors  the vectors defining the periodic box (measured in nm)
@@ -86,9 +122,19 @@ public:
      */
     void runMainThread();
     /**
-     * This routine contains the code executed by each worker thread.
+     * This routine is executed by each worker thread to sort atoms into slabs, spread charge,
+     * and sum the charge grids.
+     */
+    void runSpreadingStage(ThreadPool& threads, int index);
+    /**
+     * This routine is executed by each worker thread to compute the energy and perform the
+     * reciprocal convolution, after the forward FFT.
+     */
+    void runConvolutionStage(ThreadPool& threads, int index, bool boxChanged);
+    /**
+     * This routine is executed by each worker thread to interpolate forces, after the backward FFT.
      */
-    void runWorkerThread(ThreadPool& threads, int index);
+    void runInterpolationStage(ThreadPool& threads, int index);
     /**
      * Get whether the current CPU supports all features needed by this kernel.
      */
@@ -108,20 +154,30 @@ private:
      */
     int findFFTDimension(int minimum, bool isZ);
     static bool hasInitializedThreads;
-    static int numThreads;
-    int gridx, gridy, gridz, numParticles;
+    static int defaultNumThreads;
+    int numThreads, order, gridx, gridy, gridz, numParticles;
     double alpha;
-    bool deterministic;
-    bool hasCreatedPlan, isFinished, isDeleted;
+    std::string wisdomFile;
+    bool spinWait;
+    std::vector<int> cpuAffinity;
+    bool useBuiltinFFT, hasCreatedPlan, isFinished, isDeleted;
+    // The inputs to the last calculation, used to decide whether its results can be reused.
+    std::vector<float> cachedPosq;
+    bool hasCachedResult, cachedResultHasEnergy, useCachedResult;
     std::vector<float> force;
     std::vector<float> bsplineModuli[3];
     std::vector<float> recipEterm;
     Vec3 lastBoxVectors[3];
     std::vector<float> threadEnergy;
-    std::vector<float*> tempGrid;
+    std::vector<std::vector<float> > slabGrid;
+    std::vector<int> slabStart, planeSlab;
+    std::vector<std::vector<std::vector<int> > > slabAtoms;
     float* realGrid;
-    fftwf_complex* complexGrid;
+    std::complex<float>* complexGrid;
+#ifdef OPENMM_PME_USE_FFTW
     fftwf_plan forwardFFT, backwardFFT;
+#endif
+    SimdFFT3D* builtinFFT;
     int waitCount;
     pthread_cond_t startCondition, endCondition;
     pthread_mutex_t lock;
@@ -139,13 +195,38 @@ private:
 
 /**
  * This is an optimized CPU implementation of CalcDispersionPmeReciprocalForceKernel.  It is both
- * vectorized (requiring SSE 4.1) and multithreaded.  It uses FFTW to perform the FFTs.
+ * vectorized (requiring SSE 4.1) and multithreaded.  It uses FFTW to perform the FFTs if the plugin was
+ * built with it, and otherwise uses SimdFFT3D.
  */
 
 class OPENMM_EXPORT_PME CpuCalcDispersionPmeReciprocalForceKernel : public CalcDispersionPmeReciprocalForceKernel {
 public:
-    CpuCalcDispersionPmeReciprocalForceKernel(const std::string& name, const Platform& platform) : CalcDispersionPmeReciprocalForceKernel(name, platform),
-            hasCreatedPlan(false), isDeleted(false), realGrid(NULL), complexGrid(NULL)  {
+    /**
+     * Create the kernel.
+     *
+     * @param name         the name of the kernel
+     * @param platform     the Platform that created it
+     * @param wisdomFile     the file in which to store FFTW wisdom between processes.  If this is empty,
+     *                       wisdom is not saved.
+     * @param useBuiltinFFT  if true, SimdFFT3D is used to perform FFTs even if FFTW is available
+     * @param numThreads     the number of threads to use.  If this is 0, the number of threads is given by
+     *                       the OPENMM_CPU_THREADS environment variable, or the number of processors if that
+     *                       is not set.
+     * @param order          the order of the B-splines used to spread charges onto the grid and interpolate
+     *                       forces from it.  Values from 4 to 8 are supported.
+     * @param spinWait       if true, the worker threads spin for a limited time before sleeping when they wait
+     * @param cpuAffinity    the logical processors to pin the worker threads to, as described for ThreadPool.
+     *                       If this is empty, threads are not pinned.
+     */
+    CpuCalcDispersionPmeReciprocalForceKernel(const std::string& name, const Platform& platform, const std::string& wisdomFile="", bool useBuiltinFFT=false, int numThreads=0, int order=5,
+            bool spinWait=false, const std::vector<int>& cpuAffinity=std::vector<int>()) :
+            CalcDispersionPmeReciprocalForceKernel(name, platform), numThreads(numThreads), order(order), wisdomFile(wisdomFile), spinWait(spinWait), cpuAffinity(cpuAffinity), hasCreatedPlan(false),
+            isDeleted(false), hasCachedResult(false), realGrid(NULL), complexGrid(NULL), builtinFFT(NULL) {
+#ifdef OPENMM_PME_USE_FFTW
+        this->useBuiltinFFT = useBuiltinFFT;
+#else
+        this->useBuiltinFFT = true;
+#endif
     }
     /**
      * Initialize the kernel.
@@ -155,12 +236,18 @@ public:
      * @param gridz        the z size of the PME grid
      * @param numParticles the number of particles in the system
      * @param alpha        the Ewald blending parameter
-     * @param deterministic whether it should attempt to make the resulting forces deterministic
+     * @param deterministic whether it should attempt to make the resulting forces deterministic.  This is
+     *                      ignored, since charges are always spread and summed in a fixed order for a given
+     *                      number of threads.
      */
     void initialize(int xsize, int ysize, int zsize, int numParticles, double alpha, bool deterministic);
     ~CpuCalcDispersionPmeReciprocalForceKernel();
     /**
-     * Begin computing the force and energy.
+     * Begin computing the force and energy.  If the positions, charges, and periodic box are identical to
+     * the previous call, the forces and energy it computed are reused instead of being recomputed.  This
+     * makes it cheap to evaluate a force group containing only reciprocal space more than once at the
+     * same positions, for example when a multiple time step integrator or a Monte Carlo move requests the
+     * energy again.
      * 
      * @param io                  an object that coordinates data transfer
      * @param periodicBoxVectors  the vectors defining the periodic box (measured in nm)
@@ -179,9 +266,19 @@ public:
      */
     void runMainThread();
     /**
-     * This routine contains the code executed by each worker thread.
+     * This routine is executed by each worker thread to sort atoms into slabs, spread charge,
+     * and sum the charge grids.
+     */
+    void runSpreadingStage(ThreadPool& threads, int index);
+    /**
+     * This routine is executed by each worker thread to compute the energy and perform the
+     * reciprocal convolution, after the forward FFT.
+     */
+    void runConvolutionStage(ThreadPool& threads, int index, bool boxChanged);
+    /**
+     * This routine is executed by each worker thread to interpolate forces, after the backward FFT.
      */
-    void runWorkerThread(ThreadPool& threads, int index);
+    void runInterpolationStage(ThreadPool& threads, int index);
     /**
      * Get whether the current CPU supports all features needed by this kernel.
      */
@@ -196,26 +293,35 @@ public:
      */
     void getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const;
 private:
-    class ComputeTask;
     /**
      * Select a size for one grid dimension that FFTW can handle efficiently.
      */
     int findFFTDimension(int minimum, bool isZ);
     static bool hasInitializedThreads;
-    static int numThreads;
-    int gridx, gridy, gridz, numParticles;
+    static int defaultNumThreads;
+    int numThreads, order, gridx, gridy, gridz, numParticles;
     double alpha;
-    bool deterministic;
-    bool hasCreatedPlan, isFinished, isDeleted;
+    std::string wisdomFile;
+    bool spinWait;
+    std::vector<int> cpuAffinity;
+    bool useBuiltinFFT, hasCreatedPlan, isFinished, isDeleted;
+    // The inputs to the last calculation, used to decide whether its results can be reused.
+    std::vector<float> cachedPosq;
+    bool hasCachedResult, cachedResultHasEnergy, useCachedResult;
     std::vector<float> force;
     std::vector<float> bsplineModuli[3];
     std::vector<float> recipEterm;
     Vec3 lastBoxVectors[3];
     std::vector<float> threadEnergy;
-    std::vector<float*> tempGrid;
+    std::vector<std::vector<float> > slabGrid;
+    std::vector<int> slabStart, planeSlab;
+    std::vector<std::vector<std::vector<int> > > slabAtoms;
     float* realGrid;
-    fftwf_complex* complexGrid;
+    std::complex<float>* complexGrid;
+#ifdef OPENMM_PME_USE_FFTW
     fftwf_plan forwardFFT, backwardFFT;
+#endif
+    SimdFFT3D* builtinFFT;
     int waitCount;
     pthread_cond_t startCondition, endCondition;
     pthread_mutex_t lock;
@@ -42,9 +42,13 @@
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/Units.h"
 #include "../src/CpuPmeKernels.h"
+#include "ReferencePME.h"
 #include "SimTKOpenMMRealType.h"
 #include "sfmt/SFMT.h"
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <thread>
 #include <vector>
 
 using namespace OpenMM;
@@ -565,7 +569,7 @@ void test_water2_dpme_energies_forces_no_exclusions() {
 }
 
 
-void testPME(bool triclinic) {
+void testPME(bool triclinic, bool useBuiltinFFT=false) {
     // Create a cloud of random point charges.
 
     const int numParticles = 51;
@@ -613,7 +617,7 @@ void testPME(bool triclinic) {
     double alpha;
     int gridx, gridy, gridz;
     NonbondedForceImpl::calcPMEParameters(system, *force, alpha, gridx, gridy, gridz, false);
-    CpuCalcPmeReciprocalForceKernel pme(CalcPmeReciprocalForceKernel::Name(), platform);
+    CpuCalcPmeReciprocalForceKernel pme(CalcPmeReciprocalForceKernel::Name(), platform, "", useBuiltinFFT);
     IO io;
     double sumSquaredCharges = 0;
     for (int i = 0; i < numParticles; i++) {
@@ -637,6 +641,169 @@ void testPME(bool triclinic) {
         ASSERT_EQUAL_VEC(refState.getForces()[i], Vec3(io.force[4*i], io.force[4*i+1], io.force[4*i+2]), 1e-3);
 }
 
+void testPMEOrder(int order) {
+    // Create a cloud of random point charges.
+
+    const int numParticles = 51;
+    const double boxWidth = 5.0;
+    const double alpha = 2.5;
+    Vec3 boxVectors[3];
+    boxVectors[0] = Vec3(boxWidth, 0, 0);
+    boxVectors[1] = Vec3(0.2*boxWidth, boxWidth, 0);
+    boxVectors[2] = Vec3(-0.3*boxWidth, -0.1*boxWidth, boxWidth);
+    vector<Vec3> positions(numParticles);
+    vector<double> charges(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    IO io;
+    for (int i = 0; i < numParticles; i++) {
+        charges[i] = -1.0+i*2.0/(numParticles-1);
+        positions[i] = Vec3(boxWidth*genrand_real2(sfmt), boxWidth*genrand_real2(sfmt), boxWidth*genrand_real2(sfmt));
+        io.posq.push_back(positions[i][0]);
+        io.posq.push_back(positions[i][1]);
+        io.posq.push_back(positions[i][2]);
+        io.posq.push_back(charges[i]);
+    }
+
+    // Compute the reciprocal space forces with the optimized kernel.
+
+    Platform& platform = Platform::getPlatformByName("Reference");
+    CpuCalcPmeReciprocalForceKernel pme(CalcPmeReciprocalForceKernel::Name(), platform, "", false, 0, order);
+    pme.initialize(40, 41, 42, numParticles, alpha, true);
+    pme.beginComputation(io, boxVectors, true);
+    double energy = pme.finishComputation(io);
+
+    // Compute them with the reference implementation, using the same grid and order.
+
+    double actualAlpha;
+    int grid[3];
+    pme.getPMEParameters(actualAlpha, grid[0], grid[1], grid[2]);
+    pme_t referencePme;
+    pme_init(&referencePme, alpha, numParticles, grid, order, 1.0);
+    vector<Vec3> referenceForces(numParticles);
+    double referenceEnergy = 0.0;
+    pme_exec(referencePme, positions, referenceForces, charges, boxVectors, &referenceEnergy);
+    pme_destroy(referencePme);
+
+    // See if they match.
+
+    ASSERT_EQUAL_TOL(referenceEnergy, energy, 1e-3);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(referenceForces[i], Vec3(io.force[4*i], io.force[4*i+1], io.force[4*i+2]), 1e-3);
+
+    // Repeat the comparison for dispersion, treating the absolute values of the charges as C6 coefficients.
+    // The optimized kernel uses an approximation to erfc, so the tolerance is looser.
+
+    for (int i = 0; i < numParticles; i++) {
+        charges[i] = fabs(charges[i]);
+        io.posq[4*i+3] = charges[i];
+    }
+    CpuCalcDispersionPmeReciprocalForceKernel dpme(CalcDispersionPmeReciprocalForceKernel::Name(), platform, "", false, 0, order);
+    dpme.initialize(grid[0], grid[1], grid[2], numParticles, alpha, true);
+    dpme.beginComputation(io, boxVectors, true);
+    energy = dpme.finishComputation(io);
+    pme_init(&referencePme, alpha, numParticles, grid, order, 1.0);
+    referenceForces.assign(numParticles, Vec3());
+    referenceEnergy = 0.0;
+    pme_exec_dpme(referencePme, positions, referenceForces, charges, boxVectors, &referenceEnergy);
+    pme_destroy(referencePme);
+    ASSERT_EQUAL_TOL(referenceEnergy, energy, 1e-3);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(referenceForces[i], Vec3(io.force[4*i], io.force[4*i+1], io.force[4*i+2]), 5e-3);
+}
+
+void testCachedResults() {
+    // Create a cloud of random point charges.
+
+    const int numParticles = 51;
+    const double boxWidth = 5.0;
+    const double alpha = 2.5;
+    Vec3 boxVectors[3];
+    boxVectors[0] = Vec3(boxWidth, 0, 0);
+    boxVectors[1] = Vec3(0, boxWidth, 0);
+    boxVectors[2] = Vec3(0, 0, boxWidth);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    IO io;
+    for (int i = 0; i < numParticles; i++) {
+        io.posq.push_back(boxWidth*genrand_real2(sfmt));
+        io.posq.push_back(boxWidth*genrand_real2(sfmt));
+        io.posq.push_back(boxWidth*genrand_real2(sfmt));
+        io.posq.push_back(-1.0+i*2.0/(numParticles-1));
+    }
+    Platform& platform = Platform::getPlatformByName("Reference");
+    CpuCalcPmeReciprocalForceKernel pme(CalcPmeReciprocalForceKernel::Name(), platform);
+    pme.initialize(32, 32, 32, numParticles, alpha, true);
+
+    // Compare the cached kernel to one that computes everything from scratch.
+
+    auto checkResults = [&] (bool includeEnergy) {
+        pme.beginComputation(io, boxVectors, includeEnergy);
+        double energy = pme.finishComputation(io);
+        vector<float> force(io.force, io.force+4*numParticles);
+        CpuCalcPmeReciprocalForceKernel pme2(CalcPmeReciprocalForceKernel::Name(), platform);
+        pme2.initialize(32, 32, 32, numParticles, alpha, true);
+        pme2.beginComputation(io, boxVectors, true);
+        double expectedEnergy = pme2.finishComputation(io);
+        if (includeEnergy)
+            ASSERT_EQUAL_TOL(expectedEnergy, energy, 1e-5);
+        for (int i = 0; i < numParticles; i++)
+            ASSERT_EQUAL_VEC(Vec3(io.force[4*i], io.force[4*i+1], io.force[4*i+2]), Vec3(force[4*i], force[4*i+1], force[4*i+2]), 1e-5);
+    };
+
+    // Computing forces first and then energy at the same positions must still produce the energy.
+
+    checkResults(false);
+    checkResults(true);
+    checkResults(true);
+
+    // Changing a position, a charge, or the box must invalidate the cache.
+
+    io.posq[4*10] += 0.1f;
+    checkResults(true);
+    io.posq[4*20+3] *= -1;
+    checkResults(true);
+    boxVectors[1] = Vec3(0.1*boxWidth, boxWidth, 0);
+    checkResults(true);
+}
+
+void testDeterministicForces() {
+    // Create a cloud of random point charges.
+
+    const int numParticles = 500;
+    const double boxWidth = 5.0;
+    const double alpha = 2.5;
+    Vec3 boxVectors[3];
+    boxVectors[0] = Vec3(boxWidth, 0, 0);
+    boxVectors[1] = Vec3(0, boxWidth, 0);
+    boxVectors[2] = Vec3(0, 0, boxWidth);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    IO io;
+    for (int i = 0; i < numParticles; i++) {
+        io.posq.push_back(boxWidth*genrand_real2(sfmt));
+        io.posq.push_back(boxWidth*genrand_real2(sfmt));
+        io.posq.push_back(boxWidth*genrand_real2(sfmt));
+        io.posq.push_back(-1.0+i*2.0/(numParticles-1));
+    }
+
+    // Even without requesting deterministic forces, separate kernels should produce identical results.
+
+    Platform& platform = Platform::getPlatformByName("Reference");
+    CpuCalcPmeReciprocalForceKernel pme1(CalcPmeReciprocalForceKernel::Name(), platform, "", false, 4);
+    pme1.initialize(32, 32, 32, numParticles, alpha, false);
+    pme1.beginComputation(io, boxVectors, true);
+    double energy1 = pme1.finishComputation(io);
+    vector<float> force1(io.force, io.force+4*numParticles);
+    CpuCalcPmeReciprocalForceKernel pme2(CalcPmeReciprocalForceKernel::Name(), platform, "", false, 4);
+    pme2.initialize(32, 32, 32, numParticles, alpha, false);
+    pme2.beginComputation(io, boxVectors, true);
+    double energy2 = pme2.finishComputation(io);
+    ASSERT_EQUAL(energy1, energy2);
+    for (int i = 0; i < 4*numParticles; i++)
+        ASSERT_EQUAL(force1[i], io.force[i]);
+}
+
 void testLJPME(bool triclinic) {
     // Create a cloud of random LJ particles.
 
@@ -706,6 +873,136 @@ void testLJPME(bool triclinic) {
         ASSERT_EQUAL_VEC(refState.getForces()[i], Vec3(io.force[4*i], io.force[4*i+1], io.force[4*i+2]), 1e-3);
 }
 
+#ifdef OPENMM_PME_USE_FFTW
+void testWisdomFile() {
+    // Create a cloud of random point charges.
+
+    const int numParticles = 51;
+    const double boxWidth = 3.0;
+    const double alpha = 3.0;
+    const int grid = 30;
+    Vec3 boxVectors[3] = {Vec3(boxWidth, 0, 0), Vec3(0, boxWidth, 0), Vec3(0, 0, boxWidth)};
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    IO io1, io2;
+    for (int i = 0; i < numParticles; i++) {
+        for (int j = 0; j < 3; j++)
+            io1.posq.push_back(boxWidth*genrand_real2(sfmt));
+        io1.posq.push_back(-1.0+i*2.0/(numParticles-1));
+    }
+    io2.posq = io1.posq;
+
+    // Create two kernels with the same grid.  The first one should create the wisdom file, and the
+    // second one should share its plans.
+
+    string wisdomFile = "TestCpuPmeWisdom.txt";
+    remove(wisdomFile.c_str());
+    Platform& platform = Platform::getPlatformByName("Reference");
+    double energy1, energy2;
+    {
+        CpuCalcPmeReciprocalForceKernel pme1(CalcPmeReciprocalForceKernel::Name(), platform, wisdomFile);
+        pme1.initialize(grid, grid, grid, numParticles, alpha, true);
+        ASSERT(ifstream(wisdomFile.c_str()).good());
+        CpuCalcPmeReciprocalForceKernel pme2(CalcPmeReciprocalForceKernel::Name(), platform, wisdomFile);
+        pme2.initialize(grid, grid, grid, numParticles, alpha, true);
+        pme1.beginComputation(io1, boxVectors, true);
+        energy1 = pme1.finishComputation(io1);
+        pme2.beginComputation(io2, boxVectors, true);
+        energy2 = pme2.finishComputation(io2);
+        ASSERT_EQUAL_TOL(energy1, energy2, 1e-6);
+        for (int i = 0; i < numParticles; i++)
+            ASSERT_EQUAL_VEC(Vec3(io1.force[4*i], io1.force[4*i+1], io1.force[4*i+2]), Vec3(io2.force[4*i], io2.force[4*i+1], io2.force[4*i+2]), 1e-6);
+    }
+
+    // After the plans have been released, a new kernel should still produce the same result.
+
+    IO io3;
+    io3.posq = io1.posq;
+    CpuCalcPmeReciprocalForceKernel pme3(CalcPmeReciprocalForceKernel::Name(), platform, wisdomFile);
+    pme3.initialize(grid, grid, grid, numParticles, alpha, true);
+    pme3.beginComputation(io3, boxVectors, true);
+    ASSERT_EQUAL_TOL(energy1, pme3.finishComputation(io3), 1e-6);
+    remove(wisdomFile.c_str());
+}
+
+void testSharedPlans() {
+    // Create a cloud of random point charges, and compute the reference result for two grid sizes.
+
+    const int numParticles = 51;
+    const double boxWidth = 3.0;
+    const double alpha = 3.0;
+    const int grids[2] = {24, 20};
+    Vec3 boxVectors[3] = {Vec3(boxWidth, 0, 0), Vec3(0, boxWidth, 0), Vec3(0, 0, boxWidth)};
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<float> posq;
+    vector<Vec3> positions(numParticles);
+    vector<double> charges(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        positions[i] = Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*boxWidth;
+        charges[i] = -1.0+i*2.0/(numParticles-1);
+        posq.push_back(positions[i][0]);
+        posq.push_back(positions[i][1]);
+        posq.push_back(positions[i][2]);
+        posq.push_back(charges[i]);
+    }
+    double referenceEnergy[2], referenceDispersionEnergy = 0.0;
+    vector<Vec3> referenceForces(numParticles);
+    for (int i = 0; i < 2; i++) {
+        int grid[3] = {grids[i], grids[i], grids[i]};
+        pme_t referencePme;
+        pme_init(&referencePme, alpha, numParticles, grid, 5, 1.0);
+        referenceEnergy[i] = 0.0;
+        pme_exec(referencePme, positions, referenceForces, charges, boxVectors, &referenceEnergy[i]);
+        pme_destroy(referencePme);
+    }
+    vector<double> c6s(numParticles);
+    for (int i = 0; i < numParticles; i++)
+        c6s[i] = fabs(charges[i]);
+    int dispersionGrid[3] = {grids[0], grids[0], grids[0]};
+    pme_t referencePme;
+    pme_init(&referencePme, alpha, numParticles, dispersionGrid, 5, 1.0);
+    pme_exec_dpme(referencePme, positions, referenceForces, c6s, boxVectors, &referenceDispersionEnergy);
+    pme_destroy(referencePme);
+
+    // Create several kernels from different threads at once, so they try to create plans at the same time.
+    // Kernels with the same grid share plans, and the electrostatic and dispersion kernels share them too.
+
+    Platform& platform = Platform::getPlatformByName("Reference");
+    const int numKernels = 6;
+    vector<CpuCalcPmeReciprocalForceKernel*> kernels(numKernels);
+    CpuCalcDispersionPmeReciprocalForceKernel dispersion(CalcDispersionPmeReciprocalForceKernel::Name(), platform, "", false, 2);
+    vector<thread> threads;
+    for (int i = 0; i < numKernels; i++)
+        threads.push_back(thread([&, i] () {
+            kernels[i] = new CpuCalcPmeReciprocalForceKernel(CalcPmeReciprocalForceKernel::Name(), platform, "", false, 2);
+            kernels[i]->initialize(grids[i%2], grids[i%2], grids[i%2], numParticles, alpha, true);
+        }));
+    dispersion.initialize(grids[0], grids[0], grids[0], numParticles, alpha, true);
+    for (auto& t : threads)
+        t.join();
+
+    // Delete kernels one at a time.  The ones that remain should keep working after others sharing their
+    // plans are gone.
+
+    for (int i = 0; i < numKernels; i++) {
+        for (int j = i; j < numKernels; j++) {
+            IO io;
+            io.posq = posq;
+            kernels[j]->beginComputation(io, boxVectors, true);
+            ASSERT_EQUAL_TOL(referenceEnergy[j%2], kernels[j]->finishComputation(io), 1e-3);
+        }
+        delete kernels[i];
+    }
+    IO io;
+    io.posq = posq;
+    for (int i = 0; i < numParticles; i++)
+        io.posq[4*i+3] = c6s[i];
+    dispersion.beginComputation(io, boxVectors, true);
+    ASSERT_EQUAL_TOL(referenceDispersionEnergy, dispersion.finishComputation(io), 1e-3);
+}
+#endif
+
 int main(int argc, char* argv[]) {
     try {
         if (!CpuCalcPmeReciprocalForceKernel::isProcessorSupported()) {
@@ -714,9 +1011,18 @@ int main(int argc, char* argv[]) {
         }
         testPME(false);
         testPME(true);
+        testPME(true, true);
+        for (int order = 4; order <= 8; order++)
+            testPMEOrder(order);
+        testCachedResults();
+        testDeterministicForces();
         testLJPME(false);
         testLJPME(true);
         test_water2_dpme_energies_forces_no_exclusions();
+#ifdef OPENMM_PME_USE_FFTW
+        testWisdomFile();
+        testSharedPlans();
+#endif
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
@@ -33,9 +33,11 @@
 #include "openmm/AndersenThermostat.h"
 #include "openmm/Context.h"
 #include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
 #include "openmm/System.h"
 #include "openmm/VerletIntegrator.h"
 #include "sfmt/SFMT.h"
+#include <future>
 #include <iostream>
 #include <sstream>
 #include <vector>
@@ -116,12 +118,148 @@ void testSetState() {
     }
 }
 
+void testReuseState() {
+    const int numParticles = 10;
+    const double boxSize = 3.0;
+    System system;
+    NonbondedForce* nonbonded = new NonbondedForce();
+    system.addForce(nonbonded);
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.1 : -0.1, 0.2, 0.1);
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    }
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    context.setVelocitiesToTemperature(300.0);
+    integrator.step(10);
+
+    // Filling in an existing State should give the same result as creating a new one.
+
+    int types = State::Positions | State::Velocities | State::Forces | State::Energy;
+    State reused;
+    context.getState(reused, types);
+    const Vec3* positionData = &reused.getPositions()[0];
+    integrator.step(10);
+    context.getState(reused, types);
+    State created = context.getState(types);
+    ASSERT_EQUAL(types, reused.getDataTypes());
+    ASSERT_EQUAL(created.getTime(), reused.getTime());
+    ASSERT_EQUAL_TOL(created.getPotentialEnergy(), reused.getPotentialEnergy(), TOL);
+    ASSERT_EQUAL_TOL(created.getKineticEnergy(), reused.getKineticEnergy(), TOL);
+    ASSERT(positionData == &reused.getPositions()[0]);
+    for (int i = 0; i < numParticles; i++) {
+        ASSERT_EQUAL_VEC(created.getPositions()[i], reused.getPositions()[i], TOL);
+        ASSERT_EQUAL_VEC(created.getVelocities()[i], reused.getVelocities()[i], TOL);
+        ASSERT_EQUAL_VEC(created.getForces()[i], reused.getForces()[i], TOL);
+    }
+
+    // Data that is not requested should be removed from the State.
+
+    context.getState(reused, State::Velocities);
+    ASSERT_EQUAL(State::Velocities, reused.getDataTypes());
+    bool threwException = false;
+    try {
+        reused.getPositions();
+    }
+    catch (const exception& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+
+    // Copy data into arrays, both for all particles and for a subset of them.
+
+    vector<double> allVelocities(3*numParticles);
+    reused.getVelocities(&allVelocities[0]);
+    for (int i = 0; i < numParticles; i++)
+        for (int j = 0; j < 3; j++)
+            ASSERT_EQUAL(created.getVelocities()[i][j], allVelocities[3*i+j]);
+    vector<int> subset = {7, 2, 5};
+    vector<float> positionSubset(3*subset.size()), forceSubset(3*subset.size());
+    created.getPositions(&positionSubset[0], subset);
+    created.getForces(&forceSubset[0], subset);
+    for (int i = 0; i < (int) subset.size(); i++)
+        for (int j = 0; j < 3; j++) {
+            ASSERT_EQUAL((float) created.getPositions()[subset[i]][j], positionSubset[3*i+j]);
+            ASSERT_EQUAL((float) created.getForces()[subset[i]][j], forceSubset[3*i+j]);
+        }
+}
+
+void testAsyncState() {
+    const int numParticles = 10;
+    const double boxSize = 3.0;
+    System system;
+    NonbondedForce* nonbonded = new NonbondedForce();
+    system.addForce(nonbonded);
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.1 : -0.1, 0.2, 0.1);
+        positions[i] = Vec3(boxSize*(3*genrand_real2(sfmt)-1), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    }
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    context.setVelocitiesToTemperature(300.0);
+
+    // Request States while the simulation continues, and compare them to ones retrieved directly.
+
+    int types = State::Positions | State::Velocities | State::Energy;
+    vector<State> expected;
+    vector<future<State> > results;
+    vector<double> callbackTimes;
+    for (int i = 0; i < 5; i++) {
+        integrator.step(5);
+        expected.push_back(context.getState(types, true));
+        results.push_back(context.getStateAsync(types, true, 0xFFFFFFFF, [&] (const State& state) {
+            callbackTimes.push_back(state.getTime());
+        }));
+    }
+    for (int i = 0; i < 5; i++) {
+        State state = results[i].get();
+        ASSERT_EQUAL(types, state.getDataTypes());
+        ASSERT_EQUAL(expected[i].getTime(), state.getTime());
+        ASSERT_EQUAL(expected[i].getTime(), callbackTimes[i]);
+        ASSERT_EQUAL_TOL(expected[i].getPotentialEnergy(), state.getPotentialEnergy(), TOL);
+        for (int j = 0; j < numParticles; j++) {
+            ASSERT_EQUAL_VEC(expected[i].getPositions()[j], state.getPositions()[j], TOL);
+            ASSERT_EQUAL_VEC(expected[i].getVelocities()[j], state.getVelocities()[j], TOL);
+        }
+    }
+
+    // An exception thrown by the callback should be passed on through the future.
+
+    future<State> failed = context.getStateAsync(State::Positions, false, 0xFFFFFFFF, [] (const State& state) {
+        throw OpenMMException("Failed to process State");
+    });
+    bool threwException = false;
+    try {
+        failed.get();
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
 void runPlatformTests();
 
 int main(int argc, char* argv[]) {
     try {
         initializeTests(argc, argv);
         testSetState();
+        testReuseState();
+        testAsyncState();
         runPlatformTests();
     }
     catch(const exception& e) {
@@ -1,9 +1,12 @@
 #include "../libraries/lepton/include/Lepton.h"
 #include "openmm/internal/AssertionUtilities.h"
 
+#include <chrono>
+#include <cstring>
 #include <iostream>
 #include <limits>
 #include <map>
+#include <sstream>
 
 using namespace Lepton;
 using namespace OpenMM;
@@ -36,6 +39,54 @@ class ExampleFunction : public CustomFunction {
     }
 };
 
+/**
+ * This is a custom function made of cubic polynomials on four intervals between 0.5 and 2.5.  It describes
+ * them with getUniformPolynomials(), so compiled expressions can evaluate it directly.
+ */
+
+class PolynomialFunction : public CustomFunction {
+public:
+    PolynomialFunction() : coefficients({1.0, -0.5, 0.3, 0.2, 1.0, 0.3, 0.1, -0.4, 1.0, 0.0, -1.2, 0.7, 0.5, 0.1, 0.9, -0.3}) {
+    }
+    int getNumArguments() const {
+        return 1;
+    }
+    double evaluate(const double* arguments) const {
+        int derivOrder = 0;
+        return evaluateDerivative(arguments, &derivOrder);
+    }
+    double evaluateDerivative(const double* arguments, const int* derivOrder) const {
+        double x = arguments[0];
+        if (x < 0.5 || x > 2.5)
+            return 0.0;
+        int interval = min((int) (2*(x-0.5)), 3);
+        double t = 2*(x-0.5)-interval;
+        const double* c = &coefficients[4*interval];
+        if (derivOrder[0] == 0)
+            return c[0]+t*(c[1]+t*(c[2]+t*c[3]));
+        return 2*(c[1]+t*(2*c[2]+t*3*c[3]));
+    }
+    CustomFunction* clone() const {
+        return new PolynomialFunction();
+    }
+    bool getUniformPolynomials(const int* derivOrder, double& min, double& max, vector<double>& result) const {
+        min = 0.5;
+        max = 2.5;
+        result = coefficients;
+        if (derivOrder[0] == 1)
+            for (int i = 0; i < 4; i++) {
+                const double* c = &coefficients[4*i];
+                result[4*i] = 2*c[1];
+                result[4*i+1] = 4*c[2];
+                result[4*i+2] = 6*c[3];
+                result[4*i+3] = 0.0;
+            }
+        return true;
+    }
+private:
+    vector<double> coefficients;
+};
+
 /**
  * Verify that an expression gives the correct value.
  */
@@ -114,6 +165,21 @@ void verifyEvaluation(const string& expression, double x, double y, double expec
     ASSERT_EQUAL(&x, &compiled2.getVariableReference("x"));
     ASSERT_EQUAL(&y, &compiled2.getVariableReference("y"));
 
+    // Create CompiledVectorExpressions and see if they also give the same result.
+
+    for (int width : CompiledVectorExpression::getAllowedWidths()) {
+        CompiledVectorExpression vectorExpression = parsed.createCompiledVectorExpression(width);
+        for (int i = 0; i < width; i++) {
+            if (vectorExpression.getVariables().find("x") != vectorExpression.getVariables().end())
+                vectorExpression.getVariablePointer("x")[i] = x;
+            if (vectorExpression.getVariables().find("y") != vectorExpression.getVariables().end())
+                vectorExpression.getVariablePointer("y")[i] = y;
+        }
+        const float* result = vectorExpression.evaluate();
+        for (int i = 0; i < width; i++)
+            ASSERT_EQUAL_TOL(expectedValue, result[i], 1e-5);
+    }
+
     // Make sure that variable renaming works.
 
     variables.clear();
@@ -222,7 +288,318 @@ void testCustomFunction(const string& expression, const string& equivalent) {
     verifySameValue(deriv3, deriv4, 2.0, -3.0);
 }
 
-int main() {
+/**
+ * Verify that ExpressionCache gives the same results as processing an expression directly.  The second time
+ * through the loop the trees come from the cache, which stores them with placeholders for the custom
+ * functions, so this also checks that the functions are replaced by the ones passed in.
+ */
+
+void testExpressionCache() {
+    ExpressionCache::clear();
+    map<string, CustomFunction*> functions;
+    ExampleFunction exampleFunction;
+    functions["custom"] = &exampleFunction;
+    string expression = "custom(x^2, y)*exp(-x)+custom(y, 3)";
+    ParsedExpression parsed = Parser::parse(expression, functions).optimize();
+    for (int i = 0; i < 2; i++) {
+        verifySameValue(ExpressionCache::parse(expression, functions), parsed, 1.5, 2.0);
+        verifySameValue(ExpressionCache::differentiate(expression, functions, "x"), parsed.differentiate("x").optimize(), 1.5, 2.0);
+        verifySameValue(ExpressionCache::differentiate(expression, functions, "y"), parsed.differentiate("y").optimize(), -0.5, 3.0);
+    }
+
+    // A function with a different number of arguments must not reuse the cached tree.
+
+    PlaceholderFunction placeholder(1);
+    functions["custom"] = &placeholder;
+    ASSERT_EQUAL(0.0, ExpressionCache::parse("custom(x)", functions).evaluate({{"x", 1.0}}));
+    functions["custom"] = &exampleFunction;
+    ASSERT_EQUAL(6.0, ExpressionCache::parse("custom(x, 3)", functions).evaluate({{"x", 1.0}}));
+    ExpressionCache::clear();
+}
+
+/**
+ * Verify that compiled expressions give the same results as ParsedExpression for a function they evaluate
+ * directly from its polynomial coefficients.  The points include both ends of the range, the boundaries
+ * between intervals, and points outside the range.
+ */
+
+void testUniformPolynomials() {
+    PolynomialFunction function;
+    map<string, CustomFunction*> functions;
+    functions["poly"] = &function;
+    ParsedExpression parsed = Parser::parse("3*poly(x)+x*poly(x^2)", functions);
+    ParsedExpression deriv = parsed.differentiate("x").optimize();
+    vector<ParsedExpression> expressions = {parsed, deriv};
+    CompiledExpression compiled = ParsedExpression::createCompiledExpression(expressions);
+    for (int width : CompiledVectorExpression::getAllowedWidths()) {
+        CompiledVectorExpression vectorExpression = ParsedExpression::createCompiledVectorExpression(expressions, width);
+        vector<float> x(width);
+        map<string, float*> variablePointers;
+        variablePointers["x"] = &x[0];
+        vectorExpression.setVariableLocations(variablePointers);
+        for (int i = 0; i < 61; i += width) {
+            for (int j = 0; j < width; j++)
+                x[j] = 0.05f*(i+j);
+            vectorExpression.evaluate();
+            for (int j = 0; j < width; j++) {
+                map<string, double> variables = {{"x", x[j]}};
+                compiled.getVariableReference("x") = x[j];
+                compiled.evaluate();
+                ASSERT_EQUAL_TOL(parsed.evaluate(variables), compiled.getResult(0), 1e-10);
+                ASSERT_EQUAL_TOL(deriv.evaluate(variables), compiled.getResult(1), 1e-10);
+                ASSERT_EQUAL_TOL(parsed.evaluate(variables), vectorExpression.getResult(0)[j], 1e-5);
+                ASSERT_EQUAL_TOL(deriv.evaluate(variables), vectorExpression.getResult(1)[j], 1e-5);
+            }
+        }
+    }
+}
+
+/**
+ * Differentiate an expression in which every subexpression is used twice.  Written out as a tree it would
+ * have 2^40 nodes, so this only finishes if each shared subexpression is processed once.
+ */
+
+void testNestedDerivative() {
+    const int depth = 40;
+    stringstream expression;
+    expression << "u" << depth;
+    for (int i = depth; i > 0; i--)
+        expression << "; u" << i << "=sin(u" << (i-1) << ")+0.5*u" << (i-1);
+    expression << "; u0=x";
+    ParsedExpression parsed = Parser::parse(expression.str()).optimize();
+    CompiledExpression deriv = parsed.differentiate("x").optimize().createCompiledExpression();
+    double x = 0.7;
+    deriv.getVariableReference("x") = x;
+    double u = x, expected = 1.0;
+    for (int i = 0; i < depth; i++) {
+        expected *= cos(u)+0.5;
+        u = sin(u)+0.5*u;
+    }
+    ASSERT_EQUAL_TOL(expected, deriv.evaluate(), 1e-10);
+}
+
+/**
+ * Verify that evaluating an ExpressionProgram at many points in one call gives the same results as
+ * evaluating it at each point separately.
+ */
+
+void testBatchEvaluation(const string& expression) {
+    ExampleFunction exampleFunction;
+    map<string, CustomFunction*> customFunctions;
+    customFunctions["custom"] = &exampleFunction;
+    ExpressionProgram program = Parser::parse(expression, customFunctions).optimize().createProgram();
+    const int numPoints = 150;
+    vector<double> x(numPoints), y(numPoints), results(numPoints);
+    for (int i = 0; i < numPoints; i++) {
+        x[i] = 0.1+0.02*i;
+        y[i] = 1.5-0.01*i;
+    }
+    program.evaluate(numPoints, {"y", "x"}, {&y[0], &x[0]}, &results[0]);
+    for (int i = 0; i < numPoints; i++) {
+        map<string, double> variables = {{"x", x[i]}, {"y", y[i]}};
+        ASSERT_EQUAL_TOL(program.evaluate(variables), results[i], 1e-14);
+    }
+    if (expression.find('y') == string::npos)
+        return;
+    try {
+        program.evaluate(numPoints, {"x"}, {&x[0]}, &results[0]);
+    }
+    catch (const exception& ex) {
+        return;
+    }
+    throw exception();
+}
+
+/**
+ * Verify that a CompiledVectorExpression gives the same results as a CompiledExpression
+ * when every element of the vectors has a different value.
+ */
+
+void verifyVectorEvaluation(const string& expression) {
+    ExampleFunction exampleFunction;
+    map<string, CustomFunction*> customFunctions;
+    customFunctions["custom"] = &exampleFunction;
+    ParsedExpression parsed = Parser::parse(expression, customFunctions);
+    CompiledExpression compiled = parsed.createCompiledExpression();
+    for (int width : CompiledVectorExpression::getAllowedWidths()) {
+        CompiledVectorExpression vectorExpression = parsed.createCompiledVectorExpression(width);
+        vector<float> x(width), y(width);
+        map<string, float*> variablePointers;
+        variablePointers["x"] = &x[0];
+        variablePointers["y"] = &y[0];
+        vectorExpression.setVariableLocations(variablePointers);
+        for (int repeat = 0; repeat < 3; repeat++) {
+            for (int i = 0; i < width; i++) {
+                x[i] = 0.3f*(i+1)-0.1f*repeat;
+                y[i] = 2.0f-0.7f*i+0.5f*repeat;
+            }
+            const float* result = vectorExpression.evaluate();
+            for (int i = 0; i < width; i++) {
+                if (compiled.getVariables().find("x") != compiled.getVariables().end())
+                    compiled.getVariableReference("x") = x[i];
+                if (compiled.getVariables().find("y") != compiled.getVariables().end())
+                    compiled.getVariableReference("y") = y[i];
+                ASSERT_EQUAL_TOL(compiled.evaluate(), result[i], 1e-5);
+            }
+        }
+    }
+}
+
+/**
+ * Verify that a CompiledExpression agrees with ParsedExpression to within a relative tolerance over a wide
+ * range of arguments, including special values.
+ */
+
+void verifyCompiledFunction(const string& expression, double tol) {
+    ParsedExpression parsed = Parser::parse(expression).optimize();
+    CompiledExpression compiled = parsed.createCompiledExpression();
+    CompiledExpression copy = compiled;
+    const double inf = numeric_limits<double>::infinity();
+    vector<double> values = {-800.0, -50.0, -3.7, -1.0, -0.4, -1e-5, -0.0, 0.0, 1e-310, 1e-5, 0.3, 0.4999, 0.5, 1.0, 2.5,
+                             5.9, 26.0, 300.0, 709.5, 750.0, 1e300, inf, -inf, numeric_limits<double>::quiet_NaN()};
+    for (int i = -2000; i <= 2000; i++)
+        values.push_back(0.0137*i);
+    map<string, double> variables;
+    for (double x : values) {
+        variables["x"] = x;
+        double expected = parsed.evaluate(variables);
+        for (CompiledExpression* e : {&compiled, &copy}) {
+            if (e->getVariables().size() > 0)
+                e->getVariableReference("x") = x;
+            double value = e->evaluate();
+            bool correct;
+            if (expected != expected)
+                correct = (value != value);
+            else if (fabs(expected) < 1e-300 || fabs(expected) == inf)
+                correct = (value == expected || (fabs(value) < 1e-300 && fabs(expected) < 1e-300));
+            else
+                correct = (fabs(value-expected) <= tol*fabs(expected));
+            ASSERT(correct);
+        }
+    }
+}
+
+/**
+ * Verify that compiling several expressions together gives the same results as compiling them separately.
+ */
+
+void verifyJointCompilation(const vector<string>& expressions) {
+    vector<ParsedExpression> parsed;
+    vector<CompiledExpression> separate;
+    for (const string& expression : expressions) {
+        parsed.push_back(Parser::parse(expression).optimize());
+        separate.push_back(parsed.back().createCompiledExpression());
+    }
+    CompiledExpression joint = ParsedExpression::createCompiledExpression(parsed);
+    ASSERT_EQUAL((int) expressions.size(), joint.getNumResults());
+    CompiledExpression copy = joint;
+    double x = 0.7, y = 1.9;
+    map<string, double*> locations;
+    locations["x"] = &x;
+    locations["y"] = &y;
+    copy.setVariableLocations(locations);
+    for (int repeat = 0; repeat < 3; repeat++) {
+        x += 0.3;
+        y -= 0.5;
+        joint.getVariableReference("x") = x;
+        joint.getVariableReference("y") = y;
+        ASSERT_EQUAL_TOL(joint.evaluate(), copy.evaluate(), 1e-15);
+        for (int i = 0; i < (int) expressions.size(); i++) {
+            if (separate[i].getVariables().find("x") != separate[i].getVariables().end())
+                separate[i].getVariableReference("x") = x;
+            if (separate[i].getVariables().find("y") != separate[i].getVariables().end())
+                separate[i].getVariableReference("y") = y;
+            double expected = separate[i].evaluate();
+            ASSERT_EQUAL_TOL(expected, joint.getResult(i), 1e-15);
+            ASSERT_EQUAL_TOL(expected, copy.getResult(i), 1e-15);
+        }
+        ASSERT_EQUAL(joint.getResult(0), joint.evaluate());
+    }
+    for (int width : CompiledVectorExpression::getAllowedWidths()) {
+        CompiledVectorExpression vectorExpression = ParsedExpression::createCompiledVectorExpression(parsed, width);
+        ASSERT_EQUAL((int) expressions.size(), vectorExpression.getNumResults());
+        vector<float> xvec(width), yvec(width);
+        map<string, float*> variablePointers;
+        variablePointers["x"] = &xvec[0];
+        variablePointers["y"] = &yvec[0];
+        vectorExpression.setVariableLocations(variablePointers);
+        for (int i = 0; i < width; i++) {
+            xvec[i] = 0.3f*(i+1);
+            yvec[i] = 2.0f-0.7f*i;
+        }
+        vectorExpression.evaluate();
+        for (int j = 0; j < (int) expressions.size(); j++)
+            for (int i = 0; i < width; i++) {
+                if (separate[j].getVariables().find("x") != separate[j].getVariables().end())
+                    separate[j].getVariableReference("x") = xvec[i];
+                if (separate[j].getVariables().find("y") != separate[j].getVariables().end())
+                    separate[j].getVariableReference("y") = yvec[i];
+                ASSERT_EQUAL_TOL(separate[j].evaluate(), vectorExpression.getResult(j)[i], 1e-5);
+            }
+    }
+}
+
+/**
+ * Measure how long it takes to process the expressions used by the GBn2 implicit solvent model, the way
+ * CustomGBForce does when a Context is created: parse and optimize each one, take the derivatives that
+ * are needed, and compile them.
+ */
+
+void runBenchmark() {
+    map<string, CustomFunction*> functions;
+    PlaceholderFunction tableFunction(2);
+    functions["getd0"] = &tableFunction;
+    functions["getm0"] = &tableFunction;
+    vector<pair<string, vector<string> > > expressions = {
+        {"Ivdw+neckScale*Ineck;"
+         "Ineck=step(radius1+radius2+neckCut-r)*getm0(radindex1,radindex2)/(1+100*(r-getd0(radindex1,radindex2))^2+0.3*1000000*(r-getd0(radindex1,radindex2))^6);"
+         "Ivdw=select(step(r+sr2-or1), 0.5*(1/L-1/U+0.25*(r-sr2^2/r)*(1/(U^2)-1/(L^2))+0.5*log(L/U)/r), 0);"
+         "U=r+sr2;L=max(or1, D);D=abs(r-sr2);radius1=or1+offset; radius2=or2+offset;neckScale=0.826836; neckCut=0.68; offset=0.0195141",
+            {"r"}},
+        {"1/(1/or-tanh(alpha*psi-beta*psi^2+gamma*psi^3)/radius);psi=I*or; radius=or+offset; offset=0.0195141", {"I"}},
+        {"-0.5*138.935485*(1/soluteDielectric-1/solventDielectric)*charge^2/B; solventDielectric=78.5; soluteDielectric=1; kappa=0; offset=0.009", {"B"}},
+        {"-138.935485*(1/soluteDielectric-1/solventDielectric)*charge1*charge2/f;f=sqrt(r^2+B1*B2*exp(-r^2/(4*B1*B2)));"
+         "solventDielectric=78.5; soluteDielectric=1; kappa=0; offset=0.009", {"r", "B1", "B2"}}
+    };
+    const int repetitions = 100;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; i++) {
+        for (auto& expression : expressions) {
+            ParsedExpression parsed = Parser::parse(expression.first, functions).optimize();
+            vector<ParsedExpression> results = {parsed};
+            for (const string& variable : expression.second)
+                results.push_back(parsed.differentiate(variable).optimize());
+            CompiledExpression compiled = ParsedExpression::createCompiledExpression(results);
+        }
+    }
+    auto end = chrono::steady_clock::now();
+    cout << "Time to process the GBn2 expressions (milliseconds): " << chrono::duration<double, milli>(end-start).count()/repetitions << endl;
+
+    // Compare evaluating an ExpressionProgram one point at a time to evaluating it at all points at once.
+
+    ExpressionProgram program = Parser::parse("-138.935485*q/f; f=sqrt(r^2+B1*B2*exp(-r^2/(4*B1*B2)))").optimize().createProgram();
+    const int numPoints = 10000;
+    vector<double> r(numPoints), b1(numPoints, 0.15), b2(numPoints, 0.2), q(numPoints, 0.5), results(numPoints);
+    for (int i = 0; i < numPoints; i++)
+        r[i] = 0.1+0.0001*i;
+    start = chrono::steady_clock::now();
+    map<string, double> variables;
+    for (int i = 0; i < numPoints; i++) {
+        variables["r"] = r[i];
+        variables["B1"] = b1[i];
+        variables["B2"] = b2[i];
+        variables["q"] = q[i];
+        results[i] = program.evaluate(variables);
+    }
+    end = chrono::steady_clock::now();
+    cout << "Time to evaluate an ExpressionProgram one point at a time (ns per point): " << chrono::duration<double, nano>(end-start).count()/numPoints << endl;
+    start = chrono::steady_clock::now();
+    program.evaluate(numPoints, {"r", "B1", "B2", "q"}, {&r[0], &b1[0], &b2[0], &q[0]}, &results[0]);
+    end = chrono::steady_clock::now();
+    cout << "Time to evaluate an ExpressionProgram at all points at once (ns per point): " << chrono::duration<double, nano>(end-start).count()/numPoints << endl;
+}
+
+int main(int argc, char* argv[]) {
     try {
         verifyEvaluation("5", 5.0);
         verifyEvaluation("5*2", 10.0);
@@ -303,8 +680,27 @@ int main() {
         verifyDerivative("abs(3*x)", "step(3*x)*3+(1-step(3*x))*-3");
         verifyDerivative("floor(x)+0.5*x*ceil(x)", "0.5*ceil(x)");
         verifyDerivative("select(x, x^2, 3*x)", "select(x, 2*x, 3)");
+        verifyVectorEvaluation("x^6-2*y^-3+x^0.3");
+        verifyVectorEvaluation("exp(-x*y)*sqrt(abs(y))/(1+x)");
+        verifyVectorEvaluation("select(step(x-0.5), x, y)+delta(floor(x))+ceil(y)");
+        verifyVectorEvaluation("min(x, y)*max(x, 1)-cos(x)^2");
+        verifyVectorEvaluation("custom(x, y)+erfc(x)");
+        verifyCompiledFunction("erf(x)", 1e-12);
+        verifyCompiledFunction("erfc(x)", 1e-12);
+        verifyCompiledFunction("x^0.37", 1e-12);
+        verifyCompiledFunction("x^-2.5", 1e-12);
+        verifyCompiledFunction("x^7", 0.0);
+        verifyCompiledFunction("x^-3", 0.0);
+        verifyCompiledFunction("exp(-x^2)*log(1+x^2)+erfc(0.5*x)", 1e-12);
+        verifyJointCompilation({"x^6/(1+y^2)", "6*x^5/(1+y^2)", "-2*y*x^6/(1+y^2)^2"});
+        verifyJointCompilation({"exp(-x*y)", "x", "exp(-x*y)", "3", "y*exp(-x*y)+x"});
         testCustomFunction("custom(x, y)/2", "x*y");
         testCustomFunction("custom(x^2, 1)+custom(2, y-1)", "2*x^2+4*(y-1)");
+        testExpressionCache();
+        testNestedDerivative();
+        testUniformPolynomials();
+        testBatchEvaluation("custom(x, y)*exp(-x^2)+sqrt(y)/(1+x)-select(step(x-1), log(y+2), 3*cos(x))");
+        testBatchEvaluation("2.5");
         cout << Parser::parse("x*x").optimize() << endl;
         cout << Parser::parse("x*(x*x)").optimize() << endl;
         cout << Parser::parse("(x*x)*x").optimize() << endl;
@@ -312,6 +708,8 @@ int main() {
         cout << Parser::parse("1/(1+x)").optimize() << endl;
         cout << Parser::parse("x^(1/2)").optimize() << endl;
         cout << Parser::parse("log(3*cos(x))^(sqrt(4)-2)").optimize() << endl;
+        if (argc > 1 && strcmp(argv[1], "benchmark") == 0)
+            runBenchmark();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
@@ -0,0 +1,201 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: agent                                                             *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests ThreadPool.  If it is run with the argument "benchmark", it also measures how long it takes
+ * to dispatch a task to the threads and wait for them to finish, with and without spin waiting.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/internal/ThreadPool.h"
+#include "openmm/internal/hardware.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#ifdef __linux__
+    #include <sched.h>
+#endif
+
+using namespace OpenMM;
+using namespace std;
+
+void testExecute(bool spinWait) {
+    ThreadPool threads(4, spinWait);
+    ASSERT_EQUAL(4, threads.getNumThreads());
+    ASSERT_EQUAL(spinWait, threads.getSpinWait());
+    vector<int> count(threads.getNumThreads(), 0);
+    for (int i = 0; i < 1000; i++) {
+        threads.execute([&] (ThreadPool& pool, int threadIndex) { count[threadIndex]++; });
+        threads.waitForThreads();
+    }
+    for (int c : count)
+        ASSERT_EQUAL(1000, c);
+}
+
+void testSyncThreads(bool spinWait) {
+    // Each thread writes a value in one phase, then reads the values written by all threads in the next
+    // one.  This only works if syncThreads() really separates the phases.
+
+    const int numPhases = 5;
+    ThreadPool threads(4, spinWait);
+    int numThreads = threads.getNumThreads();
+    vector<int> values(numThreads), sums(numThreads);
+    for (int iteration = 0; iteration < 200; iteration++) {
+        threads.execute([&] (ThreadPool& pool, int threadIndex) {
+            for (int phase = 0; phase < numPhases; phase++) {
+                values[threadIndex] = iteration+phase+threadIndex;
+                pool.syncThreads();
+                int sum = 0;
+                for (int v : values)
+                    sum += v;
+                sums[threadIndex] = sum;
+                pool.syncThreads();
+            }
+        });
+        for (int phase = 0; phase < 2*numPhases; phase++) {
+            threads.waitForThreads();
+            threads.resumeThreads();
+        }
+        threads.waitForThreads();
+        int expected = numThreads*(iteration+numPhases-1)+numThreads*(numThreads-1)/2;
+        for (int s : sums)
+            ASSERT_EQUAL(expected, s);
+    }
+}
+
+void testCreateAndDestroy(bool spinWait) {
+    // Pools that are destroyed right after being created, or while idle, must shut down cleanly.
+
+    for (int i = 0; i < 50; i++) {
+        ThreadPool threads(3, spinWait);
+        if (i%2 == 0) {
+            atomic<int> count(0);
+            threads.execute([&] (ThreadPool& pool, int threadIndex) { count++; });
+            threads.waitForThreads();
+            ASSERT_EQUAL(3, count.load());
+        }
+    }
+}
+
+void testCpuAffinity() {
+    // Pin every thread to processor 0, which always exists, and check that they run there.
+
+    vector<int> cpus(1, 0);
+    ThreadPool threads(3, false, cpus);
+    ASSERT_EQUAL(1, threads.getCpuAffinity().size());
+    ASSERT_EQUAL(0, threads.getCpuAffinity()[0]);
+    ASSERT_EQUAL(0, ThreadPool(3).getCpuAffinity().size());
+#ifdef __linux__
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || !CPU_ISSET(0, &allowed))
+        return;
+    vector<int> cpu(threads.getNumThreads(), -1);
+    threads.execute([&] (ThreadPool& pool, int threadIndex) { cpu[threadIndex] = sched_getcpu(); });
+    threads.waitForThreads();
+    for (int c : cpu)
+        ASSERT_EQUAL(0, c);
+#endif
+}
+
+void testParseCpuAffinity() {
+    vector<int> cpus;
+    ASSERT(ThreadPool::getCpuAffinity("", cpus));
+    ASSERT_EQUAL(0, cpus.size());
+    ASSERT(ThreadPool::getCpuAffinity("3,0,8-10", cpus));
+    ASSERT_EQUAL(5, cpus.size());
+    ASSERT_EQUAL(3, cpus[0]);
+    ASSERT_EQUAL(0, cpus[1]);
+    ASSERT_EQUAL(8, cpus[2]);
+    ASSERT_EQUAL(9, cpus[3]);
+    ASSERT_EQUAL(10, cpus[4]);
+    ASSERT(!ThreadPool::getCpuAffinity("2-1", cpus));
+    ASSERT(!ThreadPool::getCpuAffinity("0,x", cpus));
+    ASSERT(!ThreadPool::getCpuAffinity("compactly", cpus));
+
+    // Both policies should order the same set of processors.
+
+    vector<int> compact, scatter;
+    ASSERT(ThreadPool::getCpuAffinity("compact", compact));
+    ASSERT(ThreadPool::getCpuAffinity("scatter", scatter));
+    ASSERT_EQUAL(compact.size(), scatter.size());
+    sort(compact.begin(), compact.end());
+    sort(scatter.begin(), scatter.end());
+    for (int i = 0; i < compact.size(); i++)
+        ASSERT_EQUAL(compact[i], scatter[i]);
+}
+
+double measureDispatchTime(int numThreads, bool spinWait) {
+    ThreadPool threads(numThreads, spinWait);
+    const int numTasks = 20000;
+    auto task = [] (ThreadPool& pool, int threadIndex) {};
+    for (int i = 0; i < 100; i++) {
+        threads.execute(task);
+        threads.waitForThreads();
+    }
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < numTasks; i++) {
+        threads.execute(task);
+        threads.waitForThreads();
+    }
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, micro>(end-start).count()/numTasks;
+}
+
+void runBenchmark() {
+    cout << "Time to execute an empty task and wait for it (microseconds)" << endl;
+    cout << "Threads\tSleeping\tSpinning" << endl;
+    int maxThreads = getNumProcessors();
+    for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+        cout << numThreads << "\t" << measureDispatchTime(numThreads, false) << "\t" << measureDispatchTime(numThreads, true) << endl;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        for (bool spinWait : {false, true}) {
+            testExecute(spinWait);
+            testSyncThreads(spinWait);
+            testCreateAndDestroy(spinWait);
+        }
+        testCpuAffinity();
+        testParseCpuAffinity();
+        if (argc > 1 && strcmp(argv[1], "benchmark") == 0)
+            runBenchmark();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -30,7 +30,9 @@
  * -------------------------------------------------------------------------- */
 
 #include "openmm/internal/AssertionUtilities.h"
+#include "openmm/internal/CompiledVec3Expression.h"
 #include "openmm/internal/VectorExpression.h"
+#include "openmm/OpenMMException.h"
 #include <iostream>
 
 using namespace OpenMM;
@@ -44,6 +46,14 @@ void verifyEvaluation(const string& expression, Vec3 expectedValue, Vec3 x=Vec3(
     VectorExpression expr(expression, customFunctions);
     Vec3 value = expr.evaluate(variables);
     ASSERT_EQUAL_VEC(expectedValue, value, 1e-10);
+
+    // A CompiledVec3Expression should give the same result.
+
+    CompiledVec3Expression compiled(expression, customFunctions);
+    compiled.setPerParticleVariable("x", &x);
+    compiled.setPerParticleVariable("y", &y);
+    compiled.evaluate(0, 1, &value);
+    ASSERT_EQUAL_VEC(expectedValue, value, 1e-10);
 }
 
 void testExpressions() {
@@ -59,9 +69,62 @@ void testExpressions() {
     verifyEvaluation("vector(x, 5, y)", Vec3(a[0], 5, b[2]), a, b);
 }
 
+void testCompiledRange() {
+    // Evaluate an expression for a range of particles, with every kind of variable.  The result is written
+    // into the array holding x, so this also checks that each particle's variables are read before its
+    // result is written.
+
+    const int numParticles = 10;
+    vector<Vec3> x(numParticles), y(numParticles), expected(numParticles);
+    vector<double> m(numParticles);
+    double g = 1.5;
+    for (int i = 0; i < numParticles; i++) {
+        x[i] = Vec3(i, 0.5*i, 2.0-i);
+        y[i] = Vec3(1.0, -0.2*i, 0.1*i*i);
+        m[i] = 1.0+0.1*i;
+        expected[i] = x[i]*g/m[i] + y[i].cross(x[i]) + Vec3(1, 1, 1)*x[i].dot(y[i]);
+    }
+    map<string, Lepton::CustomFunction*> customFunctions;
+    CompiledVec3Expression compiled("x*g/m + cross(y, x) + dot(x, y)", customFunctions);
+    ASSERT_EQUAL(4, compiled.getVariables().size());
+    compiled.setPerParticleVariable("x", &x[0]);
+    compiled.setPerParticleVariable("y", &y[0]);
+    compiled.setPerParticleVariable("m", &m[0]);
+    compiled.setPerParticleVariable("unused", &m[0]);
+    bool threwException = false;
+    try {
+        compiled.evaluate(0, numParticles, &x[0]);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    compiled.setGlobalVariable("g", &g);
+
+    // Copies must use the variable locations that were set on the original.
+
+    CompiledVec3Expression copy = compiled;
+    Vec3 first = x[0];
+    copy.evaluate(0, 1, &x[0]);
+    ASSERT_EQUAL_VEC(expected[0], x[0], 1e-10);
+    x[0] = first;
+    compiled.evaluate(2, numParticles, &x[0]);
+    ASSERT_EQUAL_VEC(first, x[0], 0);
+    for (int i = 2; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(expected[i], x[i], 1e-10);
+
+    // Changing a global variable should affect the next evaluation.
+
+    g = 3.0;
+    vector<Vec3> results(numParticles);
+    compiled.evaluate(1, 2, &results[0]);
+    ASSERT_EQUAL_VEC(expected[1]+x[1]*1.5/m[1], results[1], 1e-10);
+}
+
 int main(int argc, char* argv[]) {
     try {
         testExpressions();
+        testCompiledRange();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
@@ -69,6 +69,11 @@ class WrapperGenerator:
     def __init__(self, inputDirname, output):
         self.skipClasses = ['OpenMM::Vec3', 'OpenMM::XmlSerializer', 'OpenMM::Kernel', 'OpenMM::KernelImpl', 'OpenMM::KernelFactory', 'OpenMM::ContextImpl', 'OpenMM::SerializationNode', 'OpenMM::SerializationProxy']
         self.skipMethods = ['State OpenMM::Context::getState',
+                            'void OpenMM::Context::getState',
+                            'std::future<State> OpenMM::Context::getStateAsync',
+                            'void OpenMM::State::getPositions',
+                            'void OpenMM::State::getVelocities',
+                            'void OpenMM::State::getForces',
                             'void OpenMM::Context::createCheckpoint',
                             'void OpenMM::Context::loadCheckpoint',
                             'const std::vector<std::vector<int> >& OpenMM::Context::getMolecules',
@@ -16,6 +16,8 @@ DOC_STRINGS = {("Context", "setPositions") :
 SKIP_METHODS = [('State', 'getPositions'),
                 ('State', 'getVelocities'),
                 ('State', 'getForces'),
+                ('Context', 'getState', 4),
+                ('Context', 'getStateAsync'),
                 ('StateBuilder',),
                 ('Vec3',),
                 ('AngleInfo',),